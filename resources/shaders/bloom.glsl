@@ -0,0 +1,39 @@
+// filters of the bloom mip chain (PostProcess). texel is one texel of the texture being read
+
+// 13 taps in 4 overlapping 2x2 boxes around uv + one in the middle (Jimenez, "Next generation post processing in
+// call of duty: advanced warfare"). halving with this instead of a plain bilinear tap keeps small bright spots from
+// flickering as they move across the texels
+vec3 downsample13(sampler2D tex, vec2 uv, vec2 texel) {
+    vec3 a = texture(tex, uv + texel * vec2(-2.0,  2.0)).rgb;
+    vec3 b = texture(tex, uv + texel * vec2( 0.0,  2.0)).rgb;
+    vec3 c = texture(tex, uv + texel * vec2( 2.0,  2.0)).rgb;
+    vec3 d = texture(tex, uv + texel * vec2(-2.0,  0.0)).rgb;
+    vec3 e = texture(tex, uv).rgb;
+    vec3 f = texture(tex, uv + texel * vec2( 2.0,  0.0)).rgb;
+    vec3 g = texture(tex, uv + texel * vec2(-2.0, -2.0)).rgb;
+    vec3 h = texture(tex, uv + texel * vec2( 0.0, -2.0)).rgb;
+    vec3 i = texture(tex, uv + texel * vec2( 2.0, -2.0)).rgb;
+    vec3 j = texture(tex, uv + texel * vec2(-1.0,  1.0)).rgb;
+    vec3 k = texture(tex, uv + texel * vec2( 1.0,  1.0)).rgb;
+    vec3 l = texture(tex, uv + texel * vec2(-1.0, -1.0)).rgb;
+    vec3 m = texture(tex, uv + texel * vec2( 1.0, -1.0)).rgb;
+
+    return e * 0.125 + (a + c + g + i) * 0.03125 + (b + d + f + h) * 0.0625 + (j + k + l + m) * 0.125;
+}
+
+// 3x3 tent, 9 bilinear taps
+vec3 upsampleTent(sampler2D tex, vec2 uv, vec2 texel) {
+    vec4 d = texel.xyxy * vec4(1.0, 1.0, -1.0, 0.0);
+
+    vec3 s = texture(tex, uv - d.xy).rgb;
+    s += texture(tex, uv - d.wy).rgb * 2.0;
+    s += texture(tex, uv - d.zy).rgb;
+    s += texture(tex, uv + d.zw).rgb * 2.0;
+    s += texture(tex, uv).rgb * 4.0;
+    s += texture(tex, uv + d.xw).rgb * 2.0;
+    s += texture(tex, uv + d.zy).rgb;
+    s += texture(tex, uv + d.wy).rgb * 2.0;
+    s += texture(tex, uv + d.xy).rgb;
+
+    return s * (1.0 / 16.0);
+}
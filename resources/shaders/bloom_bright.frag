@@ -1,17 +1,31 @@
 #version 330 core
+
+// JITTERED is 0/1 (PostProcess compiles both)
+
+#include "bloom.glsl"
+
 in vec2 vUV;
 out vec4 fragColor;
 
 uniform sampler2D u_SceneTex;
+uniform vec2 u_TexelSize;    // of the scene, this pass writes the first (half size) level
 uniform float u_Threshold;   // like 0.8
 uniform float u_SoftKnee;    // like 0.2
+#if JITTERED
+uniform vec2 u_Jitter;       // -1..1, a different one every frame (TemporalAccumulator)
+#endif
 
 float luminance(vec3 c) {
     return dot(c, vec3(0.2126, 0.7152, 0.0722));
 }
 
 void main() {
-    vec3 col = texture(u_SceneTex, vUV).rgb;
+#if JITTERED
+    // one tap somewhere in the footprint of the 13 taps, the history averages them
+    vec3 col = texture(u_SceneTex, vUV + u_Jitter * 2.0 * u_TexelSize).rgb;
+#else
+    vec3 col = downsample13(u_SceneTex, vUV, u_TexelSize);
+#endif
     float l = luminance(col);
 
     // Soft threshold (prevents harsh cutoff)
@@ -0,0 +1,13 @@
+#version 330 core
+
+#include "bloom.glsl"
+
+in vec2 vUV;
+out vec4 fragColor;
+
+uniform sampler2D u_InputTex; // the level above, twice this one's size
+uniform vec2 u_TexelSize;     // of u_InputTex
+
+void main() {
+    fragColor = vec4(downsample13(u_InputTex, vUV, u_TexelSize), 1.0);
+}
@@ -0,0 +1,15 @@
+#version 330 core
+
+#include "bloom.glsl"
+
+in vec2 vUV;
+out vec4 fragColor;
+
+uniform sampler2D u_InputTex; // the level below (already upsampled itself), half this one's size
+uniform vec2 u_TexelSize;     // of u_InputTex
+
+// blended onto this level with GL_CONSTANT_ALPHA = radius, so the level ends up as
+// mix(itself, wider levels, radius)
+void main() {
+    fragColor = vec4(upsampleTent(u_InputTex, vUV, u_TexelSize), 1.0);
+}
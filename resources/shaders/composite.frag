@@ -0,0 +1,40 @@
+#version 330 core
+
+// the last pass of the frame: scene (+ bloom) through the post mode (+ god rays). BLOOM and GOD_RAYS are 0/1, one
+// program per combination (PostProcess). with GOD_RAYS this is the god-ray pass fused in, it adds what that pass
+// would have blended on top
+
+#if GOD_RAYS
+#include "crepuscular.glsl"
+#endif
+
+in vec2 vUV;
+out vec4 fragColor;
+
+uniform sampler2D u_SceneTex;
+uniform sampler2D u_BloomTex;
+uniform float u_Strength;   // like 0.6
+uniform int u_Mode;         // 0 passthrough, 1 invert, 2 grayscale
+
+void main() {
+    vec3 col = texture(u_SceneTex, vUV).rgb;
+
+#if BLOOM
+    col += texture(u_BloomTex, vUV).rgb * u_Strength;
+#endif
+    // what storing it in an rgba8 target used to do
+    col = clamp(col, 0.0, 1.0);
+
+    if (u_Mode == 1) {
+        col = vec3(1.0) - col;
+    } else if (u_Mode == 2) {
+        float g = dot(col, vec3(0.299, 0.587, 0.114));
+        col = vec3(g);
+    }
+
+#if GOD_RAYS
+    if (lightCount > 0) col += accumulateBlur(blurParams, vUV);
+#endif
+
+    fragColor = vec4(col, 1.0);
+}
@@ -0,0 +1,51 @@
+// radial blur of the god-ray occlusion mask towards every light on screen. crepuscular.frag draws it as its own
+// pass, composite.frag when the render graph fuses the rays into the post composite
+
+uniform sampler2D occlusionTexture;
+
+struct BlurParameters {
+    int sampleCount;
+    float blurDensity;
+    float blurExposure;
+    float decayFactor;
+    float sampleWeight;
+    float sampleJitter;  // 0..1 of a step, moves every tap but the first (TemporalAccumulator spreads it over frames)
+};
+
+uniform BlurParameters blurParams;
+uniform vec4 lightPositionsScreen[8];
+uniform int lightCount;
+
+vec3 sampleRadialBlur(BlurParameters params, vec2 uv, vec2 lightScreenPos) {
+
+    vec2 delta_tex_coord = (uv - lightScreenPos) * params.blurDensity * (1.0 / float(params.sampleCount));
+    vec2 tex_coordinates = uv;
+    vec3 color = texture(occlusionTexture, tex_coordinates).rgb;
+    float decay = 1.0;
+    tex_coordinates -= delta_tex_coord * params.sampleJitter;
+
+    for (int i = 0; i < params.sampleCount; ++i) {
+
+        tex_coordinates -= delta_tex_coord;
+        vec3 current_sample = texture(occlusionTexture, tex_coordinates).rgb;
+        current_sample *= decay * params.sampleWeight;
+        color += current_sample;
+        decay *= params.decayFactor;
+
+    }
+
+    return color * params.blurExposure;
+}
+
+vec3 accumulateBlur(BlurParameters params, vec2 uv) {
+
+    vec3 multiple_sources_color = vec3(0.0);
+
+    for (int i = 0; i < lightCount; ++i) {
+
+        multiple_sources_color += sampleRadialBlur(params, uv, lightPositionsScreen[i].xy);
+
+    }
+
+    return multiple_sources_color;
+}
@@ -21,6 +21,10 @@ layout(location = 10) in vec3 diffuse;
 layout(location = 11) in vec3 specular;
 layout(location = 12) in float shininess;
 
+// uv repeats (texture.xy, bump.zw / normal map), per instance since stems scale them by their size
+layout(location = 13) in vec4 uvRepeat;
+layout(location = 14) in vec2 normalUVRepeat;
+
 // Task 5: declare `out` variables for the world-space position and normal,
 //         to be passed to the fragment shader
 
@@ -31,20 +35,22 @@ out vec2 fragUV;
 out vec3 tangentWorldSpace;
 out vec3 bitangentWorldSpace;
 
-out vec4 lightSpacePosition;
-
 out vec3 materialAmbient;
 out vec3 materialDiffuse;
 out vec3 materialSpecular;
 out float materialShininess;
 
+out vec4 textureBumpRepeat;
+out vec2 normalRepeat;
+
 // no londer needed because of instance rendering.
 // uniform mat4 modelMatrix;
 // uniform mat4 modelInverseTrans;
 
-uniform mat4 viewMatrix;
-uniform mat4 projMatrix;
-uniform mat4 lightMatrix;
+#include "frameblock.glsl"
+
+// has to match prepass.vert bit for bit (the colour pass depth tests with GL_EQUAL after the pre-pass)
+invariant gl_Position;
 
 
 void main() {
@@ -68,10 +74,10 @@ void main() {
     materialSpecular = specular;
     materialShininess = shininess;
 
+    textureBumpRepeat = uvRepeat;
+    normalRepeat = normalUVRepeat;
+
     // set gl_Position to the object space position transformed to clip space
     gl_Position = projMatrix * viewMatrix * modelMatrix * vec4(posObjSpace, 1.0);
 
-    // compute light-space position using light matrix (for shadow mapping)
-    lightSpacePosition = lightMatrix * p;
-
 }
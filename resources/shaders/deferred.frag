@@ -0,0 +1,44 @@
+#version 330 core
+
+// deferred path, second half: one fullscreen pass that lights every pixel the g-buffer pass drew, added on top of
+// the ambient term already in the scene colour. same lighting code as default.frag
+
+// lighting.glsl reads these, here they come from the g-buffer instead of the vertex shader
+vec3 posWorldSpace;
+vec3 normalWorldSpace;
+vec3 materialSpecular;
+float materialShininess;
+
+#include "lighting.glsl"
+#include "gbuffer.glsl"
+
+uniform sampler2D gAlbedo;
+uniform sampler2D gNormal;
+uniform sampler2D gSpecular;
+uniform sampler2D gDepth;
+
+out vec4 fragColor;
+
+void main() {
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    vec4 albedo = texelFetch(gAlbedo, pixel, 0);
+    if (albedo.a == 0.0) {
+        discard; // sky or terrain
+    }
+
+    // world position back from the depth buffer
+    float depth = texelFetch(gDepth, pixel, 0).r;
+    vec2 ndc = gl_FragCoord.xy / clusterParams.xy * 2.0 - 1.0;
+    vec4 world = inverseViewProj * vec4(ndc, depth * 2.0 - 1.0, 1.0);
+    posWorldSpace = world.xyz / world.w;
+
+    vec4 normals = texelFetch(gNormal, pixel, 0);
+    normalWorldSpace = octDecode(normals.zw);
+
+    vec4 specular = texelFetch(gSpecular, pixel, 0);
+    materialSpecular = specular.rgb;
+    materialShininess = specular.a;
+
+    vec3 surfToCam = normalize(cameraPos.xyz - posWorldSpace);
+    fragColor = vec4(shadeLights(albedo.rgb, octDecode(normals.xy), surfToCam), 1.0);
+}
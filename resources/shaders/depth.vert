@@ -1,9 +1,9 @@
 #version 330 core
 
 layout (location = 0) in vec3 position;
+layout (location = 5) in mat4 modelMatrix; // per instance, 5-8
 
 uniform mat4 lightMatrix;
-uniform mat4 modelMatrix;
 
 void main() {
     gl_Position = lightMatrix * modelMatrix * vec4(position, 1.0f);
@@ -0,0 +1,14 @@
+// per frame, filled once by SceneRenderer::setupFrameUniforms (FrameBlock in scenerenderer.h). every shader that
+// draws the scene includes this one, so the layouts can't drift apart
+layout(std140) uniform FrameBlock {
+    mat4 viewMatrix;
+    mat4 projMatrix;
+    mat4 lightMatrices[4]; // shadow cascades, nearest first
+    vec4 cascadeSplits;    // view distance where each one ends
+    ivec4 cascadeInfo;     // x: cascade count, y: shadow filter mode
+    vec4 shadowParams;     // x: poisson radius (texels), y: variance light bleed cutoff, z: minimum variance
+    vec4 cameraPos;
+    ivec4 clusterInfo;     // xyz: cluster grid, w: clustered light count
+    vec4 clusterParams;    // xy: viewport size, z/w: depth slice = log(view depth) * z + w
+    mat4 inverseViewProj;  // ndc -> world, for positions rebuilt from depth
+};
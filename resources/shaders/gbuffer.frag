@@ -0,0 +1,19 @@
+#version 330 core
+
+// deferred path, first half: the same instanced batches as default.frag, but only the surface goes out. bump and
+// normal maps are resolved here so the lighting pass doesn't need the material textures
+
+#include "surface.glsl"
+#include "gbuffer.glsl"
+
+layout(location = 0) out vec4 fragColor; // scene colour, ambient only
+layout(location = 1) out vec4 gAlbedo;
+layout(location = 2) out vec4 gNormal;
+layout(location = 3) out vec4 gSpecular;
+
+void main() {
+    fragColor = clamp(vec4(ka * materialAmbient, 1.0), 0.0, 1.0);
+    gAlbedo = vec4(surfaceDiffuse(), 1.0);
+    gNormal = vec4(octEncode(getNormal()), octEncode(normalize(normalWorldSpace)));
+    gSpecular = vec4(materialSpecular, materialShininess);
+}
@@ -0,0 +1,23 @@
+// g-buffer layout (SceneRenderer::initializeGBuffer) and the octahedral normal packing both sides use.
+// attachment 0 is the scene colour itself, the g-buffer pass writes the ambient term straight into it
+//   1 albedo    RGBA8   rgb: kd * diffuse (textured), a: 1 where the g-buffer pass drew
+//   2 normals   RGBA16F xy: shading normal (bump/normal mapped), zw: geometric normal (shadow bias)
+//   3 specular  RGBA16F rgb: specular colour, a: shininess
+// + the scene depth
+
+// unit vector -> square in [-1, 1], the lower hemisphere folded over the diagonals
+vec2 octEncode(vec3 n) {
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    if (n.z >= 0.0) {
+        return n.xy;
+    }
+    return (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+}
+
+vec3 octDecode(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
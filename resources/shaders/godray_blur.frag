@@ -0,0 +1,31 @@
+#version 330 core
+
+// one pass of the low resolution god rays: 8 taps towards the light, u_Step apart. three of these with the stride
+// growing 8x each time cover 512 steps of the radial blur in crepuscular.glsl (see CrepuscularRenderer::addLowResPasses)
+
+in vec2 vUV;
+out vec4 fragColor;
+
+uniform sampler2D u_InputTex;  // the occlusion mask, then the previous pass
+uniform vec2 u_Light;          // screen uv
+uniform float u_Step;          // fraction of the way to the light per tap
+uniform float u_Offset;        // 1 on the first pass, which (like sampleRadialBlur) skips the pixel itself
+uniform float u_Decay;         // per tap
+uniform float u_Scale;
+
+const int TAPS = 8;
+
+void main() {
+    vec2 delta = (vUV - u_Light) * u_Step;
+    vec2 coord = vUV - delta * u_Offset;
+    vec3 color = vec3(0.0);
+    float decay = 1.0;
+
+    for (int i = 0; i < TAPS; ++i) {
+        color += texture(u_InputTex, coord).rgb * decay;
+        coord -= delta;
+        decay *= u_Decay;
+    }
+
+    fragColor = vec4(color * u_Scale, 1.0);
+}
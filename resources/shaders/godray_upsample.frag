@@ -0,0 +1,42 @@
+#version 330 core
+
+// the low resolution god rays up to full size. each of the 4 nearest low res texels is weighted by how close the
+// scene depth under it is to the depth of this pixel, so rays don't bleed across silhouettes
+
+in vec2 vUV;
+out vec4 fragColor;
+
+uniform sampler2D u_RaysTex;       // low res rays, every light summed
+uniform sampler2D u_OcclusionTex;  // for the unblurred pixel that sampleRadialBlur starts with
+uniform sampler2D u_DepthTex;      // scene depth, full res
+uniform vec2 u_DepthParams;        // proj[2][2], proj[3][2]
+uniform float u_CenterWeight;      // exposure * light count
+
+float viewDepth(vec2 uv) {
+    float ndc = texture(u_DepthTex, uv).r * 2.0 - 1.0;
+    return u_DepthParams.y / (ndc + u_DepthParams.x);
+}
+
+void main() {
+    vec2 size = vec2(textureSize(u_RaysTex, 0));
+    vec2 pos = vUV * size - 0.5;
+    vec2 base = floor(pos);
+    vec2 f = pos - base;
+    float depth = viewDepth(vUV);
+
+    vec3 rays = vec3(0.0);
+    float total = 0.0;
+    for (int i = 0; i < 4; ++i) {
+        vec2 offset = vec2(i & 1, i >> 1);
+        vec2 texelUV = (clamp(base + offset, vec2(0.0), size - 1.0) + 0.5) / size;
+        vec2 bilinear = mix(1.0 - f, f, offset);
+        float relative = abs(viewDepth(texelUV) - depth) / max(depth, 1e-3);
+        float weight = bilinear.x * bilinear.y * exp(-relative * 32.0);
+        rays += texture(u_RaysTex, texelUV).rgb * weight;
+        total += weight;
+    }
+    // every neighbour on another surface (thin geometry), plain bilinear is the best guess then
+    rays = total > 1e-4 ? rays / total : texture(u_RaysTex, vUV).rgb;
+
+    fragColor = vec4(rays + texture(u_OcclusionTex, vUV).rgb * u_CenterWeight, 1.0);
+}
@@ -0,0 +1,20 @@
+// std140, everything padded to vec4 (LightBlockLight in scenerenderer.h)
+struct Light {
+    ivec4 info; // x: type (0 is a pointlight, 1 is a directional, 2 is a spotlight), y: the sun (uses the cascades)
+    vec4 color;
+    vec4 function;// attenuation functoin
+    vec4 pos; // position in world space
+    vec4 dir; // Direction with CTM applied (Not applicable to point lights)
+    vec4 cone; // x: penumbra, y: angle. Only applicable to spot lights, in RADIANS
+};
+
+// per scene, only re-uploaded when the scene changes
+layout(std140) uniform LightBlock {
+    vec4 globalCoeffs; // ka, kd, ks
+    ivec4 lightInfo;   // x: light count
+    Light lights[8];
+};
+
+#define ka globalCoeffs.x
+#define kd globalCoeffs.y
+#define ks globalCoeffs.z
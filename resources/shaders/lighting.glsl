@@ -0,0 +1,360 @@
+// every light in LightBlock (with its shadows) and the clustered ones. the includer provides posWorldSpace,
+// normalWorldSpace (the geometric normal, for the shadow bias), materialSpecular and materialShininess, either as
+// inputs (default.frag) or read back from the g-buffer (deferred.frag).
+// the light count class, shadow filter and whether there are clustered lights are compiled in (MAX_SCENE_LIGHTS,
+// SHADOW_FILTER, CLUSTERED_LIGHTS, see ShaderVariants)
+
+#include "frameblock.glsl"
+#include "lightblock.glsl"
+
+// shadow filter modes (SHADOW_FILTER, ShadowFilter in settings.h)
+#define SHADOW_PCF 0       // 4 hardware compared taps, each one a bilinear 2x2
+#define SHADOW_POISSON 1   // POISSON_TAPS taps on a disk of shadowParams.x texels, rotated per pixel
+#define SHADOW_VARIANCE 2  // one fetch of the prefiltered moments
+#define POISSON_TAPS 4
+
+const vec2 poissonDisk[POISSON_TAPS] = vec2[](vec2(-0.94201624, -0.39906216), vec2(0.94558609, -0.76890725),
+                                              vec2(-0.09418410, -0.92938870), vec2(0.34495938, 0.29387760));
+
+#if SHADOW_FILTER == SHADOW_VARIANCE
+uniform sampler2DArray shadowMoments;       // depth, depth^2 blurred, only filled in SHADOW_VARIANCE mode
+#else
+uniform sampler2DArrayShadow shadowTexture; // one layer per cascade, compared in hardware (GL_LEQUAL)
+#endif
+uniform sampler2DShadow shadowAtlas;        // spot/point light tiles, same compare
+
+// spot and point light shadow tiles, only re-uploaded when they move around the atlas (lightrenderer.h)
+layout(std140) uniform ShadowAtlasBlock {
+    ivec4 lightViews[8];    // x: first view of each light, -1 if it has none. point lights have 6: +x -x +y -y +z -z
+    mat4 atlasMatrices[48];
+    vec4 atlasRects[48];    // xy: tile offset, zw: tile size (atlas uv)
+};
+
+// the first cascade whose slice this fragment is in and whose map actually covers it (a far cascade that hasn't
+// caught up with the camera yet might not, the next one will). -1 if none do
+int findCascade(out vec3 projectionCoords) {
+    float viewDepth = -(viewMatrix * vec4(posWorldSpace, 1.0)).z;
+
+    for (int c = 0; c < cascadeInfo.x; c++) {
+        if (viewDepth > cascadeSplits[c]) continue;
+
+        vec4 lightPosition = lightMatrices[c] * vec4(posWorldSpace, 1.0);
+        // [-w, w] coords to [-1, 1] coords, then to the depth map's [0, 1]
+        projectionCoords = (lightPosition.xyz / lightPosition.w) * 0.5 + 0.5;
+
+        if (all(greaterThanEqual(projectionCoords, vec3(0.0))) && all(lessThanEqual(projectionCoords, vec3(1.0)))) {
+            return c;
+        }
+    }
+    return -1;
+}
+
+// chebyshev's upper bound on how much of the filtered area is lit
+float varianceShadow(vec2 moments, float depth) {
+    if (depth <= moments.x) {
+        return 0.0;
+    }
+    float variance = max(moments.y - moments.x * moments.x, shadowParams.z);
+    float d = depth - moments.x;
+    float pMax = variance / (variance + d * d);
+
+    // cut off the low tail of the bound, that's where light bleeding comes from
+    pMax = clamp((pMax - shadowParams.y) / (1.0 - shadowParams.y), 0.0, 1.0);
+    return 1.0 - pMax;
+}
+
+float calculateShadow(vec3 lightDir) {
+    vec3 projectionCoords;
+    int cascade = findCascade(projectionCoords);
+
+    // If outside the shadow map frustum, no shadow
+    if (cascade < 0) {
+        return 0.0;
+    }
+
+#if SHADOW_FILTER == SHADOW_VARIANCE
+    return varianceShadow(texture(shadowMoments, vec3(projectionCoords.xy, cascade)).rg, projectionCoords.z);
+#else
+    vec2 texel = 1.0 / vec2(textureSize(shadowTexture, 0).xy);
+
+    vec3 normal = normalize(normalWorldSpace);
+    float NdotL = dot(normal, normalize(-lightDir));
+    NdotL = clamp(NdotL, 0.0f, 1.0f);
+    float bias = max(0.005 * (1.0 - NdotL), 0.001);
+    float currDepth = projectionCoords.z - bias;
+
+    float lit = 0.0f;
+#if SHADOW_FILTER == SHADOW_POISSON
+    // a different rotation per pixel turns the few taps into noise instead of banding
+    float angle = 6.2831853 * fract(sin(dot(gl_FragCoord.xy, vec2(12.9898, 78.233))) * 43758.5453);
+    mat2 rotation = mat2(cos(angle), sin(angle), -sin(angle), cos(angle));
+
+    for (int i = 0; i < POISSON_TAPS; i++) {
+        vec2 coords = projectionCoords.xy + rotation * poissonDisk[i] * shadowParams.x * texel;
+        lit += texture(shadowTexture, vec4(coords, cascade, currDepth));
+    }
+    return 1.0 - lit / float(POISSON_TAPS);
+#else
+    // half a texel apart, so the 4 bilinear taps cover 3x3 texels
+    for (int i = 0; i < 4; i++) {
+        vec2 offsets = (vec2(i & 1, i >> 1) - 0.5) * texel;
+        lit += texture(shadowTexture, vec4(projectionCoords.xy + offsets, cascade, currDepth));
+    }
+    return 1.0 - lit * 0.25;
+#endif
+#endif
+}
+
+// 4 bilinear compare taps like the cascades, kept half a texel inside the tile so nothing bleeds in from the next one.
+// the depth pass has a slope scaled offset, no bias here
+float atlasShadow(int view) {
+    vec4 lightPosition = atlasMatrices[view] * vec4(posWorldSpace, 1.0);
+    if (lightPosition.w <= 0.0) {
+        return 0.0;
+    }
+    vec3 projectionCoords = (lightPosition.xyz / lightPosition.w) * 0.5 + 0.5;
+    if (any(lessThan(projectionCoords, vec3(0.0))) || any(greaterThan(projectionCoords, vec3(1.0)))) {
+        return 0.0;
+    }
+
+    vec4 rect = atlasRects[view];
+    vec2 texel = 1.0 / vec2(textureSize(shadowAtlas, 0));
+    vec2 lo = rect.xy + 0.5 * texel;
+    vec2 hi = rect.xy + rect.zw - 0.5 * texel;
+
+    float lit = 0.0;
+    for (int i = 0; i < 4; i++) {
+        vec2 coords = rect.xy + projectionCoords.xy * rect.zw + (vec2(i & 1, i >> 1) - 0.5) * texel;
+        lit += texture(shadowAtlas, vec3(clamp(coords, lo, hi), projectionCoords.z));
+    }
+    return 1.0 - lit * 0.25;
+}
+
+#if CLUSTERED_LIGHTS
+// clustered point lights (LightClusters): 2 texels per light, then per cluster the range of its entries in the index list
+uniform samplerBuffer clusterLightData; // xyz: world position, w: radius / rgb: color
+uniform usamplerBuffer clusterRanges;   // x: first index, y: count
+uniform usamplerBuffer clusterIndices;
+
+// only the lights binned into this fragment's cluster. no shadows, plain lambert + phong with a falloff that reaches
+// 0 at the radius so there's no edge where the cluster lists end
+vec3 clusteredLights(vec3 matDiff, vec3 normNormalized, vec3 camDirNormalized) {
+    if (clusterInfo.w == 0) {
+        return vec3(0.0);
+    }
+
+    float viewDepth = -(viewMatrix * vec4(posWorldSpace, 1.0)).z;
+    ivec3 cell = ivec3(gl_FragCoord.xy / clusterParams.xy * vec2(clusterInfo.xy), log(max(viewDepth, 1e-4)) * clusterParams.z + clusterParams.w);
+    cell = clamp(cell, ivec3(0), clusterInfo.xyz - 1);
+    uvec2 range = texelFetch(clusterRanges, cell.x + clusterInfo.x * (cell.y + clusterInfo.y * cell.z)).xy;
+
+    vec3 color = vec3(0.0);
+    for (uint i = 0u; i < range.y; i++) {
+        int light = int(texelFetch(clusterIndices, int(range.x + i)).x);
+        vec4 posRadius = texelFetch(clusterLightData, 2 * light);
+        vec3 lightColor = texelFetch(clusterLightData, 2 * light + 1).rgb;
+
+        vec3 toLight = posRadius.xyz - posWorldSpace;
+        float dist = length(toLight);
+        float falloff = clamp(1.0 - dist / posRadius.w, 0.0, 1.0);
+        falloff *= falloff;
+        if (falloff <= 0.0) {
+            continue;
+        }
+
+        vec3 surfToLight = toLight / max(dist, 1e-4);
+        float NdotL = max(dot(normNormalized, surfToLight), 0.0);
+        float RdotV = max(dot(reflect(-surfToLight, normNormalized), camDirNormalized), 0.0);
+        float specFactor = materialShininess != 0 ? pow(RdotV, materialShininess) : 1.0;
+
+        color += falloff * lightColor * (matDiff * NdotL + ks * materialSpecular * specFactor);
+    }
+    return color;
+}
+#endif
+
+// which cube face the fragment is on, in LightUtils::localShadowMatrices order
+int cubeFace(vec3 lightToFrag) {
+    vec3 a = abs(lightToFrag);
+    if (a.x >= a.y && a.x >= a.z) {
+        return lightToFrag.x > 0.0 ? 0 : 1;
+    }
+    if (a.y >= a.z) {
+        return lightToFrag.y > 0.0 ? 2 : 3;
+    }
+    return lightToFrag.z > 0.0 ? 4 : 5;
+}
+
+// calculates the phong model for directional lights!
+vec3 phongDirectional(vec3 matDiff, vec3 lightColor, float NdotL, vec3 lightDirNormalized, vec3 normNormalized, vec3 camDirNormalized, vec3 lightDir,
+                      bool castsShadow){
+    // calculate shadow (only the light the shadow map was rendered from)
+    float shadow = castsShadow ? calculateShadow(normalize(lightDir)) : 0.0f;
+
+    // diffusion !!
+    vec3 diffuse = (1.0f - shadow) * lightColor * matDiff * NdotL;
+
+    // specular !!
+    vec3 reflectDir = normalize(reflect(-lightDirNormalized, normNormalized));
+    float RdotV = max(0.0f, dot(reflectDir, camDirNormalized));
+
+    vec3 specular = vec3(0, 0, 0);
+
+    // if (RdotV > 0.0f){
+    if (materialShininess != 0){
+        float specFactor = pow(RdotV, materialShininess);
+        specular = (1.0f - shadow) * ks * lightColor * vec3(materialSpecular) * specFactor;
+    } else {
+        specular = (1.0f - shadow) * ks * lightColor * vec3(materialSpecular);
+    }
+
+    return diffuse + specular;
+}
+
+// calculates the phong model for point lights!
+vec3 phongPoint(vec3 matDiff, vec3 lightColor, float NdotL, vec3 lightDirNormalized, vec3 lightPos, vec3 normNormalized, vec3 camDirNormalized, vec3 att_coeffs,
+                float shadow){
+
+    float distanceFromLight = distance(lightPos, posWorldSpace);
+
+    float attenuation = min(1.0f, 1.0f / (att_coeffs[0] + (distanceFromLight * att_coeffs[1]) +
+                                               (distanceFromLight * distanceFromLight) * att_coeffs[2]));
+
+    attenuation *= 1.0f - shadow;
+
+    // diffusion !!
+    vec3 diffuse = attenuation * lightColor * matDiff * NdotL;
+
+    // specular !!
+    vec3 reflectDir = reflect(-lightDirNormalized, normNormalized);
+    float RdotV = max(0.0f, dot(reflectDir, camDirNormalized));
+
+    vec3 specular = vec3(0, 0, 0);
+
+    // if (RdotV > 0.0f){
+    //     float specFactor = pow(RdotV, materialShininess);
+    //     specular = attenuation * ks * lightColor * vec3(materialSpecular) * specFactor;
+    // }
+
+
+    if (materialShininess != 0){
+        float specFactor = pow(RdotV, materialShininess);
+        specular = attenuation * ks * lightColor * vec3(materialSpecular) * specFactor;
+    } else {
+        specular = attenuation * ks * lightColor * vec3(materialSpecular);
+    }
+
+    return diffuse + specular;
+}
+
+// helper method for calculting phong model for spot lights-- used fo rhte diffuse term
+vec3 calcLightIntensity(float x, float outer_angle, float penumbra, vec3 lightColor) {
+
+    float theta_inner = outer_angle - penumbra;
+
+    if (x <= theta_inner) {
+        return lightColor; // full intensity
+
+    } else if (x > outer_angle) {
+        return vec3(0.0f); // completely outside of cone
+
+    } else { //within the outer cone
+        float t = (x - theta_inner) / (outer_angle - theta_inner);
+        float falloff = -2.0f * pow(t, 3.0f) + 3.0f * pow(t, 2.0f);
+        return lightColor * (1.0f - falloff);
+    }
+}
+
+//calculates the phong model for spot lights !
+vec3 phongSpot(vec3 matDiff, vec3 lightColor, float NdotL, vec3 lightDirNormalized, vec3 lightPos, vec3 normNormalized, vec3 camDirNormalized, vec3 att_coeffs,
+               float outer_angle, float penumbra, float shadow) {
+
+    float distanceFromLight = distance(lightPos, posWorldSpace);
+    vec3 dirFomLightToObject = normalize(posWorldSpace - lightPos);
+    vec3 dirToLight = normalize(lightPos - posWorldSpace);
+
+    //the angle between the current direction from the the hit point to the light and the direction of the spotlight itself
+    float x = acos(dot(lightDirNormalized, dirFomLightToObject));
+    //calculating the intensity of the light depending on where in the cone we are !!
+
+    vec3 lightIntensity = calcLightIntensity(x, outer_angle, penumbra, lightColor);
+
+    float attenuation = min(1.0f, 1.0f / (att_coeffs[0] + (distanceFromLight * att_coeffs[1]) +
+                                               (distanceFromLight * distanceFromLight) * att_coeffs[2]));
+
+    // diffusion !!
+    vec3 diffuse = (1.0f - shadow) * lightIntensity * attenuation * matDiff * NdotL;
+
+    // specular !!
+    vec3 reflectDir = reflect(-dirToLight, normNormalized);
+    float RdotV = max(0.0f, dot(reflectDir, camDirNormalized));
+
+
+    vec3 specular = vec3(0, 0, 0);
+
+    // if (RdotV > 0.0f){
+
+    //     float specFactor = pow(RdotV, materialShininess);
+    //     specular = attenuation * lightIntensity * ks * vec3(materialSpecular) * specFactor;
+    // }
+
+
+    if (materialShininess != 0){
+        float specFactor = pow(RdotV, materialShininess);
+        specular = (1.0f - shadow) * attenuation * ks * lightColor * vec3(materialSpecular) * specFactor;
+    } else {
+        specular = (1.0f - shadow) * attenuation * ks * lightColor * vec3(materialSpecular);
+    }
+    return diffuse + specular;
+}
+
+// everything but the ambient term
+vec3 shadeLights(vec3 matDiff, vec3 normNormalized, vec3 surfToCam) {
+    vec3 color = vec3(0.0);
+    float NdotL;
+    vec3 surfToLight;
+
+    // a constant bound the compiler can unroll, the scene's count is always within the class
+    for (int i = 0; i < MAX_SCENE_LIGHTS; i++){
+        if (i >= lightInfo.x) {
+            break;
+        }
+        vec3 lightColor = lights[i].color.rgb;
+        vec3 lightPos = lights[i].pos.xyz;
+        vec3 lightDir = lights[i].dir.xyz;
+        vec3 lightFunction = lights[i].function.xyz;
+        bool castsShadow = lights[i].info.y != 0;
+        int atlasView = lightViews[i].x;
+
+        vec3 lightDirNormalized = normalize(-lightDir);
+
+        switch(lights[i].info.x){
+            case 0: // point light
+                surfToLight = normalize(lightPos - posWorldSpace);
+                NdotL = clamp(dot(normNormalized, surfToLight), 0, 1);
+
+                color += phongPoint(matDiff, lightColor, NdotL, surfToLight, lightPos,  normNormalized, surfToCam, lightFunction,
+                                    atlasView >= 0 ? atlasShadow(atlasView + cubeFace(posWorldSpace - lightPos)) : 0.0f);
+                break;
+
+            case 1: // direction light
+                NdotL = clamp(dot(normNormalized, lightDirNormalized), 0, 1);
+                color += phongDirectional(matDiff, lightColor, NdotL, lightDirNormalized, normNormalized, surfToCam, lightDir, castsShadow);
+                break;
+
+            case 2: // spotlight
+                surfToLight = normalize(lightPos - posWorldSpace);
+                NdotL = max(0.0f, dot(normNormalized, surfToLight));
+                color += phongSpot(matDiff, lightColor, NdotL, normalize(lightDir), lightPos, normNormalized, surfToCam, lightFunction,
+                                   lights[i].cone.y, lights[i].cone.x, atlasView >= 0 ? atlasShadow(atlasView) : 0.0f);
+                break;
+            default:
+                break;
+        }
+    }
+
+#if CLUSTERED_LIGHTS
+    color += clusteredLights(matDiff, normNormalized, surfToCam);
+#endif
+    return color;
+}
@@ -0,0 +1,35 @@
+#version 330 core
+
+// the god-ray occlusion mask from the scene depth: white where a light's disc shows (over the sky for the sun, in
+// front of whatever the scene has there for the other lights), black everywhere else
+
+in vec2 vUV;
+out vec4 fragColor;
+
+uniform sampler2D u_DepthTex;    // scene depth
+uniform vec2 u_DepthParams;      // proj[2][2], proj[3][2]
+uniform vec4 u_Discs[8];         // screen uv centre, radii
+uniform float u_DiscDepths[8];   // view depth of the front of the light, 0 = only over the sky
+uniform int u_DiscCount;
+
+void main() {
+    float depth = texture(u_DepthTex, vUV).r;
+    // nothing drawn (the skybox doesn't write depth) or on the far plane
+    bool sky = depth >= 1.0;
+    float viewDepth = u_DepthParams.y / (depth * 2.0 - 1.0 + u_DepthParams.x);
+
+    vec2 texel = fwidth(vUV);
+    float mask = 0.0;
+    for (int i = 0; i < u_DiscCount; ++i) {
+        vec2 offset = (vUV - u_Discs[i].xy) / u_Discs[i].zw;
+        float edge = 1.0 - length(offset);
+        if (edge <= 0.0) continue;
+
+        bool visible = u_DiscDepths[i] > 0.0 ? sky || viewDepth > u_DiscDepths[i] : sky;
+        // a pixel of antialiasing along the rim
+        float rim = edge * min(u_Discs[i].z / texel.x, u_Discs[i].w / texel.y);
+        if (visible) mask = max(mask, clamp(rim, 0.0, 1.0));
+    }
+
+    fragColor = vec4(vec3(mask), 1.0);
+}
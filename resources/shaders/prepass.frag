@@ -0,0 +1,5 @@
+#version 330 core
+
+// nothing to write, the pre-pass only lays down depth
+void main() {
+}
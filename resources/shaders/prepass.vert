@@ -0,0 +1,19 @@
+#version 330 core
+
+// depth only, same instance layout as default.vert (only the model matrix is read)
+layout(location = 0) in vec3 posObjSpace;
+
+layout(location = 5) in vec4 model0;
+layout(location = 6) in vec4 model1;
+layout(location = 7) in vec4 model2;
+layout(location = 8) in vec4 model3;
+
+#include "frameblock.glsl"
+
+// the colour pass depth tests with GL_EQUAL, so both shaders have to come up with the exact same depth
+invariant gl_Position;
+
+void main() {
+    mat4 modelMatrix = mat4(model0, model1, model2, model3);
+    gl_Position = projMatrix * viewMatrix * modelMatrix * vec4(posObjSpace, 1.0);
+}
@@ -0,0 +1,24 @@
+#version 330 core
+in vec2 vUV;
+out vec4 fragColor;
+
+// the vertical half of the variance shadow prefilter (shadowmoments.frag does the horizontal one), same weights
+uniform sampler2D u_InputTex;
+uniform vec2 u_TexelStep; // (0, 1/height)
+
+void main() {
+    // 9-tap Gaussian weights (common set)
+    float w0 = 0.227027;
+    float w1 = 0.1945946;
+    float w2 = 0.1216216;
+    float w3 = 0.054054;
+    float w4 = 0.016216;
+
+    vec2 sum = texture(u_InputTex, vUV).rg * w0;
+    sum += (texture(u_InputTex, vUV + u_TexelStep * 1.0).rg + texture(u_InputTex, vUV - u_TexelStep * 1.0).rg) * w1;
+    sum += (texture(u_InputTex, vUV + u_TexelStep * 2.0).rg + texture(u_InputTex, vUV - u_TexelStep * 2.0).rg) * w2;
+    sum += (texture(u_InputTex, vUV + u_TexelStep * 3.0).rg + texture(u_InputTex, vUV - u_TexelStep * 3.0).rg) * w3;
+    sum += (texture(u_InputTex, vUV + u_TexelStep * 4.0).rg + texture(u_InputTex, vUV - u_TexelStep * 4.0).rg) * w4;
+
+    fragColor = vec4(sum, 0.0, 1.0);
+}
@@ -0,0 +1,31 @@
+#version 330 core
+in vec2 vUV;
+out vec4 fragColor;
+
+// one cascade of the shadow map turned into (depth, depth^2) for variance shadows, blurred horizontally on the way.
+// the vertical half of the blur goes through shadowblur.frag, same weights
+uniform sampler2DArray depthTexture;
+uniform int layer;
+uniform vec2 texelStep; // (1/width, 0)
+
+vec2 moments(vec2 uv) {
+    float depth = texture(depthTexture, vec3(uv, layer)).r;
+    return vec2(depth, depth * depth);
+}
+
+void main() {
+    // 9-tap Gaussian weights (same as shadowblur.frag)
+    float w0 = 0.227027;
+    float w1 = 0.1945946;
+    float w2 = 0.1216216;
+    float w3 = 0.054054;
+    float w4 = 0.016216;
+
+    vec2 sum = moments(vUV) * w0;
+    sum += (moments(vUV + texelStep * 1.0) + moments(vUV - texelStep * 1.0)) * w1;
+    sum += (moments(vUV + texelStep * 2.0) + moments(vUV - texelStep * 2.0)) * w2;
+    sum += (moments(vUV + texelStep * 3.0) + moments(vUV - texelStep * 3.0)) * w3;
+    sum += (moments(vUV + texelStep * 4.0) + moments(vUV - texelStep * 4.0)) * w4;
+
+    fragColor = vec4(sum, 0.0, 1.0);
+}
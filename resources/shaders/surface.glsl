@@ -0,0 +1,80 @@
+// what default.vert hands over, plus the material's maps. shared by the forward shader and the g-buffer one.
+// which maps there are is compiled in (MAP_TEXTURE / MAP_BUMP / MAP_NORMAL, see ShaderVariants)
+
+#include "lightblock.glsl"
+
+in vec3 posWorldSpace;
+in vec3 normalWorldSpace;
+in vec2 fragUV;
+
+in vec3 tangentWorldSpace;
+in vec3 bitangentWorldSpace;
+
+in vec3 materialAmbient;
+in vec3 materialDiffuse;
+in vec3 materialSpecular;
+in float materialShininess;
+
+in vec4 textureBumpRepeat;
+in vec2 normalRepeat;
+
+// one per texture set, bound per batch. repeats come from the instance (textureBumpRepeat / normalRepeat)
+layout(std140) uniform MaterialBlock {
+    ivec4 mapsUsed;  // texture, bump, normal (the variant already knows, kept for the layout)
+    vec4 mapParams;  // blend, bump strength, normal strength
+};
+
+#if MAP_TEXTURE
+uniform sampler2D textureSampler;
+#endif
+#if MAP_BUMP
+uniform sampler2D bumpTextureSampler;
+#endif
+#if MAP_NORMAL
+uniform sampler2D normTextureSampler;
+#endif
+
+// kd * diffuse, blended with the texture map
+vec3 surfaceDiffuse() {
+    vec3 matDiff = kd * vec3(materialDiffuse);
+
+#if MAP_TEXTURE
+    vec2 repeatedUV = fragUV * textureBumpRepeat.xy;
+    vec3 texColor = texture(textureSampler, repeatedUV).rgb;
+    matDiff = mix(matDiff, texColor, mapParams.x);
+#endif
+    return matDiff;
+}
+
+vec3 getNormal() {
+#if MAP_BUMP || MAP_NORMAL
+    // build TBN matrix (world space to tangent space)
+    mat3 TBN = transpose(mat3(
+        normalize(tangentWorldSpace),
+        normalize(bitangentWorldSpace),
+        normalize(normalWorldSpace)
+    ));
+
+    vec3 combinedNormal = vec3(0.0, 0.0, 1.0);
+
+#if MAP_BUMP
+    vec2 bumpUV = fragUV * textureBumpRepeat.zw;
+    vec3 bumpNormal = texture(bumpTextureSampler, bumpUV).rgb * 2.0 - 1.0;
+    combinedNormal = normalize(mix(combinedNormal, bumpNormal, mapParams.y));
+#endif
+
+#if MAP_NORMAL
+    vec2 normUV = fragUV * normalRepeat;
+    vec3 normalMapNormal = texture(normTextureSampler, normUV).rgb * 2.0 - 1.0;
+    combinedNormal = normalize(mix(combinedNormal, normalMapNormal, mapParams.z));
+#endif
+
+    // transform from tangent space to world space
+    vec3 worldSpaceNormal = transpose(TBN) * combinedNormal;
+
+    return normalize(worldSpaceNormal);
+#else
+    // just use the normalized original normal
+    return normalize(normalWorldSpace);
+#endif
+}
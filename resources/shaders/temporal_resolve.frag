@@ -0,0 +1,43 @@
+#version 330 core
+
+// this frame's noisy effect blended into its history (TemporalAccumulator). the history is fetched where this pixel
+// was last frame and clamped to the range of the new samples around it, so stale history can't smear
+
+in vec2 vUV;
+out vec4 fragColor;
+
+uniform sampler2D u_CurrentTex;
+uniform sampler2D u_HistoryTex;
+uniform sampler2D u_DepthTex;  // scene depth
+uniform mat4 u_Reproject;      // last frame's view-projection * inverse of this frame's
+uniform float u_Blend;         // share of the new frame, 1 = no history
+
+void main() {
+    vec3 current = texture(u_CurrentTex, vUV).rgb;
+    // the history may not even be initialized yet
+    if (u_Blend >= 1.0) {
+        fragColor = vec4(current, 1.0);
+        return;
+    }
+
+    vec4 clip = u_Reproject * vec4(vUV * 2.0 - 1.0, texture(u_DepthTex, vUV).r * 2.0 - 1.0, 1.0);
+    vec2 previousUV = clip.xy / clip.w * 0.5 + 0.5;
+    if (clip.w <= 0.0 || any(lessThan(previousUV, vec2(0.0))) || any(greaterThan(previousUV, vec2(1.0)))) {
+        fragColor = vec4(current, 1.0); // off screen last frame
+        return;
+    }
+
+    vec2 texel = 1.0 / vec2(textureSize(u_CurrentTex, 0));
+    vec3 lo = current;
+    vec3 hi = current;
+    for (int y = -1; y <= 1; ++y) {
+        for (int x = -1; x <= 1; ++x) {
+            vec3 neighbour = texture(u_CurrentTex, vUV + vec2(x, y) * texel).rgb;
+            lo = min(lo, neighbour);
+            hi = max(hi, neighbour);
+        }
+    }
+    vec3 history = clamp(texture(u_HistoryTex, previousUV).rgb, lo, hi);
+
+    fragColor = vec4(mix(history, current, u_Blend), 1.0);
+}
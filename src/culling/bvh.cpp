@@ -0,0 +1,307 @@
+#include "bvh.h"
+
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <numeric>
+
+namespace {
+    const int BIN_COUNT = 16;
+    const int MIN_LEAF = 4;       // never split below this
+    const int MAX_LEAF = 16;      // always split above this, even if sah says a leaf is cheaper
+    const int PARALLEL_DEPTH = 3; // 2^3 subtrees go to worker tasks
+    const int PARALLEL_MIN_ITEMS = 4096;
+}
+
+float AABB::surfaceArea() const {
+    if (empty()) return 0.f;
+    glm::vec3 e = max - min;
+    return 2.f * (e.x * e.y + e.y * e.z + e.z * e.x);
+}
+
+AABB AABB::transformed(const AABB &local, const glm::mat4 &ctm) {
+    glm::vec3 c = glm::vec3(ctm * glm::vec4(local.center(), 1.f));
+    glm::vec3 e = 0.5f * (local.max - local.min);
+
+    glm::mat3 absM = glm::mat3(ctm);
+    for (int i = 0; i < 3; i++) absM[i] = glm::abs(absM[i]);
+    glm::vec3 worldExtent = absM * e;
+
+    AABB box;
+    box.min = c - worldExtent;
+    box.max = c + worldExtent;
+    return box;
+}
+
+Frustum Frustum::fromMatrix(const glm::mat4 &viewProj) {
+    // gribb/hartmann: rows of the clip matrix, glm is column major so row i is m[0][i], m[1][i], ...
+    auto row = [&](int i) { return glm::vec4(viewProj[0][i], viewProj[1][i], viewProj[2][i], viewProj[3][i]); };
+    glm::vec4 r0 = row(0), r1 = row(1), r2 = row(2), r3 = row(3);
+
+    glm::vec4 planes[6] = {r3 + r0, r3 - r0, r3 + r1, r3 - r1, r3 + r2, r3 - r2};
+
+    Frustum f;
+    for (int i = 0; i < 8; i++) {
+        glm::vec4 p = i < 6 ? planes[i] : glm::vec4(0.f, 0.f, 0.f, 1.f); // padding, always in front
+        float len = glm::length(glm::vec3(p));
+        if (len > 0.f) p /= len;
+        f.nx[i] = p.x;
+        f.ny[i] = p.y;
+        f.nz[i] = p.z;
+        f.d[i] = p.w;
+    }
+    return f;
+}
+
+Frustum::Result Frustum::test(const AABB &box) const {
+    // per plane: the farthest (dMax) and nearest (dMin) corner distance, picked with min/max instead of branching on
+    // the normal's sign. no early out so the loop stays branch free
+    float dMax[8], dMin[8];
+    for (int i = 0; i < 8; i++) {
+        float ax = nx[i] * box.min.x, bx = nx[i] * box.max.x;
+        float ay = ny[i] * box.min.y, by = ny[i] * box.max.y;
+        float az = nz[i] * box.min.z, bz = nz[i] * box.max.z;
+        dMax[i] = std::max(ax, bx) + std::max(ay, by) + std::max(az, bz) + d[i];
+        dMin[i] = std::min(ax, bx) + std::min(ay, by) + std::min(az, bz) + d[i];
+    }
+
+    bool outside = false, inside = true;
+    for (int i = 0; i < 8; i++) {
+        outside |= dMax[i] < 0.f;
+        inside &= dMin[i] >= 0.f;
+    }
+    return outside ? OUTSIDE : (inside ? INSIDE : INTERSECTS);
+}
+
+void BVH::clear() {
+    m_nodes.clear();
+    m_items.clear();
+    m_bounds.clear();
+    m_centroids.clear();
+}
+
+size_t BVH::memoryUsage() const {
+    return m_nodes.capacity() * sizeof(Node) + m_items.capacity() * sizeof(int) + m_bounds.capacity() * sizeof(AABB);
+}
+
+void BVH::build(const std::vector<AABB> &bounds) {
+    clear();
+    if (bounds.empty()) return;
+
+    m_bounds = bounds;
+    m_centroids.resize(bounds.size());
+    for (size_t i = 0; i < bounds.size(); i++) {
+        m_centroids[i] = bounds[i].center();
+    }
+    m_items.resize(bounds.size());
+    std::iota(m_items.begin(), m_items.end(), 0);
+
+    const int count = static_cast<int>(bounds.size());
+    std::vector<Task> deferred;
+    buildNode(m_nodes, 0, count, 0, count >= PARALLEL_MIN_ITEMS ? &deferred : nullptr);
+
+    // the top levels are done, build the subtrees under them at the same time. each task owns its own range of m_items
+    std::vector<std::future<std::vector<Node>>> subtrees;
+    for (const Task &task : deferred) {
+        subtrees.push_back(std::async(std::launch::async, [this, task]() {
+            std::vector<Node> nodes;
+            buildNode(nodes, task.begin, task.end, 0, nullptr);
+            return nodes;
+        }));
+    }
+
+    // stitch them in: the subtree root replaces the placeholder, everything else goes on the end
+    for (size_t t = 0; t < deferred.size(); t++) {
+        std::vector<Node> nodes = subtrees[t].get();
+        const int placeholder = deferred[t].node;
+        const int base = static_cast<int>(m_nodes.size()) - 1; // local index 1 lands at m_nodes.size()
+
+        auto remap = [&](int local) { return local < 0 ? -1 : (local == 0 ? placeholder : base + local); };
+        for (size_t i = 0; i < nodes.size(); i++) {
+            Node node = nodes[i];
+            node.left = remap(node.left);
+            node.right = remap(node.right);
+            if (i == 0) {
+                m_nodes[placeholder] = node;
+            } else {
+                m_nodes.push_back(node);
+            }
+        }
+    }
+
+    m_centroids = std::vector<glm::vec3>();
+}
+
+int BVH::buildNode(std::vector<Node> &nodes, int begin, int end, int depth, std::vector<Task> *deferred) {
+    const int index = static_cast<int>(nodes.size());
+    nodes.emplace_back();
+
+    Node node;
+    node.first = begin;
+    node.count = end - begin;
+    for (int i = begin; i < end; i++) {
+        node.bounds.grow(m_bounds[m_items[i]]);
+    }
+
+    if (deferred && depth >= PARALLEL_DEPTH && node.count > MAX_LEAF) {
+        deferred->push_back({index, begin, end});
+        nodes[index] = node;
+        return index;
+    }
+
+    int mid;
+    if (node.count <= MIN_LEAF || !split(begin, end, node.bounds, mid)) {
+        nodes[index] = node;
+        return index;
+    }
+
+    // children are pushed after the parent, refit relies on that
+    node.left = buildNode(nodes, begin, mid, depth + 1, deferred);
+    node.right = buildNode(nodes, mid, end, depth + 1, deferred);
+    nodes[index] = node;
+    return index;
+}
+
+/**
+ * @brief BVH::split binned sah over all 3 axes. partitions m_items[begin, end) in place
+ * @return false if the range should stay a leaf
+ */
+bool BVH::split(int begin, int end, const AABB &bounds, int &mid) {
+    const int count = end - begin;
+
+    AABB centroidBounds;
+    for (int i = begin; i < end; i++) {
+        centroidBounds.grow(m_centroids[m_items[i]]);
+    }
+
+    float bestCost = FLT_MAX;
+    int bestAxis = -1;
+    int bestBin = -1;
+
+    for (int axis = 0; axis < 3; axis++) {
+        const float lo = centroidBounds.min[axis];
+        const float extent = centroidBounds.max[axis] - lo;
+        if (extent <= 1e-6f) continue;
+
+        const float scale = BIN_COUNT / extent;
+        int binCount[BIN_COUNT] = {};
+        AABB binBounds[BIN_COUNT];
+        for (int i = begin; i < end; i++) {
+            int item = m_items[i];
+            int bin = std::min(static_cast<int>((m_centroids[item][axis] - lo) * scale), BIN_COUNT - 1);
+            binCount[bin]++;
+            binBounds[bin].grow(m_bounds[item]);
+        }
+
+        // sweep from the right to get the area/count of everything after each split plane
+        float rightArea[BIN_COUNT];
+        int rightCount[BIN_COUNT];
+        AABB acc;
+        int n = 0;
+        for (int b = BIN_COUNT - 1; b > 0; b--) {
+            acc.grow(binBounds[b]);
+            n += binCount[b];
+            rightArea[b - 1] = acc.surfaceArea();
+            rightCount[b - 1] = n;
+        }
+
+        acc = AABB();
+        n = 0;
+        for (int b = 0; b < BIN_COUNT - 1; b++) {
+            acc.grow(binBounds[b]);
+            n += binCount[b];
+            if (n == 0 || rightCount[b] == 0) continue;
+
+            float cost = acc.surfaceArea() * n + rightArea[b] * rightCount[b];
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestBin = b;
+            }
+        }
+    }
+
+    if (bestAxis < 0) {
+        // every centroid in the same spot (e.g. stacked leaves), just halve it if it's too big for one leaf
+        if (count <= MAX_LEAF) return false;
+        mid = begin + count / 2;
+        return true;
+    }
+
+    // leaf cost is count * area, a split costs one more node visit on top of the children
+    const float leafCost = bounds.surfaceArea() * count;
+    const float splitCost = bounds.surfaceArea() + bestCost;
+    if (splitCost >= leafCost && count <= MAX_LEAF) return false;
+
+    const float lo = centroidBounds.min[bestAxis];
+    const float scale = BIN_COUNT / (centroidBounds.max[bestAxis] - lo);
+    auto it = std::partition(m_items.begin() + begin, m_items.begin() + end, [&](int item) {
+        int bin = std::min(static_cast<int>((m_centroids[item][bestAxis] - lo) * scale), BIN_COUNT - 1);
+        return bin <= bestBin;
+    });
+    mid = static_cast<int>(it - m_items.begin());
+    return mid > begin && mid < end;
+}
+
+void BVH::refit(const std::vector<AABB> &bounds) {
+    if (bounds.size() != m_bounds.size()) {
+        build(bounds);
+        return;
+    }
+    m_bounds = bounds;
+
+    for (int i = static_cast<int>(m_nodes.size()) - 1; i >= 0; i--) {
+        Node &node = m_nodes[i];
+        node.bounds = AABB();
+        if (node.left < 0) {
+            for (int j = node.first; j < node.first + node.count; j++) {
+                node.bounds.grow(m_bounds[m_items[j]]);
+            }
+        } else {
+            node.bounds.grow(m_nodes[node.left].bounds);
+            node.bounds.grow(m_nodes[node.right].bounds);
+        }
+    }
+}
+
+void BVH::query(const Frustum &frustum, std::vector<int> &out, CullStats *stats) const {
+    auto start = std::chrono::steady_clock::now();
+    const size_t outStart = out.size();
+    int nodesVisited = 0;
+    int instancesTested = 0;
+
+    if (!m_nodes.empty()) {
+        std::vector<int> stack;
+        stack.reserve(64);
+        stack.push_back(0);
+
+        while (!stack.empty()) {
+            const Node &node = m_nodes[stack.back()];
+            stack.pop_back();
+            nodesVisited++;
+
+            Frustum::Result result = frustum.test(node.bounds);
+            if (result == Frustum::OUTSIDE) continue;
+
+            if (result == Frustum::INSIDE) {
+                out.insert(out.end(), m_items.begin() + node.first, m_items.begin() + node.first + node.count);
+            } else if (node.left < 0) {
+                for (int i = node.first; i < node.first + node.count; i++) {
+                    instancesTested++;
+                    if (frustum.test(m_bounds[m_items[i]]) != Frustum::OUTSIDE) out.push_back(m_items[i]);
+                }
+            } else {
+                stack.push_back(node.right);
+                stack.push_back(node.left);
+            }
+        }
+    }
+
+    if (stats) {
+        stats->instances = itemCount();
+        stats->visible = static_cast<int>(out.size() - outStart);
+        stats->nodesVisited = nodesVisited;
+        stats->instancesTested = instancesTested;
+        stats->cullMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cfloat>
+#include <cstddef>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// World (or local) axis aligned box. Starts out empty (min > max) so grow() can be called straight away
+struct AABB {
+    glm::vec3 min = glm::vec3(FLT_MAX);
+    glm::vec3 max = glm::vec3(-FLT_MAX);
+
+    void grow(const glm::vec3 &p) { min = glm::min(min, p); max = glm::max(max, p); }
+    void grow(const AABB &box) { min = glm::min(min, box.min); max = glm::max(max, box.max); }
+
+    bool empty() const { return min.x > max.x; }
+    glm::vec3 center() const { return 0.5f * (min + max); }
+    float surfaceArea() const;
+
+    // bounds of a local box after a ctm (center + |M| * extents, so no 8 corner transform)
+    static AABB transformed(const AABB &local, const glm::mat4 &ctm);
+};
+
+/**
+ * The 6 clip planes of a view-projection matrix (works for the light's ortho matrix too).
+ * Planes are kept as structure of arrays and padded to 8 with planes that always pass, so the box test is one
+ * fixed length loop over plain float arrays that the compiler turns into simd compares (4 or 8 planes at once).
+ */
+struct Frustum {
+    enum Result {
+        OUTSIDE,
+        INTERSECTS,
+        INSIDE
+    };
+
+    alignas(32) float nx[8];
+    alignas(32) float ny[8];
+    alignas(32) float nz[8];
+    alignas(32) float d[8];
+
+    static Frustum fromMatrix(const glm::mat4 &viewProj);
+
+    Result test(const AABB &box) const;
+};
+
+// what the last query did, for the stats readout
+struct CullStats {
+    int instances = 0;       // everything in the bvh
+    int visible = 0;         // instances that passed
+    int nodesVisited = 0;
+    int instancesTested = 0; // leaf items that needed their own box test (the rest were accepted/rejected by a node)
+    double cullMs = 0.0;
+};
+
+/**
+ * Bounding volume hierarchy over instance bounds (one box per RenderData::shapes entry).
+ *
+ * Built once per scene with binned SAH. Big scenes split the top few levels on the calling thread and build the
+ * subtrees below them on worker tasks. Items are partitioned in place, so every node covers a contiguous range of
+ * m_items and a node that is fully inside the frustum just appends its whole range.
+ * Animated shapes move their boxes with refit(), the tree itself is not rebuilt.
+ *
+ * Nothing in here touches GL, so the same tree can be queried with the camera frustum, the light's frustum, etc.
+ */
+class BVH {
+public:
+    void build(const std::vector<AABB> &bounds);
+    // same items, new boxes (animation). children always come after their parent, so one reverse sweep does it
+    void refit(const std::vector<AABB> &bounds);
+    void clear();
+
+    // appends the indices of every item whose box touches the frustum
+    void query(const Frustum &frustum, std::vector<int> &out, CullStats *stats = nullptr) const;
+
+    bool empty() const { return m_nodes.empty(); }
+    // everything in the tree (the root's box), empty if there's nothing in it
+    AABB bounds() const { return m_nodes.empty() ? AABB() : m_nodes[0].bounds; }
+    const AABB& itemBounds(int item) const { return m_bounds[item]; }
+    int nodeCount() const { return static_cast<int>(m_nodes.size()); }
+    int itemCount() const { return static_cast<int>(m_items.size()); }
+    size_t memoryUsage() const;
+
+private:
+    struct Node {
+        AABB bounds;
+        int left = -1;  // children, -1 for a leaf
+        int right = -1;
+        int first = 0;  // range of m_items under this node (leaf or not)
+        int count = 0;
+    };
+
+    struct Task {
+        int node;
+        int begin;
+        int end;
+    };
+
+    int buildNode(std::vector<Node> &nodes, int begin, int end, int depth, std::vector<Task> *deferred);
+    bool split(int begin, int end, const AABB &bounds, int &mid);
+
+    std::vector<Node> m_nodes;
+    std::vector<int> m_items;       // item indices, in leaf order
+    std::vector<AABB> m_bounds;     // per item (index = item)
+    std::vector<glm::vec3> m_centroids; // only used while building
+};
@@ -0,0 +1,159 @@
+#include "lightclusters.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+
+namespace {
+    int sliceOf(float depth, float scale, float bias) {
+        return std::clamp(static_cast<int>(std::floor(std::log(depth) * scale + bias)), 0, LightClusters::GRID_Z - 1);
+    }
+}
+
+/**
+ * @brief LightClusters::buildClusterBounds view space box of every cluster: the 4 corners of its screen tile pushed
+ * out along their view rays to both ends of its depth slice
+ */
+void LightClusters::buildClusterBounds(const glm::mat4& proj, float near, float far) {
+    m_minX.resize(CLUSTER_COUNT);
+    m_minY.resize(CLUSTER_COUNT);
+    m_minZ.resize(CLUSTER_COUNT);
+    m_maxX.resize(CLUSTER_COUNT);
+    m_maxY.resize(CLUSTER_COUNT);
+    m_maxZ.resize(CLUSTER_COUNT);
+
+    // slice z covers depths near * (far / near)^(z / GRID_Z) to the next one
+    m_sliceScale = GRID_Z / std::log(far / near);
+    m_sliceBias = -std::log(near) * m_sliceScale;
+
+    const glm::mat4 invProj = glm::inverse(proj);
+    auto rayTo = [&](float ndcX, float ndcY) {
+        glm::vec4 p = invProj * glm::vec4(ndcX, ndcY, -1.0f, 1.0f);
+        glm::vec3 ray = glm::vec3(p) / p.w;
+        return ray / -ray.z; // at depth 1
+    };
+
+    for (int z = 0; z < GRID_Z; z++) {
+        const float from = near * std::pow(far / near, float(z) / GRID_Z);
+        const float to = near * std::pow(far / near, float(z + 1) / GRID_Z);
+
+        for (int y = 0; y < GRID_Y; y++) {
+            for (int x = 0; x < GRID_X; x++) {
+                const float x0 = -1.0f + 2.0f * x / GRID_X, x1 = -1.0f + 2.0f * (x + 1) / GRID_X;
+                const float y0 = -1.0f + 2.0f * y / GRID_Y, y1 = -1.0f + 2.0f * (y + 1) / GRID_Y;
+                const glm::vec3 rays[4] = {rayTo(x0, y0), rayTo(x1, y0), rayTo(x0, y1), rayTo(x1, y1)};
+
+                glm::vec3 lo(FLT_MAX), hi(-FLT_MAX);
+                for (const glm::vec3& ray : rays) {
+                    lo = glm::min(lo, glm::min(ray * from, ray * to));
+                    hi = glm::max(hi, glm::max(ray * from, ray * to));
+                }
+
+                const int i = x + GRID_X * (y + GRID_Y * z);
+                m_minX[i] = lo.x;
+                m_minY[i] = lo.y;
+                m_minZ[i] = lo.z;
+                m_maxX[i] = hi.x;
+                m_maxY[i] = hi.y;
+                m_maxZ[i] = hi.z;
+            }
+        }
+    }
+
+    m_boundsProj = proj;
+    m_boundsNear = near;
+    m_boundsFar = far;
+}
+
+/**
+ * @brief LightClusters::build per light: the range of slices its depth covers and the range of tiles its projected
+ * box covers, then the exact sphere/box test on just those clusters. the (cluster, light) pairs are counting sorted
+ * by cluster, so every cluster's lights end up next to each other in light order
+ */
+void LightClusters::build(const std::vector<ClusterLight>& lights, const glm::mat4& view, const glm::mat4& proj,
+                          float near, float far) {
+    auto start = std::chrono::steady_clock::now();
+    if (proj != m_boundsProj || near != m_boundsNear || far != m_boundsFar) {
+        buildClusterBounds(proj, near, far);
+    }
+
+    m_pairCluster.clear();
+    m_pairLight.clear();
+    unsigned char hit[GRID_X];
+
+    for (size_t l = 0; l < lights.size(); l++) {
+        const glm::vec3 c = glm::vec3(view * glm::vec4(lights[l].pos, 1.0f));
+        const float r = lights[l].radius;
+        const float depth = -c.z;
+        if (depth + r < near || depth - r > far) continue;
+
+        const int z0 = sliceOf(std::max(depth - r, near), m_sliceScale, m_sliceBias);
+        const int z1 = sliceOf(std::min(depth + r, far), m_sliceScale, m_sliceBias);
+
+        // screen tiles under the sphere's box, all of them if the box pokes through the near plane
+        int x0 = 0, x1 = GRID_X - 1, y0 = 0, y1 = GRID_Y - 1;
+        if (depth - r > near) {
+            glm::vec2 lo(FLT_MAX), hi(-FLT_MAX);
+            for (int i = 0; i < 8; i++) {
+                glm::vec3 corner = c + r * glm::vec3((i & 1) ? 1.0f : -1.0f, (i & 2) ? 1.0f : -1.0f, (i & 4) ? 1.0f : -1.0f);
+                glm::vec4 clip = proj * glm::vec4(corner, 1.0f);
+                glm::vec2 ndc = glm::vec2(clip) / clip.w;
+                lo = glm::min(lo, ndc);
+                hi = glm::max(hi, ndc);
+            }
+            if (hi.x < -1.0f || lo.x > 1.0f || hi.y < -1.0f || lo.y > 1.0f) continue;
+            x0 = std::clamp(static_cast<int>((lo.x * 0.5f + 0.5f) * GRID_X), 0, GRID_X - 1);
+            x1 = std::clamp(static_cast<int>((hi.x * 0.5f + 0.5f) * GRID_X), 0, GRID_X - 1);
+            y0 = std::clamp(static_cast<int>((lo.y * 0.5f + 0.5f) * GRID_Y), 0, GRID_Y - 1);
+            y1 = std::clamp(static_cast<int>((hi.y * 0.5f + 0.5f) * GRID_Y), 0, GRID_Y - 1);
+        }
+
+        const float r2 = r * r;
+        for (int z = z0; z <= z1; z++) {
+            for (int y = y0; y <= y1; y++) {
+                const int row = GRID_X * (y + GRID_Y * z);
+                const float *minX = &m_minX[row], *minY = &m_minY[row], *minZ = &m_minZ[row];
+                const float *maxX = &m_maxX[row], *maxY = &m_maxY[row], *maxZ = &m_maxZ[row];
+
+                // whole row, no branches: distance from the center to each box
+                for (int x = 0; x < GRID_X; x++) {
+                    float dx = std::max(std::max(minX[x] - c.x, 0.0f), c.x - maxX[x]);
+                    float dy = std::max(std::max(minY[x] - c.y, 0.0f), c.y - maxY[x]);
+                    float dz = std::max(std::max(minZ[x] - c.z, 0.0f), c.z - maxZ[x]);
+                    hit[x] = dx * dx + dy * dy + dz * dz <= r2;
+                }
+
+                for (int x = x0; x <= x1; x++) {
+                    if (!hit[x]) continue;
+                    m_pairCluster.push_back(static_cast<uint32_t>(row + x));
+                    m_pairLight.push_back(static_cast<uint32_t>(l));
+                }
+            }
+        }
+    }
+
+    // counting sort by cluster
+    m_ranges.assign(CLUSTER_COUNT, glm::uvec2(0));
+    for (uint32_t cluster : m_pairCluster) m_ranges[cluster].y++;
+
+    uint32_t offset = 0;
+    int maxPerCluster = 0;
+    for (glm::uvec2& range : m_ranges) {
+        range.x = offset;
+        offset += range.y;
+        maxPerCluster = std::max(maxPerCluster, static_cast<int>(range.y));
+        range.y = 0;
+    }
+
+    m_indices.resize(m_pairCluster.size());
+    for (size_t p = 0; p < m_pairCluster.size(); p++) {
+        glm::uvec2& range = m_ranges[m_pairCluster[p]];
+        m_indices[range.x + range.y++] = m_pairLight[p];
+    }
+
+    m_stats.lights = static_cast<int>(lights.size());
+    m_stats.indices = static_cast<int>(m_indices.size());
+    m_stats.maxPerCluster = maxPerCluster;
+    m_stats.buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// a shadowless point light that only lives for a frame (fireflies)
+struct ClusterLight {
+    glm::vec3 pos;   // world space
+    float radius;    // nothing is lit past this
+    glm::vec3 color; // already scaled by the intensity
+};
+
+struct ClusterStats {
+    int lights = 0;
+    int indices = 0;       // light references over all clusters
+    int maxPerCluster = 0; // worst case loop length in the shader
+    double buildMs = 0.0;
+};
+
+/**
+ * Clustered light assignment on the cpu.
+ *
+ * The view frustum is cut into GRID_X x GRID_Y screen tiles and GRID_Z depth slices (exponential, so near slices are
+ * thin and far ones thick). Every light's sphere is tested against the view space boxes of the clusters it could
+ * touch, and each cluster ends up with a list of light indices that the fragment shader loops over instead of all
+ * of them. With lights that only reach a couple of units, a cluster has a handful no matter how many there are.
+ *
+ * The cluster boxes are kept as structure of arrays (one row of x tiles contiguous) and only rebuilt when the
+ * projection changes. The sphere test is a fixed length, branch free loop over a row so it gets vectorized, the same
+ * trick as Frustum::test. Nothing in here touches GL.
+ *
+ * Cluster index = x + GRID_X * (y + GRID_Y * z), y = 0 is the bottom of the screen (like gl_FragCoord).
+ */
+class LightClusters {
+public:
+    static const int GRID_X = 16;
+    static const int GRID_Y = 9;
+    static const int GRID_Z = 24;
+    static const int CLUSTER_COUNT = GRID_X * GRID_Y * GRID_Z;
+
+    void build(const std::vector<ClusterLight>& lights, const glm::mat4& view, const glm::mat4& proj,
+               float near, float far);
+
+    // per cluster: first entry in indices() and how many
+    const std::vector<glm::uvec2>& ranges() const { return m_ranges; }
+    const std::vector<uint32_t>& indices() const { return m_indices; }
+    const ClusterStats& stats() const { return m_stats; }
+
+    // depth slice of a view depth d is floor(log(d) * sliceScale + sliceBias)
+    float sliceScale() const { return m_sliceScale; }
+    float sliceBias() const { return m_sliceBias; }
+
+private:
+    void buildClusterBounds(const glm::mat4& proj, float near, float far);
+
+    std::vector<glm::uvec2> m_ranges;
+    std::vector<uint32_t> m_indices;
+    ClusterStats m_stats;
+
+    // view space cluster boxes, CLUSTER_COUNT each
+    std::vector<float> m_minX, m_minY, m_minZ;
+    std::vector<float> m_maxX, m_maxY, m_maxZ;
+    glm::mat4 m_boundsProj = glm::mat4(0.0f); // what the boxes were built for
+    float m_boundsNear = 0.0f;
+    float m_boundsFar = 0.0f;
+    float m_sliceScale = 0.0f;
+    float m_sliceBias = 0.0f;
+
+    // scratch, kept around so a frame doesn't allocate
+    std::vector<uint32_t> m_pairCluster;
+    std::vector<uint32_t> m_pairLight;
+};
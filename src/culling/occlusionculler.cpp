@@ -0,0 +1,267 @@
+#include "occlusionculler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <thread>
+#include <utility>
+
+namespace {
+    const float MIN_W = 1e-5f;
+
+    double msSince(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+OcclusionCuller::~OcclusionCuller() {
+    if (m_job.valid()) m_job.wait();
+}
+
+int OcclusionCuller::taskCount() {
+    return std::clamp(static_cast<int>(std::thread::hardware_concurrency()), 1, 8);
+}
+
+void OcclusionCuller::setOccluders(std::vector<glm::vec3> triangles) {
+    if (m_job.valid()) m_job.wait();
+    m_occluders = std::move(triangles);
+}
+
+std::vector<glm::vec3> OcclusionCuller::takeOccluders() {
+    if (m_job.valid()) m_job.wait();
+    m_screenTriangles.clear();
+    return std::exchange(m_occluders, {});
+}
+
+void OcclusionCuller::clear() {
+    if (m_job.valid()) m_job.wait();
+    m_occluders.clear();
+    m_screenTriangles.clear();
+}
+
+void OcclusionCuller::begin(const glm::mat4 &viewProj, const std::vector<AABB> &bounds, std::vector<int> candidates) {
+    if (m_job.valid()) m_job.wait(); // last frame's result was never picked up
+    m_job = std::async(std::launch::async, &OcclusionCuller::run, this, viewProj, &bounds, std::move(candidates));
+}
+
+void OcclusionCuller::finish(std::vector<int> &visible, OcclusionStats *stats) {
+    if (!m_job.valid()) return;
+
+    Result result = m_job.get();
+    visible = std::move(result.visible);
+    if (stats) *stats = result.stats;
+}
+
+OcclusionCuller::Result OcclusionCuller::run(glm::mat4 viewProj, const std::vector<AABB> *bounds, std::vector<int> candidates) {
+    Result result;
+
+    auto start = std::chrono::steady_clock::now();
+    rasterize(viewProj);
+    buildHiZ();
+    result.stats.rasterMs = msSince(start);
+    result.stats.occluderTriangles = static_cast<int>(m_screenTriangles.size());
+
+    // box tests in chunks, one flag per candidate so the output keeps the input order
+    start = std::chrono::steady_clock::now();
+    const int count = static_cast<int>(candidates.size());
+    const int tasks = std::min(taskCount(), std::max(1, count / 256));
+    std::vector<unsigned char> occluded(count, 0);
+
+    std::vector<std::future<void>> chunks;
+    for (int t = 0; t < tasks; t++) {
+        const int first = count * t / tasks;
+        const int last = count * (t + 1) / tasks;
+        chunks.push_back(std::async(std::launch::async, [&, first, last]() {
+            for (int i = first; i < last; i++) {
+                occluded[i] = isOccluded((*bounds)[candidates[i]], viewProj);
+            }
+        }));
+    }
+    for (auto &chunk : chunks) chunk.get();
+
+    result.visible.reserve(count);
+    for (int i = 0; i < count; i++) {
+        if (!occluded[i]) result.visible.push_back(candidates[i]);
+    }
+    result.stats.testMs = msSince(start);
+    result.stats.tested = count;
+    result.stats.occluded = count - static_cast<int>(result.visible.size());
+    return result;
+}
+
+/**
+ * @brief OcclusionCuller::rasterize projects the occluders and rasterizes them into level 0, one row band per task.
+ * triangles that cross the near plane are dropped (leaving an occluder out is always safe)
+ */
+void OcclusionCuller::rasterize(const glm::mat4 &viewProj) {
+    if (m_levels.empty()) {
+        for (glm::ivec2 size(WIDTH, HEIGHT); size.x >= 1 && size.y >= 1; size /= 2) {
+            m_levelSize.push_back(size);
+            m_levels.emplace_back(size.x * size.y, 1.f);
+        }
+    }
+    std::fill(m_levels[0].begin(), m_levels[0].end(), 1.f);
+
+    m_screenTriangles.clear();
+    for (size_t t = 0; t + 2 < m_occluders.size(); t += 3) {
+        ScreenTriangle tri;
+        bool behind = false;
+        int left = 0, right = 0, below = 0, above = 0, far = 0;
+
+        for (int v = 0; v < 3; v++) {
+            glm::vec4 clip = viewProj * glm::vec4(m_occluders[t + v], 1.f);
+            if (clip.w < MIN_W || clip.z < -clip.w) {
+                behind = true;
+                break;
+            }
+            left += clip.x < -clip.w;
+            right += clip.x > clip.w;
+            below += clip.y < -clip.w;
+            above += clip.y > clip.w;
+            far += clip.z > clip.w;
+
+            glm::vec3 ndc = glm::vec3(clip) / clip.w;
+            tri.x[v] = (ndc.x * 0.5f + 0.5f) * WIDTH;
+            tri.y[v] = (ndc.y * 0.5f + 0.5f) * HEIGHT;
+            tri.z[v] = ndc.z * 0.5f + 0.5f;
+        }
+
+        if (behind || left == 3 || right == 3 || below == 3 || above == 3 || far == 3) continue;
+        m_screenTriangles.push_back(tri);
+    }
+
+    const int tasks = m_screenTriangles.empty() ? 0 : taskCount();
+    std::vector<std::future<void>> bands;
+    for (int t = 0; t < tasks; t++) {
+        const int rowBegin = HEIGHT * t / tasks;
+        const int rowEnd = HEIGHT * (t + 1) / tasks;
+        bands.push_back(std::async(std::launch::async, &OcclusionCuller::rasterizeBand, this, rowBegin, rowEnd));
+    }
+    for (auto &band : bands) band.get();
+}
+
+/**
+ * @brief OcclusionCuller::rasterizeBand edge functions at pixel centers. the depth written is the farthest the triangle
+ * gets inside the pixel, so the buffer never claims something is closer than it is. the inner x loop has no branches
+ * (a select instead of an if) so it vectorizes
+ */
+void OcclusionCuller::rasterizeBand(int rowBegin, int rowEnd) {
+    std::vector<float> &depth = m_levels[0];
+
+    for (ScreenTriangle tri : m_screenTriangles) {
+        float area = (tri.x[1] - tri.x[0]) * (tri.y[2] - tri.y[0]) - (tri.x[2] - tri.x[0]) * (tri.y[1] - tri.y[0]);
+        if (std::abs(area) < 1e-8f) continue;
+        if (area < 0.f) {
+            // occluders are drawn two sided, just flip it to ccw
+            std::swap(tri.x[1], tri.x[2]);
+            std::swap(tri.y[1], tri.y[2]);
+            std::swap(tri.z[1], tri.z[2]);
+            area = -area;
+        }
+
+        const int minX = std::max(0, static_cast<int>(std::floor(std::min({tri.x[0], tri.x[1], tri.x[2]}))));
+        const int maxX = std::min(WIDTH - 1, static_cast<int>(std::ceil(std::max({tri.x[0], tri.x[1], tri.x[2]}))));
+        const int minY = std::max(rowBegin, static_cast<int>(std::floor(std::min({tri.y[0], tri.y[1], tri.y[2]}))));
+        const int maxY = std::min(rowEnd - 1, static_cast<int>(std::ceil(std::max({tri.y[0], tri.y[1], tri.y[2]}))));
+        if (minX > maxX || minY > maxY) continue;
+
+        // edge i goes from vertex i to vertex i + 1: E(x, y) = a * x + b * y + c, positive inside
+        float a[3], b[3], c[3];
+        for (int i = 0; i < 3; i++) {
+            int j = (i + 1) % 3;
+            a[i] = tri.y[i] - tri.y[j];
+            b[i] = tri.x[j] - tri.x[i];
+            c[i] = tri.x[i] * tri.y[j] - tri.x[j] * tri.y[i];
+        }
+
+        // depth plane z = z0 + dzdx * (x - x0) + dzdy * (y - y0), pushed out to the far corner of the pixel
+        const float e1x = tri.x[1] - tri.x[0], e1y = tri.y[1] - tri.y[0], e1z = tri.z[1] - tri.z[0];
+        const float e2x = tri.x[2] - tri.x[0], e2y = tri.y[2] - tri.y[0], e2z = tri.z[2] - tri.z[0];
+        const float dzdx = (e1z * e2y - e2z * e1y) / area;
+        const float dzdy = (e2z * e1x - e1z * e2x) / area;
+        const float zOffset = 0.5f * (std::abs(dzdx) + std::abs(dzdy));
+        const float zMax = std::max({tri.z[0], tri.z[1], tri.z[2]});
+
+        for (int y = minY; y <= maxY; y++) {
+            const float py = y + 0.5f;
+            const float row0 = b[0] * py + c[0];
+            const float row1 = b[1] * py + c[1];
+            const float row2 = b[2] * py + c[2];
+            const float rowZ = tri.z[0] + dzdy * (py - tri.y[0]) - dzdx * tri.x[0] + zOffset;
+            float *out = &depth[y * WIDTH];
+
+            for (int x = minX; x <= maxX; x++) {
+                const float px = x + 0.5f;
+                const bool inside = (a[0] * px + row0 >= 0.f) & (a[1] * px + row1 >= 0.f) & (a[2] * px + row2 >= 0.f);
+                const float z = std::min(rowZ + dzdx * px, zMax);
+                out[x] = inside ? std::min(out[x], z) : out[x];
+            }
+        }
+    }
+}
+
+void OcclusionCuller::buildHiZ() {
+    for (size_t l = 1; l < m_levels.size(); l++) {
+        const std::vector<float> &src = m_levels[l - 1];
+        std::vector<float> &dst = m_levels[l];
+        const int srcWidth = m_levelSize[l - 1].x;
+        const glm::ivec2 size = m_levelSize[l];
+
+        for (int y = 0; y < size.y; y++) {
+            const float *row0 = &src[(2 * y) * srcWidth];
+            const float *row1 = &src[(2 * y + 1) * srcWidth];
+            for (int x = 0; x < size.x; x++) {
+                dst[y * size.x + x] = std::max(std::max(row0[2 * x], row0[2 * x + 1]), std::max(row1[2 * x], row1[2 * x + 1]));
+            }
+        }
+    }
+}
+
+/**
+ * @brief OcclusionCuller::isOccluded projects the box, picks the pyramid level where it covers at most 2x2 texels and
+ * compares its nearest depth with the farthest depth in those texels. anything touching the near plane or leaving
+ * the screen counts as visible
+ */
+bool OcclusionCuller::isOccluded(const AABB &box, const glm::mat4 &viewProj) const {
+    if (m_screenTriangles.empty() || m_levels.empty()) return false;
+
+    float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+    float nearZ = FLT_MAX;
+    for (int i = 0; i < 8; i++) {
+        glm::vec3 corner((i & 1) ? box.max.x : box.min.x, (i & 2) ? box.max.y : box.min.y, (i & 4) ? box.max.z : box.min.z);
+        glm::vec4 clip = viewProj * glm::vec4(corner, 1.f);
+        if (clip.w < MIN_W || clip.z < -clip.w) return false;
+
+        glm::vec3 ndc = glm::vec3(clip) / clip.w;
+        float x = (ndc.x * 0.5f + 0.5f) * WIDTH;
+        float y = (ndc.y * 0.5f + 0.5f) * HEIGHT;
+        minX = std::min(minX, x);
+        maxX = std::max(maxX, x);
+        minY = std::min(minY, y);
+        maxY = std::max(maxY, y);
+        nearZ = std::min(nearZ, ndc.z * 0.5f + 0.5f);
+    }
+
+    if (maxX < 0.f || maxY < 0.f || minX >= WIDTH || minY >= HEIGHT) return false;
+
+    int x0 = std::clamp(static_cast<int>(minX), 0, WIDTH - 1);
+    int x1 = std::clamp(static_cast<int>(maxX), 0, WIDTH - 1);
+    int y0 = std::clamp(static_cast<int>(minY), 0, HEIGHT - 1);
+    int y1 = std::clamp(static_cast<int>(maxY), 0, HEIGHT - 1);
+
+    int level = 0;
+    while (level + 1 < levelCount() && ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1)) {
+        level++;
+    }
+
+    const std::vector<float> &depth = m_levels[level];
+    const glm::ivec2 size = m_levelSize[level];
+    float farthest = 0.f;
+    for (int y = y0 >> level; y <= std::min(y1 >> level, size.y - 1); y++) {
+        for (int x = x0 >> level; x <= std::min(x1 >> level, size.x - 1); x++) {
+            farthest = std::max(farthest, depth[y * size.x + x]);
+        }
+    }
+
+    return nearZ > farthest;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "bvh.h"
+
+#include <future>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+struct OcclusionStats {
+    int occluderTriangles = 0; // in front of the near plane this frame
+    int tested = 0;
+    int occluded = 0;
+    double rasterMs = 0.0;     // occluders + hi-z
+    double testMs = 0.0;
+};
+
+/**
+ * Software occlusion culling on the cpu.
+ *
+ * A handful of big occluders (world space triangles, set once per scene) are rasterized into a small depth buffer,
+ * which is reduced into a hierarchical z pyramid (every level keeps the farthest depth of the 2x2 texels under it).
+ * Instance boxes are then projected and thrown out if their nearest point is behind everything in the pyramid texels
+ * they cover. The rasterizer splits the screen into row bands and the box tests into chunks, each on its own task.
+ *
+ * begin() kicks all of that off on a worker and returns right away, finish() waits for it, so the renderer can get
+ * the skybox/terrain/uniforms out in the meantime. Nothing in here touches GL.
+ *
+ * Depth is window z in [0, 1] (1 = far plane, what the buffer is cleared to).
+ */
+class OcclusionCuller {
+public:
+    static const int WIDTH = 256;
+    static const int HEIGHT = 128;
+
+    ~OcclusionCuller();
+
+    void setOccluders(std::vector<glm::vec3> triangles);
+    // hands the occluders back (the scene renderer keeps them with a scene that goes off screen)
+    std::vector<glm::vec3> takeOccluders();
+    void clear();
+    bool empty() const { return m_occluders.empty(); }
+
+    // bounds has to stay alive and unchanged until finish()
+    void begin(const glm::mat4 &viewProj, const std::vector<AABB> &bounds, std::vector<int> candidates);
+    // waits for the job started by begin() and puts the candidates that weren't occluded in visible (same order)
+    void finish(std::vector<int> &visible, OcclusionStats *stats = nullptr);
+
+    // the steps begin() runs, usable on their own
+    void rasterize(const glm::mat4 &viewProj);
+    void buildHiZ();
+    bool isOccluded(const AABB &box, const glm::mat4 &viewProj) const;
+
+    int levelCount() const { return static_cast<int>(m_levels.size()); }
+    const std::vector<float> &level(int i) const { return m_levels[i]; }
+
+private:
+    struct ScreenTriangle {
+        float x[3], y[3], z[3];
+    };
+
+    struct Result {
+        std::vector<int> visible;
+        OcclusionStats stats;
+    };
+
+    Result run(glm::mat4 viewProj, const std::vector<AABB> *bounds, std::vector<int> candidates);
+    void rasterizeBand(int rowBegin, int rowEnd);
+
+    static int taskCount();
+
+    std::vector<glm::vec3> m_occluders; // 3 per triangle
+    std::vector<ScreenTriangle> m_screenTriangles;
+
+    std::vector<std::vector<float>> m_levels; // level 0 is WIDTH x HEIGHT
+    std::vector<glm::ivec2> m_levelSize;
+
+    std::future<Result> m_job;
+};
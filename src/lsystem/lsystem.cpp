@@ -231,13 +231,15 @@ float LSystem::evaluateArithmetic(const std::string &expr) {
  * @brief LSystem::expandLSystem expands an L system based on the current nodes rules. iterated through the string depending on the amount
  * of iterations, and for each iteration expands based on teh data's rules
  * @param data
+ * @param symbolCounts optional, number of symbols before each iteration and at the end
  * @return
  */
-std::vector<LSymbol> LSystem::expandLSystem(const LSystemData &data){
+std::vector<LSymbol> LSystem::expandLSystem(const LSystemData &data, std::vector<size_t> *symbolCounts){
     std::string current = data.axiom;
 
     for (int i = 0; i < data.iterations; i++) {
         auto symbols = tokenize(current);
+        if (symbolCounts) symbolCounts->push_back(symbols.size());
         std::string next;
 
         for (auto &s : symbols) {
@@ -247,7 +249,9 @@ std::vector<LSymbol> LSystem::expandLSystem(const LSystemData &data){
         current = next;
     }
 
-    return tokenize(current);
+    std::vector<LSymbol> result = tokenize(current);
+    if (symbolCounts) symbolCounts->push_back(result.size());
+    return result;
 }
 
 std::string LSystem::applyRule(const LSymbol &symbol, const LSystemData &data) {
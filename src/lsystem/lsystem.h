@@ -31,9 +31,9 @@ public:
     static LSymbol parseLSymbol(const std::string &tokenString);
     static std::vector<LSymbol> tokenize(const std::string &string);
 
-    // L-system expansion (with params)
+    // L-system expansion (with params). symbolCounts (optional) gets the string length before every iteration + the final one
     static std::string applyRule(const LSymbol &symbol, const LSystemData &data);
-    static std::vector<LSymbol> expandLSystem(const LSystemData &data);
+    static std::vector<LSymbol> expandLSystem(const LSystemData &data, std::vector<size_t> *symbolCounts = nullptr);
 
     // Interpretation → produce CTMs for stems & leaves
     static void interpretLSystem(const LSystemData &data, const std::vector<LSymbol> &symbols,
@@ -126,8 +126,22 @@ void MainWindow::initialize() {
     QVBoxLayout *sceneLayout = new QVBoxLayout;
 
     uploadFile = new QPushButton("Upload Scene File");
+    preloadSeasons = new QCheckBox("Preload All Seasons");
+    preloadSeasons->setChecked(false);
+
+    loadStatus = new QLabel;
+    loadStatus->setObjectName("SideHint");
+    loadProgress = new QProgressBar;
+    loadProgress->setRange(0, 100);
+    loadProgress->setTextVisible(false);
+    loadProgress->setMaximumHeight(8);
+    loadStatus->hide();
+    loadProgress->hide();
 
     sceneLayout->addWidget(uploadFile);
+    sceneLayout->addWidget(preloadSeasons);
+    sceneLayout->addWidget(loadStatus);
+    sceneLayout->addWidget(loadProgress);
     sceneBox->setLayout(sceneLayout);
 
     // Effects group
@@ -140,8 +154,19 @@ void MainWindow::initialize() {
     ec1->setChecked(false);
     ec2->setChecked(false);
 
+    bloomStrength = new QSlider(Qt::Horizontal);
+    bloomStrength->setRange(0, 300);
+    bloomStrength->setValue(100);
+    bloomRadius = new QSlider(Qt::Horizontal);
+    bloomRadius->setRange(0, 100);
+    bloomRadius->setValue(70);
+
     effectsLayout->addWidget(ec1);
     effectsLayout->addWidget(ec2);
+    effectsLayout->addWidget(new QLabel("Bloom Strength"));
+    effectsLayout->addWidget(bloomStrength);
+    effectsLayout->addWidget(new QLabel("Bloom Radius"));
+    effectsLayout->addWidget(bloomRadius);
     effectsBox->setLayout(effectsLayout);
 
     // Seasons group (disabled until particles enabled)
@@ -172,21 +197,82 @@ void MainWindow::initialize() {
     seasonLayout->addWidget(seasonAutumn);
     seasonBox->setLayout(seasonLayout);
 
+    // Rendering group
+    QGroupBox *renderingBox = new QGroupBox("Rendering");
+    QVBoxLayout *renderingLayout = new QVBoxLayout;
+
+    depthPrepass = new QCheckBox("Depth Pre-pass");
+    printFrameStats = new QCheckBox("Print Frame Stats");
+    shadowLeafProxies = new QCheckBox("Coarse Leaf Shadows");
+    amortizeShadowUpdates = new QCheckBox("Amortized Shadow Updates");
+    fireflyLights = new QCheckBox("Firefly Lights");
+    deferredShading = new QCheckBox("Deferred Shading");
+    lowResGodRays = new QCheckBox("Low-res God Rays");
+    temporalEffects = new QCheckBox("Temporal Effects");
+    depthPrepass->setChecked(false);
+    printFrameStats->setChecked(false);
+    shadowLeafProxies->setChecked(true);
+    amortizeShadowUpdates->setChecked(true);
+    fireflyLights->setChecked(true);
+    deferredShading->setChecked(false);
+    lowResGodRays->setChecked(false);
+    temporalEffects->setChecked(false);
+
+    renderingLayout->addWidget(depthPrepass);
+    renderingLayout->addWidget(printFrameStats);
+    renderingLayout->addWidget(shadowLeafProxies);
+    renderingLayout->addWidget(amortizeShadowUpdates);
+    renderingLayout->addWidget(fireflyLights);
+    renderingLayout->addWidget(deferredShading);
+    renderingLayout->addWidget(lowResGodRays);
+    renderingLayout->addWidget(temporalEffects);
+
+    QRadioButton *shadowPCF = new QRadioButton("Shadows: PCF (4 taps)");
+    QRadioButton *shadowPoisson = new QRadioButton("Shadows: Poisson (4 taps)");
+    QRadioButton *shadowVariance = new QRadioButton("Shadows: Variance (1 tap)");
+    shadowFilterGroup = new QButtonGroup(this);
+    shadowFilterGroup->addButton(shadowPCF, SHADOW_FILTER_PCF);
+    shadowFilterGroup->addButton(shadowPoisson, SHADOW_FILTER_POISSON);
+    shadowFilterGroup->addButton(shadowVariance, SHADOW_FILTER_VARIANCE);
+    shadowPCF->setChecked(true);
+
+    renderingLayout->addWidget(shadowPCF);
+    renderingLayout->addWidget(shadowPoisson);
+    renderingLayout->addWidget(shadowVariance);
+    renderingBox->setLayout(renderingLayout);
+
     side->addWidget(sceneBox);
     side->addWidget(effectsBox);
     side->addWidget(seasonBox);
+    side->addWidget(renderingBox);
 
     connectUIElements();
+    realtime->setLoadProgressCallback([this](int percent, const std::string &status) {
+        onLoadProgress(percent, status);
+    });
 
     // Default settings
     settings.extraCredit1 = ec1->isChecked();
     settings.extraCredit2 = ec2->isChecked();
+    settings.bloomStrength = bloomStrength->value() / 100.f;
+    settings.bloomRadius = bloomRadius->value() / 100.f;
 
     settings.particlesWinter = true;
     settings.particlesSpring = false;
     settings.particlesSummer = false;
     settings.particlesAutumn = false;
 
+    settings.preloadSeasons = preloadSeasons->isChecked();
+    settings.depthPrepass = depthPrepass->isChecked();
+    settings.printFrameStats = printFrameStats->isChecked();
+    settings.shadowLeafProxies = shadowLeafProxies->isChecked();
+    settings.amortizeShadowUpdates = amortizeShadowUpdates->isChecked();
+    settings.fireflyLights = fireflyLights->isChecked();
+    settings.deferredShading = deferredShading->isChecked();
+    settings.lowResGodRays = lowResGodRays->isChecked();
+    settings.temporalEffects = temporalEffects->isChecked();
+    settings.shadowFilter = static_cast<ShadowFilter>(shadowFilterGroup->checkedId());
+
     applyFixedParams();
 }
 
@@ -200,21 +286,37 @@ void MainWindow::connectUIElements() {
     connectUploadFile();
     connectExtraCredit();
     connectParticleSeasons();
+    connectRendering();
 }
 
 void MainWindow::connectUploadFile() {
     connect(uploadFile, &QPushButton::clicked, this, &MainWindow::onUploadFile);
+    connect(preloadSeasons, &QCheckBox::clicked, this, &MainWindow::onPreloadSeasons);
 }
 
 void MainWindow::connectExtraCredit() {
     connect(ec1, &QCheckBox::clicked, this, &MainWindow::onExtraCredit1);
     connect(ec2, &QCheckBox::clicked, this, &MainWindow::onExtraCredit2);
+    connect(bloomStrength, &QSlider::valueChanged, this, &MainWindow::onBloomSliders);
+    connect(bloomRadius, &QSlider::valueChanged, this, &MainWindow::onBloomSliders);
 }
 
 void MainWindow::connectParticleSeasons() {
     connect(seasonGroup, &QButtonGroup::idClicked, this, &MainWindow::onSeasonChanged);
 }
 
+void MainWindow::connectRendering() {
+    connect(depthPrepass, &QCheckBox::clicked, this, &MainWindow::onRenderingToggles);
+    connect(printFrameStats, &QCheckBox::clicked, this, &MainWindow::onRenderingToggles);
+    connect(shadowLeafProxies, &QCheckBox::clicked, this, &MainWindow::onRenderingToggles);
+    connect(amortizeShadowUpdates, &QCheckBox::clicked, this, &MainWindow::onRenderingToggles);
+    connect(fireflyLights, &QCheckBox::clicked, this, &MainWindow::onRenderingToggles);
+    connect(deferredShading, &QCheckBox::clicked, this, &MainWindow::onRenderingToggles);
+    connect(lowResGodRays, &QCheckBox::clicked, this, &MainWindow::onRenderingToggles);
+    connect(temporalEffects, &QCheckBox::clicked, this, &MainWindow::onRenderingToggles);
+    connect(shadowFilterGroup, &QButtonGroup::idClicked, this, &MainWindow::onRenderingToggles);
+}
+
 void MainWindow::onUploadFile() {
     QString configFilePath = QFileDialog::getOpenFileName(
         this, tr("Upload File"),
@@ -231,12 +333,40 @@ void MainWindow::onUploadFile() {
     }
 
     settings.sceneFilePath = configFilePath.toStdString();
-    std::cout << "Loaded scenefile: \"" << settings.sceneFilePath << "\"." << std::endl;
+    std::cout << "Loading scenefile: \"" << settings.sceneFilePath << "\"..." << std::endl;
 
     applyFixedParams();
     realtime->sceneChanged();
 }
 
+void MainWindow::onLoadProgress(int percent, const std::string &status) {
+    // called from Realtime on the GUI thread while the loader is busy, 100 means the new scene is in
+    bool loading = percent < 100;
+    loadStatus->setVisible(!status.empty());
+    loadProgress->setVisible(loading);
+    loadStatus->setText(QString::fromStdString(status));
+    loadProgress->setValue(percent);
+}
+
+void MainWindow::onPreloadSeasons() {
+    settings.preloadSeasons = preloadSeasons->isChecked();
+    applyFixedParams();
+    realtime->settingsChanged();
+}
+
+void MainWindow::onRenderingToggles() {
+    settings.depthPrepass = depthPrepass->isChecked();
+    settings.printFrameStats = printFrameStats->isChecked();
+    settings.shadowLeafProxies = shadowLeafProxies->isChecked();
+    settings.amortizeShadowUpdates = amortizeShadowUpdates->isChecked();
+    settings.fireflyLights = fireflyLights->isChecked();
+    settings.deferredShading = deferredShading->isChecked();
+    settings.lowResGodRays = lowResGodRays->isChecked();
+    settings.temporalEffects = temporalEffects->isChecked();
+    settings.shadowFilter = static_cast<ShadowFilter>(shadowFilterGroup->checkedId());
+    realtime->settingsChanged();
+}
+
 void MainWindow::onSaveImage() {
     if (settings.sceneFilePath.empty()) {
         std::cout << "No scene file loaded." << std::endl;
@@ -281,6 +411,12 @@ void MainWindow::onExtraCredit2() {
     realtime->settingsChanged();
 }
 
+void MainWindow::onBloomSliders() {
+    settings.bloomStrength = bloomStrength->value() / 100.f;
+    settings.bloomRadius = bloomRadius->value() / 100.f;
+    realtime->settingsChanged();
+}
+
 void MainWindow::onSeasonChanged() {
     // Respect current selected radio
     int id = seasonGroup->checkedId();
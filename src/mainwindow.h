@@ -5,6 +5,9 @@
 #include <QPushButton>
 #include <QRadioButton>
 #include <QButtonGroup>
+#include <QLabel>
+#include <QProgressBar>
+#include <QSlider>
 
 #include "realtime/realtime.h"
 #include "utils/aspectratiowidget/aspectratiowidget.hpp"
@@ -23,9 +26,11 @@ private:
     void connectSaveImage();
     void connectExtraCredit();
     void connectParticleSeasons();
+    void connectRendering();
 
     void applyFixedParams();
     void applyPrettyStyle();
+    void onLoadProgress(int percent, const std::string &status);
 
     Realtime *realtime = nullptr;
     AspectRatioWidget *aspectRatioWidget = nullptr;
@@ -33,6 +38,23 @@ private:
     QPushButton *uploadFile = nullptr;
     QPushButton *saveImage  = nullptr;
 
+    QCheckBox *preloadSeasons = nullptr;
+
+    // Rendering toggles
+    QCheckBox *depthPrepass = nullptr;
+    QCheckBox *printFrameStats = nullptr;
+    QCheckBox *shadowLeafProxies = nullptr;
+    QCheckBox *amortizeShadowUpdates = nullptr;
+    QCheckBox *fireflyLights = nullptr;
+    QCheckBox *deferredShading = nullptr;
+    QCheckBox *lowResGodRays = nullptr;
+    QCheckBox *temporalEffects = nullptr;
+    QButtonGroup *shadowFilterGroup = nullptr; // ids are ShadowFilter values
+
+    // Async scene loading feedback
+    QLabel *loadStatus = nullptr;
+    QProgressBar *loadProgress = nullptr;
+
     // Particles + seasons
     QCheckBox *ec1 = nullptr; // particles master
     QRadioButton *seasonWinter = nullptr;
@@ -43,6 +65,8 @@ private:
 
     // Other toggles
     QCheckBox *ec2 = nullptr;
+    QSlider *bloomStrength = nullptr; // 0..300 = 0..3
+    QSlider *bloomRadius = nullptr;   // 0..100 = 0..1
 
 private slots:
     void onUploadFile();
@@ -50,6 +74,9 @@ private slots:
 
     void onExtraCredit1();
     void onExtraCredit2();
+    void onBloomSliders();
 
     void onSeasonChanged();
+    void onPreloadSeasons();
+    void onRenderingToggles();
 };
@@ -110,6 +110,21 @@ int ParticleSystem::aliveCount() const {
     return static_cast<int>(m_particles.size());
 }
 
+void ParticleSystem::collectLights(std::vector<ClusterLight>& out, float radius, float intensity) const {
+    if (!m_enabled || !m_emitter.enabled) return;
+
+    out.reserve(out.size() + m_particles.size());
+    for (const Particle &p : m_particles) {
+        // same color over life + fade as render()
+        float t = std::clamp(p.age / p.life, 0.f, 1.f);
+        glm::vec4 c = glm::mix(m_emitter.colorStart, m_emitter.colorEnd, t);
+        float alpha = c.a * (1.f - t);
+        if (alpha <= 0.f) continue;
+
+        out.push_back({p.pos, radius, glm::vec3(c) * alpha * intensity});
+    }
+}
+
 float ParticleSystem::rand01() {
     return m_dist(m_rng);
 }
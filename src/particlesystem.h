@@ -12,6 +12,8 @@
 #include <random>
 #include <cstdint>
 
+#include "culling/lightclusters.h"
+
 class ParticleSystem {
 public:
     struct Emitter {
@@ -70,6 +72,9 @@ public:
 
     int aliveCount() const;
 
+    // One point light per live particle, colored like the particle (fades out with it). Used for the fireflies
+    void collectLights(std::vector<ClusterLight>& out, float radius, float intensity) const;
+
 private:
     struct Particle {
         glm::vec3 pos = glm::vec3(0.f);
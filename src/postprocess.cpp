@@ -3,8 +3,10 @@
 #include <iostream>
 #include <initializer_list>
 #include <algorithm> // std::max, std::min
+#include <string>
 
 #include "utils/shaderloader.h"
+#include "renderers/temporalaccumulator.h"
 
 static GLint getUniformAny(GLuint program, std::initializer_list<const char*> names) {
     for (const char* n : names) {
@@ -15,18 +17,14 @@ static GLint getUniformAny(GLuint program, std::initializer_list<const char*> na
 }
 
 bool PostProcess::ready() const {
-    return m_fbo != 0 && m_colorTex != 0 && m_depthRbo != 0 &&
-           m_program != 0 && m_quadVao != 0;
+    return m_composite[0].program != 0 && m_quadVao != 0;
 }
 
 bool PostProcess::bloomReady() const {
     if (!m_bloomEnabled) return false;
 
     return ready() &&
-           m_bloomFbo != 0 && m_bloomTex != 0 &&
-           m_pingpongFbo[0] != 0 && m_pingpongFbo[1] != 0 &&
-           m_pingpongTex[0] != 0 && m_pingpongTex[1] != 0 &&
-           m_brightProgram != 0 && m_blurProgram != 0 && m_combineProgram != 0;
+           m_bright[0].program != 0 && m_downProgram != 0 && m_upProgram != 0 && m_composite[1].program != 0;
 }
 
 void PostProcess::setBloomEnabled(bool enabled) {
@@ -38,155 +36,106 @@ void PostProcess::setBloomStrength(float s) {
     m_bloomStrength = std::min(std::max(s, 0.f), 10.f);
 }
 
+void PostProcess::setBloomRadius(float r) {
+    m_bloomRadius = std::min(std::max(r, 0.f), 1.f);
+}
+
 void PostProcess::init(int w, int h) {
     destroy(); // safe re-init
 
-    m_w = w;
-    m_h = h;
-
-    // ---------------- Main postprocess FBO ----------------
-    glGenFramebuffers(1, &m_fbo);
-    glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
-
-    glGenTextures(1, &m_colorTex);
-    glBindTexture(GL_TEXTURE_2D, m_colorTex);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_colorTex, 0);
-
-    glGenRenderbuffers(1, &m_depthRbo);
-    glBindRenderbuffer(GL_RENDERBUFFER, m_depthRbo);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, w, h);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_depthRbo);
-
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-        std::cerr << "Error: PostProcess framebuffer incomplete.\n";
-    }
-
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    glBindTexture(GL_TEXTURE_2D, 0);
-    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    ensureSize(w, h);
 
-    // Compile post shader program (passthrough/invert/grayscale)
-    try {
-        m_program = ShaderLoader::createShaderProgram(
-            ":/resources/shaders/fullscreen.vert",
-            ":/resources/shaders/post.frag"
-            );
-    } catch (const std::runtime_error &e) {
-        std::cerr << "PostProcess shader error: " << e.what() << "\n";
-        m_program = 0;
-    }
+    // Composite programs (scene + bloom + god rays, passthrough/invert/grayscale), one per combination
+    for (int i = 0; i < 4; i++) {
+        const bool bloom = i & 1;
+        const bool rays = i & 2;
+        const std::string defines = std::string("#define BLOOM ") + (bloom ? "1" : "0") + "\n" +
+                                    "#define GOD_RAYS " + (rays ? "1" : "0") + "\n";
+
+        CompositeProgram& composite = m_composite[i];
+        try {
+            composite.program = ShaderLoader::createShaderProgram(
+                ":/resources/shaders/fullscreen.vert",
+                ":/resources/shaders/composite.frag",
+                defines
+                );
+        } catch (const std::runtime_error &e) {
+            std::cerr << "PostProcess composite shader error (bloom " << bloom << ", god rays " << rays << "): "
+                      << e.what() << "\n";
+            composite.program = 0;
+            continue;
+        }
 
-    if (m_program != 0) {
-        glUseProgram(m_program);
-        m_uScreenTex = getUniformAny(m_program, {"u_ScreenTex", "u_SceneTex", "u_Texture"});
-        m_uMode      = getUniformAny(m_program, {"u_Mode", "u_mode"});
-        if (m_uScreenTex >= 0) glUniform1i(m_uScreenTex, 0);
+        glUseProgram(composite.program);
+        composite.uMode     = glGetUniformLocation(composite.program, "u_Mode");
+        composite.uStrength = glGetUniformLocation(composite.program, "u_Strength");
+        glUniform1i(glGetUniformLocation(composite.program, "u_SceneTex"), 0);
+        glUniform1i(glGetUniformLocation(composite.program, "u_BloomTex"), 1);
         glUseProgram(0);
-    }
-
-    // ---------------- Bloom targets ----------------
-    glGenFramebuffers(1, &m_bloomFbo);
-    glBindFramebuffer(GL_FRAMEBUFFER, m_bloomFbo);
-
-    glGenTextures(1, &m_bloomTex);
-    glBindTexture(GL_TEXTURE_2D, m_bloomTex);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_bloomTex, 0);
-
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-        std::cerr << "Error: Bloom framebuffer incomplete.\n";
-    }
 
-    glGenFramebuffers(2, m_pingpongFbo);
-    glGenTextures(2, m_pingpongTex);
+        // the god-ray occlusion mask goes on unit 2
+        if (rays) composite.rays.find(composite.program, 2);
 
-    for (int i = 0; i < 2; i++) {
-        glBindFramebuffer(GL_FRAMEBUFFER, m_pingpongFbo[i]);
-
-        glBindTexture(GL_TEXTURE_2D, m_pingpongTex[i]);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
-
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_pingpongTex[i], 0);
-
-        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-            std::cerr << "Error: Pingpong framebuffer " << i << " incomplete.\n";
+        // If this is -1, bloom might "do nothing" even though it runs.
+        if (bloom && composite.uStrength < 0) {
+            std::cerr << "[Bloom] Warning: strength uniform not found. Check composite.frag uniform name.\n";
         }
     }
 
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    glBindTexture(GL_TEXTURE_2D, 0);
-
     // Bloom shaders
     try {
-        m_brightProgram = ShaderLoader::createShaderProgram(
+        m_downProgram = ShaderLoader::createShaderProgram(
             ":/resources/shaders/fullscreen.vert",
-            ":/resources/shaders/bloom_bright.frag"
+            ":/resources/shaders/bloom_down.frag"
             );
-        m_blurProgram = ShaderLoader::createShaderProgram(
+        m_upProgram = ShaderLoader::createShaderProgram(
             ":/resources/shaders/fullscreen.vert",
-            ":/resources/shaders/bloom_blur.frag"
-            );
-        m_combineProgram = ShaderLoader::createShaderProgram(
-            ":/resources/shaders/fullscreen.vert",
-            ":/resources/shaders/bloom_combine.frag"
+            ":/resources/shaders/bloom_up.frag"
             );
     } catch (const std::runtime_error &e) {
         std::cerr << "Bloom shader error: " << e.what() << "\n";
-        m_brightProgram = 0;
-        m_blurProgram = 0;
-        m_combineProgram = 0;
+        m_downProgram = 0;
+        m_upProgram = 0;
     }
 
-    // Bright uniforms
-    if (m_brightProgram != 0) {
-        glUseProgram(m_brightProgram);
-        m_uBrightSceneTex = getUniformAny(m_brightProgram, {"u_SceneTex", "u_ScreenTex", "u_InputTex", "u_Texture"});
-        m_uThreshold      = getUniformAny(m_brightProgram, {"u_Threshold", "u_threshold", "uBrightThreshold"});
-        m_uSoftKnee       = getUniformAny(m_brightProgram, {"u_SoftKnee", "u_softKnee", "u_Knee"});
-        if (m_uBrightSceneTex >= 0) glUniform1i(m_uBrightSceneTex, 0);
-        glUseProgram(0);
-    }
+    // Bright pass, the 13 tap one and the jittered one tap one
+    for (int jittered = 0; jittered < 2; jittered++) {
+        BrightProgram& bright = m_bright[jittered];
+        try {
+            bright.program = ShaderLoader::createShaderProgram(
+                ":/resources/shaders/fullscreen.vert",
+                ":/resources/shaders/bloom_bright.frag",
+                std::string("#define JITTERED ") + (jittered ? "1" : "0") + "\n"
+                );
+        } catch (const std::runtime_error &e) {
+            std::cerr << "Bloom bright shader error (jittered " << jittered << "): " << e.what() << "\n";
+            bright.program = 0;
+            continue;
+        }
 
-    // Blur uniforms
-    if (m_blurProgram != 0) {
-        glUseProgram(m_blurProgram);
-        m_uBlurInputTex = getUniformAny(m_blurProgram, {"u_InputTex", "u_SceneTex", "u_Texture", "u_SrcTex"});
-        m_uTexelStep    = getUniformAny(m_blurProgram, {"u_TexelStep", "u_TexelSize", "u_Direction", "u_Step"});
-        m_uHorizontal   = getUniformAny(m_blurProgram, {"u_Horizontal", "u_horizontal", "u_IsHorizontal"});
-        if (m_uBlurInputTex >= 0) glUniform1i(m_uBlurInputTex, 0);
+        glUseProgram(bright.program);
+        bright.uTexelSize = getUniformAny(bright.program, {"u_TexelSize"});
+        bright.uThreshold = getUniformAny(bright.program, {"u_Threshold", "u_threshold", "uBrightThreshold"});
+        bright.uSoftKnee  = getUniformAny(bright.program, {"u_SoftKnee", "u_softKnee", "u_Knee"});
+        bright.uJitter    = getUniformAny(bright.program, {"u_Jitter"});
+        glUniform1i(getUniformAny(bright.program, {"u_SceneTex", "u_ScreenTex", "u_InputTex", "u_Texture"}), 0);
         glUseProgram(0);
-    }
 
-    // Combine uniforms
-    if (m_combineProgram != 0) {
-        glUseProgram(m_combineProgram);
-        m_uCombineSceneTex = getUniformAny(m_combineProgram, {"u_SceneTex", "u_ScreenTex", "u_Texture"});
-        m_uCombineBloomTex = getUniformAny(m_combineProgram, {"u_BloomTex", "u_BlurTex", "u_Bloom"});
-        m_uBloomStrength   = getUniformAny(m_combineProgram, {"u_Strength", "u_BloomStrength", "u_Intensity", "u_BloomIntensity"});
-        if (m_uCombineSceneTex >= 0) glUniform1i(m_uCombineSceneTex, 0);
-        if (m_uCombineBloomTex >= 0) glUniform1i(m_uCombineBloomTex, 1);
-        glUseProgram(0);
+        // If any of these are -1, bloom might "do nothing" even though it runs.
+        if (bright.uThreshold < 0 || bright.uSoftKnee < 0) {
+            std::cerr << "[Bloom] Warning: threshold/knee uniforms not found. Check bloom_bright.frag uniform names.\n";
+        }
     }
 
-    // If any of these are -1, bloom might "do nothing" even though it runs.
-    if (m_brightProgram != 0 && (m_uThreshold < 0 || m_uSoftKnee < 0)) {
-        std::cerr << "[Bloom] Warning: threshold/knee uniforms not found. Check bloom_bright.frag uniform names.\n";
-    }
-    if (m_combineProgram != 0 && m_uBloomStrength < 0) {
-        std::cerr << "[Bloom] Warning: strength uniform not found. Check bloom_combine.frag uniform name.\n";
+    // Mip chain uniforms
+    if (m_downProgram != 0 && m_upProgram != 0) {
+        m_uDownTexelSize = getUniformAny(m_downProgram, {"u_TexelSize"});
+        m_uUpTexelSize   = getUniformAny(m_upProgram, {"u_TexelSize"});
+        for (GLuint program : {m_downProgram, m_upProgram}) {
+            glUseProgram(program);
+            glUniform1i(getUniformAny(program, {"u_InputTex"}), 0);
+        }
+        glUseProgram(0);
     }
 
     createFullscreenQuad();
@@ -195,249 +144,166 @@ void PostProcess::init(int w, int h) {
 void PostProcess::destroy() {
     destroyFullscreenQuad();
 
-    // Base post shader
-    if (m_program != 0) {
-        glDeleteProgram(m_program);
-        m_program = 0;
+    // Composite shaders
+    for (CompositeProgram& composite : m_composite) {
+        if (composite.program != 0) glDeleteProgram(composite.program);
+        composite = CompositeProgram();
     }
-    m_uScreenTex = -1;
-    m_uMode = -1;
 
     // Bloom shaders
-    if (m_brightProgram != 0) {
-        glDeleteProgram(m_brightProgram);
-        m_brightProgram = 0;
+    for (BrightProgram& bright : m_bright) {
+        if (bright.program != 0) glDeleteProgram(bright.program);
+        bright = BrightProgram();
     }
-    if (m_blurProgram != 0) {
-        glDeleteProgram(m_blurProgram);
-        m_blurProgram = 0;
+    if (m_downProgram != 0) {
+        glDeleteProgram(m_downProgram);
+        m_downProgram = 0;
     }
-    if (m_combineProgram != 0) {
-        glDeleteProgram(m_combineProgram);
-        m_combineProgram = 0;
+    if (m_upProgram != 0) {
+        glDeleteProgram(m_upProgram);
+        m_upProgram = 0;
     }
 
-    m_uBrightSceneTex = -1;
-    m_uThreshold = -1;
-    m_uSoftKnee = -1;
-
-    m_uBlurInputTex = -1;
-    m_uTexelStep = -1;
-    m_uHorizontal = -1;
-
-    m_uCombineSceneTex = -1;
-    m_uCombineBloomTex = -1;
-    m_uBloomStrength = -1;
-
-    // Base FBO
-    if (m_colorTex != 0) {
-        glDeleteTextures(1, &m_colorTex);
-        m_colorTex = 0;
-    }
-    if (m_depthRbo != 0) {
-        glDeleteRenderbuffers(1, &m_depthRbo);
-        m_depthRbo = 0;
-    }
-    if (m_fbo != 0) {
-        glDeleteFramebuffers(1, &m_fbo);
-        m_fbo = 0;
-    }
-
-    // Bloom FBOs/textures
-    if (m_bloomTex != 0) {
-        glDeleteTextures(1, &m_bloomTex);
-        m_bloomTex = 0;
-    }
-    if (m_bloomFbo != 0) {
-        glDeleteFramebuffers(1, &m_bloomFbo);
-        m_bloomFbo = 0;
-    }
-
-    if (m_pingpongTex[0] != 0 || m_pingpongTex[1] != 0) {
-        glDeleteTextures(2, m_pingpongTex);
-    }
-    if (m_pingpongFbo[0] != 0 || m_pingpongFbo[1] != 0) {
-        glDeleteFramebuffers(2, m_pingpongFbo);
-    }
-    m_pingpongTex[0] = 0; m_pingpongTex[1] = 0;
-    m_pingpongFbo[0] = 0; m_pingpongFbo[1] = 0;
+    m_uDownTexelSize = -1;
+    m_uUpTexelSize = -1;
 
     m_w = 0;
     m_h = 0;
+    m_levels.clear();
 }
 
 void PostProcess::ensureSize(int w, int h) {
-    if (!ready()) return;
-    if (w == m_w && h == m_h) return;
-    resizeAttachments(w, h);
-}
-
-void PostProcess::resizeAttachments(int w, int h) {
+    if (w == m_w && h == m_h && !m_levels.empty()) return;
     m_w = w;
     m_h = h;
 
-    // Base attachments
-    glBindTexture(GL_TEXTURE_2D, m_colorTex);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
-
-    glBindRenderbuffer(GL_RENDERBUFFER, m_depthRbo);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, w, h);
+    // halved until BLOOM_LEVELS or a level would get thinner than 2 texels (the 13 taps reach 2 texels out)
+    m_levels.clear();
+    glm::ivec2 size(std::max(w / 2, 1), std::max(h / 2, 1));
+    do {
+        m_levels.push_back(size);
+        size = glm::max(size / 2, glm::ivec2(1));
+    } while (static_cast<int>(m_levels.size()) < BLOOM_LEVELS && size.x >= 2 && size.y >= 2);
+}
 
-    // Bloom attachments
-    if (m_bloomTex != 0) {
-        glBindTexture(GL_TEXTURE_2D, m_bloomTex);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+/**
+ * @brief PostProcess::addBloomPasses the bright pass reads the scene with the 13 tap filter straight into the half
+ * size level, then every level is a 13 tap downsample of the one above. on the way back up each level gets the tent
+ * filtered level below blended in (GL_CONSTANT_ALPHA = radius), so level 0 ends up with all the wider glows in it.
+ * every pass draws at most a quarter of the screen, the whole chain is about a third of one full screen pass.
+ * temporal: the bright pass is the full res read, one tap somewhere in the 13 tap footprint instead (a different
+ * spot every frame) and level 0 goes through the history afterwards
+ */
+RenderGraph::Resource PostProcess::addBloomPasses(RenderGraph& graph, RenderGraph::Resource scene,
+                                                  TemporalAccumulator* temporal, RenderGraph::Resource sceneDepth) {
+    if (!bloomReady() || m_levels.empty()) return RenderGraph::NONE;
+    if (m_bright[1].program == 0 || sceneDepth == RenderGraph::NONE) temporal = nullptr;
+    const BrightProgram& bright = m_bright[temporal ? 1 : 0];
+    const glm::vec2 jitter = temporal ? temporal->frame().jitter * 2.0f - 1.0f : glm::vec2(0.0f);
+
+    // half floats, the wide levels are faint and banded badly in rgba8
+    std::vector<RenderGraph::Resource> levels;
+    for (const glm::ivec2& size : m_levels) {
+        levels.push_back(graph.createTexture("bloom level", {size.x, size.y, GL_RGBA16F}));
+    }
+    const int count = static_cast<int>(levels.size());
+
+    // 1) Bright pass: scene -> level 0
+    graph.addPass("bloom bright", {scene}, {levels[0]}, [=, this, &graph]() {
+        graph.bindFramebuffer(levels[0]);
+        glDisable(GL_DEPTH_TEST);
+        glDisable(GL_CULL_FACE);
+
+        // LDR-friendly defaults (so you actually see something)
+        const float threshold = 0.02f;
+        const float softKnee  = 0.50f;
+        glUseProgram(bright.program);
+        if (bright.uThreshold >= 0) glUniform1f(bright.uThreshold, threshold);
+        if (bright.uSoftKnee >= 0)  glUniform1f(bright.uSoftKnee,  softKnee);
+        if (bright.uJitter >= 0)    glUniform2f(bright.uJitter, jitter.x, jitter.y);
+        filterPass(bright.program, bright.uTexelSize, graph.texture(scene), graph.desc(scene));
+    });
+
+    // 2) Down the chain
+    for (int i = 1; i < count; i++) {
+        graph.addPass("bloom down", {levels[i - 1]}, {levels[i]}, [=, this, &graph]() {
+            graph.bindFramebuffer(levels[i]);
+            filterPass(m_downProgram, m_uDownTexelSize, graph.texture(levels[i - 1]), graph.desc(levels[i - 1]));
+        });
     }
 
-    for (int i = 0; i < 2; i++) {
-        if (m_pingpongTex[i] != 0) {
-            glBindTexture(GL_TEXTURE_2D, m_pingpongTex[i]);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
-        }
+    // 3) Back up, each level = mix(level, upsampled level below, radius)
+    for (int i = count - 2; i >= 0; i--) {
+        graph.addPass("bloom up", {levels[i + 1], levels[i]}, {levels[i]}, [=, this, &graph]() {
+            graph.bindFramebuffer(levels[i]);
+            glEnable(GL_BLEND);
+            glBlendColor(0.f, 0.f, 0.f, m_bloomRadius);
+            glBlendFunc(GL_CONSTANT_ALPHA, GL_ONE_MINUS_CONSTANT_ALPHA);
+            filterPass(m_upProgram, m_uUpTexelSize, graph.texture(levels[i + 1]), graph.desc(levels[i + 1]));
+            glDisable(GL_BLEND);
+        });
     }
 
-    glBindTexture(GL_TEXTURE_2D, 0);
-    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    if (temporal) return temporal->addResolvePass(graph, "bloom", levels[0], sceneDepth);
+    return levels[0];
 }
 
-void PostProcess::beginScenePass(int w, int h) {
-
-    if (!ready()) return;
+int PostProcess::addCompositePass(RenderGraph& graph, RenderGraph::Resource scene, RenderGraph::Resource bloom,
+                                  RenderGraph::Resource target, int mode) {
+    std::vector<RenderGraph::Resource> reads = {scene};
+    if (bloom != RenderGraph::NONE) reads.push_back(bloom);
 
-    ensureSize(w, h);
+    return graph.addPass("composite", reads, {target}, [=, this, &graph]() {
+        graph.bindFramebuffer(target);
+        composite(graph.texture(scene), bloom != RenderGraph::NONE ? graph.texture(bloom) : 0, mode);
+    });
+}
 
-    glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
-    glViewport(0, 0, w, h);
+void PostProcess::filterPass(GLuint program, GLint texelSizeLoc, GLuint inputTex, const RenderTextureDesc& inputSize) {
+    glUseProgram(program);
+    if (texelSizeLoc >= 0) glUniform2f(texelSizeLoc, 1.0f / float(inputSize.width), 1.0f / float(inputSize.height));
 
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_CULL_FACE);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, inputTex);
 
-    glClearColor(0.f, 0.f, 0.f, 1.f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    
+    glBindVertexArray(m_quadVao);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+    glBindVertexArray(0);
 }
 
-void PostProcess::endToTarget(GLuint targetFbo, int w, int h, int mode) {
-    if (!ready()) return;
-
-    // mode 3 = bloom
-    if (mode == 3) {
-        static bool warned = false;
-        if (!bloomReady()) {
-            if (!warned) {
-                std::cerr << "[Bloom] Not running. bloomEnabled=" << (m_bloomEnabled ? 1 : 0)
-                << " bloomReady=" << (bloomReady() ? 1 : 0) << "\n";
-                warned = true;
-            }
-            mode = 0; // fallback to passthrough
-        } else {
-            glDisable(GL_DEPTH_TEST);
-            glDisable(GL_CULL_FACE);
-
-            // LDR-friendly defaults (so you actually see something)
-            const float threshold = 0.02f;
-            const float softKnee  = 0.50f;
-            const float strength  = m_bloomStrength; // THIS is now driven by your slider
-            const int   blurPasses = 10;
-
-            // 1) Bright pass: m_colorTex -> m_bloomTex
-            glBindFramebuffer(GL_FRAMEBUFFER, m_bloomFbo);
-            glViewport(0, 0, w, h);
-            glClear(GL_COLOR_BUFFER_BIT);
-
-            glUseProgram(m_brightProgram);
-            if (m_uThreshold >= 0) glUniform1f(m_uThreshold, threshold);
-            if (m_uSoftKnee >= 0)  glUniform1f(m_uSoftKnee,  softKnee);
-
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, m_colorTex);
-
-            glBindVertexArray(m_quadVao);
-            glDrawArrays(GL_TRIANGLES, 0, 6);
-
-            // 2) Blur ping-pong: m_bloomTex -> pingpong textures
-            glUseProgram(m_blurProgram);
-
-            GLuint inputTex = m_bloomTex;
-            bool horizontal = true;
-
-            for (int i = 0; i < blurPasses; i++) {
-                int dst = horizontal ? 1 : 0;
-
-                glBindFramebuffer(GL_FRAMEBUFFER, m_pingpongFbo[dst]);
-                glViewport(0, 0, w, h);
-                glClear(GL_COLOR_BUFFER_BIT);
-
-                glActiveTexture(GL_TEXTURE0);
-                glBindTexture(GL_TEXTURE_2D, inputTex);
-
-                // If your shader uses a bool horizontal, set it.
-                if (m_uHorizontal >= 0) {
-                    glUniform1i(m_uHorizontal, horizontal ? 1 : 0);
-                }
-
-                // If your shader uses a vec2 step/direction, set it.
-                float dx = horizontal ? (1.0f / float(w)) : 0.0f;
-                float dy = horizontal ? 0.0f : (1.0f / float(h));
-                if (m_uTexelStep >= 0) glUniform2f(m_uTexelStep, dx, dy);
-
-                glBindVertexArray(m_quadVao);
-                glDrawArrays(GL_TRIANGLES, 0, 6);
-
-                inputTex = m_pingpongTex[dst];
-                horizontal = !horizontal;
-            }
-
-            // 3) Combine: m_colorTex + blurred bloom -> targetFbo
-            glBindFramebuffer(GL_FRAMEBUFFER, targetFbo);
-            glViewport(0, 0, w, h);
-            glClear(GL_COLOR_BUFFER_BIT);
-
-            glUseProgram(m_combineProgram);
-            if (m_uBloomStrength >= 0) glUniform1f(m_uBloomStrength, strength);
-
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, m_colorTex);
-
-            glActiveTexture(GL_TEXTURE1);
-            glBindTexture(GL_TEXTURE_2D, inputTex);
-
-            glBindVertexArray(m_quadVao);
-            glDrawArrays(GL_TRIANGLES, 0, 6);
-
-            glBindVertexArray(0);
-            glActiveTexture(GL_TEXTURE1);
-            glBindTexture(GL_TEXTURE_2D, 0);
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, 0);
-            glUseProgram(0);
-            return;
-        }
-    }
-
-    // Default post modes (0 passthrough, 1 invert, 2 grayscale)
-    glBindFramebuffer(GL_FRAMEBUFFER, targetFbo);
-    glViewport(0, 0, w, h);
+void PostProcess::composite(GLuint sceneTex, GLuint bloomTex, int mode, const GodRays* rays, GLuint occlusionTex) {
+    const CompositeProgram& program = m_composite[(bloomTex ? 1 : 0) | (rays ? 2 : 0)];
+    if (program.program == 0) return;
 
     glDisable(GL_DEPTH_TEST);
     glDisable(GL_CULL_FACE);
 
     glClear(GL_COLOR_BUFFER_BIT);
 
-    glUseProgram(m_program);
+    glUseProgram(program.program);
 
-    if (m_uMode >= 0) {
-        glUniform1i(m_uMode, mode);
-    }
+    if (program.uMode >= 0) glUniform1i(program.uMode, mode);
+    if (bloomTex && program.uStrength >= 0) glUniform1f(program.uStrength, m_bloomStrength);
+    if (rays) program.rays.upload(*rays);
 
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, m_colorTex);
+    glBindTexture(GL_TEXTURE_2D, sceneTex);
+
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, bloomTex);
+
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, occlusionTex);
 
     glBindVertexArray(m_quadVao);
     glDrawArrays(GL_TRIANGLES, 0, 6);
 
     glBindVertexArray(0);
     glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, 0);
     glUseProgram(0);
 }
 
@@ -5,6 +5,13 @@
 #endif
 
 #include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "renderers/godrayrenderer.h"
+#include "renderers/rendergraph.h"
+
+class TemporalAccumulator;
 
 class PostProcess
 {
@@ -22,60 +29,77 @@ public:
     void setBloomStrength(float s);
     float bloomStrength() const { return m_bloomStrength; }
 
-    // Safe to call every frame. If size differs, resizes attachments.
+    // 0..1, how much of the wider (smaller) mip levels is blended back into each level on the way up. 0 is only the
+    // half size level's short glow, towards 1 it's mostly the widest ones.
+    void setBloomRadius(float r);
+    float bloomRadius() const { return m_bloomRadius; }
+
+    // Safe to call every frame. The targets are transient textures of the render graph, this is where the sizes of
+    // the mip chain they're made at come from.
     void ensureSize(int w, int h);
 
     bool ready() const;
     bool bloomReady() const;
 
-    // Pass 1: bind internal FBO, set viewport, clear, enable depth/cull.
-    void beginScenePass(int w, int h);
+    // Bright pass into the half size level, down the mip chain and back up. Returns the half size level with the
+    // whole glow in it, or NONE when bloom isn't running. With temporal the bright pass reads the scene with one
+    // jittered tap instead of 13 and the result is that level accumulated over frames (sceneDepth reprojects it).
+    RenderGraph::Resource addBloomPasses(RenderGraph& graph, RenderGraph::Resource scene,
+                                         TemporalAccumulator* temporal = nullptr,
+                                         RenderGraph::Resource sceneDepth = RenderGraph::NONE);
 
-    // Pass 2: bind targetFbo (0 for screen or screenshot FBO), draw fullscreen quad.
-    // mode: 0 passthrough, 1 invert, 2 grayscale, 3 bloom
-    void endToTarget(GLuint targetFbo, int w, int h, int mode);
+    // scene (+ bloom, unless it's NONE) into target, returns the pass
+    // mode: 0 passthrough, 1 invert, 2 grayscale
+    int addCompositePass(RenderGraph& graph, RenderGraph::Resource scene, RenderGraph::Resource bloom,
+                         RenderGraph::Resource target, int mode);
+
+    // The composite into the bound framebuffer (bloomTex 0 = no bloom). With rays, the god rays of that occlusion
+    // mask are added on top in the same pass, which is what the graph runs when it fuses the god-ray pass in.
+    void composite(GLuint sceneTex, GLuint bloomTex, int mode, const GodRays* rays = nullptr, GLuint occlusionTex = 0);
 
 private:
-    void resizeAttachments(int w, int h);
+    struct CompositeProgram {
+        GLuint program = 0;
+        GLint uMode = -1;
+        GLint uStrength = -1;
+        GodRayUniforms rays;
+    };
+
+    struct BrightProgram {
+        GLuint program = 0;
+        GLint uTexelSize = -1;
+        GLint uThreshold = -1;
+        GLint uSoftKnee = -1;
+        GLint uJitter = -1;
+    };
+
+    // one fullscreen filter from inputTex (texel size inputSize) into the bound framebuffer
+    void filterPass(GLuint program, GLint texelSizeLoc, GLuint inputTex, const RenderTextureDesc& inputSize);
     void createFullscreenQuad();
     void destroyFullscreenQuad();
 
-    GLuint m_fbo = 0;
-    GLuint m_colorTex = 0;
-    GLuint m_depthRbo = 0;
     int m_w = 0;
     int m_h = 0;
 
-    GLuint m_program = 0;
-    GLint  m_uScreenTex = -1;
-    GLint  m_uMode = -1;
+    // Bloom mip chain, level 0 is half of m_w x m_h and every next one half of that
+    static const int BLOOM_LEVELS = 6;
+    std::vector<glm::ivec2> m_levels;
+
+    // index: bloom | god rays << 1
+    CompositeProgram m_composite[4];
 
     GLuint m_quadVao = 0;
     GLuint m_quadVbo = 0;
 
-    // Bloom
-    GLuint m_bloomFbo = 0;
-    GLuint m_bloomTex = 0;
-
-    GLuint m_pingpongFbo[2] = {0, 0};
-    GLuint m_pingpongTex[2] = {0, 0};
-
-    GLuint m_brightProgram  = 0;
-    GLuint m_blurProgram    = 0;
-    GLuint m_combineProgram = 0;
-
-    GLint m_uBrightSceneTex = -1;
-    GLint m_uThreshold      = -1;
-    GLint m_uSoftKnee       = -1;
-
-    GLint m_uBlurInputTex   = -1;
-    GLint m_uTexelStep      = -1;
-    GLint m_uHorizontal     = -1;
+    // Bloom. bright index: jittered (temporal)
+    BrightProgram m_bright[2];
+    GLuint m_downProgram    = 0;
+    GLuint m_upProgram      = 0;
 
-    GLint m_uCombineSceneTex = -1;
-    GLint m_uCombineBloomTex = -1;
-    GLint m_uBloomStrength   = -1;
+    GLint m_uDownTexelSize   = -1;
+    GLint m_uUpTexelSize     = -1;
 
     bool  m_bloomEnabled = false;
     float m_bloomStrength = 1.0f;
+    float m_bloomRadius = 0.7f;
 };
@@ -3,16 +3,59 @@
 #include <QCoreApplication>
 #include <QMouseEvent>
 #include <QKeyEvent>
+#include <algorithm>
+#include <cstdio>
 #include <iostream>
 #include "settings.h"
 #include "utils/sceneparser.h"
 #include "shapes/shapetesselator.h"
 #include "utils/shaderloader.h"
+#include "renderers/shadervariants.h"
 
 static float clampf(float x, float lo, float hi) {
     return std::max(lo, std::min(hi, x));
 }
 
+// every program the renderers create in their initialize(), started together before any of them asks for one. keep in
+// sync with the createShaderProgram calls, anything missing just compiles when it's created
+static void prefetchShaders() {
+    const char* programs[][2] = {
+        {":/resources/shaders/texture.vert", ":/resources/shaders/texture.frag"},
+        {":/resources/shaders/fullscreen.vert", ":/resources/shaders/bloom_down.frag"},
+        {":/resources/shaders/fullscreen.vert", ":/resources/shaders/bloom_up.frag"},
+        {":/resources/shaders/particle.vert", ":/resources/shaders/particle.frag"},
+        {":/resources/shaders/prepass.vert", ":/resources/shaders/prepass.frag"},
+        {":/resources/shaders/terrain.vert", ":/resources/shaders/terrain.frag"},
+        {":/resources/shaders/depth.vert", ":/resources/shaders/depth.frag"},
+        {":/resources/shaders/fullscreen.vert", ":/resources/shaders/shadowmoments.frag"},
+        {":/resources/shaders/fullscreen.vert", ":/resources/shaders/shadowblur.frag"},
+        {":/resources/shaders/crepuscular.vert", ":/resources/shaders/crepuscular.frag"},
+        {":/resources/shaders/fullscreen.vert", ":/resources/shaders/occlusion_mask.frag"},
+        {":/resources/shaders/fullscreen.vert", ":/resources/shaders/godray_blur.frag"},
+        {":/resources/shaders/fullscreen.vert", ":/resources/shaders/godray_upsample.frag"},
+        {":/resources/shaders/fullscreen.vert", ":/resources/shaders/temporal_resolve.frag"},
+        {":/resources/shaders/copy.vert", ":/resources/shaders/copy.frag"},
+    };
+    for (const auto& program : programs) ShaderLoader::prefetch(program[0], program[1]);
+    for (const char* jittered : {"0", "1"}) {
+        ShaderLoader::prefetch(":/resources/shaders/fullscreen.vert", ":/resources/shaders/bloom_bright.frag",
+                               std::string("#define JITTERED ") + jittered + "\n");
+    }
+    for (const char* bloom : {"0", "1"}) {
+        for (const char* godRays : {"0", "1"}) {
+            ShaderLoader::prefetch(":/resources/shaders/fullscreen.vert", ":/resources/shaders/composite.frag",
+                                   std::string("#define BLOOM ") + bloom + "\n#define GOD_RAYS " + godRays + "\n");
+        }
+    }
+
+    // the scene variants are compiled on demand, but plain and textured bark/leaves under one sun are in every scene
+    const uint32_t lighting = ShaderFeature::lightClass(1) | ShaderFeature::shadowFilter(settings.shadowFilter);
+    for (uint32_t maps : {0u, uint32_t(ShaderFeature::TEXTURE_MAP)}) {
+        ShaderLoader::prefetch(":/resources/shaders/default.vert", ":/resources/shaders/default.frag",
+                               ShaderVariants::defines(maps | lighting));
+    }
+}
+
 ParticleSystem::Emitter makeWinterSnowEmitter() {
     ParticleSystem::Emitter e;
     e.enabled      = true;
@@ -203,16 +246,21 @@ Realtime::Realtime(QWidget *parent)
 
 void Realtime::finish() {
     killTimer(m_timer);
+    m_sceneLoader.cancel();
     this->makeCurrent();
+    dropPendingScene();
+    dropResidentScenes();
 
     // Students: anything requiring OpenGL calls when the program exits should be done here
     m_shapeRenderer.cleanup();
     m_sceneRenderer.cleanup();
     m_crepuscularRenderer.cleanup();
+    m_temporal.cleanup();
     m_screenRenderer.cleanup();
 
     m_particles.destroyGL();
     m_post.destroy();
+    m_graph.cleanup();
 
     this->doneCurrent();
 }
@@ -237,6 +285,10 @@ void Realtime::initializeGL() {
     }
     std::cout << "Initialized GL: Version " << glewGetString(GLEW_VERSION) << std::endl;
 
+    m_startupTimer.start();
+    ShaderLoader::initialize();
+    prefetchShaders();
+
     // Allows OpenGL to draw objects appropriately on top of one another
     glEnable(GL_DEPTH_TEST);
     // Tells OpenGL to only draw the front face
@@ -263,7 +315,7 @@ void Realtime::initializeGL() {
     m_lightRenderer.initialize(&m_shapeRenderer, m_texture_shader);
 
     m_crepuscularRenderer.initialize(1.0f, 1.0f, 0.5f, 0.01f, 100);
-    m_crepuscularRenderer.setDefaultFBO(defaultFBO);
+    m_temporal.initialize();
 
     m_screenRenderer.initialize();
 
@@ -274,8 +326,20 @@ void Realtime::initializeGL() {
 
 void Realtime::paintGL() {
     // Students: anything requiring OpenGL calls every frame should be done here
+
+    // finish any async scene load first, so a swap always happens before the frame starts drawing
+    if (m_pendingScene || m_sceneLoader.isLoading()) {
+        uploadPendingScene(UPLOAD_BUDGET_NS);
+    }
+
     if (!m_camera) return; // don't draw yet if the camera is undefined !
 
+    // gpu numbers come back a few frames late anyway, once a second is plenty
+    if (settings.printFrameStats && (!m_statsTimer.isValid() || m_statsTimer.elapsed() > 1000)) {
+        std::cout << m_sceneRenderer.frameStatsReport() << "\n" << m_graph.report() << std::endl;
+        m_statsTimer.restart();
+    }
+
     // Capture whatever framebuffer is currently bound (screen or screenshot FBO)
     GLint targetFBOInt = 0;
     glGetIntegerv(GL_FRAMEBUFFER_BINDING, &targetFBOInt);
@@ -290,139 +354,404 @@ void Realtime::paintGL() {
     const bool particlesEnabled = settings.extraCredit1;
     const bool bloomEnabled = settings.extraCredit2;
 
+    // summer fireflies double as point lights, the scene renderer bins them into clusters
+    const float FIREFLY_LIGHT_RADIUS = 2.5f;
+    const float FIREFLY_LIGHT_INTENSITY = 1.5f;
+    std::vector<ClusterLight> clusterLights;
+    if (particlesEnabled && settings.particlesSummer && settings.fireflyLights) {
+        m_particles.collectLights(clusterLights, FIREFLY_LIGHT_RADIUS, FIREFLY_LIGHT_INTENSITY);
+    }
+    m_sceneRenderer.setClusterLights(std::move(clusterLights));
+
     // Ensure postprocess exists and matches our target size
     if (!m_post.ready()) m_post.init(w, h);
     else m_post.ensureSize(w, h);
     m_post.setBloomEnabled(bloomEnabled);
+    m_post.setBloomStrength(settings.bloomStrength);
+    m_post.setBloomRadius(settings.bloomRadius);
 
-    // PARTICLE & POSTPROCESS PIPELINE
-    // if postprocess is ready, use it for bloom effects
+    glDisable(GL_BLEND);
 
-    if (m_post.ready()) {
+    m_graph.reset();
+    buildFrameGraph(targetFBO, w, h);
+    m_graph.compile();
+    m_graph.execute();
 
-        glDisable(GL_BLEND);
+    reportFirstFrame();
+}
 
-        // render scene + terrain to scene FBO first
-        m_lightRenderer.render(m_renderData, static_cast<GLuint>(w), static_cast<GLuint>(h));
-        m_sceneRenderer.render(m_renderData, *m_camera, m_shapeRenderer, m_lightRenderer.getShadow());
+/**
+ * @brief Realtime::buildFrameGraph the frame as render graph passes: shadows, scene, particles, then post (bloom +
+ * composite) and the god rays into the target. the scene copy into the post target is dropped by the graph whenever
+ * the scene texture can be read straight away, and the full res god rays are fused into the composite when both run
+ * (the low res and the temporal ones are their own passes).
+ * without the post shaders the scene is copied to the target as is and the rays go on top of that
+ */
+void Realtime::buildFrameGraph(GLuint targetFBO, int w, int h) {
+    const bool particlesEnabled = settings.extraCredit1;
+    const glm::mat4 view = m_camera->getViewMatrix();
+    const glm::mat4 proj = m_camera->getProjMatrix();
+
+    if (m_sceneRenderer.getSceneTexture() == 0) m_sceneRenderer.resize(m_screen_width, m_screen_height);
+    m_temporal.beginFrame(proj * view);
+    TemporalAccumulator* temporal = settings.temporalEffects ? &m_temporal : nullptr;
+    const RenderTextureDesc sceneDesc{m_sceneRenderer.getSceneWidth(), m_sceneRenderer.getSceneHeight(), GL_RGBA8};
+
+    RenderGraph::Resource shadows = m_graph.importTexture("shadow maps", m_lightRenderer.getShadow().depth_map, {});
+    RenderGraph::Resource scene = m_graph.importTexture("scene colour", m_sceneRenderer.getSceneTexture(), sceneDesc);
+    RenderGraph::Resource sceneDepth = m_graph.importTexture("scene depth", m_sceneRenderer.getDepthTexture(),
+                                                             {sceneDesc.width, sceneDesc.height, GL_DEPTH_COMPONENT24});
+    RenderGraph::Resource target = m_graph.importFramebuffer("target", targetFBO, w, h);
+
+    m_graph.addPass("shadows", {}, {shadows}, [=, this]() {
+        m_lightRenderer.render(m_renderData, m_sceneRenderer, *m_camera, static_cast<GLuint>(w), static_cast<GLuint>(h));
+    });
+    m_graph.addPass("scene", {shadows}, {scene, sceneDepth}, [this]() {
+        m_sceneRenderer.render(*m_camera, m_shapeRenderer, m_lightRenderer.getShadow());
         m_sceneRenderer.paintTerrain(*m_camera);
+    });
+
+    if (!m_post.ready()) {
+        if (particlesEnabled) {
+            m_graph.addPass("particles", {scene}, {scene}, [=, this]() {
+                m_graph.bindFramebuffer(scene);
+                m_particles.render(view, proj);
+            });
+        }
+        m_graph.addCopyPass("present", scene, target, [=, this]() {
+            m_graph.bindFramebuffer(target);
+            m_screenRenderer.renderToScreen(m_graph.texture(scene), w, h);
+        });
+        if (m_enableCrepuscular) {
+            const GodRays rays = m_crepuscularRenderer.rays(view, proj, m_renderData);
+            RenderGraph::Resource occlusion = m_crepuscularRenderer.addOcclusionPass(m_graph, sceneDepth, rays, proj,
+                                                                                     w, h);
+            if (settings.lowResGodRays) {
+                m_crepuscularRenderer.addLowResPasses(m_graph, occlusion, sceneDepth, target, rays, proj);
+            } else if (temporal) {
+                m_crepuscularRenderer.addTemporalPasses(m_graph, occlusion, sceneDepth, target, rays, *temporal);
+            } else {
+                m_crepuscularRenderer.addBlendPass(m_graph, occlusion, target, rays);
+            }
+        }
+        return;
+    }
 
-        // bind postprocess FBO and composite scene + particles
-        m_post.beginScenePass(w, h);
+    // the post passes read their own copy of the scene, particles go on top of that copy
+    RenderGraph::Resource post = m_graph.createTexture("post colour", {w, h, GL_RGBA8});
+    m_graph.addCopyPass("scene copy", scene, post, [=, this]() {
+        m_graph.bindFramebuffer(post);
+        m_screenRenderer.renderToScreen(m_graph.texture(scene), w, h);
+    });
+    if (particlesEnabled) {
+        m_graph.addPass("particles", {post}, {post}, [=, this]() {
+            m_graph.bindFramebuffer(post);
+            m_particles.render(view, proj);
+        });
+    }
 
-        // copy scene texture to postprocess fbo
-        m_screenRenderer.renderToScreen(m_sceneRenderer.getSceneTexture(), w, h);
+    const GodRays rays = m_crepuscularRenderer.rays(view, proj, m_renderData);
+    RenderGraph::Resource occlusion = RenderGraph::NONE;
+    if (m_enableCrepuscular) {
+        occlusion = m_crepuscularRenderer.addOcclusionPass(m_graph, sceneDepth, rays, proj, w, h);
+    }
+
+    RenderGraph::Resource bloom = m_post.addBloomPasses(m_graph, post, temporal, sceneDepth);
+    const int composite = m_post.addCompositePass(m_graph, post, bloom, target, 0);
+
+    if (m_enableCrepuscular && settings.lowResGodRays) {
+        m_crepuscularRenderer.addLowResPasses(m_graph, occlusion, sceneDepth, target, rays, proj);
+    } else if (m_enableCrepuscular && temporal) {
+        m_crepuscularRenderer.addTemporalPasses(m_graph, occlusion, sceneDepth, target, rays, *temporal);
+    } else if (m_enableCrepuscular) {
+        const int godRays = m_crepuscularRenderer.addBlendPass(m_graph, occlusion, target, rays);
+        m_graph.addFusion(composite, godRays, "composite + god rays", [=, this]() {
+            m_graph.bindFramebuffer(target);
+            m_post.composite(m_graph.texture(post), bloom != RenderGraph::NONE ? m_graph.texture(bloom) : 0, 0,
+                             &rays, m_graph.texture(occlusion));
+        });
+    }
+}
 
-        // render particles on top
-        if (particlesEnabled) m_particles.render(m_camera->getViewMatrix(), m_camera->getProjMatrix());
+/**
+ * @brief Realtime::reportFirstFrame once: time from initializeGL to the first drawn frame (scene load included) and
+ * what the shaders took. a cold start compiles everything, a warm one links it all from the program binary cache
+ */
+void Realtime::reportFirstFrame() {
+    if (m_reportedFirstFrame) return;
+    m_reportedFirstFrame = true;
+
+    glFinish(); // only this once, so the gpu side of the first frame is in the number too
+    const ShaderLoaderStats& shaders = ShaderLoader::stats();
+    const bool warm = shaders.binaryMisses == 0 && shaders.binaryHits > 0;
+    char buf[256];
+    snprintf(buf, sizeof(buf), "first frame after %lld ms (%s start) | shaders: %d programs in %.1f ms, "
+             "%d from the binary cache, %d compiled, %d stale binaries, parallel compile %s",
+             static_cast<long long>(m_startupTimer.elapsed()), warm ? "warm" : "cold", shaders.programs, shaders.ms,
+             shaders.binaryHits, shaders.binaryMisses, shaders.binaryRejected, shaders.parallel ? "on" : "off");
+    std::cout << buf << std::endl;
+}
 
-        // apply bloom and composite to target fbo
-        m_post.endToTarget(targetFBO, w, h, bloomEnabled ? 3 : 0);
+void Realtime::resizeGL(int w, int h) {
+    m_screen_width  = static_cast<GLuint>(w * m_devicePixelRatio);
+    m_screen_height = static_cast<GLuint>(h * m_devicePixelRatio);
 
-        // blend god rays on top if enabled
-        if (m_enableCrepuscular) {
-    
-            m_crepuscularRenderer.renderOcclusion(
-                m_camera->getViewMatrix(), m_camera->getProjMatrix(),
-                w, h, m_renderData, m_shapeRenderer
-            );
-
-            // blend on target fbo
-            glBindFramebuffer(GL_FRAMEBUFFER, targetFBO);
-            glViewport(0, 0, w, h);
-            glDisable(GL_DEPTH_TEST);
-            glBlendFunc(GL_SRC_ALPHA, GL_ONE);
-            glEnable(GL_BLEND);
-
-            m_crepuscularRenderer.blendCrepuscular(
-                m_camera->getViewMatrix(), m_camera->getProjMatrix(),
-                w, h, m_renderData
-            );
-
-            glDisable(GL_BLEND);
-            glEnable(GL_DEPTH_TEST);
-        }
+    glViewport(0, 0, m_screen_width, m_screen_height);
 
-        return;
+    if (m_post.ready()) {
+        m_post.ensureSize(static_cast<int>(m_screen_width), static_cast<int>(m_screen_height));
     }
+    // Students: anything requiring OpenGL calls when the program starts should be done here
+    m_sceneRenderer.resize(w * m_devicePixelRatio, h * m_devicePixelRatio);
 
-    // FALLBACK path if postprocess is not ready
-    int width = size().width() * m_devicePixelRatio;
-    int height = size().height() * m_devicePixelRatio;
+}
 
-    // occlusion pre-pass for crepuscular rays
-    if (m_enableCrepuscular) {
-        m_crepuscularRenderer.renderOcclusion(
-            m_camera->getViewMatrix(), m_camera->getProjMatrix(),
-            width, height, m_renderData, m_shapeRenderer
-        );
+void Realtime::sceneChanged(bool keepCamera) {
+
+    SceneKey key{settings.sceneFilePath, settings.getCurrentSeasonIndex()};
+
+    // a different file, the preloaded variants belong to the old one
+    if (!isSeasonVariant(key.first, m_currentSceneKey.first)) {
+        dropResidentScenes();
+        m_preloadQueue.clear();
     }
 
-    // render scene from light's perspective for shadow map
-    m_lightRenderer.render(m_renderData, m_screen_width, m_screen_height);
+    // already resident -> swap the scene data and its batches in, no parsing, no uploads and nothing rebuilt. the
+    // batches, instance buffers, bvh, occluders and light block come along as they were
+    auto resident = m_residentScenes.find(key);
+    if (resident != m_residentScenes.end()) {
+        QElapsedTimer timer;
+        timer.start();
+
+        ResidentScene incoming = std::move(resident->second);
+        m_residentScenes.erase(resident);
+        std::unique_ptr<SceneBatches> outgoing = m_sceneRenderer.swapScene(std::move(incoming.batches));
+        if (!m_currentSceneKey.first.empty()) {
+            m_residentScenes[m_currentSceneKey] = ResidentScene{std::move(m_renderData), std::move(outgoing)};
+        } else {
+            m_sceneRenderer.retireScene(std::move(outgoing));
+        }
+        m_renderData = std::move(incoming.renderData);
+        m_temporal.invalidate();
+        m_currentSceneKey = key;
+        m_animationTime = 0.f;
 
-    // render scene (includes skybox) into scene FBO
-    m_sceneRenderer.render(m_renderData, *m_camera, m_shapeRenderer, m_lightRenderer.getShadow());
+        char buf[160];
+        snprintf(buf, sizeof(buf), "season swap: %d shapes, %d resident batches swapped in (%.3f ms, nothing rebuilt)",
+                 m_renderData.drawCount, m_sceneRenderer.batchCount(), timer.nsecsElapsed() / 1e6);
+        std::cout << buf << std::endl;
 
-    // add terrain into scene FBO (paintTerrain binds scene FBO internally)
-    m_sceneRenderer.paintTerrain(*m_camera);
+        update();
+        return;
+    }
 
-    // render particles into scene FBO if enabled
-    if (particlesEnabled) {
-        glBindFramebuffer(GL_FRAMEBUFFER, m_sceneRenderer.getSceneFBO());
-        glViewport(0, 0, width, height);
-        m_particles.render(m_camera->getViewMatrix(), m_camera->getProjMatrix());
+    // whatever was being preloaded gets dropped by the loader, so put it back in line
+    if (m_preloadInFlight) {
+        m_preloadQueue.push_front(*m_preloadInFlight);
+        m_preloadInFlight.reset();
     }
 
-    // copy complete scene (skybox + terrain + particles) to screen
-    glBindFramebuffer(GL_FRAMEBUFFER, targetFBO);
-    glViewport(0, 0, w, h);
-    m_screenRenderer.renderToScreen(m_sceneRenderer.getSceneTexture(), w, h);
+    // parsing + growing the trees + decoding meshes/textures all happen on the loader thread, we keep drawing the
+    // old scene until paintGL has uploaded the new one (see uploadPendingScene)
+    std::map<std::string, MeshCPUData> residentMeshes = m_shapeRenderer.residentMeshData();
+    std::set<std::string> residentTextures = m_sceneRenderer.residentTextures();
+    dropPendingScene(); // whatever it uploaded so far stays in the caches
+    m_keepCameraOnSwap = keepCamera && m_camera;
 
-    // blend god rays on top if enabled
-    if (m_enableCrepuscular) {
+    m_sceneLoader.load(key.first, key.second, std::move(residentMeshes), std::move(residentTextures));
+    reportLoadProgress();
+
+    update(); // asks for a PaintGL() call to occur
+}
+
+/**
+ * @brief Realtime::isSeasonVariant true if both paths are the same final_scene in (possibly) different seasons
+ */
+bool Realtime::isSeasonVariant(const std::string &a, const std::string &b) {
+    if (a.empty() || b.empty()) return false;
+    return getSeasonScenePath(a, 0) == getSeasonScenePath(b, 0);
+}
 
-        glm::mat4 view = m_camera->getViewMatrix();
-        glm::mat4 proj = m_camera ->getProjMatrix();
+/**
+ * @brief Realtime::queueSeasonPreloads queues every season variant of the current scene that isn't loaded yet.
+ * they're loaded one at a time in the background by startNextPreload
+ */
+void Realtime::queueSeasonPreloads() {
+    if (!settings.preloadSeasons || m_currentSceneKey.first.empty()) return;
+
+    for (int season = 0; season < 4; season++) {
+        SceneKey key{getSeasonScenePath(m_currentSceneKey.first, season), season};
+        if (key == m_currentSceneKey || m_residentScenes.contains(key)) continue;
+        if (m_preloadInFlight == key) continue;
+        if (std::find(m_preloadQueue.begin(), m_preloadQueue.end(), key) != m_preloadQueue.end()) continue;
+        m_preloadQueue.push_back(key);
+    }
+}
 
-        // additive blending for god rays
-        glDisable(GL_DEPTH_TEST);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE);
-        glEnable(GL_BLEND);
+void Realtime::startNextPreload() {
+    if (!settings.preloadSeasons || m_sceneLoader.isLoading() || m_pendingScene) return;
 
-        m_crepuscularRenderer.blendCrepuscular(
-            view, proj,
-            width, height, m_renderData
-        );
+    while (!m_preloadQueue.empty()) {
+        SceneKey key = m_preloadQueue.front();
+        m_preloadQueue.pop_front();
+        if (key == m_currentSceneKey || m_residentScenes.contains(key)) continue;
 
-        glDisable(GL_BLEND);
-        glEnable(GL_DEPTH_TEST);
+        m_preloadInFlight = key;
+        m_sceneLoader.load(key.first, key.second, m_shapeRenderer.residentMeshData(), m_sceneRenderer.residentTextures(), true);
+        return;
+    }
+}
 
+/**
+ * @brief Realtime::dropPendingScene forgets a load that's still being uploaded, the batches it has made so far are
+ * deleted by the scene renderer on the next frame
+ */
+void Realtime::dropPendingScene() {
+    if (m_pendingScene && m_pendingScene->batches) {
+        m_sceneRenderer.retireScene(std::move(m_pendingScene->batches));
     }
+    m_pendingScene.reset();
+}
 
+/**
+ * @brief Realtime::dropResidentScenes forgets every preloaded season, their batches go to the scene renderer to be
+ * deleted on the next frame (this can run outside paintGL)
+ */
+void Realtime::dropResidentScenes() {
+    for (auto &[key, resident] : m_residentScenes) {
+        m_sceneRenderer.retireScene(std::move(resident.batches));
+    }
+    m_residentScenes.clear();
 }
 
+/**
+ * @brief Realtime::residentMemoryReport memory used by the scene on screen + every preloaded one. gpu meshes/textures are
+ * shared through the renderer caches so they're only counted once, every scene has its own instance buffers
+ * @return
+ */
+std::string Realtime::residentMemoryReport() {
+    size_t sceneBytes = SceneParser::estimateMemory(m_renderData);
+    size_t batchBytes = 0;
+    for (const auto &[key, resident] : m_residentScenes) {
+        sceneBytes += SceneParser::estimateMemory(resident.renderData);
+        batchBytes += m_sceneRenderer.batchBytes(*resident.batches);
+    }
+    size_t meshBytes = m_shapeRenderer.meshBytes();
+    size_t textureBytes = m_sceneRenderer.textureBytes();
 
+    auto mb = [](size_t bytes) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%.1f MB", bytes / (1024.0 * 1024.0));
+        return std::string(buf);
+    };
 
-void Realtime::resizeGL(int w, int h) {
-    m_screen_width  = static_cast<GLuint>(w * m_devicePixelRatio);
-    m_screen_height = static_cast<GLuint>(h * m_devicePixelRatio);
+    return std::to_string(m_residentScenes.size() + 1) + " scene(s) resident: scene data " + mb(sceneBytes)
+         + ", GPU " + mb(meshBytes + textureBytes) + " shared (meshes " + mb(meshBytes) + ", textures " + mb(textureBytes) + ")"
+         + ", off screen batches " + mb(batchBytes);
+}
 
-    glViewport(0, 0, m_screen_width, m_screen_height);
+/**
+ * @brief Realtime::uploadPendingScene picks up a finished load and uploads its meshes/textures, then makes the gl objects
+ * of the batches the loader planned, stopping once budgetNs is used up so a big scene is spread over several frames.
+ * the old scene stays on screen until all of it is on the gpu, then the new one is swapped in
+ * @param budgetNs
+ * @return true if the new scene was swapped in this frame
+ */
+bool Realtime::uploadPendingScene(qint64 budgetNs) {
+    if (!m_pendingScene) {
+        m_pendingScene = m_sceneLoader.takeResult();
+        if (!m_pendingScene) return false;
+    }
 
-    if (m_post.ready()) {
-        m_post.ensureSize(static_cast<int>(m_screen_width), static_cast<int>(m_screen_height));
+    LoadedScene &scene = *m_pendingScene;
+    if (!scene.success || !scene.batches) {
+        // keep showing whatever we had
+        if (scene.preload) m_preloadInFlight.reset();
+        m_pendingScene.reset();
+        reportLoadProgress();
+        return false;
     }
-    // Students: anything requiring OpenGL calls when the program starts should be done here
-    m_sceneRenderer.resize(w * m_devicePixelRatio, h * m_devicePixelRatio);
 
+    QElapsedTimer timer;
+    timer.start();
+
+    // always make progress by at least one item, even if a single texture is over budget
+    while (scene.uploadCursor < scene.uploadCount()) {
+        if (scene.uploadCursor < scene.meshes.size()) {
+            DecodedMesh &mesh = scene.meshes[scene.uploadCursor];
+            m_shapeRenderer.uploadMesh(mesh.filename, mesh.vertices, std::move(mesh.cpu));
+            mesh.vertices = std::vector<float>(); // free it, the gpu has it now
+        } else {
+            DecodedTexture &texture = scene.textures[scene.uploadCursor - scene.meshes.size()];
+            m_sceneRenderer.uploadTexture(texture.filename, texture.image);
+            texture.image = QImage();
+        }
+        scene.uploadCursor++;
+
+        if (timer.nsecsElapsed() > budgetNs) break;
+    }
+
+    // then the batch vaos + instance buffers, with whatever is left of the budget (the meshes they use are up now)
+    const qint64 left = budgetNs - timer.nsecsElapsed();
+    if (scene.uploadCursor < scene.uploadCount() || left <= 0 ||
+        !m_sceneRenderer.createBatchObjects(*scene.batches, m_shapeRenderer, left)) {
+        reportLoadProgress();
+        return false;
+    }
+
+    if (scene.preload) {
+        // background season variant, park it next to the current scene
+        SceneKey key{scene.filepath, scene.seasonIdx};
+        if (settings.preloadSeasons && isSeasonVariant(key.first, m_currentSceneKey.first) && !m_residentScenes.contains(key)) {
+            m_residentScenes[key] = ResidentScene{std::move(scene.renderData), std::move(scene.batches)};
+            std::cout << residentMemoryReport() << std::endl;
+        }
+        m_preloadInFlight.reset();
+        dropPendingScene();
+        reportLoadProgress();
+        return false;
+    }
+
+    swapInScene(scene);
+    m_pendingScene.reset();
+    queueSeasonPreloads();
+    reportLoadProgress();
+    return true;
 }
 
-void Realtime::sceneChanged() {
+/**
+ * @brief Realtime::swapInScene replaces the current scene with a fully uploaded one, at the start of a frame so nothing
+ * ever draws half of each
+ * @param scene
+ */
+void Realtime::swapInScene(LoadedScene &scene) {
+    SceneKey key{scene.filepath, scene.seasonIdx};
+
+    std::unique_ptr<SceneBatches> outgoing = m_sceneRenderer.swapScene(std::move(scene.batches));
 
-    m_renderData.lights.clear();
+    // the outgoing scene is one of the seasons we want to keep around anyway
+    if (settings.preloadSeasons && !m_currentSceneKey.first.empty() && isSeasonVariant(key.first, m_currentSceneKey.first)) {
+        m_residentScenes[m_currentSceneKey] = ResidentScene{std::move(m_renderData), std::move(outgoing)};
+    } else {
+        m_sceneRenderer.retireScene(std::move(outgoing));
+    }
+    auto stale = m_residentScenes.find(key);
+    if (stale != m_residentScenes.end()) {
+        m_sceneRenderer.retireScene(std::move(stale->second.batches));
+        m_residentScenes.erase(stale);
+    }
+
+    m_renderData = std::move(scene.renderData);
+    m_temporal.invalidate();
+    m_currentSceneKey = key;
+    m_animationTime = 0.f;
 
-    SceneParser::parse(settings.sceneFilePath, m_renderData);
+    std::cout << "Loaded scenefile: \"" << scene.filepath << "\"" << std::endl;
+
+    if (m_keepCameraOnSwap && m_camera) {
+        m_keepCameraOnSwap = false;
+        return;
+    }
 
     int width = size().width() * m_devicePixelRatio;
     int height = size().height() * m_devicePixelRatio;
@@ -436,9 +765,22 @@ void Realtime::sceneChanged() {
                                         height);
 
     fitEmitterToCamera(true);
+}
 
-
-    update(); // asks for a PaintGL() call to occur
+void Realtime::reportLoadProgress() {
+    if (!m_loadProgressCallback) return;
+
+    if (m_preloadInFlight) {
+        // preloads happen quietly in the background
+        m_loadProgressCallback(100, "Preloading seasons...");
+    } else if (m_pendingScene) {
+        // worker part is the first 80%, uploads + batches are the rest
+        m_loadProgressCallback(80 + int(20.f * m_pendingScene->uploadProgress()), "Uploading to GPU...");
+    } else if (m_sceneLoader.isLoading()) {
+        m_loadProgressCallback(int(80.f * m_sceneLoader.progress()), m_sceneLoader.status());
+    } else {
+        m_loadProgressCallback(100, settings.preloadSeasons ? residentMemoryReport() : "");
+    }
 }
 
 std::string Realtime::getSeasonScenePath(const std::string& basePath, int seasonIdx) {
@@ -483,7 +825,17 @@ void Realtime::settingsChanged() {
     }
 
 
-    m_shapeRenderer.updateTessellation();
+    if (m_shapeRenderer.updateTessellation()) {
+        // every scene's vaos still point at the old primitive buffers, each gets new ones when it's drawn next (a
+        // pending one before it's swapped in)
+        m_sceneRenderer.invalidateBatches();
+        for (auto &[key, resident] : m_residentScenes) {
+            resident.batches->stale = true;
+        }
+        if (m_pendingScene && m_pendingScene->batches) {
+            m_pendingScene->batches->stale = true;
+        }
+    }
     m_lightRenderer.setShapes(&m_shapeRenderer);
     m_camera->createProjectionMatrix();
 
@@ -512,14 +864,25 @@ void Realtime::settingsChanged() {
 
     // Reload scene if season changed (to update L-system trees and lighting)
     if (seasonChanged) {
+        // getSeasonScenePath / the god ray presets / the plant presets all use the settings index (0 = spring .. 3 = winter)
+        int seasonIdx = settings.getCurrentSeasonIndex();
+
         // Switch to season-specific scene file if it exists
-        std::string newScenePath = getSeasonScenePath(settings.sceneFilePath, curSeason);
+        std::string newScenePath = getSeasonScenePath(settings.sceneFilePath, seasonIdx);
         if (newScenePath != settings.sceneFilePath) {
             settings.sceneFilePath = newScenePath;
         }
         // Apply seasonal god ray parameters
-        applySeasonalGodRayParameters(curSeason);
-        sceneChanged();
+        applySeasonalGodRayParameters(seasonIdx);
+        sceneChanged(true);
+    }
+
+    // preloading seasons toggled
+    if (settings.preloadSeasons) {
+        queueSeasonPreloads();
+    } else {
+        dropResidentScenes();
+        m_preloadQueue.clear();
     }
 
     wasParticles = nowParticles;
@@ -556,6 +919,8 @@ void Realtime::mouseReleaseEvent(QMouseEvent *event) {
 }
 
 void Realtime::mouseMoveEvent(QMouseEvent *event) {
+    if (!m_camera) return; // no scene swapped in yet
+
     if (m_mouseDown) {
         int posX = event->position().x();
         int posY = event->position().y();
@@ -582,6 +947,25 @@ void Realtime::timerEvent(QTimerEvent *event) {
     float deltaTime = elapsedms * 0.001f;
     m_elapsedTimer.restart();
 
+    // kick off the next background season load once the loader is free
+    if (!m_preloadQueue.empty()) {
+        startNextPreload();
+    }
+
+    // keep paintGL running while a scene is loading so it can pick up + upload the result
+    const bool loading = m_sceneLoader.isLoading() || m_pendingScene;
+    static bool wasLoading = false;
+    if (loading || wasLoading) {
+        reportLoadProgress();
+    }
+    wasLoading = loading;
+
+    // the camera only exists once the first scene is swapped in, until then just keep paintGL picking up the load
+    if (!m_camera) {
+        if (loading) update();
+        return;
+    }
+
     // Use deltaTime and m_keyMap here to move around
 
     if (m_keyMap[Qt::Key_W]){
@@ -627,8 +1011,19 @@ void Realtime::timerEvent(QTimerEvent *event) {
         m_particles.update(deltaTime);
     }
 
+    // Advance animated groups; only the shapes under a group that actually moved get a new ctm
+    bool animated = false;
+    if (!m_renderData.animation.empty()) {
+        m_animationTime += deltaTime;
+        if (m_renderData.animation.update(m_animationTime)) {
+            m_renderData.animation.applyToShapes(m_renderData.shapes);
+            m_sceneRenderer.markShapesDirty(m_renderData.animation);
+            animated = true;
+        }
+    }
+
     // Redraw if anything animated is on, or if the camera moved
-    if (moved || particlesOn || bloomOn) {
+    if (moved || particlesOn || bloomOn || animated || loading) {
         update();
     }
 }
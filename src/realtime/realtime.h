@@ -7,6 +7,7 @@
 #include <GL/glew.h>
 #include <glm/glm.hpp>
 #include "utils/sceneparser.h"
+#include "utils/sceneloader.h"
 #include "camera/camera.h"
 #include "renderers/shaperenderer.h"
 #include "renderers/scenerenderer.h"
@@ -15,7 +16,11 @@
 #include "particlesystem.h"
 #include "renderers/godrayrenderer.h"
 #include "renderers/screenrenderer.h"
+#include "renderers/temporalaccumulator.h"
 
+#include <deque>
+#include <functional>
+#include <optional>
 #include <unordered_map>
 #include <QElapsedTimer>
 #include <QOpenGLWidget>
@@ -30,10 +35,13 @@ class Realtime : public QOpenGLWidget
 public:
     Realtime(QWidget *parent = nullptr);
     void finish();                                      // Called on program exit
-    void sceneChanged();
+    void sceneChanged(bool keepCamera = false);          // keepCamera: season switch, same layout
     void settingsChanged();
     void saveViewportImage(std::string filePath);
 
+    // Called (on the GUI thread) while a scene is loading: percent in [0, 100] and a short status line
+    void setLoadProgressCallback(std::function<void(int, const std::string&)> callback) { m_loadProgressCallback = std::move(callback); }
+
     GLuint m_screen_width;
     GLuint m_screen_height;
     GLuint m_texture_shader;
@@ -59,12 +67,30 @@ private:
     std::string getSeasonScenePath(const std::string& basePath, int seasonIdx);
     void applySeasonalGodRayParameters(int seasonIdx);
 
+    bool uploadPendingScene(qint64 budgetNs);
+    void swapInScene(LoadedScene &scene);
+    void reportLoadProgress();
+
+    using SceneKey = std::pair<std::string, int>;       // scene file + season index
+    bool isSeasonVariant(const std::string &a, const std::string &b);
+    void queueSeasonPreloads();
+    void startNextPreload();
+    void dropPendingScene();
+    void dropResidentScenes();
+    std::string residentMemoryReport();
+    void reportFirstFrame();
+    void buildFrameGraph(GLuint targetFBO, int w, int h);
+
 
     GLPrimitiveData createPrimitiveGLData(PrimitiveType type);
 
     // Tick Related Variables
     int m_timer;                                        // Stores timer which attempts to run ~60 times per second
     QElapsedTimer m_elapsedTimer;                       // Stores timer which keeps track of actual time between frames
+    float m_animationTime = 0.f;                        // Seconds since the scene was loaded, drives the keyframed groups
+    QElapsedTimer m_statsTimer;                         // Throttles settings.printFrameStats
+    QElapsedTimer m_startupTimer;                       // From initializeGL to the first frame
+    bool m_reportedFirstFrame = false;
 
     // Input Related Variables
     bool m_mouseDown = false;                           // Stores state of left mouse button
@@ -75,6 +101,26 @@ private:
     double m_devicePixelRatio;
 
     RenderData m_renderData;
+
+    // Async loading: the worker parses/decodes and plans the batches, paintGL uploads the result and makes the batch
+    // objects in slices, then swaps it in
+    SceneLoader m_sceneLoader;
+    std::unique_ptr<LoadedScene> m_pendingScene;
+    std::function<void(int, const std::string&)> m_loadProgressCallback;
+    static constexpr qint64 UPLOAD_BUDGET_NS = 4'000'000; // gl upload time allowed per frame while loading
+    bool m_keepCameraOnSwap = false;
+
+    // Preloaded seasonal variants (settings.preloadSeasons). Fully uploaded scenes that aren't on screen, each with the
+    // scene renderer's batches for it; switching to one swaps both with what's on screen (the current one comes back in
+    // here), nothing is rebuilt. meshes and textures are shared through the renderer caches
+    struct ResidentScene {
+        RenderData renderData;
+        std::unique_ptr<SceneBatches> batches;
+    };
+    SceneKey m_currentSceneKey;
+    std::map<SceneKey, ResidentScene> m_residentScenes;
+    std::deque<SceneKey> m_preloadQueue;
+    std::optional<SceneKey> m_preloadInFlight;
     std::unique_ptr<Camera> m_camera;
     ShapeRenderer m_shapeRenderer;
     SceneRenderer m_sceneRenderer;
@@ -86,6 +132,8 @@ private:
     bool m_isInitialized = false;
 
     PostProcess m_post;
+    RenderGraph m_graph;                                // rebuilt every frame in paintGL
+    TemporalAccumulator m_temporal;                     // god-ray/bloom histories (settings.temporalEffects)
     ParticleSystem m_particles;
     // GLuint m_shader;
 
@@ -0,0 +1,45 @@
+#include "drawkey.h"
+
+#include <algorithm>
+#include <array>
+
+uint64_t DrawKey::make(int pass, int variant, int textureSet, int geometry, int depthBucket) {
+    return (uint64_t(pass & 0xf) << 60)
+         | (uint64_t(variant & 0xff) << 52)
+         | (uint64_t(textureSet & 0xfffff) << 32)
+         | (uint64_t(geometry & 0xffff) << 16)
+         | uint64_t(depthBucket & 0xffff);
+}
+
+int DrawKey::depthBucket(float distance, float farPlane) {
+    float t = std::clamp(distance / std::max(farPlane, 1e-3f), 0.f, 1.f);
+    return static_cast<int>(t * 65535.f);
+}
+
+void DrawKey::radixSort(std::vector<DrawItem> &items) {
+    if (items.size() < 2) return;
+
+    std::vector<DrawItem> scratch(items.size());
+
+    for (int shift = 0; shift < 64; shift += 8) {
+        std::array<size_t, 256> counts{};
+        for (const DrawItem &item : items) {
+            counts[(item.key >> shift) & 0xff]++;
+        }
+
+        // every key has the same byte here, nothing to move
+        if (counts[(items[0].key >> shift) & 0xff] == items.size()) continue;
+
+        size_t offset = 0;
+        for (size_t &count : counts) {
+            size_t c = count;
+            count = offset;
+            offset += c;
+        }
+
+        for (const DrawItem &item : items) {
+            scratch[counts[(item.key >> shift) & 0xff]++] = item;
+        }
+        items.swap(scratch);
+    }
+}
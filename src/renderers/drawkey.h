@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// One shape waiting to be drawn, sorted by its key
+struct DrawItem {
+    uint64_t key;
+    int shape; // index into RenderData::shapes
+};
+
+/**
+ * 64-bit sort key for scene draws. From most to least significant:
+ *
+ *   [63:60] pass   [59:52] shader variant   [51:32] texture set   [31:16] geometry   [15:0] depth bucket
+ *
+ * so sorting by it groups draws by the most expensive state change first (program, then textures, then vao).
+ * Shapes whose keys only differ in the depth bucket go into the same instanced draw, the bucket just orders the
+ * instances front to back inside it.
+ */
+class DrawKey {
+public:
+    enum Pass {
+        PASS_OPAQUE = 0
+    };
+
+    static uint64_t make(int pass, int variant, int textureSet, int geometry, int depthBucket);
+
+    static int variant(uint64_t key) { return static_cast<int>((key >> 52) & 0xff); }
+    static int textureSet(uint64_t key) { return static_cast<int>((key >> 32) & 0xfffff); }
+    static int geometry(uint64_t key) { return static_cast<int>((key >> 16) & 0xffff); }
+
+    // the part of the key that has to match for two shapes to share a draw
+    static uint64_t batchBits(uint64_t key) { return key & ~uint64_t(0xffff); }
+
+    // distance from the eye -> 16 bit bucket (0 = closest)
+    static int depthBucket(float distance, float farPlane);
+
+    // lsd radix sort, 8 bits per pass. passes where every key has the same byte are skipped, so in practice
+    // only a handful of the 8 run. stable, so equal keys keep their scene order
+    static void radixSort(std::vector<DrawItem> &items);
+};
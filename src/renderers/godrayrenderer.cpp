@@ -1,15 +1,103 @@
 #include "godrayrenderer.h"
+#include "temporalaccumulator.h"
 #include "glm/ext/matrix_transform.hpp"
 #include "utils/sceneparser.h"
 #include "utils/shaderloader.h"
-#include "shapes/shapetesselator.h"
-#include "shaperenderer.h"
 #include "utils/scenedata.h"
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 
+namespace {
+    // the low res rays: BLUR_PASSES passes of BLUR_TAPS taps, the stride growing BLUR_TAPS times per pass
+    const int BLUR_PASSES = 3;
+    const int BLUR_TAPS = 8;
+    const int BLUR_STEPS = BLUR_TAPS * BLUR_TAPS * BLUR_TAPS;
+
+    // the temporal rays take a quarter of the samples per frame
+    const int TEMPORAL_SAMPLE_DIVISOR = 4;
+
+    // where a light's sphere is for the occlusion mask, and its scale (a unit sphere primitive, radius 0.5)
+    void lightSphere(const SceneLightData& light, glm::vec3& center, float& scale) {
+        if (light.type == LightType::LIGHT_DIRECTIONAL) {
+            // rendering the sun to be gigantic.
+            center = -glm::normalize(glm::vec3(light.dir)) * 100.0f;
+            scale = 25.0f;
+        } else if (light.type == LightType::LIGHT_POINT) {
+            center = glm::vec3(light.pos);
+            scale = 0.5f;
+        } else {
+            center = glm::vec3(light.pos);
+            scale = 0.3f;
+        }
+    }
+
+    /**
+     * how far (screen uv) from a light its rays still add something visible to an rgba8 target. a pixel d away only
+     * picks the light's disc up with the taps of sampleRadialBlur that land within radius of the light, i.e. taps
+     * i in N/density * (1 -+ radius/d), and their decayed weights shrink as d grows
+     */
+    float rayReach(const GodRays& rays, float radius) {
+        const float VISIBLE = 0.5f / 255.f;
+        const float n = float(rays.sampleCount);
+        const float density = std::max(rays.density, 1e-4f);
+
+        float d = radius;
+        while (d < 2.f) { // past the screen diagonal anyway
+            float first = std::max(std::ceil(n / density * (1.f - radius / d)), 1.f);
+            float last = std::min(std::floor(n / density * (1.f + radius / d)), n);
+            float sum = 0.f;
+            if (last >= first) {
+                sum = rays.decay < 1.f
+                    ? (std::pow(rays.decay, first - 1.f) - std::pow(rays.decay, last)) / (1.f - rays.decay)
+                    : last - first + 1.f;
+            }
+            if (sum * rays.weight * rays.exposure < VISIBLE) break;
+            d *= 1.25f;
+        }
+        return d;
+    }
+
+    // the pixels of a width x height target inside uv lo..hi, grown by margin pixels. x, y, width, height
+    glm::ivec4 scissorRect(glm::vec2 lo, glm::vec2 hi, int width, int height, int margin) {
+        lo = glm::clamp(lo, 0.f, 1.f);
+        hi = glm::clamp(hi, 0.f, 1.f);
+        int x0 = std::max(int(std::floor(lo.x * width)) - margin, 0);
+        int y0 = std::max(int(std::floor(lo.y * height)) - margin, 0);
+        int x1 = std::min(int(std::ceil(hi.x * width)) + margin, width);
+        int y1 = std::min(int(std::ceil(hi.y * height)) + margin, height);
+        return glm::ivec4(x0, y0, std::max(x1 - x0, 0), std::max(y1 - y0, 0));
+    }
+}
+
+void GodRayUniforms::find(GLuint program, int occlusionUnit) {
+    sampleCount = glGetUniformLocation(program, "blurParams.sampleCount");
+    density = glGetUniformLocation(program, "blurParams.blurDensity");
+    weight = glGetUniformLocation(program, "blurParams.sampleWeight");
+    decay = glGetUniformLocation(program, "blurParams.decayFactor");
+    exposure = glGetUniformLocation(program, "blurParams.blurExposure");
+    jitter = glGetUniformLocation(program, "blurParams.sampleJitter");
+    lightPositions = glGetUniformLocation(program, "lightPositionsScreen");
+    lightCount = glGetUniformLocation(program, "lightCount");
+
+    glUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "occlusionTexture"), occlusionUnit);
+    glUseProgram(0);
+}
+
+void GodRayUniforms::upload(const GodRays& rays) const {
+    glUniform1i(sampleCount, rays.sampleCount);
+    glUniform1f(density, rays.density);
+    glUniform1f(weight, rays.weight);
+    glUniform1f(decay, rays.decay);
+    glUniform1f(exposure, rays.exposure);
+    glUniform1f(jitter, rays.jitter);
+    if (rays.lightCount > 0) glUniform4fv(lightPositions, rays.lightCount, &rays.lightPositions[0][0]);
+    glUniform1i(lightCount, rays.lightCount);
+}
+
 CrepuscularRenderer::CrepuscularRenderer()
-    : m_crepuscularShader(0), m_occlusionShader(0), m_fbo(0), m_outputTexture(0),
-      m_occlusionFBO(0), m_occlusionTexture(0), m_occlusionDepth(0),
+    : m_crepuscularShader(0), m_occlusionShader(0), m_blurShader(0), m_upsampleShader(0), m_addShader(0),
       m_quadVAO(0), m_quadVBO(0),
       m_exposure(0.96f), m_decay(0.96f), m_density(0.8f),
       m_weight(0.01f), m_samples(100) {}
@@ -25,16 +113,58 @@ void CrepuscularRenderer::initialize(float exposure, float decay, float density,
     );
 
     m_occlusionShader = ShaderLoader::createShaderProgram(
-        ":/resources/shaders/occlusion.vert",
-        ":/resources/shaders/occlusion.frag"
+        ":/resources/shaders/fullscreen.vert",
+        ":/resources/shaders/occlusion_mask.frag"
+    );
+
+    m_loc_occlusionDepthParams = glGetUniformLocation(m_occlusionShader, "u_DepthParams");
+    m_loc_occlusionDiscs = glGetUniformLocation(m_occlusionShader, "u_Discs");
+    m_loc_occlusionDiscDepths = glGetUniformLocation(m_occlusionShader, "u_DiscDepths");
+    m_loc_occlusionDiscCount = glGetUniformLocation(m_occlusionShader, "u_DiscCount");
+    glUseProgram(m_occlusionShader);
+    glUniform1i(glGetUniformLocation(m_occlusionShader, "u_DepthTex"), 0);
+    glUseProgram(0);
+
+    // occlusion mask always sits on unit 0
+    m_rayUniforms.find(m_crepuscularShader, 0);
+
+    m_blurShader = ShaderLoader::createShaderProgram(
+        ":/resources/shaders/fullscreen.vert",
+        ":/resources/shaders/godray_blur.frag"
+    );
+    m_upsampleShader = ShaderLoader::createShaderProgram(
+        ":/resources/shaders/fullscreen.vert",
+        ":/resources/shaders/godray_upsample.frag"
+    );
+
+    m_addShader = ShaderLoader::createShaderProgram(
+        ":/resources/shaders/copy.vert",
+        ":/resources/shaders/copy.frag"
     );
 
+    m_loc_blurLight = glGetUniformLocation(m_blurShader, "u_Light");
+    m_loc_blurStep = glGetUniformLocation(m_blurShader, "u_Step");
+    m_loc_blurOffset = glGetUniformLocation(m_blurShader, "u_Offset");
+    m_loc_blurDecay = glGetUniformLocation(m_blurShader, "u_Decay");
+    m_loc_blurScale = glGetUniformLocation(m_blurShader, "u_Scale");
+    glUseProgram(m_blurShader);
+    glUniform1i(glGetUniformLocation(m_blurShader, "u_InputTex"), 0);
+
+    m_loc_upsampleDepthParams = glGetUniformLocation(m_upsampleShader, "u_DepthParams");
+    m_loc_upsampleCenterWeight = glGetUniformLocation(m_upsampleShader, "u_CenterWeight");
+    glUseProgram(m_upsampleShader);
+    glUniform1i(glGetUniformLocation(m_upsampleShader, "u_RaysTex"), 0);
+    glUniform1i(glGetUniformLocation(m_upsampleShader, "u_OcclusionTex"), 1);
+    glUniform1i(glGetUniformLocation(m_upsampleShader, "u_DepthTex"), 2);
+    glUseProgram(m_addShader);
+    glUniform1i(glGetUniformLocation(m_addShader, "textureSampler"), 0);
+    glUseProgram(0);
+
     m_exposure = exposure;
     m_decay = decay;
     m_density = density;
     m_weight = weight;
     m_samples = samples;
-    m_defaultFBO = 0;
     
     initializeFullscreenQuad();
 
@@ -42,18 +172,17 @@ void CrepuscularRenderer::initialize(float exposure, float decay, float density,
 
 void CrepuscularRenderer::cleanup() {
 
-    if (m_fbo) glDeleteFramebuffers(1, &m_fbo);
-    if (m_outputTexture) glDeleteTextures(1, &m_outputTexture);
-
-    if (m_occlusionFBO) glDeleteFramebuffers(1, &m_occlusionFBO);
-    if (m_occlusionTexture) glDeleteTextures(1, &m_occlusionTexture);
-    if (m_occlusionDepth) glDeleteRenderbuffers(1, &m_occlusionDepth);
-
     if (m_quadVAO) glDeleteVertexArrays(1, &m_quadVAO);
     if (m_quadVBO) glDeleteBuffers(1, &m_quadVBO);
 
     if (m_crepuscularShader) glDeleteProgram(m_crepuscularShader);
     if (m_occlusionShader) glDeleteProgram(m_occlusionShader);
+    if (m_blurShader) glDeleteProgram(m_blurShader);
+    if (m_upsampleShader) glDeleteProgram(m_upsampleShader);
+    if (m_addShader) glDeleteProgram(m_addShader);
+
+    m_quadVAO = m_quadVBO = 0;
+    m_crepuscularShader = m_occlusionShader = m_blurShader = m_upsampleShader = m_addShader = 0;
 
 }
 
@@ -91,234 +220,294 @@ void CrepuscularRenderer::initializeFullscreenQuad() {
 
 }
 
-void CrepuscularRenderer::initializeFBO(int width, int height) {
-
-    m_fboWidth = width;
-    m_fboHeight = height;
-
-    // end scene fbo
-    if (m_fbo) glDeleteFramebuffers(1, &m_fbo);
-    if (m_outputTexture) glDeleteTextures(1, &m_outputTexture);
-
-    glGenFramebuffers(1, &m_fbo);
-    glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
-
-    glGenTextures(1, &m_outputTexture);
-    glBindTexture(GL_TEXTURE_2D, m_outputTexture);
-
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, 
-                 GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, 
-                          GL_TEXTURE_2D, m_outputTexture, 0);
-
-
-    // making occlusion fbo at HALF RESOLUTION for performance
-    int occlusionWidth = width / 2;
-    int occlusionHeight = height / 2;
-    if (occlusionWidth < 1) occlusionWidth = 1;
-    if (occlusionHeight < 1) occlusionHeight = 1;
-    
-    m_occlusionWidth = occlusionWidth;
-    m_occlusionHeight = occlusionHeight;
-    
-    if (m_occlusionFBO) glDeleteFramebuffers(1, &m_occlusionFBO);
-    if (m_occlusionTexture) glDeleteTextures(1, &m_occlusionTexture);
-    if (m_occlusionDepth) glDeleteRenderbuffers(1, &m_occlusionDepth);
-
-    glGenFramebuffers(1, &m_occlusionFBO);
-    glBindFramebuffer(GL_FRAMEBUFFER, m_occlusionFBO);
-
-    glGenTextures(1, &m_occlusionTexture);
-    glBindTexture(GL_TEXTURE_2D, m_occlusionTexture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, occlusionWidth, occlusionHeight, 0, 
-                 GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, 
-                          GL_TEXTURE_2D, m_occlusionTexture, 0);
-    
-    // create depth renderbuffer for proper depth testing
-    glGenRenderbuffers(1, &m_occlusionDepth);
-    glBindRenderbuffer(GL_RENDERBUFFER, m_occlusionDepth);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, occlusionWidth, occlusionHeight);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT,
-                              GL_RENDERBUFFER, m_occlusionDepth);
-
-    glBindFramebuffer(GL_FRAMEBUFFER, m_defaultFBO);
-
+/**
+ * @brief CrepuscularRenderer::addOcclusionPass the mask is rendered at HALF RESOLUTION for performance, and transient
+ * so the graph can hand its memory to other passes once the rays are drawn. it comes from the scene depth, so whatever
+ * the scene drew (meshes and terrain too) occludes, without drawing anything again
+ */
+RenderGraph::Resource CrepuscularRenderer::addOcclusionPass(RenderGraph& graph, RenderGraph::Resource sceneDepth,
+                                                            const GodRays& rays, const glm::mat4& projectionMatrix,
+                                                            int width, int height) {
+
+    const int occlusionWidth = std::max(width / 2, 1);
+    const int occlusionHeight = std::max(height / 2, 1);
+
+    RenderGraph::Resource mask = graph.createTexture("god-ray occlusion", {occlusionWidth, occlusionHeight, GL_RGBA8});
+
+    graph.addPass("god-ray occlusion", {sceneDepth}, {mask}, [=, this, &graph]() {
+        graph.bindFramebuffer(mask);
+        renderOcclusion(graph.texture(sceneDepth), rays, projectionMatrix);
+    });
+    return mask;
 }
 
-void CrepuscularRenderer::renderOcclusionMaskInternal(const glm::mat4& viewMatrix,
-                                              const glm::mat4& projectionMatrix,
-                                              const RenderData& renderData,
-                                              ShapeRenderer& shapeRenderer) {
-
-    // save me.
-    glBindFramebuffer(GL_FRAMEBUFFER, m_occlusionFBO);
-    glViewport(0, 0, m_occlusionWidth, m_occlusionHeight);
+int CrepuscularRenderer::addBlendPass(RenderGraph& graph, RenderGraph::Resource occlusion,
+                                      RenderGraph::Resource target, const GodRays& rays) {
 
-    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glEnable(GL_DEPTH_TEST);
+    return graph.addPass("god rays", {occlusion}, {target}, [=, this, &graph]() {
+        graph.bindFramebuffer(target);
+        glDisable(GL_DEPTH_TEST);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+        glEnable(GL_BLEND);
 
-    glUseProgram(m_occlusionShader);
-    
-    // upload view and projection matrices
-    glUniformMatrix4fv(glGetUniformLocation(m_occlusionShader, "view"),
-                       1, GL_FALSE, &viewMatrix[0][0]);
-
-    glUniformMatrix4fv(glGetUniformLocation(m_occlusionShader, "proj"),
-                       1, GL_FALSE, &projectionMatrix[0][0]);
-    
+        blendCrepuscular(graph.texture(occlusion), rays);
 
-    GLint modelLocation = glGetUniformLocation(m_occlusionShader, "model");
-    GLint colorLocation = glGetUniformLocation(m_occlusionShader, "occlusionColor");
-    glUniform4f(colorLocation, 0.0f, 0.0f, 0.0f, 1.0f);
-    
-    for (const auto& shape : renderData.shapes) {
-        if (shape.primitive.type == PrimitiveType::PRIMITIVE_MESH) {
-            continue; // meshes handled elsewhere, skip for occlusion
-        }
-
-        try {
-            GLPrimitiveData primitiveData = shapeRenderer.getPrimitiveData(shape.primitive.type);
-            if (primitiveData.vao == 0 || primitiveData.vertexCount == 0) {
-                continue;
-            }
-
-            glUniformMatrix4fv(modelLocation, 1, GL_FALSE, &shape.ctm[0][0]);
-            glBindVertexArray(primitiveData.vao);
-            glDrawArrays(GL_TRIANGLES, 0, primitiveData.vertexCount);
-            glBindVertexArray(0);
-        } catch (...) {
-            continue;
-        }
-    }
-
-
-    // render all lights as white spheres
-    glUniform4f(colorLocation, 1.0f, 1.0f, 1.0f, 1.0f);
-
-    for (const auto& light : renderData.lights) {
-
-        glm::mat4 lightModel = glm::mat4(1.0f);
-
-        // rendering the sun to be gigantic.
-        if (light.type == LightType::LIGHT_DIRECTIONAL) {
-
-            glm::vec3 lightDir = glm::normalize(glm::vec3(light.dir));
-            glm::vec3 lightWorldPos = -lightDir * 100.0f;
-            lightModel = glm::translate(lightModel, lightWorldPos);
-            lightModel = glm::scale(lightModel, glm::vec3(25.0f));
-
-        } else if (light.type == LightType::LIGHT_POINT) {
-
-            lightModel = glm::translate(lightModel, glm::vec3(light.pos));
-            lightModel = glm::scale(lightModel, glm::vec3(0.5f));
-
-        } else {
-            lightModel = glm::translate(lightModel, glm::vec3(light.pos));
-            lightModel = glm::scale(lightModel, glm::vec3(0.3f));
-        }
+        glDisable(GL_BLEND);
+        glEnable(GL_DEPTH_TEST);
+    });
+}
 
-        glUniformMatrix4fv(modelLocation, 1, GL_FALSE, &lightModel[0][0]);
+/**
+ * @brief CrepuscularRenderer::addTemporalPasses a quarter of the taps, so each tap stands for TEMPORAL_SAMPLE_DIVISOR
+ * of the full res ones (weight times that, decay to that power). the taps move by the frame's jitter, the history
+ * averages the gaps between them back in while the camera holds still
+ */
+int CrepuscularRenderer::addTemporalPasses(RenderGraph& graph, RenderGraph::Resource occlusion,
+                                           RenderGraph::Resource sceneDepth, RenderGraph::Resource target,
+                                           const GodRays& rays, TemporalAccumulator& temporal) {
+
+    GodRays reduced = rays;
+    reduced.sampleCount = std::max(rays.sampleCount / TEMPORAL_SAMPLE_DIVISOR, 1);
+    const float stepsPerTap = float(rays.sampleCount) / float(reduced.sampleCount);
+    reduced.weight = rays.weight * stepsPerTap;
+    reduced.decay = std::pow(rays.decay, stepsPerTap);
+    reduced.jitter = temporal.frame().jitter.x;
+
+    const RenderTextureDesc targetDesc = graph.desc(target);
+    const RenderGraph::Resource samples = graph.createTexture("god-ray samples",
+                                                              {targetDesc.width, targetDesc.height, GL_RGBA16F});
+
+    graph.addPass("god rays", {occlusion}, {samples}, [=, this, &graph]() {
+        graph.bindFramebuffer(samples);
+        glDisable(GL_DEPTH_TEST);
+        glDisable(GL_BLEND);
+        blendCrepuscular(graph.texture(occlusion), reduced);
+        glEnable(GL_DEPTH_TEST);
+    });
+
+    const RenderGraph::Resource accumulated = temporal.addResolvePass(graph, "god rays", samples, sceneDepth);
+
+    return graph.addPass("god rays add", {accumulated}, {target}, [=, this, &graph]() {
+        graph.bindFramebuffer(target);
+        glDisable(GL_DEPTH_TEST);
+        glBlendFunc(GL_ONE, GL_ONE);
+        glEnable(GL_BLEND);
+
+        glUseProgram(m_addShader);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, graph.texture(accumulated));
+        drawQuad();
+        glUseProgram(0);
+
+        glDisable(GL_BLEND);
+        glEnable(GL_DEPTH_TEST);
+    });
+}
 
-        try {
-            GLuint sphereVAO = shapeRenderer.getVAO(PrimitiveType::PRIMITIVE_SPHERE);
-            int sphereVertices = shapeRenderer.getVertexCount(PrimitiveType::PRIMITIVE_SPHERE);
-            if (sphereVAO != 0 && sphereVertices > 0) {
-                glBindVertexArray(sphereVAO);
-                glDrawArrays(GL_TRIANGLES, 0, sphereVertices);
-                glBindVertexArray(0);
-            }
-        } catch (...) {
-            continue;
+/**
+ * @brief CrepuscularRenderer::addLowResPasses the radial blur of each light at a quarter of the target's size, as
+ * BLUR_PASSES passes of BLUR_TAPS taps (24 taps a pixel instead of sampleCount). the stride grows BLUR_TAPS times per
+ * pass, so together they add up BLUR_STEPS evenly spaced taps over the same stretch towards the light, with the decay
+ * and weight rescaled to match. every pass of a light is scissored to the square its rays can reach (rayReach), which
+ * for the seasonal densities is a few disc radii around the light. check changes against the full res rays with
+ * imagediff
+ */
+int CrepuscularRenderer::addLowResPasses(RenderGraph& graph, RenderGraph::Resource occlusion,
+                                         RenderGraph::Resource sceneDepth, RenderGraph::Resource target,
+                                         const GodRays& rays, const glm::mat4& projectionMatrix) {
+
+    const RenderTextureDesc targetDesc = graph.desc(target);
+    const RenderTextureDesc lowDesc{std::max(targetDesc.width / 4, 1), std::max(targetDesc.height / 4, 1), GL_RGBA16F};
+
+    // BLUR_STEPS taps cover what sampleCount did, each one is worth sampleCount / BLUR_STEPS of theirs
+    const float samples = float(std::max(rays.sampleCount, 1));
+    const float step = rays.density / float(BLUR_STEPS);
+    const float stepDecay = std::pow(rays.decay, samples / float(BLUR_STEPS));
+    const float stepWeight = rays.weight * rays.exposure * samples / float(BLUR_STEPS);
+
+    const RenderGraph::Resource blur[2] = {graph.createTexture("god-ray blur 1", lowDesc),
+                                           graph.createTexture("god-ray blur 2", lowDesc)};
+    const RenderGraph::Resource lowRays = graph.createTexture("god-ray low res", lowDesc);
+
+    glm::vec2 lo(1.f), hi(0.f); // everything the lights drew, uv
+    int drawn = 0;
+    for (int light = 0; light < rays.lightCount; light++) {
+        if (rays.lightRadii[light] <= 0.f) continue;
+
+        // with density > 1 the taps also go past the light
+        const glm::vec2 center(rays.lightPositions[light]);
+        const float reach = rayReach(rays, rays.lightRadii[light]) * std::max(1.f, rays.density - 1.f);
+        const glm::vec2 lightLo = center - reach, lightHi = center + reach;
+        const glm::ivec4 onScreen = scissorRect(lightLo, lightHi, lowDesc.width, lowDesc.height, 0);
+        if (onScreen.z == 0 || onScreen.w == 0) continue;
+        lo = glm::min(lo, lightLo);
+        hi = glm::max(hi, lightHi);
+        const bool first = drawn++ == 0;
+
+        RenderGraph::Resource input = occlusion;
+        for (int pass = 0; pass < BLUR_PASSES; pass++) {
+            const bool last = pass == BLUR_PASSES - 1;
+            const RenderGraph::Resource output = last ? lowRays : blur[pass % 2];
+            // the next pass reads between its pixels and the light, + a texel for the filtering
+            const glm::ivec4 scissor = scissorRect(lightLo, lightHi, lowDesc.width, lowDesc.height,
+                                                   BLUR_PASSES - 1 - pass);
+            const float stride = std::pow(float(BLUR_TAPS), float(pass));
+
+            std::vector<RenderGraph::Resource> reads = {input};
+            if (last && !first) reads.push_back(lowRays);
+
+            graph.addPass("god-ray blur", reads, {output}, [=, this, &graph]() {
+                graph.bindFramebuffer(output);
+                if (last && first) {
+                    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+                    glClear(GL_COLOR_BUFFER_BIT);
+                }
+                glDisable(GL_DEPTH_TEST);
+                glEnable(GL_SCISSOR_TEST);
+                glScissor(scissor.x, scissor.y, scissor.z, scissor.w);
+                if (last) {
+                    glBlendFunc(GL_ONE, GL_ONE);
+                    glEnable(GL_BLEND);
+                }
+
+                glUseProgram(m_blurShader);
+                glUniform2f(m_loc_blurLight, center.x, center.y);
+                glUniform1f(m_loc_blurStep, step * stride);
+                glUniform1f(m_loc_blurOffset, pass == 0 ? 1.0f : 0.0f);
+                glUniform1f(m_loc_blurDecay, std::pow(stepDecay, stride));
+                glUniform1f(m_loc_blurScale, last ? stepWeight : 1.0f);
+                glActiveTexture(GL_TEXTURE0);
+                glBindTexture(GL_TEXTURE_2D, graph.texture(input));
+                drawQuad();
+                glUseProgram(0);
+
+                glDisable(GL_BLEND);
+                glDisable(GL_SCISSOR_TEST);
+                glEnable(GL_DEPTH_TEST);
+            });
+            input = output;
         }
     }
-    
-    
-    glUseProgram(0);
-    glBindFramebuffer(GL_FRAMEBUFFER, m_defaultFBO);
-
+    if (drawn == 0) return -1;
+
+    const glm::ivec4 scissor = scissorRect(lo, hi, targetDesc.width, targetDesc.height, 2);
+    const glm::vec2 depthParams(projectionMatrix[2][2], projectionMatrix[3][2]);
+    // sampleRadialBlur starts every light with the unblurred pixel
+    const float centerWeight = rays.exposure * float(rays.lightCount);
+
+    return graph.addPass("god-ray upsample", {lowRays, occlusion, sceneDepth}, {target}, [=, this, &graph]() {
+        graph.bindFramebuffer(target);
+        glDisable(GL_DEPTH_TEST);
+        glEnable(GL_SCISSOR_TEST);
+        glScissor(scissor.x, scissor.y, scissor.z, scissor.w);
+        glBlendFunc(GL_ONE, GL_ONE);
+        glEnable(GL_BLEND);
+
+        glUseProgram(m_upsampleShader);
+        glUniform2f(m_loc_upsampleDepthParams, depthParams.x, depthParams.y);
+        glUniform1f(m_loc_upsampleCenterWeight, centerWeight);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, graph.texture(lowRays));
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, graph.texture(occlusion));
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, graph.texture(sceneDepth));
+        glActiveTexture(GL_TEXTURE0);
+        drawQuad();
+        glUseProgram(0);
+
+        glDisable(GL_BLEND);
+        glDisable(GL_SCISSOR_TEST);
+        glEnable(GL_DEPTH_TEST);
+    });
 }
 
-void CrepuscularRenderer::renderOcclusion(const glm::mat4& viewMatrix,
-                                          const glm::mat4& projectionMatrix,
-                                          int width, int height,
-                                          const RenderData& renderData,
-                                          ShapeRenderer& shapeRenderer) {
+/**
+ * @brief CrepuscularRenderer::renderOcclusion one fullscreen pass: every light on screen is an analytic disc (its
+ * sphere projected), white where nothing in the scene depth is in front of it. the sun only shows over the sky
+ */
+void CrepuscularRenderer::renderOcclusion(GLuint sceneDepthTexture, const GodRays& rays,
+                                          const glm::mat4& projectionMatrix) {
+
+    // lightRadii is the bigger of the two, the disc is squashed along the other axis by the aspect
+    const float scaleX = projectionMatrix[0][0] / std::max(projectionMatrix[0][0], projectionMatrix[1][1]);
+    const float scaleY = projectionMatrix[1][1] / std::max(projectionMatrix[0][0], projectionMatrix[1][1]);
+
+    glm::vec4 discs[8];
+    float depths[8];
+    int count = 0;
+    for (int i = 0; i < rays.lightCount; i++) {
+        if (rays.lightRadii[i] <= 0.0f) continue;
+        discs[count] = glm::vec4(glm::vec2(rays.lightPositions[i]),
+                                 rays.lightRadii[i] * scaleX, rays.lightRadii[i] * scaleY);
+        depths[count] = rays.lightDepths[i];
+        count++;
+    }
 
-    static int lastWidth = 0, lastHeight = 0;
-    if (width != lastWidth || height != lastHeight) {
-        initializeFBO(width, height);
-        lastWidth = width;
-        lastHeight = height;
+    glDisable(GL_DEPTH_TEST);
+    glUseProgram(m_occlusionShader);
+    glUniform2f(m_loc_occlusionDepthParams, projectionMatrix[2][2], projectionMatrix[3][2]);
+    if (count > 0) {
+        glUniform4fv(m_loc_occlusionDiscs, count, &discs[0][0]);
+        glUniform1fv(m_loc_occlusionDiscDepths, count, depths);
     }
+    glUniform1i(m_loc_occlusionDiscCount, count);
 
-    // render occlusion mask to occlusion FBO
-    renderOcclusionMaskInternal(viewMatrix, projectionMatrix, renderData, shapeRenderer);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, sceneDepthTexture);
+    drawQuad();
+
+    glUseProgram(0);
+    glEnable(GL_DEPTH_TEST);
 
 }
 
-void CrepuscularRenderer::blendCrepuscular(const glm::mat4& viewMatrix,
-                                           const glm::mat4& projectionMatrix,
-                                           int width, int height,
-                                           const RenderData& renderData) {
+GodRays CrepuscularRenderer::rays(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix,
+                                  const RenderData& renderData) const {
 
-    glViewport(0, 0, width, height);
-    glUseProgram(m_crepuscularShader);
+    GodRays rays;
+    rays.sampleCount = m_samples;
+    rays.density = m_density;
+    rays.weight = m_weight;
+    rays.decay = m_decay;
+    rays.exposure = m_exposure;
 
     // collect light screen positions
-    std::vector<glm::vec4> lightPositions;
     for (const auto& light : renderData.lights) {
+        if (rays.lightCount == 8) break;
+
         glm::vec3 lightWorldPos;
-        if (light.type == LightType::LIGHT_DIRECTIONAL) {
-            glm::vec3 lightDir = glm::normalize(glm::vec3(light.dir));
-            lightWorldPos = -lightDir * 100.0f;
-        } else if (light.type == LightType::LIGHT_POINT) {
-            lightWorldPos = glm::vec3(light.pos);
-        } else {
-            lightWorldPos = glm::vec3(light.pos);
-        }
+        float scale;
+        lightSphere(light, lightWorldPos, scale);
 
         glm::vec4 clip = projectionMatrix * viewMatrix * glm::vec4(lightWorldPos, 1.0f);
         glm::vec4 ndc = clip / clip.w;
-        glm::vec4 screen = (ndc + 1.0f) * 0.5f;
-        lightPositions.push_back(screen);
+        float ndcRadius = 0.5f * scale * std::max(projectionMatrix[0][0], projectionMatrix[1][1]) / clip.w;
+        rays.lightRadii[rays.lightCount] = clip.w > 0.0f ? ndcRadius * 0.5f : 0.0f;
+        rays.lightDepths[rays.lightCount] = light.type == LightType::LIGHT_DIRECTIONAL
+            ? 0.0f : std::max(clip.w - 0.5f * scale, 1e-3f);
+        rays.lightPositions[rays.lightCount++] = (ndc + 1.0f) * 0.5f;
     }
+    return rays;
+}
 
-    // setting all uniforms
-    glUniform1i(glGetUniformLocation(m_crepuscularShader, "blurParams.sampleCount"), m_samples);
-    glUniform1f(glGetUniformLocation(m_crepuscularShader, "blurParams.blurDensity"), m_density);
-    glUniform1f(glGetUniformLocation(m_crepuscularShader, "blurParams.sampleWeight"), m_weight);
-    glUniform1f(glGetUniformLocation(m_crepuscularShader, "blurParams.decayFactor"), m_decay);
-    glUniform1f(glGetUniformLocation(m_crepuscularShader, "blurParams.blurExposure"), m_exposure);
+void CrepuscularRenderer::blendCrepuscular(GLuint occlusionTexture, const GodRays& rays) {
 
-    if (!lightPositions.empty()) {
-        glUniform4fv(glGetUniformLocation(m_crepuscularShader, "lightPositionsScreen"),
-                     lightPositions.size(), &lightPositions[0][0]);
-    }
-    glUniform1i(glGetUniformLocation(m_crepuscularShader, "lightCount"), static_cast<int>(lightPositions.size()));
+    glUseProgram(m_crepuscularShader);
+    m_rayUniforms.upload(rays);
     
     // bind occlusion texture only (scene already on screen)
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, m_occlusionTexture);
-    glUniform1i(glGetUniformLocation(m_crepuscularShader, "occlusionTexture"), 0);
+    glBindTexture(GL_TEXTURE_2D, occlusionTexture);
     
-    // draw fullscreen quad
+    drawQuad();
+    glUseProgram(0);
+}
+
+void CrepuscularRenderer::drawQuad() {
     glBindVertexArray(m_quadVAO);
     glDrawArrays(GL_TRIANGLES, 0, 6);
     glBindVertexArray(0);
-    
-    glEnable(GL_DEPTH_TEST);
-    glUseProgram(0);
 }
 
 /* OLD APPROACH: Renders to FBO then copies to screen (not used anymore)
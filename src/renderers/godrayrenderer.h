@@ -1,10 +1,42 @@
 #pragma once
 #include <GL/glew.h>
 #include <glm/glm.hpp>
+#include "rendergraph.h"
+
+class TemporalAccumulator;
 
-class ShapeRenderer;
 struct RenderData;
 
+// what drawing the rays takes besides the occlusion mask, see CrepuscularRenderer::rays
+struct GodRays {
+    int sampleCount = 0;
+    float density = 0.f;
+    float weight = 0.f;
+    float decay = 0.f;
+    float exposure = 0.f;
+    float jitter = 0.f;                 // 0..1 of a step, all taps but the first move by it
+    int lightCount = 0;                 // lightPositionsScreen only holds 8
+    glm::vec4 lightPositions[8] = {};   // screen uv
+    float lightRadii[8] = {};           // of each light's disc in the occlusion mask, screen uv (0 = behind the camera)
+    float lightDepths[8] = {};          // view depth of the front of each light's sphere, 0 for the sun (sky only)
+};
+
+// the crepuscular.glsl uniforms of a program that includes it
+struct GodRayUniforms {
+    GLint sampleCount = -1;
+    GLint density = -1;
+    GLint weight = -1;
+    GLint decay = -1;
+    GLint exposure = -1;
+    GLint jitter = -1;
+    GLint lightPositions = -1;
+    GLint lightCount = -1;
+
+    // also points occlusionTexture at occlusionUnit
+    void find(GLuint program, int occlusionUnit);
+    void upload(const GodRays& rays) const;
+};
+
 class CrepuscularRenderer {
 
     public:
@@ -14,7 +46,6 @@ class CrepuscularRenderer {
         void initialize(float exposure, float decay, float density,
                         float weight, int samples);
         void cleanup();
-        void setDefaultFBO(GLuint fbo) { m_defaultFBO = fbo; }
         
         // Update parameters without reinitializing
         void setParameters(float exposure, float decay, float density,
@@ -26,48 +57,63 @@ class CrepuscularRenderer {
             m_samples = samples;
         }
 
-        void renderOcclusion(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix,
-                             int width, int height, const RenderData& renderData,
-                             ShapeRenderer& shapeRenderer);
-        
-        void blendCrepuscular(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix,
-                             int width, int height, const RenderData& renderData);        GLuint getOutputTexture() const { return m_outputTexture; }
-        GLuint getFBO() const { return m_fbo; }
+        GodRays rays(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix,
+                     const RenderData& renderData) const;
+
+        // occlusion mask at half of width x height from the scene depth, into a transient target of the graph
+        RenderGraph::Resource addOcclusionPass(RenderGraph& graph, RenderGraph::Resource sceneDepth,
+                                               const GodRays& rays, const glm::mat4& projectionMatrix,
+                                               int width, int height);
+        // the rays blended (additively) onto target, returns the pass
+        int addBlendPass(RenderGraph& graph, RenderGraph::Resource occlusion, RenderGraph::Resource target,
+                         const GodRays& rays);
+        // the rays with a quarter of the samples, jittered, into temporal's history, which is added onto target.
+        // returns the pass that adds it
+        int addTemporalPasses(RenderGraph& graph, RenderGraph::Resource occlusion, RenderGraph::Resource sceneDepth,
+                              RenderGraph::Resource target, const GodRays& rays, TemporalAccumulator& temporal);
+        // the same rays from quarter resolution passes, bilaterally upsampled onto target with the scene depth.
+        // returns the upsample pass, -1 when no light's rays reach the screen
+        int addLowResPasses(RenderGraph& graph, RenderGraph::Resource occlusion, RenderGraph::Resource sceneDepth,
+                            RenderGraph::Resource target, const GodRays& rays, const glm::mat4& projectionMatrix);
+
+        // the occlusion mask into the bound framebuffer
+        void renderOcclusion(GLuint sceneDepthTexture, const GodRays& rays, const glm::mat4& projectionMatrix);
+        // the rays added onto the bound framebuffer
+        void blendCrepuscular(GLuint occlusionTexture, const GodRays& rays);
 
     private:
 
-        void initializeFBO(int width, int height);
         void initializeFullscreenQuad();
+        void drawQuad();
 
-        void initializeDirectionalGeometry();
-        void renderOcclusionMaskInternal(const glm::mat4& viewMatrix,
-                                        const glm::mat4& projectionMatrix,
-                                        const RenderData& renderData,
-                                        ShapeRenderer& shapeRenderer);
         GLuint m_crepuscularShader;
         GLuint m_occlusionShader;
-        
-        GLuint m_fbo;
-        GLuint m_outputTexture;
+        GLuint m_blurShader;
+        GLuint m_upsampleShader;
+        GLuint m_addShader;
+
+        // occlusion pass
+        GLint m_loc_occlusionDepthParams;
+        GLint m_loc_occlusionDiscs;
+        GLint m_loc_occlusionDiscDepths;
+        GLint m_loc_occlusionDiscCount;
 
-        // occlusion fbo
-        GLuint m_occlusionFBO;
-        GLuint m_occlusionTexture;
-        GLuint m_occlusionDepth;
+        // crepuscular pass
+        GodRayUniforms m_rayUniforms;
+
+        // low res passes
+        GLint m_loc_blurLight;
+        GLint m_loc_blurStep;
+        GLint m_loc_blurOffset;
+        GLint m_loc_blurDecay;
+        GLint m_loc_blurScale;
+        GLint m_loc_upsampleDepthParams;
+        GLint m_loc_upsampleCenterWeight;
 
         // fullscreen quad
         GLuint m_quadVAO;
         GLuint m_quadVBO;
 
-        //
-        int m_fboWidth;
-        int m_fboHeight;
-        int m_occlusionWidth;
-        int m_occlusionHeight;
-
-        // default fbo
-        GLuint m_defaultFBO;
-
         // crepuscular rays parameters
         float m_exposure;
         float m_decay;
@@ -0,0 +1,36 @@
+#include "gpuquery.h"
+
+void GpuQuery::initialize(GLenum target) {
+    cleanup();
+    m_target = target;
+    glGenQueries(FRAMES, m_queries);
+}
+
+void GpuQuery::cleanup() {
+    if (m_queries[0]) glDeleteQueries(FRAMES, m_queries);
+    for (int i = 0; i < FRAMES; i++) {
+        m_queries[i] = 0;
+        m_issued[i] = false;
+    }
+    m_current = 0;
+    m_result = 0;
+}
+
+void GpuQuery::begin() {
+    if (!m_queries[0]) return;
+
+    // this slot was last used FRAMES frames ago, pick its result up before reusing it
+    if (m_issued[m_current]) {
+        glGetQueryObjectui64v(m_queries[m_current], GL_QUERY_RESULT, &m_result);
+        m_issued[m_current] = false;
+    }
+    glBeginQuery(m_target, m_queries[m_current]);
+}
+
+void GpuQuery::end() {
+    if (!m_queries[0]) return;
+
+    glEndQuery(m_target);
+    m_issued[m_current] = true;
+    m_current = (m_current + 1) % FRAMES;
+}
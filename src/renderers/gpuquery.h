@@ -0,0 +1,30 @@
+#pragma once
+
+#include <GL/glew.h>
+
+/**
+ * One GL query (GL_TIME_ELAPSED, GL_SAMPLES_PASSED, ...) wrapped around the same pass every frame.
+ * Keeps a small ring of query objects and reads each one back FRAMES frames later, by which point the gpu is done
+ * with it, so reading a result never stalls the frame. result() is the last value that came back.
+ * Queries with the same target can't be nested, different targets can.
+ */
+class GpuQuery {
+public:
+    void initialize(GLenum target);
+    void cleanup();
+
+    void begin();
+    void end();
+
+    GLuint64 result() const { return m_result; }
+    double ms() const { return m_result / 1.0e6; } // for GL_TIME_ELAPSED
+
+private:
+    static const int FRAMES = 3;
+
+    GLenum m_target = GL_TIME_ELAPSED;
+    GLuint m_queries[FRAMES] = {};
+    bool m_issued[FRAMES] = {};
+    int m_current = 0;
+    GLuint64 m_result = 0;
+};
@@ -2,14 +2,44 @@
 #include "utils/shaderloader.h"
 #include "utils/sceneparser.h"
 #include "renderers/shaperenderer.h"
+#include "renderers/scenerenderer.h"
 #include "realtime/realtime.h"
+#include "settings.h"
 
 #include <QOpenGLWidget>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include <algorithm>
+#include <cstring>
+
+namespace {
+    // index -> cell of a z order (morton) curve, x from the even bits and y from the odd ones
+    glm::ivec2 zOrderCell(int index) {
+        glm::ivec2 cell(0);
+        for (int bit = 0; bit < 8; bit++) {
+            cell.x |= ((index >> (2 * bit)) & 1) << bit;
+            cell.y |= ((index >> (2 * bit + 1)) & 1) << bit;
+        }
+        return cell;
+    }
+}
+
 void LightRenderer::initialize(ShapeRenderer* renderer, GLuint texture_shader) {
     m_depth_shader = ShaderLoader::createShaderProgram(":/resources/shaders/depth.vert", ":/resources/shaders/depth.frag");
     m_texture_shader = texture_shader;
+    m_loc_lightMatrix = glGetUniformLocation(m_depth_shader, "lightMatrix");
+    m_loc_texture = glGetUniformLocation(m_texture_shader, "myTexture");
+
+    m_moments_shader = ShaderLoader::createShaderProgram(":/resources/shaders/fullscreen.vert", ":/resources/shaders/shadowmoments.frag");
+    m_blur_shader = ShaderLoader::createShaderProgram(":/resources/shaders/fullscreen.vert", ":/resources/shaders/shadowblur.frag");
+    m_loc_momentsLayer = glGetUniformLocation(m_moments_shader, "layer");
+    m_loc_momentsStep = glGetUniformLocation(m_moments_shader, "texelStep");
+    m_loc_blurStep = glGetUniformLocation(m_blur_shader, "u_TexelStep");
+    glUseProgram(m_moments_shader);
+    glUniform1i(glGetUniformLocation(m_moments_shader, "depthTexture"), 0);
+    glUseProgram(m_blur_shader);
+    glUniform1i(glGetUniformLocation(m_blur_shader, "u_InputTex"), 0);
+    glUseProgram(0);
     m_default_fbo = 2; // was previously 2
     m_shape_renderer = renderer; // pass in shape info
 
@@ -42,37 +72,159 @@ void LightRenderer::initialize(ShapeRenderer* renderer, GLuint texture_shader) {
 }
 
 void LightRenderer::makeShadowFBO() {
-    glGenFramebuffers(1, &m_shadow.fbo);
-    glGenTextures(1, &m_shadow.depth_map);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, m_shadow.depth_map);
-
-    // 1024 x 1024 16-bit depth texture
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, SHADOW_WIDTH, SHADOW_HEIGHT,
-                 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+    m_staticArray = makeCascadeArray(m_staticFBO);
+    m_compositeArray = makeCascadeArray(m_compositeFBO);
+    m_shadow.depth_map = m_staticArray;
+    makeMomentTargets();
+    makeAtlas();
+}
 
+void LightRenderer::makeAtlas() {
+    glGenTextures(1, &m_shadow.atlas);
+    glBindTexture(GL_TEXTURE_2D, m_shadow.atlas);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, ATLAS_SIZE, ATLAS_SIZE, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+    // the scene samples it through its compare sampler, lookups are clamped to their own tile in the shader
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-    // Set border color to 1.0 (max depth) so areas outside shadow map aren't shadowed
-    float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
-    glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
 
-    glBindFramebuffer(GL_FRAMEBUFFER, m_shadow.fbo);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, m_shadow.depth_map, 0);
-    // tell OpenGL we aren't rendering color data
+    glGenFramebuffers(1, &m_atlasFBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_atlasFBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, m_shadow.atlas, 0);
     glDrawBuffer(GL_NONE);
     glReadBuffer(GL_NONE);
 
     if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-        std::cout << "Incomplete Depth FBO" << std::endl;
+        std::cout << "Incomplete shadow atlas FBO" << std::endl;
+    }
+
+    for (glm::ivec4& views : m_shadow.atlasViews.lightViews) views = glm::ivec4(-1);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_default_fbo);
+}
+
+void LightRenderer::makeMomentTargets() {
+    glGenTextures(1, &m_shadow.moments);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_shadow.moments);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RG32F, CASCADE_SIZE, CASCADE_SIZE, MAX_SHADOW_CASCADES, 0, GL_RG, GL_FLOAT, nullptr);
+    // filtered, that's the point of prefiltering
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    glGenFramebuffers(MAX_SHADOW_CASCADES, m_momentsFBO);
+    for (int c = 0; c < MAX_SHADOW_CASCADES; c++) {
+        glBindFramebuffer(GL_FRAMEBUFFER, m_momentsFBO[c]);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, m_shadow.moments, 0, c);
+    }
+
+    glGenTextures(1, &m_blurTexture);
+    glBindTexture(GL_TEXTURE_2D, m_blurTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, CASCADE_SIZE, CASCADE_SIZE, 0, GL_RG, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &m_blurFBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_blurFBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_blurTexture, 0);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cout << "Incomplete shadow moments FBO" << std::endl;
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, m_default_fbo);
+}
+
+/**
+ * @brief LightRenderer::filterMoments prefilters one cascade for variance shadows: moments + horizontal blur into the
+ * scratch texture, vertical blur into the cascade's layer. only runs when the cascade's depth changed, so the scene
+ * pays for one filtered fetch per fragment and nothing else
+ */
+void LightRenderer::filterMoments(int cascade, GLuint depthArray) {
+    glDisable(GL_DEPTH_TEST);
+    glBindVertexArray(m_fullscreen_vao);
+    glActiveTexture(GL_TEXTURE0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, m_blurFBO);
+    glUseProgram(m_moments_shader);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, depthArray);
+    glUniform1i(m_loc_momentsLayer, cascade);
+    glUniform2f(m_loc_momentsStep, 1.0f / CASCADE_SIZE, 0.0f);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, m_momentsFBO[cascade]);
+    glUseProgram(m_blur_shader);
+    glBindTexture(GL_TEXTURE_2D, m_blurTexture);
+    glUniform2f(m_loc_blurStep, 0.0f, 1.0f / CASCADE_SIZE);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    glBindVertexArray(0);
+    glEnable(GL_DEPTH_TEST);
+    glUseProgram(m_depth_shader);
+}
+
+/**
+ * @brief LightRenderer::makeCascadeArray depth texture array with a layer per cascade and an fbo on each layer
+ * @return the texture
+ */
+GLuint LightRenderer::makeCascadeArray(GLuint fbos[MAX_SHADOW_CASCADES]) {
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+
+    // 24-bit depth, sized so the static layers can be blitted into the composite ones
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, CASCADE_SIZE, CASCADE_SIZE, MAX_SHADOW_CASCADES,
+                 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+    // Set border color to 1.0 (max depth) so areas outside shadow map aren't shadowed
+    float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, borderColor);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    glGenFramebuffers(MAX_SHADOW_CASCADES, fbos);
+    for (int c = 0; c < MAX_SHADOW_CASCADES; c++) {
+        glBindFramebuffer(GL_FRAMEBUFFER, fbos[c]);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, c);
+        // tell OpenGL we aren't rendering color data
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            std::cout << "Incomplete Depth FBO (cascade " << c << ")" << std::endl;
+        }
     }
 
     glBindFramebuffer(GL_FRAMEBUFFER, m_default_fbo);
+    return texture;
 }
 
-void LightRenderer::render(const RenderData& renderData, GLuint screenWidth, GLuint screenHeight) {
+/**
+ * @brief LightRenderer::render refreshes whatever shadow maps went stale: the sun's cascades, then the atlas tiles of
+ * the spot and point lights
+ */
+void LightRenderer::render(const RenderData& renderData, SceneRenderer& sceneRenderer, const Camera& camera,
+                           GLuint screenWidth, GLuint screenHeight) {
+    if (renderData.lights.empty()) {
+        m_shadow.cascades.count = 0;
+        return;
+    }
+
+    sceneRenderer.prepareFrame(*m_shape_renderer);
+    const std::vector<AABB> moved = sceneRenderer.takeMovedCasters();
+
     // Save whatever framebuffer was bound when we were called
     GLint prevFboInt = 0;
     glGetIntegerv(GL_FRAMEBUFFER_BINDING, &prevFboInt);
@@ -82,22 +234,8 @@ void LightRenderer::render(const RenderData& renderData, GLuint screenWidth, GLu
     GLint prevVP[4];
     glGetIntegerv(GL_VIEWPORT, prevVP);
 
-    // glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glUseProgram(m_depth_shader);
-
-    // support for a single light (the sun)
-    const SceneLightData *light = &renderData.lights[0];
-    GLint locMat = glGetUniformLocation(m_depth_shader, "lightMatrix");
-    glUniformMatrix4fv(locMat, 1, GL_FALSE, &light->matrix[0][0]);
-
-    glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
-    glBindFramebuffer(GL_FRAMEBUFFER, m_shadow.fbo);
-
-    // glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    // Shadow map only needs depth, clearing color is unnecessary and sometimes confusing
-    glClear(GL_DEPTH_BUFFER_BIT);
-
-    renderDepth(renderData);
+    renderCascades(renderData, sceneRenderer, camera);
+    renderAtlas(renderData, sceneRenderer, camera, moved);
 
     // glBindFramebuffer(GL_FRAMEBUFFER, m_default_fbo);
     glBindFramebuffer(GL_FRAMEBUFFER, prevFbo);
@@ -112,147 +250,263 @@ void LightRenderer::render(const RenderData& renderData, GLuint screenWidth, GLu
     // If you want anything, depth-only is the least destructive:
     // glClear(GL_DEPTH_BUFFER_BIT);
 
-    // paintTexture(m_shadow.depth_map);
-
     glUseProgram(0);
 }
 
-void LightRenderer::setShapes(ShapeRenderer* renderer) {
-    m_shape_renderer = renderer;
-}
-
-/*
- * Renders the scene from the light's perspective and saves
- * the resulting depth map in m_shadow_fbo
+/**
+ * @brief LightRenderer::renderCascades fits the cascades to the camera and keeps their layers up to date, doing as
+ * little as it can:
+ * - a cascade's static layer is only redrawn when its (texel snapped) matrix or the scene changes, so a still camera
+ *   and sun cost nothing at all
+ * - with amortizeShadowUpdates only one of the far cascades is redrawn per frame, the rest keep their old matrix for
+ *   a few frames (default.frag falls through to the next cascade where a stale one doesn't reach)
+ * - animated casters are drawn over a copy of the static layer whenever either changed
+ * only the sun (first directional light) gets cascades, spot and point lights go in the atlas
  */
-void LightRenderer::renderDepth(const RenderData& renderData) {
-    for (const RenderShapeData& shape : renderData.shapes) {
-
-        // Set model matrix uniform (same for both primitives and meshes)
-        m_model = shape.ctm;
-        GLint modelMatLoc = glGetUniformLocation(m_depth_shader, "modelMatrix");
-        glUniformMatrix4fv(modelMatLoc, 1, GL_FALSE, &m_model[0][0]);
+void LightRenderer::renderCascades(const RenderData& renderData, SceneRenderer& sceneRenderer, const Camera& camera) {
+    const int sunIndex = LightUtils::sunIndex(renderData.lights);
+
+    ShadowCascades target;
+    if (sunIndex >= 0) {
+        target = LightUtils::fitCascades(glm::vec3(renderData.lights[sunIndex].dir), camera.getViewMatrix(),
+                                         camera.getProjMatrix(), settings.nearPlane, settings.farPlane,
+                                         MAX_SHADOW_CASCADES, CASCADE_SIZE, sceneRenderer.bvh());
+    }
 
-        glActiveTexture(GL_TEXTURE0);
+    const int count = target.count;
+    m_shadow.cascades.count = count;
+    m_shadow.cascades.splits = target.splits;
+    if (count == 0) {
+        return;
+    }
 
-        if (shape.primitive.type == PrimitiveType::PRIMITIVE_MESH) {
-            // Handle mesh
-            MeshGLData meshData = m_shape_renderer->getMeshData(shape.primitive.meshfile);
+    const bool sceneChanged = sceneRenderer.staticCasterVersion() != m_staticVersion;
+    const bool dynamic = sceneRenderer.hasDynamicCasters();
+    const bool dynamicMoved = dynamic && sceneRenderer.dynamicCasterVersion() != m_dynamicVersion;
 
-            if (meshData.vertexCount == 0) {
-                continue;  // Skip if mesh failed to load
+    bool redraw[MAX_SHADOW_CASCADES] = {};
+    bool anyRedraw = false;
+    for (int c = 0; c < count; c++) {
+        redraw[c] = sceneChanged || target.matrices[c] != m_shadow.cascades.matrices[c];
+    }
+    if (settings.amortizeShadowUpdates && !sceneChanged && count > NEAR_CASCADES) {
+        const int farCount = count - NEAR_CASCADES;
+        bool picked = false;
+        for (int k = 0; k < farCount; k++) {
+            int c = NEAR_CASCADES + (m_nextFarCascade + k) % farCount;
+            if (!redraw[c]) continue;
+            if (picked) {
+                redraw[c] = false;
+            } else {
+                picked = true;
+                m_nextFarCascade = c - NEAR_CASCADES + 1;
             }
-
-            glBindVertexArray(meshData.vao);
-            glDrawArrays(GL_TRIANGLES, 0, meshData.vertexCount);
-            glBindVertexArray(0);
-        } else {
-            // Handle primitive shapes
-            GLPrimitiveData shapeData = m_shape_renderer->getPrimitiveData(shape.primitive.type);
-            glBindVertexArray(shapeData.vao);
-            glDrawArrays(GL_TRIANGLES, 0, shapeData.vertexCount);
-            glBindVertexArray(0);
         }
     }
-}
+    for (int c = 0; c < count; c++) anyRedraw |= redraw[c];
 
-Shadow LightRenderer::getShadow() {
-    return m_shadow;
-}
+    // switching to variance filtering needs every cascade's moments, not just the ones that changed
+    const bool variance = settings.shadowFilter == SHADOW_FILTER_VARIANCE;
+    const bool refilterAll = variance && !m_momentsValid;
+    if (!variance) m_momentsValid = false;
 
-// used for debugging, renders depth map
-void LightRenderer::paintTexture(GLuint texture) {
-    glUseProgram(m_texture_shader);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, texture);
+    if (!anyRedraw && !dynamicMoved && !refilterAll) {
+        return;
+    }
 
-    GLuint loc_texture = glGetUniformLocation(m_texture_shader, "myTexture");
-    glUniform1i(loc_texture, 0);
+    glUseProgram(m_depth_shader);
+    glViewport(0, 0, CASCADE_SIZE, CASCADE_SIZE);
+
+    for (int c = 0; c < count; c++) {
+        glm::mat4& matrix = m_shadow.cascades.matrices[c];
+        const bool composite = dynamic && (redraw[c] || dynamicMoved);
+
+        if (redraw[c]) {
+            matrix = target.matrices[c];
+            glBindFramebuffer(GL_FRAMEBUFFER, m_staticFBO[c]);
+            // Shadow map only needs depth, clearing color is unnecessary and sometimes confusing
+            glClear(GL_DEPTH_BUFFER_BIT);
+            glUniformMatrix4fv(m_loc_lightMatrix, 1, GL_FALSE, &matrix[0][0]);
+            sceneRenderer.drawShadowCasters(*m_shape_renderer, matrix, VIEW_SHADOW_STATIC);
+        }
 
-    glBindVertexArray(m_fullscreen_vao);
+        if (composite) {
+            // composite: copy the static depth in and draw the animated casters over it with the same matrix
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, m_staticFBO[c]);
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_compositeFBO[c]);
+            glBlitFramebuffer(0, 0, CASCADE_SIZE, CASCADE_SIZE, 0, 0, CASCADE_SIZE, CASCADE_SIZE, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
 
-    glDrawArrays(GL_TRIANGLES, 0, 6);
-    glBindTexture(GL_TEXTURE_2D, 0);
-    glBindVertexArray(0);
-    glUseProgram(0);
-}
-
-glm::mat4 LightRenderer::calculateLightMatrix(SceneLight *light, glm::vec3 position, glm::vec3 dir) {
-
-    glm::mat4 lightSpaceMatrix = glm::mat4(1.0f);
-    glm::vec3 lightInvDir = -1.0f * dir;
-    glm::mat4 lightProjection, lightView;
-
-    switch(light->type) {
-    case LightType::LIGHT_POINT:
-        break;
-    case LightType::LIGHT_DIRECTIONAL:
-        // calculate light space matrix for shadow mapping
-        // Position the light far enough to see the whole scene
-        {
-            float orthoSize = 100.0f;  // covers a 200x200 area (adjust based on your scene)
-            float nearPlane = 0.1f;
-            float farPlane = 200.0f;   // far enough to capture distant objects
-            
-            // Position light above the scene center, offset by light direction
-            glm::vec3 lightPos = lightInvDir * 100.0f;  // move light far back along inverse direction
-            
-            lightProjection = glm::ortho(-orthoSize, orthoSize, -orthoSize, orthoSize, nearPlane, farPlane);
-            lightView = glm::lookAt(lightPos, glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-            lightSpaceMatrix = lightProjection * lightView;
+            glBindFramebuffer(GL_FRAMEBUFFER, m_compositeFBO[c]);
+            glUniformMatrix4fv(m_loc_lightMatrix, 1, GL_FALSE, &matrix[0][0]);
+            sceneRenderer.drawShadowCasters(*m_shape_renderer, matrix, VIEW_SHADOW_DYNAMIC);
         }
-        break;
 
-    case LightType::LIGHT_SPOT:
-        // change orthographic mat into perspective mat
-        glm::vec3 look = glm::vec3(dir);
-        glm::vec3 up = glm::vec3(0.0f, 0.0f, 1.0f);
+        if (variance && (redraw[c] || composite || refilterAll)) {
+            filterMoments(c, dynamic ? m_compositeArray : m_staticArray);
+        }
+    }
+    m_momentsValid = variance;
 
-        glm::vec3 w = -glm::normalize(glm::vec3(look));
-        glm::vec3 v_prime = up - (glm::dot(up, w)) * w;
-        glm::vec3 v = glm::normalize(v_prime);
-        glm::vec3 u = glm::cross(v, w);
+    m_staticVersion = sceneRenderer.staticCasterVersion();
+    m_dynamicVersion = sceneRenderer.dynamicCasterVersion();
+    m_shadow.depth_map = dynamic ? m_compositeArray : m_staticArray;
+}
 
-        glm::mat4 mT = glm::mat4(1.0f, 0.0f, 0.0f, 0.0f,
-                                 0.0f, 1.0f, 0.0f, 0.0f,
-                                 0.0f, 0.0f, 1.0f, 0.0f,
-                                 -position[0], -position[1], -position[2], 1.0f);
+/**
+ * @brief LightRenderer::renderAtlas hands out atlas tiles to the spot and point lights and redraws the ones that went
+ * stale. lights whose range doesn't reach into the view get nothing, the rest get a 512, 256 or 128 tile (6 for a
+ * point light) depending on how big their range looks from the camera. if that doesn't fit, the least important
+ * lights are shrunk first and dropped (unshadowed) last.
+ * a tile is only redrawn when its light or its spot in the atlas moved, the static casters changed or an animated
+ * caster moved inside its frustum
+ */
+void LightRenderer::renderAtlas(const RenderData& renderData, SceneRenderer& sceneRenderer, const Camera& camera,
+                                const std::vector<AABB>& movedCasters) {
+    struct Candidate {
+        int light;
+        float range;
+        float importance;
+        int size;
+        int views;
+    };
+
+    const Frustum view = Frustum::fromMatrix(camera.getProjMatrix() * camera.getViewMatrix());
+    const glm::vec3 eye = camera.getPos();
+    const int lightCount = std::min(static_cast<int>(renderData.lights.size()), SHADOW_ATLAS_MAX_LIGHTS);
+
+    std::vector<Candidate> candidates;
+    for (int i = 0; i < lightCount; i++) {
+        const SceneLightData& light = renderData.lights[i];
+        if (light.type != LightType::LIGHT_SPOT && light.type != LightType::LIGHT_POINT) continue;
+
+        const float range = LightUtils::lightRange(light.function);
+        const glm::vec3 pos = glm::vec3(light.pos);
+        AABB reach;
+        reach.grow(pos - range);
+        reach.grow(pos + range);
+        if (view.test(reach) == Frustum::OUTSIDE) continue;
+
+        // about the angular size of the lit sphere, over 1 once the camera is inside it
+        const float importance = range / std::max(glm::length(pos - eye), 1e-3f);
+        const int size = importance > 1.0f ? ATLAS_MAX_TILE : (importance > 0.25f ? ATLAS_MAX_TILE / 2 : ATLAS_MIN_TILE);
+        candidates.push_back({i, range, importance, size, light.type == LightType::LIGHT_POINT ? 6 : 1});
+    }
 
-        glm::mat4 rot = glm::mat4(glm::vec4(u, 0.0f),
-                                  glm::vec4(v, 0.0f),
-                                  glm::vec4(w, 0.0f),
-                                  glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
-        glm::mat4 mR = glm::transpose(rot);
+    auto cellsOf = [](const Candidate& c) { return c.views * (c.size / ATLAS_MIN_TILE) * (c.size / ATLAS_MIN_TILE); };
+    const int capacity = (ATLAS_SIZE / ATLAS_MIN_TILE) * (ATLAS_SIZE / ATLAS_MIN_TILE);
+    for (;;) {
+        int used = 0;
+        for (const Candidate& c : candidates) used += cellsOf(c);
+        if (used <= capacity) break;
+
+        // halve the least important of the biggest tiles, or drop the least important light once all are minimum
+        auto worst = std::min_element(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+            return a.size != b.size ? a.size > b.size : a.importance < b.importance;
+        });
+        if (worst->size > ATLAS_MIN_TILE) {
+            worst->size /= 2;
+        } else {
+            candidates.erase(std::min_element(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+                return a.importance < b.importance;
+            }));
+        }
+    }
 
-        lightView = mR * mT;
+    // biggest first keeps every tile aligned on the z order curve. light index (not importance) inside a size, so
+    // tiles only move around when a light changes size
+    std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+        return a.size != b.size ? a.size > b.size : a.light < b.light;
+    });
+
+    ShadowAtlasBlock block{};
+    for (glm::ivec4& views : block.lightViews) views = glm::ivec4(-1);
+    std::vector<AtlasTile> tiles;
+    int cell = 0;
+    for (const Candidate& c : candidates) {
+        glm::mat4 matrices[MAX_LIGHT_SHADOW_VIEWS];
+        const int count = LightUtils::localShadowMatrices(renderData.lights[c.light], c.range, matrices);
+        block.lightViews[c.light].x = static_cast<int>(tiles.size());
+
+        for (int f = 0; f < count; f++) {
+            const glm::ivec2 origin = zOrderCell(cell) * ATLAS_MIN_TILE;
+            cell += (c.size / ATLAS_MIN_TILE) * (c.size / ATLAS_MIN_TILE);
+
+            const int v = static_cast<int>(tiles.size());
+            AtlasTile tile;
+            tile.matrix = matrices[f];
+            tile.rect = glm::ivec4(origin, c.size, 0);
+            tiles.push_back(tile);
+            block.matrices[v] = matrices[f];
+            block.rects[v] = glm::vec4(origin.x, origin.y, c.size, c.size) / float(ATLAS_SIZE);
+        }
+    }
 
-        float far = 10.f;
-        float near = 3.0f;
-        float theta = light->angle * 2.0f;
+    const uint64_t staticVersion = sceneRenderer.staticCasterVersion();
+    bool drawing = false;
+    for (size_t v = 0; v < tiles.size(); v++) {
+        AtlasTile& tile = tiles[v];
+        bool redraw = v >= m_atlasTiles.size() || m_atlasTiles[v].matrix != tile.matrix ||
+                      m_atlasTiles[v].rect != tile.rect || m_atlasTiles[v].staticVersion != staticVersion;
+        if (!redraw && !movedCasters.empty()) {
+            const Frustum frustum = Frustum::fromMatrix(tile.matrix);
+            for (const AABB& box : movedCasters) {
+                if (frustum.test(box) != Frustum::OUTSIDE) {
+                    redraw = true;
+                    break;
+                }
+            }
+        }
+        tile.staticVersion = staticVersion;
+        if (!redraw) continue;
+
+        if (!drawing) {
+            glBindFramebuffer(GL_FRAMEBUFFER, m_atlasFBO);
+            glUseProgram(m_depth_shader);
+            glEnable(GL_SCISSOR_TEST);
+            // perspective depth bunches up far from the light, a slope scaled offset keeps the acne away
+            glEnable(GL_POLYGON_OFFSET_FILL);
+            glPolygonOffset(2.0f, 4.0f);
+            drawing = true;
+        }
 
-        glm::mat4 scaleMat = glm::mat4(1.0f / (far * tan(theta / 2.0f)), 0.0f, 0.0f, 0.0f,
-                                       0.0f, 1.0f / (far * tan(theta / 2.0f)), 0.0f, 0.0f,
-                                       0.0f, 0.0f, 1.0f / far, 0.0f,
-                                       0.0f, 0.0f, 0.0f, 1.0f);
+        glViewport(tile.rect.x, tile.rect.y, tile.rect.z, tile.rect.z);
+        glScissor(tile.rect.x, tile.rect.y, tile.rect.z, tile.rect.z);
+        glClear(GL_DEPTH_BUFFER_BIT);
+        glUniformMatrix4fv(m_loc_lightMatrix, 1, GL_FALSE, &tile.matrix[0][0]);
+        sceneRenderer.drawShadowCasters(*m_shape_renderer, tile.matrix, VIEW_SHADOW_STATIC);
+        if (sceneRenderer.hasDynamicCasters()) {
+            sceneRenderer.drawShadowCasters(*m_shape_renderer, tile.matrix, VIEW_SHADOW_DYNAMIC);
+        }
+    }
 
-        float c = -near / far;
+    if (drawing) {
+        glDisable(GL_POLYGON_OFFSET_FILL);
+        glDisable(GL_SCISSOR_TEST);
+    }
 
-        glm::mat4 unhingingMat = glm::mat4(1.0f, 0.0f, 0.0f, 0.0f,
-                                           0.0f, 1.0f, 0.0f, 0.0f,
-                                           0.0f, 0.0f, 1.0f / (1.0f + c), -1.0f,
-                                           0.0f, 0.0f, -c / (1.0f + c), 0.0f);
+    m_atlasTiles = std::move(tiles);
+    if (std::memcmp(&block, &m_shadow.atlasViews, sizeof(ShadowAtlasBlock)) != 0) {
+        m_shadow.atlasViews = block;
+        m_shadow.atlasVersion++;
+    }
+}
 
-        glm::mat4 glFix = glm::mat4(1.0f, 0.0f, 0.0f, 0.0f,
-                                    0.0f, 1.0f, 0.0f, 0.0f,
-                                    0.0f, 0.0f, -2.0f, 0.0f,
-                                    0.0f, 0.0f, -1.0f, 1.0f);
+void LightRenderer::setShapes(ShapeRenderer* renderer) {
+    m_shape_renderer = renderer;
+}
 
+// used for debugging, renders depth map
+void LightRenderer::paintTexture(GLuint texture) {
+    glUseProgram(m_texture_shader);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, texture);
 
-        lightProjection = glFix * unhingingMat * scaleMat;
-        lightSpaceMatrix = lightProjection * lightView;
-        break;
-    }
+    glUniform1i(m_loc_texture, 0);
 
-    return lightSpaceMatrix;
+    glBindVertexArray(m_fullscreen_vao);
 
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindVertexArray(0);
+    glUseProgram(0);
 }
@@ -4,44 +4,110 @@
 #include <GL/glew.h>
 #include <glm/glm.hpp>
 #include <QOpenGLWidget>
+#include <cstdint>
+#include <vector>
 #include "utils/scenedata.h"
 #include "utils/sceneparser.h"
 #include "renderers/shaperenderer.h"
+#include "utils/lightutils.h"
+#include "camera/camera.h"
+
+class SceneRenderer;
+
+const int SHADOW_ATLAS_MAX_LIGHTS = 8;                               // UniformBlocks::MAX_LIGHTS
+const int SHADOW_ATLAS_MAX_VIEWS = SHADOW_ATLAS_MAX_LIGHTS * MAX_LIGHT_SHADOW_VIEWS; // all point lights
+
+// std140 mirror of ShadowAtlasBlock in default.frag (vec4 sized members only, like the blocks in scenerenderer.h)
+struct ShadowAtlasBlock {
+    glm::ivec4 lightViews[SHADOW_ATLAS_MAX_LIGHTS]; // x: the light's first view, -1 if it didn't get a tile
+    glm::mat4 matrices[SHADOW_ATLAS_MAX_VIEWS];     // what each tile was rendered with
+    glm::vec4 rects[SHADOW_ATLAS_MAX_VIEWS];        // tile offset + size in atlas uv
+};
 
 struct Shadow {
-    GLuint fbo;
-    GLuint depth_map;
+    GLuint depth_map = 0;     // GL_TEXTURE_2D_ARRAY, one layer per cascade
+    GLuint moments = 0;       // same layout, blurred depth + depth^2 (only kept up to date for variance filtering)
+    ShadowCascades cascades;  // matrices are what each layer was rendered with, lookups have to use the same ones
+
+    GLuint atlas = 0;         // GL_TEXTURE_2D depth, a tile per spot light and 6 per point light
+    ShadowAtlasBlock atlasViews;
+    uint64_t atlasVersion = 0; // bumped when atlasViews changes, so it's only re-uploaded then
 };
 
 class LightRenderer {
 public:
     void initialize(ShapeRenderer* renderer, GLuint texture_shader);
-    void render(const RenderData& renderData, GLuint screenWidth, GLuint screenHeight);
-    static glm::mat4 calculateLightMatrix(SceneLight *light, glm::vec3 position, glm::vec3 dir);
-    Shadow getShadow();
+    // the casters come out of the scene renderer's instance batches (culled against the light, one draw per batch).
+    // the cascades are fitted to the camera, the atlas tiles are sized by how much of the screen their light covers
+    void render(const RenderData& renderData, SceneRenderer& sceneRenderer, const Camera& camera,
+                GLuint screenWidth, GLuint screenHeight);
+    const Shadow& getShadow() const { return m_shadow; }
     void setShapes(ShapeRenderer* renderer);
 
 private:
+    void renderCascades(const RenderData& renderData, SceneRenderer& sceneRenderer, const Camera& camera);
+    void renderAtlas(const RenderData& renderData, SceneRenderer& sceneRenderer, const Camera& camera,
+                     const std::vector<AABB>& movedCasters);
     void makeShadowFBO();
-    void renderDepth(const RenderData& renderData);
+    void makeAtlas();
+    GLuint makeCascadeArray(GLuint fbos[MAX_SHADOW_CASCADES]);
+    void makeMomentTargets();
+    void filterMoments(int cascade, GLuint depthArray);
     void paintTexture(GLuint texture);
 
     GLuint m_depth_shader;
     GLuint m_texture_shader;
+
+    GLint m_loc_lightMatrix;
+    GLint m_loc_texture;
+
+    // variance shadow prefilter: depth -> moments + horizontal blur, then vertical blur into the cascade's layer
+    GLuint m_moments_shader;
+    GLuint m_blur_shader;
+    GLint m_loc_momentsLayer;
+    GLint m_loc_momentsStep;
+    GLint m_loc_blurStep;
     GLuint m_default_fbo;
 
-    GLuint SHADOW_WIDTH = 2048;
-    GLuint SHADOW_HEIGHT = 2048;
+    // 4 cascades of 512^2 is a quarter of the texels the old single 2048^2 map had
+    static const int CASCADE_SIZE = 512;
+    static const int NEAR_CASCADES = 2; // always kept up to date, the ones after these can lag with amortizeShadowUpdates
 
     GLuint m_fullscreen_vbo;
     GLuint m_fullscreen_vao;
 
     ShapeRenderer* m_shape_renderer;
 
-    glm::mat4 m_model = glm::mat4(1.0f);
-
+    // static casters are cached per cascade and only redrawn when that cascade's matrix changes, animated ones get
+    // drawn over a copy of the static layer in the composite array. m_shadow is whichever the scene should sample
+    GLuint m_staticArray = 0;
+    GLuint m_compositeArray = 0;
+    GLuint m_staticFBO[MAX_SHADOW_CASCADES] = {};
+    GLuint m_compositeFBO[MAX_SHADOW_CASCADES] = {};
     Shadow m_shadow;
 
+    GLuint m_momentsFBO[MAX_SHADOW_CASCADES] = {};
+    GLuint m_blurTexture = 0; // one cascade's worth, between the two blur passes
+    GLuint m_blurFBO = 0;
+    bool m_momentsValid = false;
+
+    uint64_t m_staticVersion = 0;
+    uint64_t m_dynamicVersion = 0;
+    int m_nextFarCascade = 0; // round robin over the far cascades
+
+    // spot/point light shadows, one depth texture cut into power of two tiles (ATLAS_MIN_TILE cells, packed in
+    // z order so big tiles placed first always stay aligned)
+    struct AtlasTile {
+        glm::mat4 matrix;
+        glm::ivec4 rect;             // x, y, size in texels
+        uint64_t staticVersion = 0;  // scene's static casters when it was drawn
+    };
+    static const int ATLAS_SIZE = 2048;
+    static const int ATLAS_MIN_TILE = 128;
+    static const int ATLAS_MAX_TILE = 512;
+    GLuint m_atlasFBO = 0;
+    std::vector<AtlasTile> m_atlasTiles; // by view index, what's in the atlas right now
+
     GLuint m_texture;
 
 };
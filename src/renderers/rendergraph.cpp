@@ -0,0 +1,406 @@
+#include "rendergraph.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+
+namespace {
+    struct FormatInfo {
+        GLenum format;
+        GLenum type;
+        int bytesPerPixel;
+    };
+
+    FormatInfo formatInfo(GLenum internalFormat) {
+        switch (internalFormat) {
+        case GL_RGBA16F: return {GL_RGBA, GL_HALF_FLOAT, 8};
+        case GL_RG16F: return {GL_RG, GL_HALF_FLOAT, 4};
+        case GL_R16F: return {GL_RED, GL_HALF_FLOAT, 2};
+        case GL_R8: return {GL_RED, GL_UNSIGNED_BYTE, 1};
+        case GL_DEPTH_COMPONENT24: return {GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, 4};
+        default: return {GL_RGBA, GL_UNSIGNED_BYTE, 4};
+        }
+    }
+}
+
+size_t RenderTextureDesc::bytes() const {
+    return static_cast<size_t>(width) * height * formatInfo(format).bytesPerPixel;
+}
+
+void RenderGraph::cleanup() {
+    reset();
+    for (PooledTexture& pooled : m_pool) glDeleteTextures(1, &pooled.texture);
+    m_pool.clear();
+    for (auto& [key, cached] : m_framebuffers) glDeleteFramebuffers(1, &cached.fbo);
+    m_framebuffers.clear();
+
+    for (FrameTimestamps& frame : m_timestamps) {
+        if (!frame.queries.empty()) glDeleteQueries(static_cast<GLsizei>(frame.queries.size()), frame.queries.data());
+        frame = FrameTimestamps();
+    }
+    m_timestampFrame = 0;
+    m_passMs.clear();
+    m_stats = RenderGraphStats();
+}
+
+void RenderGraph::reset() {
+    m_resources.clear();
+    m_passes.clear();
+    m_fusions.clear();
+
+    // framebuffers nothing bound last frame (a bloom toggle, a resized scene target) go
+    for (auto it = m_framebuffers.begin(); it != m_framebuffers.end();) {
+        if (!it->second.used) {
+            glDeleteFramebuffers(1, &it->second.fbo);
+            it = m_framebuffers.erase(it);
+        } else {
+            it->second.used = false;
+            ++it;
+        }
+    }
+}
+
+RenderGraph::Resource RenderGraph::importTexture(const std::string& name, GLuint texture, RenderTextureDesc desc) {
+    ResourceNode node;
+    node.name = name;
+    node.desc = desc;
+    node.texture = texture;
+    node.imported = true;
+    m_resources.push_back(node);
+    return static_cast<Resource>(m_resources.size() - 1);
+}
+
+RenderGraph::Resource RenderGraph::importFramebuffer(const std::string& name, GLuint fbo, int width, int height) {
+    ResourceNode node;
+    node.name = name;
+    node.desc = {width, height, GL_RGBA8};
+    node.framebuffer = fbo;
+    node.imported = true;
+    node.isFramebuffer = true;
+    m_resources.push_back(node);
+    return static_cast<Resource>(m_resources.size() - 1);
+}
+
+RenderGraph::Resource RenderGraph::createTexture(const std::string& name, RenderTextureDesc desc) {
+    ResourceNode node;
+    node.name = name;
+    node.desc = desc;
+    m_resources.push_back(node);
+    return static_cast<Resource>(m_resources.size() - 1);
+}
+
+int RenderGraph::addPass(const std::string& name, std::vector<Resource> reads, std::vector<Resource> writes,
+                         Execute execute, unsigned flags) {
+    PassNode pass;
+    pass.name = name;
+    pass.reads = std::move(reads);
+    pass.writes = std::move(writes);
+    pass.execute = std::move(execute);
+    pass.flags = flags;
+    m_passes.push_back(std::move(pass));
+    return static_cast<int>(m_passes.size() - 1);
+}
+
+int RenderGraph::addCopyPass(const std::string& name, Resource from, Resource to, Execute execute) {
+    return addPass(name, {from}, {to}, std::move(execute), COPY);
+}
+
+void RenderGraph::addFusion(int first, int second, const std::string& name, Execute execute) {
+    m_fusions.push_back({first, second, name, std::move(execute)});
+}
+
+RenderGraph::Resource RenderGraph::resolve(Resource resource) const {
+    while (resource != NONE && m_resources[resource].aliasOf != NONE) resource = m_resources[resource].aliasOf;
+    return resource;
+}
+
+GLuint RenderGraph::texture(Resource resource) const {
+    return m_resources[resolve(resource)].texture;
+}
+
+const RenderTextureDesc& RenderGraph::desc(Resource resource) const {
+    return m_resources[resolve(resource)].desc;
+}
+
+void RenderGraph::compile() {
+    m_stats = RenderGraphStats();
+
+    for (size_t p = 0; p < m_passes.size(); p++) {
+        if ((m_passes[p].flags & COPY) && dropCopy(static_cast<int>(p))) m_stats.droppedCopies++;
+    }
+    cullPasses();
+    fusePasses();
+    allocateTransients();
+}
+
+/**
+ * @brief RenderGraph::dropCopy a copy into a transient texture of the same description is only needed if the source
+ * changes (or is read) after the copy, or the destination was already in use before it. otherwise everything that
+ * reads or writes the destination can just as well use the source
+ */
+bool RenderGraph::dropCopy(int pass) {
+    const Resource from = resolve(m_passes[pass].reads[0]);
+    const Resource to = m_passes[pass].writes[0];
+    const ResourceNode& target = m_resources[to];
+    if (target.imported || target.aliasOf != NONE || !(m_resources[from].desc == target.desc)) return false;
+
+    auto touches = [&](const PassNode& node, Resource resource, bool resolved) {
+        for (const std::vector<Resource>* list : {&node.reads, &node.writes}) {
+            for (Resource r : *list) {
+                if ((resolved ? resolve(r) : r) == resource) return true;
+            }
+        }
+        return false;
+    };
+    for (int p = 0; p < static_cast<int>(m_passes.size()); p++) {
+        if (p == pass || m_passes[p].dropped) continue;
+        if (p < pass && touches(m_passes[p], to, false)) return false;
+        if (p > pass && touches(m_passes[p], from, true)) return false;
+    }
+
+    m_resources[to].aliasOf = from;
+    m_passes[pass].dropped = true;
+    return true;
+}
+
+// back to front: a pass is live if it has side effects or writes a framebuffer or something a live pass reads later
+void RenderGraph::cullPasses() {
+    std::vector<bool> needed(m_resources.size(), false);
+    for (int p = static_cast<int>(m_passes.size()) - 1; p >= 0; p--) {
+        PassNode& pass = m_passes[p];
+        pass.live = false;
+        if (pass.dropped) continue;
+
+        bool live = pass.flags & SIDE_EFFECT;
+        for (Resource r : pass.writes) {
+            r = resolve(r);
+            if (m_resources[r].isFramebuffer || needed[r]) live = true;
+        }
+        if (!live) {
+            m_stats.culledPasses++;
+            continue;
+        }
+
+        pass.live = true;
+        for (Resource r : pass.reads) needed[resolve(r)] = true;
+    }
+}
+
+void RenderGraph::fusePasses() {
+    auto resolvedSet = [&](const std::vector<Resource>& resources) {
+        std::vector<Resource> out;
+        for (Resource r : resources) out.push_back(resolve(r));
+        std::sort(out.begin(), out.end());
+        out.erase(std::unique(out.begin(), out.end()), out.end());
+        return out;
+    };
+
+    for (Fusion& fusion : m_fusions) {
+        PassNode& first = m_passes[fusion.first];
+        PassNode& second = m_passes[fusion.second];
+        if (!first.live || !second.live) continue;
+
+        bool adjacent = true;
+        for (int p = fusion.first + 1; p < fusion.second; p++) adjacent = adjacent && !m_passes[p].live;
+        if (!adjacent) continue;
+
+        const std::vector<Resource> writes = resolvedSet(first.writes);
+        if (writes != resolvedSet(second.writes)) continue;
+
+        bool readsFirst = false;
+        for (Resource r : resolvedSet(second.reads)) {
+            readsFirst = readsFirst || std::binary_search(writes.begin(), writes.end(), r);
+        }
+        if (readsFirst) continue;
+
+        first.name = fusion.name;
+        first.execute = std::move(fusion.execute);
+        first.reads.insert(first.reads.end(), second.reads.begin(), second.reads.end());
+        second.live = false;
+        second.dropped = true;
+        m_stats.fusedPasses++;
+    }
+}
+
+/**
+ * @brief RenderGraph::allocateTransients walks the live passes in order. a transient gets a pooled texture at its first
+ * use and gives it back after its last, so a texture whose readers are all done is free for the next one written with
+ * the same description (within the same pass, reads are given back only after the writes took theirs)
+ */
+void RenderGraph::allocateTransients() {
+    for (ResourceNode& resource : m_resources) {
+        resource.firstUse = resource.lastUse = -1;
+    }
+    for (int p = 0; p < static_cast<int>(m_passes.size()); p++) {
+        if (!m_passes[p].live) continue;
+        for (const std::vector<Resource>* list : {&m_passes[p].reads, &m_passes[p].writes}) {
+            for (Resource r : *list) {
+                ResourceNode& resource = m_resources[resolve(r)];
+                if (resource.imported) continue;
+                if (resource.firstUse < 0) resource.firstUse = p;
+                resource.lastUse = p;
+            }
+        }
+    }
+
+    for (PooledTexture& pooled : m_pool) {
+        pooled.inUse = false;
+        pooled.usedThisFrame = false;
+    }
+
+    for (int p = 0; p < static_cast<int>(m_passes.size()); p++) {
+        if (!m_passes[p].live) continue;
+        for (ResourceNode& resource : m_resources) {
+            if (resource.firstUse != p) continue;
+            resource.texture = acquire(resource.desc);
+            m_stats.unaliasedBytes += resource.desc.bytes();
+        }
+        for (ResourceNode& resource : m_resources) {
+            if (resource.lastUse != p) continue;
+            for (PooledTexture& pooled : m_pool) {
+                if (pooled.texture == resource.texture) pooled.inUse = false;
+            }
+        }
+    }
+
+    // whatever no pass needed this frame (old sizes after a resize, bloom turned off) is given back to the driver
+    for (auto it = m_pool.begin(); it != m_pool.end();) {
+        if (!it->usedThisFrame) {
+            deleteTexture(it->texture);
+            it = m_pool.erase(it);
+        } else {
+            m_stats.transientBytes += it->desc.bytes();
+            ++it;
+        }
+    }
+    m_stats.transientTextures = static_cast<int>(m_pool.size());
+}
+
+GLuint RenderGraph::acquire(const RenderTextureDesc& desc) {
+    for (PooledTexture& pooled : m_pool) {
+        if (pooled.inUse || !(pooled.desc == desc)) continue;
+        pooled.inUse = pooled.usedThisFrame = true;
+        return pooled.texture;
+    }
+
+    const FormatInfo info = formatInfo(desc.format);
+    const GLint filter = info.format == GL_DEPTH_COMPONENT ? GL_NEAREST : GL_LINEAR;
+
+    PooledTexture pooled;
+    pooled.desc = desc;
+    glGenTextures(1, &pooled.texture);
+    glBindTexture(GL_TEXTURE_2D, pooled.texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, desc.format, desc.width, desc.height, 0, info.format, info.type, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    pooled.inUse = pooled.usedThisFrame = true;
+    m_pool.push_back(pooled);
+    return pooled.texture;
+}
+
+void RenderGraph::deleteTexture(GLuint texture) {
+    for (auto it = m_framebuffers.begin(); it != m_framebuffers.end();) {
+        if (std::get<0>(it->first) == texture || std::get<1>(it->first) == texture) {
+            glDeleteFramebuffers(1, &it->second.fbo);
+            it = m_framebuffers.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    glDeleteTextures(1, &texture);
+}
+
+void RenderGraph::bindFramebuffer(Resource colour, Resource depth) {
+    const ResourceNode& target = m_resources[resolve(colour)];
+    if (target.isFramebuffer) {
+        glBindFramebuffer(GL_FRAMEBUFFER, target.framebuffer);
+        glViewport(0, 0, target.desc.width, target.desc.height);
+        return;
+    }
+
+    const GLuint depthTexture = depth == NONE ? 0 : texture(depth);
+    CachedFramebuffer& cached = m_framebuffers[{target.texture, depthTexture, target.desc.width, target.desc.height}];
+    if (!cached.fbo) {
+        glGenFramebuffers(1, &cached.fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, cached.fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target.texture, 0);
+        if (depthTexture) glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            std::cout << "Render graph framebuffer for " << target.name << " is incomplete" << std::endl;
+        }
+    } else {
+        glBindFramebuffer(GL_FRAMEBUFFER, cached.fbo);
+    }
+    cached.used = true;
+    glViewport(0, 0, target.desc.width, target.desc.height);
+}
+
+void RenderGraph::execute() {
+    FrameTimestamps& frame = m_timestamps[m_timestampFrame];
+    if (frame.issued) readTimestamps(frame);
+
+    frame.passes.clear();
+    for (const PassNode& pass : m_passes) {
+        if (pass.live) frame.passes.push_back(pass.name);
+    }
+    const size_t needed = frame.passes.size() + 1;
+    if (frame.queries.size() < needed) {
+        const size_t have = frame.queries.size();
+        frame.queries.resize(needed);
+        glGenQueries(static_cast<GLsizei>(needed - have), frame.queries.data() + have);
+    }
+
+    size_t query = 0;
+    for (PassNode& pass : m_passes) {
+        if (!pass.live) continue;
+        glQueryCounter(frame.queries[query++], GL_TIMESTAMP);
+        pass.execute();
+    }
+    glQueryCounter(frame.queries[query], GL_TIMESTAMP);
+
+    frame.issued = true;
+    m_timestampFrame = (m_timestampFrame + 1) % TIMESTAMP_FRAMES;
+    m_stats.passes = static_cast<int>(frame.passes.size());
+}
+
+// TIMESTAMP_FRAMES frames old by now, so the results are in without waiting
+void RenderGraph::readTimestamps(FrameTimestamps& frame) {
+    m_passMs.clear();
+    GLuint64 previous = 0;
+    for (size_t i = 0; i <= frame.passes.size(); i++) {
+        GLuint64 time = 0;
+        glGetQueryObjectui64v(frame.queries[i], GL_QUERY_RESULT, &time);
+        if (i > 0) {
+            // passes with the same name (the bloom blur steps) are reported as one
+            const double ms = (time - previous) / 1.0e6;
+            auto found = std::find_if(m_passMs.begin(), m_passMs.end(),
+                                      [&](const auto& pass) { return pass.first == frame.passes[i - 1]; });
+            if (found != m_passMs.end()) found->second += ms;
+            else m_passMs.emplace_back(frame.passes[i - 1], ms);
+        }
+        previous = time;
+    }
+    frame.issued = false;
+}
+
+std::string RenderGraph::report() const {
+    auto mb = [](size_t bytes) { return bytes / (1024.0 * 1024.0); };
+
+    char buf[256];
+    snprintf(buf, sizeof(buf), "graph: %d passes (%d culled, %d copies dropped, %d fused) | transient targets %.1f MB "
+             "in %d textures (%.1f MB without aliasing) |", m_stats.passes, m_stats.culledPasses,
+             m_stats.droppedCopies, m_stats.fusedPasses, mb(m_stats.transientBytes), m_stats.transientTextures,
+             mb(m_stats.unaliasedBytes));
+
+    std::string out = buf;
+    for (const auto& [name, ms] : m_passMs) {
+        snprintf(buf, sizeof(buf), " %s %.2f ms,", name.c_str(), ms);
+        out += buf;
+    }
+    if (out.back() == ',') out.pop_back();
+    return out;
+}
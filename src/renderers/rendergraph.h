@@ -0,0 +1,161 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <functional>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+// size + internal format of a graph texture. transient textures with equal descriptions can share memory
+struct RenderTextureDesc {
+    int width = 0;
+    int height = 0;
+    GLenum format = GL_RGBA8; // GL_RGBA8, GL_RGBA16F, GL_R8, GL_R16F, GL_RG16F or GL_DEPTH_COMPONENT24
+
+    bool operator==(const RenderTextureDesc& other) const {
+        return width == other.width && height == other.height && format == other.format;
+    }
+    size_t bytes() const;
+};
+
+struct RenderGraphStats {
+    int passes = 0;           // ran last frame
+    int culledPasses = 0;     // nothing live read what they wrote
+    int droppedCopies = 0;    // copy passes whose output was read straight from their input instead
+    int fusedPasses = 0;      // pairs that ran as one pass
+    int transientTextures = 0;
+    size_t transientBytes = 0; // the pool, after aliasing
+    size_t unaliasedBytes = 0; // every transient texture of the frame with its own memory
+};
+
+/**
+ * A small frame graph, rebuilt every frame.
+ *
+ * Passes are added in the order they run and declare which resources they read and write. Resources are either
+ * imported (textures/framebuffers someone else owns, like the scene target or the screen) or transient: those only
+ * have a description, and compile() hands them textures from a pool once it knows where each one is first written and
+ * last read. A pooled texture goes back to the pool after its last reader, so passes later in the frame reuse it and
+ * the ping-pong/bloom/occlusion targets don't each keep their own memory around.
+ *
+ * compile() also
+ * - drops copy passes (addCopyPass) into a transient texture nobody else touches: its readers read the source instead,
+ * - culls passes whose writes nobody live reads (framebuffers are the outputs),
+ * - runs a registered fusion (addFusion) in place of two fullscreen passes when both are live, next to each other,
+ *   draw into the same target and the second doesn't read what the first wrote.
+ *
+ * Every pass that runs gets a gpu timestamp before and after, read back a few frames later like GpuQuery does.
+ */
+class RenderGraph {
+public:
+    using Resource = int;
+    using Execute = std::function<void()>;
+    static constexpr Resource NONE = -1;
+
+    enum PassFlags : unsigned {
+        SIDE_EFFECT = 1u << 0, // never culled (writes something outside the graph)
+        COPY = 1u << 1         // set by addCopyPass
+    };
+
+    void cleanup();
+
+    // starts a new frame, everything added last frame is gone (the texture pool stays)
+    void reset();
+
+    Resource importTexture(const std::string& name, GLuint texture, RenderTextureDesc desc);
+    Resource importFramebuffer(const std::string& name, GLuint fbo, int width, int height);
+    Resource createTexture(const std::string& name, RenderTextureDesc desc);
+
+    int addPass(const std::string& name, std::vector<Resource> reads, std::vector<Resource> writes, Execute execute,
+                unsigned flags = 0);
+    // execute copies from into to. dropped when to can be read straight from from
+    int addCopyPass(const std::string& name, Resource from, Resource to, Execute execute);
+    // execute does what first and second do, in one pass
+    void addFusion(int first, int second, const std::string& name, Execute execute);
+
+    void compile();
+    void execute();
+
+    // for the passes while they run
+    GLuint texture(Resource resource) const;
+    const RenderTextureDesc& desc(Resource resource) const;
+    // binds a framebuffer with colour (and depth, if any) attached and sets the viewport to its size
+    void bindFramebuffer(Resource colour, Resource depth = NONE);
+
+    const RenderGraphStats& stats() const { return m_stats; }
+    std::string report() const; // memory + the per pass gpu times, for printFrameStats
+
+private:
+    struct ResourceNode {
+        std::string name;
+        RenderTextureDesc desc;
+        GLuint texture = 0;     // imported, or from the pool after compile()
+        GLuint framebuffer = 0; // imported framebuffers
+        bool imported = false;
+        bool isFramebuffer = false;
+        Resource aliasOf = NONE; // a dropped copy's output, read from its input instead
+        int firstUse = -1;
+        int lastUse = -1;
+    };
+
+    struct PassNode {
+        std::string name;
+        std::vector<Resource> reads;
+        std::vector<Resource> writes;
+        Execute execute;
+        unsigned flags = 0;
+        bool live = false;
+        bool dropped = false; // a copy nobody needs, or the second half of a fusion
+    };
+
+    struct Fusion {
+        int first;
+        int second;
+        std::string name;
+        Execute execute;
+    };
+
+    struct CachedFramebuffer {
+        GLuint fbo = 0;
+        bool used = false; // this frame, the rest are deleted on reset()
+    };
+
+    struct PooledTexture {
+        RenderTextureDesc desc;
+        GLuint texture = 0;
+        bool inUse = false;
+        bool usedThisFrame = false;
+    };
+
+    // GpuQuery style ring, but with one timestamp per pass boundary since the passes change from frame to frame
+    struct FrameTimestamps {
+        std::vector<GLuint> queries;
+        std::vector<std::string> passes;
+        bool issued = false;
+    };
+    static const int TIMESTAMP_FRAMES = 3;
+
+    Resource resolve(Resource resource) const;
+    bool dropCopy(int pass);
+    void cullPasses();
+    void fusePasses();
+    void allocateTransients();
+    GLuint acquire(const RenderTextureDesc& desc);
+    void deleteTexture(GLuint texture);
+    void readTimestamps(FrameTimestamps& frame);
+
+    std::vector<ResourceNode> m_resources;
+    std::vector<PassNode> m_passes;
+    std::vector<Fusion> m_fusions;
+
+    std::vector<PooledTexture> m_pool;
+    // colour, depth, width, height (an imported texture that's recreated at a new size gets a new framebuffer)
+    std::map<std::tuple<GLuint, GLuint, int, int>, CachedFramebuffer> m_framebuffers;
+
+    FrameTimestamps m_timestamps[TIMESTAMP_FRAMES];
+    int m_timestampFrame = 0;
+    std::vector<std::pair<std::string, double>> m_passMs;
+
+    RenderGraphStats m_stats;
+};
@@ -3,17 +3,33 @@
 #include "utils/textureutils.h"
 #include "renderers/lightrenderer.h"
 #include "utils/terraingenerator.h"
+#include "renderers/drawkey.h"
+#include "settings.h"
 #include <glm/gtc/matrix_transform.hpp>
 #include <QImage>
 #include <QString>
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <functional>
 #include <iostream>
+#include <iterator>
+#include <numeric>
+#include <tuple>
 
-void SceneRenderer::initialize(GLuint texture_shader) {
+namespace {
+    // shadow filtering (FrameBlock::shadowParams)
+    const float POISSON_RADIUS = 1.5f;         // texels
+    const float VARIANCE_BLEED_CUTOFF = 0.3f;
+    const float VARIANCE_MIN = 1e-5f;
+
+    const size_t MAX_MOVED_CASTERS = 256; // swept boxes kept apart for the shadow atlas
+}
 
-    m_shader = ShaderLoader::createShaderProgram(
-        ":/resources/shaders/default.vert", 
-        ":/resources/shaders/default.frag"
-    );
+void SceneRenderer::initialize(GLuint texture_shader) {
 
     m_sceneFBO = 0;
     m_sceneTexture = 0;
@@ -23,10 +39,46 @@ void SceneRenderer::initialize(GLuint texture_shader) {
 
     m_defaultFBO = 0;
 
-    m_shader = ShaderLoader::createShaderProgram(":/resources/shaders/default.vert", ":/resources/shaders/default.frag");
+    m_prepass_shader = ShaderLoader::createShaderProgram(":/resources/shaders/prepass.vert", ":/resources/shaders/prepass.frag");
     m_texture_shader = texture_shader;
     m_terrain_shader = ShaderLoader::createShaderProgram(":/resources/shaders/terrain.vert", ":/resources/shaders/terrain.frag");
+    m_loc_terrainProj = glGetUniformLocation(m_terrain_shader, "projMatrix");
+    m_loc_terrainMV = glGetUniformLocation(m_terrain_shader, "mvMatrix");
+    // compiled when a batch first needs them
+    m_forwardVariants.initialize(":/resources/shaders/default.vert", ":/resources/shaders/default.frag", setupProgram);
+    m_gbufferVariants.initialize(":/resources/shaders/default.vert", ":/resources/shaders/gbuffer.frag", setupProgram);
+    m_deferredVariants.initialize(":/resources/shaders/fullscreen.vert", ":/resources/shaders/deferred.frag", setupProgram);
+
+    initializeUniformBlocks();
+    m_scene = std::make_unique<SceneBatches>();
+
+    std::vector<GLfloat> fullscreen_quad_data =
+        { // positions (3), uv coords (2)
+            -1.f,  1.f, 0.0f, 0.0f, 1.0f,
+            -1.f, -1.f, 0.0f, 0.0f, 0.0f,
+            1.f, -1.f, 0.0f, 1.0f, 0.0f,
+            1.f,  1.f, 0.0f, 1.0f, 1.0f,
+            -1.f,  1.f, 0.0f, 0.0f, 1.0f,
+            1.f, -1.f, 0.0f, 1.0f, 0.0f
+        };
+
+    glGenBuffers(1, &m_fullscreen_vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, m_fullscreen_vbo);
+    glBufferData(GL_ARRAY_BUFFER, fullscreen_quad_data.size() * sizeof(GLfloat), fullscreen_quad_data.data(), GL_STATIC_DRAW);
+    glGenVertexArrays(1, &m_fullscreen_vao);
+    glBindVertexArray(m_fullscreen_vao);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), nullptr);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), reinterpret_cast<void*>(3 * sizeof(GLfloat)));
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
 
+    m_prepassTimer.initialize(GL_TIME_ELAPSED);
+    m_colorTimer.initialize(GL_TIME_ELAPSED);
+    m_skyboxTimer.initialize(GL_TIME_ELAPSED);
+    m_lightingTimer.initialize(GL_TIME_ELAPSED);
+    m_colorSamples.initialize(GL_SAMPLES_PASSED);
 
     loadSkybox();
     loadTerrain();
@@ -35,7 +87,36 @@ void SceneRenderer::initialize(GLuint texture_shader) {
 
 void SceneRenderer::cleanup() {
 
-    glDeleteProgram(m_shader);
+    glDeleteProgram(m_prepass_shader);
+    m_forwardVariants.cleanup();
+    m_gbufferVariants.cleanup();
+    m_deferredVariants.cleanup();
+    deleteRetiredScenes();
+    deleteBatchObjects(*m_scene);
+    m_scene = std::make_unique<SceneBatches>();
+    m_occlusion.clear();
+    deleteGBuffer();
+    glDeleteBuffers(1, &m_fullscreen_vbo);
+    glDeleteVertexArrays(1, &m_fullscreen_vao);
+    m_fullscreen_vbo = m_fullscreen_vao = 0;
+
+    m_prepassTimer.cleanup();
+    m_colorTimer.cleanup();
+    m_skyboxTimer.cleanup();
+    m_lightingTimer.cleanup();
+    m_colorSamples.cleanup();
+
+    glDeleteSamplers(1, &m_shadowSampler);
+    m_shadowSampler = 0;
+    glDeleteBuffers(1, &m_frameUBO);
+    glDeleteBuffers(1, &m_lightUBO);
+    glDeleteBuffers(1, &m_atlasUBO);
+    m_frameUBO = m_lightUBO = m_atlasUBO = 0;
+    m_lightsDirty = true;
+    glDeleteTextures(3, m_clusterTextures);
+    glDeleteBuffers(3, m_clusterBuffers);
+    std::fill(std::begin(m_clusterTextures), std::end(m_clusterTextures), 0);
+    std::fill(std::begin(m_clusterBuffers), std::end(m_clusterBuffers), 0);
 
     // deleting scene fbo for cleanup
     if (m_sceneFBO) glDeleteFramebuffers(1, &m_sceneFBO);
@@ -46,10 +127,13 @@ void SceneRenderer::cleanup() {
         glDeleteTextures(1, &pair.second);
     }
     m_textureCache.clear();
+    m_textureBytes = 0;
 }
 
 void SceneRenderer::initializeFBO(int width, int height) {
 
+    // the g-buffer shares the scene colour/depth, it's rebuilt at the new size the next time it's used
+    deleteGBuffer();
     if (m_sceneFBO) glDeleteFramebuffers(1, &m_sceneFBO);
     if (m_sceneTexture) glDeleteTextures(1, &m_sceneTexture);
     if (m_depthTexture) glDeleteTextures(1, &m_depthTexture);
@@ -86,6 +170,91 @@ void SceneRenderer::initializeFBO(int width, int height) {
 
 }
 
+/**
+ * @brief SceneRenderer::initializeGBuffer the deferred targets at the scene fbo's size. the g-buffer fbo renders into
+ * the scene colour and depth too, so terrain/skybox and the ambient term land where the forward path puts them
+ */
+void SceneRenderer::initializeGBuffer() {
+    auto makeTarget = [&](GLuint& texture, GLenum internalFormat, GLenum type) {
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, m_fboWidth, m_fboHeight, 0, GL_RGBA, type, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    };
+    makeTarget(m_gAlbedo, GL_RGBA8, GL_UNSIGNED_BYTE);
+    makeTarget(m_gNormal, GL_RGBA16F, GL_HALF_FLOAT);
+    makeTarget(m_gSpecular, GL_RGBA16F, GL_HALF_FLOAT);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &m_gbufferFBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_gbufferFBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_sceneTexture, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, m_gAlbedo, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, m_gNormal, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT3, GL_TEXTURE_2D, m_gSpecular, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, m_depthTexture, 0);
+    const GLenum drawBuffers[4] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT3};
+    glDrawBuffers(4, drawBuffers);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cout << "G-buffer framebuffer is incomplete" << std::endl;
+    }
+
+    glGenFramebuffers(1, &m_lightingFBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_lightingFBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_sceneTexture, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cout << "Deferred lighting framebuffer is incomplete" << std::endl;
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, m_defaultFBO);
+}
+
+void SceneRenderer::deleteGBuffer() {
+    if (m_gbufferFBO) glDeleteFramebuffers(1, &m_gbufferFBO);
+    if (m_lightingFBO) glDeleteFramebuffers(1, &m_lightingFBO);
+    if (m_gAlbedo) glDeleteTextures(1, &m_gAlbedo);
+    if (m_gNormal) glDeleteTextures(1, &m_gNormal);
+    if (m_gSpecular) glDeleteTextures(1, &m_gSpecular);
+    m_gbufferFBO = m_lightingFBO = m_gAlbedo = m_gNormal = m_gSpecular = 0;
+}
+
+/**
+ * @brief SceneRenderer::shadeDeferred every light (and its shadow lookups) once per covered pixel instead of once per
+ * shaded fragment. added on top of the ambient the g-buffer pass wrote, which clamps the same as the forward shader
+ * as long as the scene colour is rgba8
+ */
+void SceneRenderer::shadeDeferred() {
+    m_lightingTimer.begin();
+    glBindFramebuffer(GL_FRAMEBUFFER, m_lightingFBO);
+    glDisable(GL_DEPTH_TEST);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+
+    // no material bits, the g-buffer already has the maps applied
+    glUseProgram(m_deferredVariants.program(frameFeatures()));
+
+    const GLuint targets[4] = {m_gAlbedo, m_gNormal, m_gSpecular, m_depthTexture};
+    for (int i = 0; i < 4; i++) {
+        glActiveTexture(GL_TEXTURE9 + i);
+        glBindTexture(GL_TEXTURE_2D, targets[i]);
+    }
+    glActiveTexture(GL_TEXTURE0);
+
+    glBindVertexArray(m_fullscreen_vao);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+    glBindVertexArray(0);
+
+    glDisable(GL_BLEND);
+    glEnable(GL_DEPTH_TEST);
+    m_lightingTimer.end();
+
+    // back to the plain scene fbo for the skybox
+    glBindFramebuffer(GL_FRAMEBUFFER, m_sceneFBO);
+}
+
 void SceneRenderer::resize(int width, int height) {
 
     if ( width != m_fboWidth || height != m_fboHeight ) initializeFBO(width, height);
@@ -95,251 +264,755 @@ void SceneRenderer::resize(int width, int height) {
 /**
  * @brief SceneRenderer::render actually renders what's on screen ! called within the render loop. sets up uniforms
  * and draws each shape
- * @param renderData
  * @param camera
  * @param shapeRenderer
  */
-void SceneRenderer::render(const RenderData& renderData, const Camera& camera, ShapeRenderer& shapeRenderer, const Shadow &shadow) {
+void SceneRenderer::render(const Camera& camera, ShapeRenderer& shapeRenderer, const Shadow &shadow) {
 
     if (m_sceneFBO == 0) initializeFBO(800, 600);
 
+    // usually already done by the shadow pass
+    prepareFrame(shapeRenderer);
+    const SceneBatches& scene = *m_scene;
+
+    // frustum cull against the bvh. the occlusion test keeps going on worker threads while the skybox, terrain and
+    // uniforms go out (and the gpu is still busy with the last frame)
+    cullInstances(camera);
+
     // binding scene fbo
     glBindFramebuffer(GL_FRAMEBUFFER, m_sceneFBO);
     glViewport(0, 0, m_fboWidth, m_fboHeight);
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    // draw skybox first while depth is cleared
-    glDisable(GL_CULL_FACE);
-    paintTexture(camera);
-    glEnable(GL_CULL_FACE);
-
     // draw terrain as background (before foreground geometry)
     paintTerrainInternal(camera);
 
-    glm::vec3 cameraPos = camera.getPos();
+    // deferred: from here on the batches also fill the g-buffer. albedo alpha stays 0 where only terrain/sky is
+    const bool deferred = settings.deferredShading;
+    if (deferred) {
+        if (m_gbufferFBO == 0) initializeGBuffer();
+        glBindFramebuffer(GL_FRAMEBUFFER, m_gbufferFBO);
+        const GLfloat zero[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+        for (int i = 1; i <= 3; i++) glClearBufferfv(GL_COLOR, i, zero);
+    }
 
-    glUseProgram(m_shader);
-    setupCameraUniforms(camera, cameraPos);
-    setupLightUniforms(renderData.lights, renderData.globalData);
+    updateLightClusters(camera);
+    setupFrameUniforms(camera, shadow);
     // sends over shadow map (2D texture)
     setupShadowUniform(shadow);
 
-    // for instance rendering, we're grouping all shapes by their type--> meshes have to be handles differently so they're
-    // in their own group !!
-    std::unordered_map<PrimitiveType, std::vector<const RenderShapeData*>> groupedShapes;
+    // compact what's left into each batch's instance buffer
+    resolveVisibility();
+    uploadVisibleInstances(VIEW_MAIN, m_shapeVisible);
+    sortBatchesFrontToBack(camera);
+
+    // depth only, nearest batches first so the far ones get rejected early
+    const bool prepass = settings.depthPrepass;
+    if (prepass) {
+        m_prepassTimer.begin();
+        glUseProgram(m_prepass_shader);
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+
+        for (int b : m_frontToBack) {
+            const InstanceView& view = scene.batches[b].views[VIEW_MAIN];
+            glBindVertexArray(view.vao);
+            glDrawArraysInstanced(GL_TRIANGLES, 0, view.vertexCount, view.visible.size());
+        }
+
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        m_prepassTimer.end();
 
-    std::unordered_map<std::string, std::vector<const RenderShapeData*>> groupedMeshes;
+        // only the fragment that won the pre-pass gets shaded
+        glDepthFunc(GL_EQUAL);
+        glDepthMask(GL_FALSE);
+    }
 
+    m_colorTimer.begin();
+    m_colorSamples.begin();
+
+    // each batch gets the variant for its maps + this frame's lighting. batches are in key order (variant, then
+    // texture set), so in that order a program switch only happens when the maps change
+    ShaderVariants& variants = deferred ? m_gbufferVariants : m_forwardVariants;
+    const uint32_t features = frameFeatures();
+    GLuint boundProgram = 0;
+    m_programBinds = 0;
+
+    // with the pre-pass depth is already resolved, so go in texture set order and only rebind textures when the set
+    // changes. without it front to back is what saves the shading
+    auto drawShaded = [&](const InstanceBatch& batch, int& boundTextureSet) {
+        const InstanceView& view = batch.views[VIEW_MAIN];
+        GLuint program = variants.program(batch.variant | features);
+        if (program != boundProgram) {
+            glUseProgram(program);
+            boundProgram = program;
+            m_programBinds++;
+        }
+        glBindVertexArray(view.vao);
 
-    for (const auto& shape : renderData.shapes) {
-        if (shape.primitive.type == PrimitiveType::PRIMITIVE_MESH) {
-            // gruop meshes by their file path
-            groupedMeshes[shape.primitive.meshfile].push_back(&shape);
-        } else {
-            groupedShapes[shape.primitive.type].push_back(&shape);
+        if (batch.textureSet != boundTextureSet) {
+            setupTextureUniforms(scene.textureSets[batch.textureSet], batch.textureSet);
+            boundTextureSet = batch.textureSet;
+        }
+
+        glDrawArraysInstanced(GL_TRIANGLES, 0, view.vertexCount, view.visible.size());
+    };
+
+    int boundTextureSet = -1;
+    if (prepass) {
+        for (const InstanceBatch& batch : scene.batches) {
+            if (!batch.views[VIEW_MAIN].visible.empty()) drawShaded(batch, boundTextureSet);
         }
+    } else {
+        for (int b : m_frontToBack) drawShaded(scene.batches[b], boundTextureSet);
+    }
+    glBindVertexArray(0);
+
+    m_colorSamples.end();
+    m_colorTimer.end();
+
+    if (deferred) shadeDeferred();
+    glBindSampler(0, 0); // the skybox uses unit 0 too
+    glBindSampler(5, 0);
+
+    if (prepass) {
+        glDepthFunc(GL_LESS);
+        glDepthMask(GL_TRUE);
+    }
+
+    // skybox last, at the far plane, so it only covers what nothing else drew over
+    m_skyboxTimer.begin();
+    glDisable(GL_CULL_FACE);
+    paintTexture(camera);
+    glEnable(GL_CULL_FACE);
+    m_skyboxTimer.end();
+
+    glUseProgram(0);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_defaultFBO);
+
+}
+
+/**
+ * @brief SceneRenderer::prepareFrame a scene's batches, instance buffers and light block are made before it's swapped
+ * in (planBatches on the loader thread, createBatchObjects over a few frames) and only handed around after that
+ * (swapScene). what's left here: the light block of a scene that was just swapped in, vaos that went stale, and
+ * refitting the bvh after markShapesDirty moved things
+ */
+void SceneRenderer::prepareFrame(ShapeRenderer& shapeRenderer) {
+    deleteRetiredScenes();
+
+    SceneBatches& scene = *m_scene;
+    createBatchObjects(scene, shapeRenderer); // nothing to do unless they went stale
+
+    if (m_lightsDirty) {
+        glBindBuffer(GL_UNIFORM_BUFFER, m_lightUBO);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(LightBlock), &scene.lightBlock);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        m_sceneLightCount = scene.lightBlock.lightInfo.x;
+        m_lightsDirty = false;
+    }
+
+    if (scene.boundsDirty) {
+        scene.bvh.refit(scene.worldBounds);
+        scene.boundsDirty = false;
+    }
+}
+
+/**
+ * @brief SceneRenderer::drawShadowCasters the light's ortho frustum goes through the same bvh as the camera's, the
+ * casters of the layer inside it get compacted into each batch's view for that layer and every batch is one instanced
+ * draw. no occlusion test here, something hidden from the camera can still throw a shadow onto something that isn't
+ */
+void SceneRenderer::drawShadowCasters(ShapeRenderer& shapeRenderer, const glm::mat4& cullMatrix, InstanceViewType layer) {
+    prepareFrame(shapeRenderer);
+    const SceneBatches& scene = *m_scene;
+
+    m_shadowCasters.clear();
+    scene.bvh.query(Frustum::fromMatrix(cullMatrix), m_shadowCasters, &m_shadowCullStats);
+
+    const unsigned char dynamic = layer == VIEW_SHADOW_DYNAMIC;
+    m_shadowVisible.assign(scene.shapeSlots.size(), 0);
+    for (int shape : m_shadowCasters) m_shadowVisible[shape] = scene.shapeDynamic[shape] == dynamic;
+    uploadVisibleInstances(layer, m_shadowVisible);
+
+    for (const InstanceBatch& batch : scene.batches) {
+        const InstanceView& view = batch.views[layer];
+        if (view.visible.empty()) continue;
+        glBindVertexArray(view.vao);
+        glDrawArraysInstanced(GL_TRIANGLES, 0, view.vertexCount, view.visible.size());
     }
+    glBindVertexArray(0);
+}
+
+InstanceData SceneRenderer::makeInstanceData(const DrawnShape& draw) {
+    const SceneMaterial& info = draw.shape->material;
 
-    // rendering each primitive by group instead of individually
-    for (const auto& [type, shapes] : groupedShapes) {
+    // unused maps don't have their repeats filled in
+    auto repeat = [](const SceneFileMap& map) {
+        return map.isUsed ? glm::vec2(map.repeatU, map.repeatV) : glm::vec2(1.0f);
+    };
 
-        if (shapes.empty()) continue;
+    return InstanceData{draw.ctm, info.cAmbient, info.cDiffuse, info.cSpecular, info.shininess,
+                        glm::vec4(repeat(info.textureMap), repeat(info.bumpMap)), repeat(info.normalMap)};
+}
 
-        // collecting per-instance data
-        std::vector<glm::mat4> modelMatricies;
-        std::vector<glm::mat4> normalMatricies;
-        std::vector<glm::vec3> ambients, diffuses, speculars;
-        std::vector<float> shininesses;
+/**
+ * @brief SceneRenderer::swapScene the occluders go to the culler with the scene, and the shadow caches are told
+ * everything changed. the outgoing scene keeps its batches, instance buffers, bvh and light block as they are
+ */
+std::unique_ptr<SceneBatches> SceneRenderer::swapScene(std::unique_ptr<SceneBatches> scene) {
+    m_scene->occluders = m_occlusion.takeOccluders();
+    m_occlusion.setOccluders(std::move(scene->occluders));
+    std::swap(m_scene, scene);
+
+    m_lightsDirty = true;
+    m_movedCasters.clear();
+    m_staticCasterVersion++;
+    m_dynamicCasterVersion++;
+    return scene;
+}
 
-        // assuming all shapes have the same texture, we can use the first shape
-        // for the texture info.
-        const RenderShapeData* materialInfo = shapes[0];
+void SceneRenderer::retireScene(std::unique_ptr<SceneBatches> scene) {
+    if (scene) m_retiredScenes.push_back(std::move(scene));
+}
+
+void SceneRenderer::deleteRetiredScenes() {
+    for (std::unique_ptr<SceneBatches>& scene : m_retiredScenes) deleteBatchObjects(*scene);
+    m_retiredScenes.clear();
+}
 
-        for (const auto* shape : shapes) {
+size_t SceneRenderer::batchBytes(const SceneBatches& scene) const {
+    size_t instances = 0;
+    for (const InstanceBatch& batch : scene.batches) instances += batch.instances.size();
+    return instances * VIEW_COUNT * sizeof(InstanceData) + scene.materialBlocks.size() * m_materialStride;
+}
 
-            auto info = shape->material;
+/**
+ * @brief SceneRenderer::planBatches the cpu side of a scene's batches. every drawn shape (plain shapes and each
+ * instance's template shapes) gets a draw key (texture set, geometry, distance from the scene camera), they're radix
+ * sorted and each unique key becomes one batch. also the bounds + bvh, the occluders and the light block
+ * @param renderData
+ * @param meshes bounds + positions of the meshes, by file
+ * @param farPlane for the depth buckets of the keys
+ */
+std::unique_ptr<SceneBatches> SceneRenderer::planBatches(const RenderData& renderData,
+                                                         const std::map<std::string, MeshCPUData>& meshes, float farPlane) {
+    auto scene = std::make_unique<SceneBatches>();
+
+    // instanced shapes only exist as (instance, template shape) until here. animated ones are where the bindings say
+    std::vector<DrawnShape> draws(renderData.drawCount);
+    forEachDrawnShape(renderData, [&](int index, const RenderShapeData& shape, const glm::mat4& ctm) {
+        draws[index] = {&shape, ctm};
+    });
+    for (int b = 0; b < renderData.animation.bindingCount(); b++) {
+        draws[renderData.animation.boundShape(b)].ctm = renderData.animation.boundCTM(b);
+    }
 
-            modelMatricies.push_back(shape->ctm);
-            ambients.push_back(info.cAmbient);
-            diffuses.push_back(info.cDiffuse);
-            speculars.push_back(info.cSpecular);
-            shininesses.push_back(info.shininess);
+    // geometry ids: the 4 primitive types, then one per mesh file
+    const int firstMeshId = static_cast<int>(PrimitiveType::PRIMITIVE_MESH);
+    std::map<std::string, int> meshIds;
+    for (const DrawnShape& draw : draws) {
+        if (draw.shape->primitive.type == PrimitiveType::PRIMITIVE_MESH) meshIds.emplace(draw.shape->primitive.meshfile, 0);
+    }
+    for (auto& [meshfile, id] : meshIds) {
+        id = firstMeshId + static_cast<int>(scene->meshFiles.size());
+        scene->meshFiles.push_back(meshfile);
+    }
 
+    // texture sets: everything setupTextureUniforms binds or sets as a uniform. uv repeats are per instance
+    using TextureSetKey = std::tuple<std::string, std::string, std::string, float, float, float>;
+    std::map<TextureSetKey, int> textureSets;
+    auto textureSetOf = [&](const SceneMaterial& mat) {
+        TextureSetKey key{mat.textureMap.isUsed ? mat.textureMap.filename : "",
+                          mat.bumpMap.isUsed ? mat.bumpMap.filename : "",
+                          mat.normalMap.isUsed ? mat.normalMap.filename : "",
+                          mat.textureMap.isUsed ? mat.blend : 0.f,
+                          mat.bumpMap.isUsed ? mat.bumpMap.strength : 0.f,
+                          mat.normalMap.isUsed ? mat.normalMap.strength : 0.f};
+        auto [it, added] = textureSets.emplace(key, static_cast<int>(textureSets.size()));
+        if (added) {
+            scene->textureSets.push_back(mat);
+            scene->materialBlocks.push_back({glm::ivec4(mat.textureMap.isUsed, mat.bumpMap.isUsed, mat.normalMap.isUsed, 0),
+                                             glm::vec4(std::get<3>(key), std::get<4>(key), std::get<5>(key), 0.f)});
         }
+        return it->second;
+    };
 
-        GLPrimitiveData primitiveData = shapeRenderer.getPrimitiveData(type);
-        glBindVertexArray(primitiveData.vao);
+    glm::vec3 eye = glm::vec3(renderData.cameraData.pos);
 
-        // now we're uploading the instace data :)
-        glBindBuffer(GL_ARRAY_BUFFER, primitiveData.instanceVBO);
+    std::vector<DrawItem> items;
+    items.reserve(draws.size());
+    for (int i = 0; i < static_cast<int>(draws.size()); i++) {
+        const RenderShapeData& shape = *draws[i].shape;
 
-        size_t matrixSize = modelMatricies.size() * sizeof(glm::mat4);
-        size_t vec3Size = ambients.size() * sizeof(glm::vec3);
-        size_t floatSize = shininesses.size() * sizeof(float);
-        size_t totalSize = matrixSize + (vec3Size * 3) + floatSize;
+        int geometry = shape.primitive.type == PrimitiveType::PRIMITIVE_MESH
+                     ? meshIds[shape.primitive.meshfile] : static_cast<int>(shape.primitive.type);
+        float distance = glm::length(glm::vec3(draws[i].ctm[3]) - eye);
 
-        glBufferData(GL_ARRAY_BUFFER, totalSize, nullptr, GL_DYNAMIC_DRAW);
+        // which maps the shader variant has compiled in
+        const SceneMaterial& mat = shape.material;
+        int variant = (mat.textureMap.isUsed ? ShaderFeature::TEXTURE_MAP : 0) |
+                      (mat.bumpMap.isUsed ? ShaderFeature::BUMP_MAP : 0) |
+                      (mat.normalMap.isUsed ? ShaderFeature::NORMAL_MAP : 0);
 
-        size_t offset = 0;
-        glBufferSubData(GL_ARRAY_BUFFER, offset, matrixSize, modelMatricies.data());
-        offset += matrixSize;
+        items.push_back({DrawKey::make(DrawKey::PASS_OPAQUE, variant, textureSetOf(mat), geometry,
+                                       DrawKey::depthBucket(distance, farPlane)), i});
+    }
+    DrawKey::radixSort(items);
+
+    scene->shapeSlots.assign(draws.size(), {-1, -1});
+
+    // primitives are all unit shapes, meshes get their own bounds below
+    AABB unitBox;
+    unitBox.min = glm::vec3(-0.5f);
+    unitBox.max = glm::vec3(0.5f);
+    scene->localBounds.assign(draws.size(), unitBox);
+
+    for (size_t first = 0; first < items.size();) {
+        uint64_t batchBits = DrawKey::batchBits(items[first].key);
+        InstanceBatch batch;
+        size_t last = first;
+        while (last < items.size() && DrawKey::batchBits(items[last].key) == batchBits) {
+            batch.shapes.push_back(items[last].shape);
+            last++;
+        }
+        first = last;
+
+        batch.textureSet = DrawKey::textureSet(batchBits);
+        batch.variant = DrawKey::variant(batchBits);
+        batch.geometry = DrawKey::geometry(batchBits);
+        if (batch.geometry >= firstMeshId) {
+            const std::string& meshfile = scene->meshFiles[batch.geometry - firstMeshId];
+            auto mesh = meshes.find(meshfile);
+            if (mesh == meshes.end() || !mesh->second.positions) {
+                std::cerr << "Failed to load mesh: " << meshfile << std::endl;
+                continue;
+            }
+            AABB meshBox;
+            meshBox.min = mesh->second.boundsMin;
+            meshBox.max = mesh->second.boundsMax;
+            for (int shape : batch.shapes) scene->localBounds[shape] = meshBox;
+        } else {
+            batch.leaves = std::all_of(batch.shapes.begin(), batch.shapes.end(), [&](int shape) {
+                return draws[shape].shape->role == ShapeRole::LEAF;
+            });
+        }
+
+        batch.instances.reserve(batch.shapes.size());
+        for (int slot = 0; slot < static_cast<int>(batch.shapes.size()); slot++) {
+            batch.instances.push_back(makeInstanceData(draws[batch.shapes[slot]]));
+            scene->shapeSlots[batch.shapes[slot]] = {static_cast<int>(scene->batches.size()), slot};
+        }
+        scene->batches.push_back(std::move(batch));
+    }
 
-        glBufferSubData(GL_ARRAY_BUFFER, offset, vec3Size, ambients.data());
-        offset += vec3Size;
+    scene->worldBounds.resize(draws.size());
+    for (size_t i = 0; i < draws.size(); i++) {
+        scene->worldBounds[i] = AABB::transformed(scene->localBounds[i], draws[i].ctm);
+    }
+    scene->bvh.build(scene->worldBounds);
+    collectOccluders(*scene, draws, meshes);
 
-        glBufferSubData(GL_ARRAY_BUFFER, offset, vec3Size, diffuses.data());
-        offset += vec3Size;
+    scene->shapeDynamic.assign(draws.size(), 0);
+    for (int b = 0; b < renderData.animation.bindingCount(); b++) {
+        scene->shapeDynamic[renderData.animation.boundShape(b)] = 1;
+    }
+    scene->dynamicShapeCount = static_cast<int>(std::count(scene->shapeDynamic.begin(), scene->shapeDynamic.end(), 1));
+    scene->animated = !renderData.animation.empty();
 
-        glBufferSubData(GL_ARRAY_BUFFER, offset, vec3Size, speculars.data());
-        offset += vec3Size;
+    scene->lightBlock = makeLightBlock(renderData.lights, renderData.globalData);
+    return scene;
+}
 
-        glBufferSubData(GL_ARRAY_BUFFER, offset, floatSize, shininesses.data());
+/**
+ * @brief SceneRenderer::createBatchObjects the material ubo, then the views of one batch after the other until the
+ * budget is used up, the next call picks up where this one stopped. views made for the old primitive buffers or the
+ * other leaf proxy setting are thrown away first, the instance data is still there to make them again
+ */
+bool SceneRenderer::createBatchObjects(SceneBatches& scene, ShapeRenderer& shapeRenderer, qint64 budgetNs) {
+    if (scene.stale || (scene.materialUBO && scene.leafProxies != settings.shadowLeafProxies)) {
+        deleteBatchObjects(scene);
+    }
+    const int batchCount = static_cast<int>(scene.batches.size());
+    if (scene.materialUBO && scene.createdBatches == batchCount) return true;
 
-        offset = 0;
+    auto start = std::chrono::steady_clock::now();
 
-        // passing model matrix
-        for (int i = 0; i < 4; i++) {
+    if (!scene.materialUBO) {
+        // all texture sets in one buffer, each one padded to the offset alignment so a batch can bind just its range
+        std::vector<unsigned char> materialData(scene.materialBlocks.size() * m_materialStride);
+        for (size_t i = 0; i < scene.materialBlocks.size(); i++) {
+            std::memcpy(materialData.data() + i * m_materialStride, &scene.materialBlocks[i], sizeof(MaterialBlock));
+        }
+        glGenBuffers(1, &scene.materialUBO);
+        glBindBuffer(GL_UNIFORM_BUFFER, scene.materialUBO);
+        glBufferData(GL_UNIFORM_BUFFER, materialData.size(), materialData.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        scene.leafProxies = settings.shadowLeafProxies;
+        scene.stale = false;
+    }
 
-            glEnableVertexAttribArray(5 + i);
-            glVertexAttribPointer(5 + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
-                                 (void*)(offset + i * sizeof(glm::vec4)));
-            glVertexAttribDivisor(5 + i, 1);
+    // animated scenes rewrite parts of their instance buffers, everything else is written once
+    const GLenum usage = scene.animated ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW;
+    const int firstMeshId = static_cast<int>(PrimitiveType::PRIMITIVE_MESH);
 
+    while (scene.createdBatches < batchCount) {
+        InstanceBatch& batch = scene.batches[scene.createdBatches];
+        if (batch.geometry >= firstMeshId) {
+            MeshGLData meshData = shapeRenderer.getMeshData(scene.meshFiles[batch.geometry - firstMeshId]);
+            createBatchViews(batch, meshData.vbo, meshData.vertexCount, meshData.vbo, meshData.vertexCount, usage);
+        } else {
+            PrimitiveType type = static_cast<PrimitiveType>(batch.geometry);
+            GLPrimitiveData primitiveData = shapeRenderer.getPrimitiveData(type);
+
+            // leaves are small and there are a lot of them, nobody can tell their shadow is a 4 sided cone
+            GLPrimitiveData shadowData = batch.leaves && settings.shadowLeafProxies
+                                       ? shapeRenderer.getShadowProxyData(type) : primitiveData;
+            createBatchViews(batch, primitiveData.vbo, primitiveData.vertexCount, shadowData.vbo, shadowData.vertexCount,
+                             usage);
         }
+        scene.createdBatches++;
 
-        offset += matrixSize;
+        if (std::chrono::steady_clock::now() - start > std::chrono::nanoseconds(budgetNs)) break;
+    }
 
-        // ambient
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return scene.createdBatches == batchCount;
+}
+
+/**
+ * @brief SceneRenderer::createBatchViews uploads the instance data of one batch and records the vertex and instance
+ * attributes of each view in its vao. the shadow views only get what depth.vert reads (position + model matrix)
+ */
+void SceneRenderer::createBatchViews(InstanceBatch& batch, GLuint vertexVBO, int vertexCount, GLuint shadowVBO,
+                                     int shadowVertexCount, GLenum usage) {
+    const std::vector<InstanceData>& instances = batch.instances;
+
+    for (int v = 0; v < VIEW_COUNT; v++) {
+        InstanceView& view = batch.views[v];
+        const bool main = v == VIEW_MAIN;
+        view.vertexCount = main ? vertexCount : shadowVertexCount;
+        view.visible.resize(instances.size());
+        std::iota(view.visible.begin(), view.visible.end(), 0); // everything is uploaded to start with
+        view.dirtyFirst = 1;
+        view.dirtyLast = 0;
+
+        glGenVertexArrays(1, &view.vao);
+        glBindVertexArray(view.vao);
+
+        // per vertex, same layout as ShapeRenderer / MeshLoader
+        glBindBuffer(GL_ARRAY_BUFFER, main ? vertexVBO : shadowVBO);
+        glEnableVertexAttribArray(0); //position
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 14 * sizeof(GLfloat), reinterpret_cast<void*>(0));
+        if (main) {
+            glEnableVertexAttribArray(1); //normal
+            glEnableVertexAttribArray(2); // uv coordinates
+            glEnableVertexAttribArray(3); // tangent
+            glEnableVertexAttribArray(4); // bitangent
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 14 * sizeof(GLfloat), reinterpret_cast<void*>(3 * sizeof(GLfloat)));
+            glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 14 * sizeof(GLfloat), reinterpret_cast<void*>(6 * sizeof(GLfloat)));
+            glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 14 * sizeof(GLfloat), reinterpret_cast<void*>(8 * sizeof(GLfloat)));
+            glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, 14 * sizeof(GLfloat), reinterpret_cast<void*>(11 * sizeof(GLfloat)));
+        }
+
+        // per instance
+        glGenBuffers(1, &view.instanceVBO);
+        glBindBuffer(GL_ARRAY_BUFFER, view.instanceVBO);
+        glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(InstanceData), instances.data(), usage);
+
+        // model matrix
+        for (int i = 0; i < 4; i++) {
+            glEnableVertexAttribArray(5 + i);
+            glVertexAttribPointer(5 + i, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                                  reinterpret_cast<void*>(offsetof(InstanceData, model) + i * sizeof(glm::vec4)));
+            glVertexAttribDivisor(5 + i, 1);
+        }
+        if (!main) continue;
+
+        // ambient, diffuse, specular, shininess
         glEnableVertexAttribArray(9);
-        glVertexAttribPointer(9, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)offset);
+        glVertexAttribPointer(9, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData), reinterpret_cast<void*>(offsetof(InstanceData, ambient)));
         glVertexAttribDivisor(9, 1);
-        offset += vec3Size;
 
-        // diffuse
         glEnableVertexAttribArray(10);
-        glVertexAttribPointer(10, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)offset);
+        glVertexAttribPointer(10, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData), reinterpret_cast<void*>(offsetof(InstanceData, diffuse)));
         glVertexAttribDivisor(10, 1);
-        offset += vec3Size;
 
-        // specular
         glEnableVertexAttribArray(11);
-        glVertexAttribPointer(11, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)offset);
+        glVertexAttribPointer(11, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData), reinterpret_cast<void*>(offsetof(InstanceData, specular)));
         glVertexAttribDivisor(11, 1);
-        offset += vec3Size;
 
-        // shininess
         glEnableVertexAttribArray(12);
-        glVertexAttribPointer(12, 1, GL_FLOAT, GL_FALSE, sizeof(float), (void*)offset);
+        glVertexAttribPointer(12, 1, GL_FLOAT, GL_FALSE, sizeof(InstanceData), reinterpret_cast<void*>(offsetof(InstanceData, shininess)));
         glVertexAttribDivisor(12, 1);
-        offset += vec3Size;
 
-        // setting up textures fo this batch
-        setupTextureUniforms(materialInfo->material);
+        // uv repeats
+        glEnableVertexAttribArray(13);
+        glVertexAttribPointer(13, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), reinterpret_cast<void*>(offsetof(InstanceData, uvRepeat)));
+        glVertexAttribDivisor(13, 1);
 
-        glDrawArraysInstanced(GL_TRIANGLES, 0, primitiveData.vertexCount, shapes.size());
-        glBindVertexArray(0);
+        glEnableVertexAttribArray(14);
+        glVertexAttribPointer(14, 2, GL_FLOAT, GL_FALSE, sizeof(InstanceData), reinterpret_cast<void*>(offsetof(InstanceData, normalUVRepeat)));
+        glVertexAttribDivisor(14, 1);
+    }
+}
 
+/**
+ * @brief SceneRenderer::markShapesDirty refreshes the cpu copy + world bounds of the moved shapes right away and marks
+ * their slots dirty in every view. each view uploads them with its visible ones, the bvh gets refit in prepareFrame.
+ * the ctm comes from the binding, instanced shapes don't have a RenderShapeData to read it from
+ */
+void SceneRenderer::markShapesDirty(const TransformHierarchy& animation) {
+    SceneBatches& scene = *m_scene;
+
+    for (int b : animation.dirtyBindings()) {
+        const int i = animation.boundShape(b);
+        if (i >= static_cast<int>(scene.shapeSlots.size())) continue;
+        auto [batchIndex, slot] = scene.shapeSlots[i];
+        if (batchIndex < 0) continue;
+
+        const glm::mat4& ctm = animation.boundCTM(b);
+        InstanceBatch& batch = scene.batches[batchIndex];
+        batch.instances[slot].model = ctm;
+        AABB swept = scene.worldBounds[i];
+        scene.worldBounds[i] = AABB::transformed(scene.localBounds[i], ctm);
+        swept.grow(scene.worldBounds[i]);
+        scene.boundsDirty = true;
+
+        // past a few hundred it's cheaper to test one box around all of them
+        if (m_movedCasters.size() >= MAX_MOVED_CASTERS) {
+            AABB all;
+            for (const AABB& box : m_movedCasters) all.grow(box);
+            m_movedCasters.assign(1, all);
+        }
+        m_movedCasters.push_back(swept);
+        m_dynamicCasterVersion++;
+
+        for (InstanceView& view : batch.views) {
+            if (view.dirtyFirst > view.dirtyLast) {
+                view.dirtyFirst = view.dirtyLast = slot;
+            } else {
+                view.dirtyFirst = std::min(view.dirtyFirst, slot);
+                view.dirtyLast = std::max(view.dirtyLast, slot);
+            }
+        }
     }
+}
 
-    //rendering meshes !!!!
-    for (const auto& [meshfile, shapes] : groupedMeshes) {
+/**
+ * @brief SceneRenderer::collectOccluders picks what gets rasterized by the occlusion culler: meshes that are big compared
+ * to the whole scene (the cliff) with their real triangles, and a box inside each of the thickest stems as a stand in
+ * for the trunk. the box has to fit inside the stem or it would hide things the stem doesn't
+ */
+void SceneRenderer::collectOccluders(SceneBatches& scene, const std::vector<DrawnShape>& draws,
+                                     const std::map<std::string, MeshCPUData>& meshes) {
+    const float MESH_SCENE_FRACTION = 0.125f;
+    const size_t MAX_TRUNK_PROXIES = 256;
 
-        if (shapes.empty()) continue;
+    AABB sceneBox;
+    for (const AABB& box : scene.worldBounds) sceneBox.grow(box);
+    const float sceneSize = sceneBox.empty() ? 0.f : glm::length(sceneBox.max - sceneBox.min);
 
-        MeshGLData meshData = shapeRenderer.getMeshData(meshfile);
+    std::vector<glm::vec3> triangles;
+    std::vector<std::pair<float, int>> stems; // radius, shape
 
-        if (meshData.vertexCount == 0) {
-            std::cerr << "Failed to load mesh: " << meshfile << std::endl;
-            continue;
+    for (int i = 0; i < static_cast<int>(draws.size()); i++) {
+        const RenderShapeData& shape = *draws[i].shape;
+        const glm::mat4& ctm = draws[i].ctm;
+
+        if (shape.primitive.type == PrimitiveType::PRIMITIVE_MESH) {
+            const AABB& box = scene.worldBounds[i];
+            if (glm::length(box.max - box.min) < sceneSize * MESH_SCENE_FRACTION) continue;
+
+            auto mesh = meshes.find(shape.primitive.meshfile);
+            if (mesh == meshes.end() || !mesh->second.positions) continue;
+            for (const glm::vec3& p : *mesh->second.positions) triangles.push_back(glm::vec3(ctm * glm::vec4(p, 1.0f)));
+
+        } else if (shape.role == ShapeRole::STEM && (shape.primitive.type == PrimitiveType::PRIMITIVE_CYLINDER ||
+                                                     shape.primitive.type == PrimitiveType::PRIMITIVE_CUBE)) {
+            float radius = 0.5f * std::min(glm::length(glm::vec3(ctm[0])), glm::length(glm::vec3(ctm[2])));
+            stems.push_back({radius, i});
         }
+    }
 
-        std::vector<glm::mat4> modelMatrices;
-        std::vector<glm::vec3> ambients, diffuses, speculars;
-        std::vector<float> shininesses;
+    std::sort(stems.begin(), stems.end(), std::greater<>());
+    if (stems.size() > MAX_TRUNK_PROXIES) stems.resize(MAX_TRUNK_PROXIES);
 
-        const RenderShapeData* materialInfo = shapes[0];
+    // square inside the unit cylinder's circle (0.5 / sqrt 2), full height
+    const float r = 0.35f;
+    const glm::vec3 corners[8] = {{-r, -0.5f, -r}, {r, -0.5f, -r}, {r, -0.5f, r}, {-r, -0.5f, r},
+                                  {-r, 0.5f, -r}, {r, 0.5f, -r}, {r, 0.5f, r}, {-r, 0.5f, r}};
+    const int faces[6][4] = {{0, 1, 2, 3}, {4, 7, 6, 5}, {0, 4, 5, 1}, {1, 5, 6, 2}, {2, 6, 7, 3}, {3, 7, 4, 0}};
 
-        for (const auto* shape : shapes) {
-            auto info = shape->material;
-            modelMatrices.push_back(shape->ctm);
-            ambients.push_back(info.cAmbient);
-            diffuses.push_back(info.cDiffuse);
-            speculars.push_back(info.cSpecular);
-            shininesses.push_back(info.shininess);
+    for (const auto& [radius, shape] : stems) {
+        const glm::mat4& ctm = draws[shape].ctm;
+        glm::vec3 world[8];
+        for (int c = 0; c < 8; c++) world[c] = glm::vec3(ctm * glm::vec4(corners[c], 1.0f));
+
+        for (const auto& face : faces) {
+            triangles.insert(triangles.end(), {world[face[0]], world[face[1]], world[face[2]]});
+            triangles.insert(triangles.end(), {world[face[0]], world[face[2]], world[face[3]]});
         }
+    }
 
-        glBindVertexArray(meshData.vao);
-        glBindBuffer(GL_ARRAY_BUFFER, meshData.instanceVBO);
+    scene.occluders = std::move(triangles);
+}
 
-        size_t matrixSize = modelMatrices.size() * sizeof(glm::mat4);
-        size_t vec3Size = ambients.size() * sizeof(glm::vec3);
-        size_t floatSize = shininesses.size() * sizeof(float);
-        size_t totalSize = matrixSize + (vec3Size * 3) + floatSize;
+void SceneRenderer::cullInstances(const Camera& camera) {
+    const SceneBatches& scene = *m_scene;
+    const int shapeCount = static_cast<int>(scene.shapeSlots.size());
+    const glm::mat4 viewProj = camera.getProjMatrix() * camera.getViewMatrix();
+
+    m_visibleShapes.clear();
+    if (settings.frustumCulling) {
+        scene.bvh.query(Frustum::fromMatrix(viewProj), m_visibleShapes, &m_cullStats);
+    } else {
+        m_visibleShapes.resize(shapeCount);
+        std::iota(m_visibleShapes.begin(), m_visibleShapes.end(), 0);
+        m_cullStats = CullStats();
+        m_cullStats.instances = m_cullStats.visible = shapeCount;
+    }
+
+    m_occlusionStats = OcclusionStats();
+    if (settings.occlusionCulling && !m_occlusion.empty()) {
+        m_occlusion.begin(viewProj, scene.worldBounds, m_visibleShapes);
+    }
+}
 
-        glBufferData(GL_ARRAY_BUFFER, totalSize, nullptr, GL_DYNAMIC_DRAW);
+/**
+ * @brief SceneRenderer::sortBatchesFrontToBack orders the batches with anything visible by the distance to their
+ * nearest visible instance. distances are bucketed coarsely and the sort is stable, so batches at about the same
+ * distance stay in texture set order
+ * @param camera
+ */
+void SceneRenderer::sortBatchesFrontToBack(const Camera& camera) {
+    const glm::vec3 eye = camera.getPos();
+
+    std::vector<std::pair<uint32_t, int>> order;
+    const SceneBatches& scene = *m_scene;
+    for (int b = 0; b < static_cast<int>(scene.batches.size()); b++) {
+        const InstanceBatch& batch = scene.batches[b];
+        const std::vector<int>& visible = batch.views[VIEW_MAIN].visible;
+        if (visible.empty()) continue;
+
+        float nearest = FLT_MAX;
+        for (int slot : visible) {
+            const AABB& box = scene.worldBounds[batch.shapes[slot]];
+            nearest = std::min(nearest, glm::length(glm::clamp(eye, box.min, box.max) - eye));
+        }
+        order.push_back({DrawKey::depthBucket(nearest, settings.farPlane) >> 10, b});
+    }
 
-        size_t offset = 0;
-        glBufferSubData(GL_ARRAY_BUFFER, offset, matrixSize, modelMatrices.data());
-        offset += matrixSize;
+    std::stable_sort(order.begin(), order.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
 
-        glBufferSubData(GL_ARRAY_BUFFER, offset, vec3Size, ambients.data());
-        offset += vec3Size;
+    m_frontToBack.clear();
+    for (const auto& [bucket, b] : order) m_frontToBack.push_back(b);
+}
 
-        glBufferSubData(GL_ARRAY_BUFFER, offset, vec3Size, diffuses.data());
-        offset += vec3Size;
+PassTimings SceneRenderer::passTimings() const {
+    PassTimings timings;
+    timings.prepassMs = settings.depthPrepass ? m_prepassTimer.ms() : 0.0;
+    timings.colorMs = m_colorTimer.ms();
+    timings.lightingMs = settings.deferredShading ? m_lightingTimer.ms() : 0.0;
+    timings.skyboxMs = m_skyboxTimer.ms();
+    timings.colorSamples = m_colorSamples.result();
+    return timings;
+}
 
-        glBufferSubData(GL_ARRAY_BUFFER, offset, vec3Size, speculars.data());
-        offset += vec3Size;
+std::string SceneRenderer::frameStatsReport() const {
+    PassTimings timings = passTimings();
+
+    const ClusterStats& clusters = m_clusters.stats();
+    const int clusterLights = static_cast<int>(m_clusterLights.size());
+
+    char buf[768];
+    snprintf(buf, sizeof(buf),
+             "culling: %d/%d visible (frustum %.2f ms, %d occluded %.2f ms), %d shadow casters (%.2f ms) | "
+             "clusters: %d lights, %d refs, max %d per cluster (%.2f ms) | "
+             "shaders: %d variants (%.1f ms compiling), %d program binds | "
+             "gpu (%s): pre-pass %.2f ms, shaded %.2f ms (%llu fragments), lighting %.2f ms, skybox %.2f ms",
+             m_occlusionStats.tested > 0 ? m_cullStats.visible - m_occlusionStats.occluded : m_cullStats.visible,
+             m_cullStats.instances, m_cullStats.cullMs, m_occlusionStats.occluded,
+             m_occlusionStats.rasterMs + m_occlusionStats.testMs, m_shadowCullStats.visible, m_shadowCullStats.cullMs,
+             clusterLights, clusterLights ? clusters.indices : 0, clusterLights ? clusters.maxPerCluster : 0,
+             clusterLights ? clusters.buildMs : 0.0,
+             m_forwardVariants.compiledCount() + m_gbufferVariants.compiledCount() + m_deferredVariants.compiledCount(),
+             m_forwardVariants.compileMs() + m_gbufferVariants.compileMs() + m_deferredVariants.compileMs(), m_programBinds,
+             settings.deferredShading ? "deferred" : "forward", timings.prepassMs, timings.colorMs,
+             static_cast<unsigned long long>(timings.colorSamples), timings.lightingMs, timings.skyboxMs);
+    return buf;
+}
 
-        glBufferSubData(GL_ARRAY_BUFFER, offset, floatSize, shininesses.data());
+// waits for the occlusion job (if there is one) and flags what's left
+void SceneRenderer::resolveVisibility() {
+    m_occlusion.finish(m_visibleShapes, &m_occlusionStats);
 
-        offset = 0;
+    m_shapeVisible.assign(m_scene->shapeSlots.size(), 0);
+    for (int shape : m_visibleShapes) m_shapeVisible[shape] = 1;
+}
 
-        // model matrix
-        for (int i = 0; i < 4; i++) {
-            glEnableVertexAttribArray(5 + i);
-            glVertexAttribPointer(5 + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
-                                  (void*)(offset + i * sizeof(glm::vec4)));
-            glVertexAttribDivisor(5 + i, 1);
+/**
+ * @brief SceneRenderer::uploadVisibleInstances compacts the visible slots of every batch into the front of the view's
+ * instance buffer. nothing is uploaded for a batch whose visible set didn't change, unless one of its visible slots animated
+ * @param viewType
+ * @param shapeVisible one flag per shape
+ */
+void SceneRenderer::uploadVisibleInstances(InstanceViewType viewType, const std::vector<unsigned char>& shapeVisible) {
+    std::vector<int> visible;
+    std::vector<InstanceData> compacted;
+
+    for (InstanceBatch& batch : m_scene->batches) {
+        InstanceView& view = batch.views[viewType];
+        visible.clear();
+        for (int slot = 0; slot < static_cast<int>(batch.shapes.size()); slot++) {
+            if (shapeVisible[batch.shapes[slot]]) visible.push_back(slot);
         }
-        offset += matrixSize;
 
-        // ambient
-        glEnableVertexAttribArray(9);
-        glVertexAttribPointer(9, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)offset);
-        glVertexAttribDivisor(9, 1);
-        offset += vec3Size;
+        const bool dirty = view.dirtyFirst <= view.dirtyLast;
+        const int dirtyFirst = view.dirtyFirst, dirtyLast = view.dirtyLast;
+        view.dirtyFirst = 1;
+        view.dirtyLast = 0;
 
-        // diffuse
-        glEnableVertexAttribArray(10);
-        glVertexAttribPointer(10, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)offset);
-        glVertexAttribDivisor(10, 1);
-        offset += vec3Size;
+        glBindBuffer(GL_ARRAY_BUFFER, view.instanceVBO);
 
-        // specular
-        glEnableVertexAttribArray(11);
-        glVertexAttribPointer(11, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)offset);
-        glVertexAttribDivisor(11, 1);
-        offset += vec3Size;
+        if (visible == view.visible) {
+            if (!dirty) continue;
 
-        // shininess
-        glEnableVertexAttribArray(12);
-        glVertexAttribPointer(12, 1, GL_FLOAT, GL_FALSE, sizeof(float), (void*)offset);
-        glVertexAttribDivisor(12, 1);
+            // the moved slots aren't drawn, they'll be picked up from the cpu copy once they are
+            auto it = std::lower_bound(visible.begin(), visible.end(), dirtyFirst);
+            if (it == visible.end() || *it > dirtyLast) continue;
 
-        // setup textures
-        setupTextureUniforms(materialInfo->material);
-
-        // draw all instances of this mesh
-        glDrawArraysInstanced(GL_TRIANGLES, 0, meshData.vertexCount, shapes.size());
+            if (visible.size() == batch.shapes.size()) {
+                // nothing culled, so slots are still buffer positions and only the dirty range has to go up
+                glBufferSubData(GL_ARRAY_BUFFER, dirtyFirst * sizeof(InstanceData),
+                                (dirtyLast - dirtyFirst + 1) * sizeof(InstanceData), &batch.instances[dirtyFirst]);
+                continue;
+            }
+        }
 
-        glBindVertexArray(0);
+        compacted.clear();
+        for (int slot : visible) compacted.push_back(batch.instances[slot]);
+        if (!compacted.empty()) {
+            glBufferSubData(GL_ARRAY_BUFFER, 0, compacted.size() * sizeof(InstanceData), compacted.data());
+        }
+        view.visible.swap(visible);
     }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
 
-    glUseProgram(0);
-    glBindFramebuffer(GL_FRAMEBUFFER, m_defaultFBO);
-
+// the gl side only, the scene can make them again with createBatchObjects
+void SceneRenderer::deleteBatchObjects(SceneBatches& scene) {
+    for (InstanceBatch& batch : scene.batches) {
+        for (InstanceView& view : batch.views) {
+            glDeleteVertexArrays(1, &view.vao);
+            glDeleteBuffers(1, &view.instanceVBO);
+            view.vao = view.instanceVBO = 0;
+        }
+    }
+    glDeleteBuffers(1, &scene.materialUBO);
+    scene.materialUBO = 0;
+    scene.createdBatches = 0;
 }
 
 void SceneRenderer::paintTerrainInternal(const Camera& camera) {
@@ -348,8 +1021,7 @@ void SceneRenderer::paintTerrainInternal(const Camera& camera) {
     glUseProgram(m_terrain_shader);
     glBindVertexArray(m_terrain_vao);
 
-    GLuint locProj = glGetUniformLocation(m_terrain_shader, "projMatrix");
-    glUniformMatrix4fv(locProj, 1, GL_FALSE, &camera.getProjMatrix()[0][0]);
+    glUniformMatrix4fv(m_loc_terrainProj, 1, GL_FALSE, &camera.getProjMatrix()[0][0]);
 
     // Position terrain far behind camera, scaled up to fill background
     glm::mat4 world = glm::mat4(1.0f);
@@ -364,8 +1036,7 @@ void SceneRenderer::paintTerrainInternal(const Camera& camera) {
     world = glm::translate(world, terrainPos);
 
     glm::mat4 cam = camera.getViewMatrix() * world;
-    GLuint locMV = glGetUniformLocation(m_terrain_shader, "mvMatrix");
-    glUniformMatrix4fv(locMV, 1, GL_FALSE, &cam[0][0]);
+    glUniformMatrix4fv(m_loc_terrainMV, 1, GL_FALSE, &cam[0][0]);
 
     int res = m_terrain.getResolution();
 
@@ -397,88 +1068,208 @@ void SceneRenderer::paintTerrain(const Camera& camera) {
 
 //the below functions are helper functions for all of the uniforms in the shaders !
 
-void SceneRenderer::setupShadowUniform(const Shadow& shadow) {
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, shadow.depth_map);
-
-    GLuint locMap = glGetUniformLocation(m_shader, "shadowTexture");
-    glUniform1i(locMap, 0);
+/**
+ * @brief SceneRenderer::setupProgram block bindings and texture units, the same for every scene program and variant.
+ * anything a variant compiled out just isn't found
+ */
+void SceneRenderer::setupProgram(GLuint program) {
+    auto bindBlock = [](GLuint program, const char* name, GLuint binding) {
+        GLuint index = glGetUniformBlockIndex(program, name);
+        if (index != GL_INVALID_INDEX) glUniformBlockBinding(program, index, binding);
+    };
+    bindBlock(program, "FrameBlock", UniformBlocks::FRAME);
+    bindBlock(program, "LightBlock", UniformBlocks::LIGHTS);
+    bindBlock(program, "MaterialBlock", UniformBlocks::MATERIAL);
+    bindBlock(program, "ShadowAtlasBlock", UniformBlocks::ATLAS);
+
+    // texture units never change
+    glUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "shadowTexture"), 0);
+    glUniform1i(glGetUniformLocation(program, "textureSampler"), 1);
+    glUniform1i(glGetUniformLocation(program, "normTextureSampler"), 2);
+    glUniform1i(glGetUniformLocation(program, "bumpTextureSampler"), 3);
+    glUniform1i(glGetUniformLocation(program, "shadowMoments"), 4);
+    glUniform1i(glGetUniformLocation(program, "shadowAtlas"), 5);
+    glUniform1i(glGetUniformLocation(program, "clusterLightData"), 6);
+    glUniform1i(glGetUniformLocation(program, "clusterRanges"), 7);
+    glUniform1i(glGetUniformLocation(program, "clusterIndices"), 8);
+    glUniform1i(glGetUniformLocation(program, "gAlbedo"), 9);
+    glUniform1i(glGetUniformLocation(program, "gNormal"), 10);
+    glUniform1i(glGetUniformLocation(program, "gSpecular"), 11);
+    glUniform1i(glGetUniformLocation(program, "gDepth"), 12);
+    glUseProgram(0);
 }
 
-void SceneRenderer::setupCameraUniforms(const Camera& camera, glm::vec3 cameraPos) {
-    //passing matrices from camera !
-
-    glUniformMatrix4fv(glGetUniformLocation(m_shader, "viewMatrix"), 1, GL_FALSE, &camera.getViewMatrix()[0][0]);
-    glUniformMatrix4fv(glGetUniformLocation(m_shader, "projMatrix"), 1, GL_FALSE, &camera.getProjMatrix()[0][0]);
-    glUniform3f(glGetUniformLocation(m_shader, "cameraPos"), cameraPos.x, cameraPos.y, cameraPos.z);
+// the variant bits that come from the scene and this frame rather than from a batch's material
+uint32_t SceneRenderer::frameFeatures() const {
+    uint32_t features = ShaderFeature::lightClass(m_sceneLightCount) | ShaderFeature::shadowFilter(settings.shadowFilter);
+    if (!m_clusterLights.empty()) features |= ShaderFeature::CLUSTERED_LIGHTS;
+    return features;
+}
 
+/**
+ * @brief SceneRenderer::initializeUniformBlocks sets up the pre-pass program (the variants do it themselves when they
+ * link), makes the frame/light/atlas ubos, binds them to their binding points and makes the shadow compare
+ * sampler. only runs once, at startup
+ */
+void SceneRenderer::initializeUniformBlocks() {
+    setupProgram(m_prepass_shader);
+
+    glGenBuffers(1, &m_frameUBO);
+    glBindBuffer(GL_UNIFORM_BUFFER, m_frameUBO);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameBlock), nullptr, GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, UniformBlocks::FRAME, m_frameUBO);
+
+    glGenBuffers(1, &m_lightUBO);
+    glBindBuffer(GL_UNIFORM_BUFFER, m_lightUBO);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(LightBlock), nullptr, GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, UniformBlocks::LIGHTS, m_lightUBO);
+
+    glGenBuffers(1, &m_atlasUBO);
+    glBindBuffer(GL_UNIFORM_BUFFER, m_atlasUBO);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(ShadowAtlasBlock), nullptr, GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, UniformBlocks::ATLAS, m_atlasUBO);
+    m_atlasVersion = 0;
+
+    // every scene has its own material ubo (createBatchObjects), bound per batch with glBindBufferRange
+    GLint alignment = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    m_materialStride = (sizeof(MaterialBlock) + alignment - 1) / alignment * alignment;
+
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    glGenSamplers(1, &m_shadowSampler);
+    glSamplerParameteri(m_shadowSampler, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glSamplerParameteri(m_shadowSampler, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    glSamplerParameteri(m_shadowSampler, GL_TEXTURE_MIN_FILTER, GL_LINEAR); // linear + compare = bilinear pcf
+    glSamplerParameteri(m_shadowSampler, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glSamplerParameteri(m_shadowSampler, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glSamplerParameteri(m_shadowSampler, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+    float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    glSamplerParameterfv(m_shadowSampler, GL_TEXTURE_BORDER_COLOR, borderColor);
 }
 
-void SceneRenderer::setupShapeUniforms(const RenderShapeData& shape, const SceneMaterial& material) {
-    //filling out the material strcut !
-    glUniform3fv(glGetUniformLocation(m_shader, "material.cAmbient"), 1, &material.cAmbient[0]);
-    glUniform3fv(glGetUniformLocation(m_shader, "material.cDiffuse"), 1, &material.cDiffuse[0]);
-    glUniform3fv(glGetUniformLocation(m_shader, "material.cSpecular"), 1, &material.cSpecular[0]);
-    glUniform1f(glGetUniformLocation(m_shader, "material.shininess"), material.shininess);
+void SceneRenderer::setupShadowUniform(const Shadow& shadow) {
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, shadow.depth_map);
+    glBindSampler(0, m_shadowSampler);
 
-    glm::mat4 modInvTrans = glm::transpose(glm::inverse(shape.ctm));
-    //and the model matrix
+    glActiveTexture(GL_TEXTURE4);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, shadow.moments);
 
-    glUniformMatrix4fv(glGetUniformLocation(m_shader, "modelMatrix"), 1, GL_FALSE, &shape.ctm[0][0]);
-    glUniformMatrix4fv(glGetUniformLocation(m_shader, "modelInverseTrans"), 1, GL_FALSE, &modInvTrans[0][0]);
+    // same compare sampler, the atlas is a plain 2d depth texture
+    glActiveTexture(GL_TEXTURE5);
+    glBindTexture(GL_TEXTURE_2D, shadow.atlas);
+    glBindSampler(5, m_shadowSampler);
+    glActiveTexture(GL_TEXTURE0);
 
+    // tiles only move when a light changes size or comes in/out of view
+    if (shadow.atlasVersion != m_atlasVersion) {
+        glBindBuffer(GL_UNIFORM_BUFFER, m_atlasUBO);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(ShadowAtlasBlock), &shadow.atlasViews);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        m_atlasVersion = shadow.atlasVersion;
+    }
 }
 
-void SceneRenderer::setupLightUniforms(const std::vector<SceneLightData>& lights, SceneGlobalData globalData) {
-   // glUniform1i(glGetUniformLocation(m_shader, "lightCount"), lights.size());
-    glUniform1i(glGetUniformLocation(m_shader, "lightCount"), 1);
-    // std::cout << "Light count: " << lights.size() << std::endl;
-
-    for (int i = 0; i < lights.size(); i++) {
-        const SceneLightData& light = lights[i];
-        std::string base = "lights[" + std::to_string(i) + "].";
+void SceneRenderer::setupFrameUniforms(const Camera& camera, const Shadow& shadow) {
+    //passing matrices from camera ! + the matrices the shadow cascades were rendered with (far ones can lag a frame or two)
+    FrameBlock frame;
+    frame.viewMatrix = camera.getViewMatrix();
+    frame.projMatrix = camera.getProjMatrix();
+    for (int c = 0; c < MAX_SHADOW_CASCADES; c++) frame.lightMatrices[c] = shadow.cascades.matrices[c];
+    frame.cascadeSplits = shadow.cascades.splits;
+    frame.cascadeInfo = glm::ivec4(shadow.cascades.count, settings.shadowFilter, 0, 0);
+    frame.shadowParams = glm::vec4(POISSON_RADIUS, VARIANCE_BLEED_CUTOFF, VARIANCE_MIN, 0.0f);
+    frame.cameraPos = glm::vec4(camera.getPos(), 1.0f);
+    frame.clusterInfo = glm::ivec4(LightClusters::GRID_X, LightClusters::GRID_Y, LightClusters::GRID_Z,
+                                   static_cast<int>(m_clusterLights.size()));
+    frame.clusterParams = glm::vec4(m_fboWidth, m_fboHeight, m_clusters.sliceScale(), m_clusters.sliceBias());
+    frame.inverseViewProj = glm::inverse(frame.projMatrix * frame.viewMatrix);
+
+    glBindBuffer(GL_UNIFORM_BUFFER, m_frameUBO);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameBlock), &frame);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
 
-        //filling out an array of light strcuts
-        glUniform1i(glGetUniformLocation(m_shader, (base + "type").c_str()), static_cast<int>(light.type));
-        glUniform3fv(glGetUniformLocation(m_shader, (base + "color").c_str()), 1, &light.color[0]);
-        glUniform3fv(glGetUniformLocation(m_shader, (base + "function").c_str()), 1, &light.function[0]);
-        glUniform3fv(glGetUniformLocation(m_shader, (base + "pos").c_str()), 1, &light.pos[0]);
-        glUniform3fv(glGetUniformLocation(m_shader, (base + "dir").c_str()), 1, &light.dir[0]);
-        glUniform1f(glGetUniformLocation(m_shader, (base + "penumbra").c_str()), light.penumbra);
-        glUniform1f(glGetUniformLocation(m_shader, (base + "angle").c_str()), light.angle);
+// once per scene, prepareFrame uploads it when the scene is swapped in
+LightBlock SceneRenderer::makeLightBlock(const std::vector<SceneLightData>& lights, SceneGlobalData globalData) {
+    int lightCount = std::min(static_cast<int>(lights.size()), UniformBlocks::MAX_LIGHTS);
+    if (lightCount < static_cast<int>(lights.size())) {
+        std::cerr << "Scene has " << lights.size() << " lights, only the first " << UniformBlocks::MAX_LIGHTS
+                  << " are used" << std::endl;
     }
 
-    // send light matrix (for light 0/the sun) for shadow mapping
-    GLuint lightMatLoc = glGetUniformLocation(m_shader, "lightMatrix");
-    glUniformMatrix4fv(lightMatLoc, 1, GL_FALSE, &lights[0].matrix[0][0]);
-
+    LightBlock block{};
     //passing the gloabl coefecients for light calculations
-    glUniform1f(glGetUniformLocation(m_shader, "ka"), globalData.ka);
-    glUniform1f(glGetUniformLocation(m_shader, "kd"), globalData.kd);
-    glUniform1f(glGetUniformLocation(m_shader, "ks"), globalData.ks);
+    block.globalCoeffs = glm::vec4(globalData.ka, globalData.kd, globalData.ks, 0.0f);
+    block.lightInfo = glm::ivec4(lightCount, 0, 0, 0);
+
+    const int sunIndex = LightUtils::sunIndex(lights);
+    for (int i = 0; i < lightCount; i++) {
+        const SceneLightData& light = lights[i];
+        LightBlockLight& l = block.lights[i];
+
+        // the sun samples the cascades, spot/point lights find their tiles in the atlas block
+        l.info = glm::ivec4(static_cast<int>(light.type), i == sunIndex, 0, 0);
+        l.color = light.color;
+        l.function = glm::vec4(light.function, 0.0f);
+        l.pos = light.pos;
+        l.dir = light.dir;
+        l.cone = glm::vec4(light.penumbra, light.angle, 0.0f, 0.0f);
+    }
+    return block;
 }
 
-void SceneRenderer::setupTextureUniforms(const SceneMaterial& material) {
-    glUniform1i(glGetUniformLocation(m_shader, "textureInfo.isUsed"), material.textureMap.isUsed);
-    glUniform1f(glGetUniformLocation(m_shader, "textureInfo.repeatU"), material.textureMap.repeatU);
-    glUniform1f(glGetUniformLocation(m_shader, "textureInfo.repeatV"), material.textureMap.repeatV);
-    glUniform1f(glGetUniformLocation(m_shader, "textureInfo.blend"), material.blend);
+/**
+ * @brief SceneRenderer::updateLightClusters bins this frame's clustered lights and uploads the three buffer textures.
+ * the buffers are orphaned every frame, their size follows the light count
+ */
+void SceneRenderer::updateLightClusters(const Camera& camera) {
+    if (m_clusterTextures[0] == 0) {
+        const GLenum formats[3] = {GL_RGBA32F, GL_RG32UI, GL_R32UI};
+        glGenBuffers(3, m_clusterBuffers);
+        glGenTextures(3, m_clusterTextures);
+        for (int i = 0; i < 3; i++) {
+            glBindBuffer(GL_TEXTURE_BUFFER, m_clusterBuffers[i]);
+            glBufferData(GL_TEXTURE_BUFFER, 16, nullptr, GL_STREAM_DRAW);
+            glBindTexture(GL_TEXTURE_BUFFER, m_clusterTextures[i]);
+            glTexBuffer(GL_TEXTURE_BUFFER, formats[i], m_clusterBuffers[i]);
+        }
+    }
+
+    for (int i = 0; i < 3; i++) {
+        glActiveTexture(GL_TEXTURE6 + i);
+        glBindTexture(GL_TEXTURE_BUFFER, m_clusterTextures[i]);
+    }
+    glActiveTexture(GL_TEXTURE0);
+    if (m_clusterLights.empty()) return; // the shader skips the clusters when the count is 0
 
-    glUniform1i(glGetUniformLocation(m_shader, "bumpMapInfo.isUsed"), material.bumpMap.isUsed);
-    glUniform1f(glGetUniformLocation(m_shader, "bumpMapInfo.repeatU"), material.bumpMap.repeatU);
-    glUniform1f(glGetUniformLocation(m_shader, "bumpMapInfo.repeatV"), material.bumpMap.repeatV);
-    glUniform1f(glGetUniformLocation(m_shader, "bumpMapInfo.strength"), material.bumpMap.strength);
+    m_clusters.build(m_clusterLights, camera.getViewMatrix(), camera.getProjMatrix(), settings.nearPlane, settings.farPlane);
 
-    // Normal map info
-    glUniform1i(glGetUniformLocation(m_shader, "normalMapInfo.isUsed"), material.normalMap.isUsed);
-    glUniform1f(glGetUniformLocation(m_shader, "normalMapInfo.repeatU"), material.normalMap.repeatU);
-    glUniform1f(glGetUniformLocation(m_shader, "normalMapInfo.repeatV"), material.normalMap.repeatV);
-    glUniform1f(glGetUniformLocation(m_shader, "normalMapInfo.strength"), material.normalMap.strength);
+    // 2 texels per light: position + radius, color
+    std::vector<glm::vec4> lightData;
+    lightData.reserve(2 * m_clusterLights.size());
+    for (const ClusterLight& light : m_clusterLights) {
+        lightData.push_back(glm::vec4(light.pos, light.radius));
+        lightData.push_back(glm::vec4(light.color, 0.0f));
+    }
 
-    // always set the sampler uniforms, even if not used so opengl doesnt get mad at me
-    glUniform1i(glGetUniformLocation(m_shader, "textureSampler"), 1);
-    glUniform1i(glGetUniformLocation(m_shader, "normTextureSampler"), 2);
-    glUniform1i(glGetUniformLocation(m_shader, "bumpTextureSampler"), 3);
+    auto upload = [](GLuint buffer, const void* data, size_t bytes) {
+        glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+        glBufferData(GL_TEXTURE_BUFFER, std::max<size_t>(bytes, 16), nullptr, GL_STREAM_DRAW);
+        if (bytes > 0) glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes, data);
+    };
+    upload(m_clusterBuffers[0], lightData.data(), lightData.size() * sizeof(glm::vec4));
+    upload(m_clusterBuffers[1], m_clusters.ranges().data(), m_clusters.ranges().size() * sizeof(glm::uvec2));
+    upload(m_clusterBuffers[2], m_clusters.indices().data(), m_clusters.indices().size() * sizeof(uint32_t));
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void SceneRenderer::setupTextureUniforms(const SceneMaterial& material, int textureSet) {
+    // flags + strengths live in the material ubo, uv repeats come in per instance (attributes 13/14)
+    glBindBufferRange(GL_UNIFORM_BUFFER, UniformBlocks::MATERIAL, m_scene->materialUBO,
+                      textureSet * m_materialStride, sizeof(MaterialBlock));
 
     if (material.textureMap.isUsed) {
         // load texture if not already cached and bindd
@@ -614,17 +1405,39 @@ GLuint SceneRenderer::loadTexture(const std::string& filename, bool isBump, GLui
         return m_textureCache[filename];
     }
 
-    QImage image(QString::fromStdString(filename));
+    QImage image = TextureUtils::loadTextureImage(filename, isBump);
     if (image.isNull()) {
-        std::cerr << "Failed to load texture: " << filename << std::endl;
         return 0;
     }
 
-    if (isBump){ //if it's a bump map we have to figure out the tangent space normals and store that as a new image ot be used within our shader !
-        image = TextureUtils::parseBumpMap(image);
+    return uploadTexture(filename, image, slot);
+}
+
+std::set<std::string> SceneRenderer::residentTextures() const {
+    std::set<std::string> names;
+    for (const auto& [filename, id] : m_textureCache) {
+        names.insert(filename);
     }
+    return names;
+}
 
-    image = image.convertToFormat(QImage::Format_RGBA8888).mirrored();
+/**
+ * @brief SceneRenderer::uploadTexture creates the gl texture for an already decoded image (see TextureUtils::loadTextureImage)
+ * and caches it under filename. a null image is cached as 0 so we don't keep retrying a missing file every frame
+ * @param filename
+ * @param image RGBA8888, already flipped
+ * @param slot
+ * @return
+ */
+GLuint SceneRenderer::uploadTexture(const std::string& filename, const QImage& image, GLuint slot) {
+    if (m_textureCache.find(filename) != m_textureCache.end()) {
+        return m_textureCache[filename];
+    }
+
+    if (image.isNull()) {
+        m_textureCache[filename] = 0;
+        return 0;
+    }
 
     // generate and configure texture !!!
     GLuint textureID;
@@ -645,6 +1458,7 @@ GLuint SceneRenderer::loadTexture(const std::string& filename, bool isBump, GLui
 
     // cacheeee
     m_textureCache[filename] = textureID;
+    m_textureBytes += size_t(image.width()) * image.height() * 4;
 
     return textureID;
 }
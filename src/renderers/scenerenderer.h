@@ -7,6 +7,155 @@
 #include "utils/sceneparser.h"
 #include "camera/camera.h"
 #include "utils/terraingenerator.h"
+#include "culling/bvh.h"
+#include "culling/occlusionculler.h"
+#include "culling/lightclusters.h"
+#include "renderers/gpuquery.h"
+#include "renderers/shadervariants.h"
+
+#include <QImage>
+#include <limits>
+#include <memory>
+#include <set>
+#include <utility>
+
+// Per-instance attributes (locations 5-14), interleaved so a run of instances is one contiguous upload
+struct InstanceData {
+    glm::mat4 model;
+    glm::vec3 ambient;
+    glm::vec3 diffuse;
+    glm::vec3 specular;
+    float shininess;
+    glm::vec4 uvRepeat;       // texture repeatU/V, bump repeatU/V (stems scale these per shape)
+    glm::vec2 normalUVRepeat; // normal map repeatU/V
+};
+
+// A shape the way the batches see it: a plain one or one of an instance's template shapes, with where it is now
+struct DrawnShape {
+    const RenderShapeData* shape;
+    glm::mat4 ctm;
+};
+
+// Each batch is drawn from a couple of points of view (the camera, the shadow casting light). They cull differently,
+// so every view keeps its own compacted instance buffer and vao. the shadow map has a static layer (cached) and a
+// dynamic one (animated shapes), those get a view each so drawing one doesn't throw away the other's upload
+enum InstanceViewType {
+    VIEW_MAIN = 0,
+    VIEW_SHADOW_STATIC = 1,
+    VIEW_SHADOW_DYNAMIC = 2,
+    VIEW_COUNT
+};
+
+struct InstanceView {
+    GLuint vao = 0;
+    GLuint instanceVBO = 0;  // only the instances visible from this view, compacted (room for all of them)
+    int vertexCount = 0;     // the shadow view can use a coarser proxy than the main one
+    std::vector<int> visible; // slots currently in instanceVBO, in order
+
+    // instance slots [dirtyFirst, dirtyLast] changed since the last upload (empty when first > last)
+    int dirtyFirst = 1;
+    int dirtyLast = 0;
+};
+
+// One instanced draw = one unique draw key (see DrawKey). Built once per scene: each view's vao has the shared vertex
+// buffer (primitive or mesh) and the view's own instance buffer recorded in it, so drawing is just bind + draw
+struct InstanceBatch {
+    InstanceView views[VIEW_COUNT];
+    int textureSet = -1;     // batches with the same texture set share their texture binds
+    uint32_t variant = 0;    // material feature bits (ShaderFeature), DrawKey::variant
+    int geometry = 0;        // DrawKey::geometry: a PrimitiveType, or a mesh from PRIMITIVE_MESH on (SceneBatches::meshFiles)
+    bool leaves = false;     // nothing but leaves, the shadow views can use the proxy
+    std::vector<int> shapes; // draw indices (see RenderData), in instance order
+
+    std::vector<InstanceData> instances; // every slot, what the visible ones get copied from
+};
+
+// std140 mirrors of the uniform blocks in frameblock.glsl / lightblock.glsl / surface.glsl, keep them in sync.
+// every member is vec4 sized so the c++ layout matches std140 without any manual padding
+namespace UniformBlocks {
+    enum Binding {
+        FRAME = 0,    // per frame: camera + shadow cascades
+        LIGHTS = 1,   // per scene: lights + global coefficients
+        MATERIAL = 2, // per batch: one range of the texture set buffer
+        ATLAS = 3     // when the light renderer moves tiles around: ShadowAtlasBlock (lightrenderer.h)
+    };
+    const int MAX_LIGHTS = 8;
+    static_assert(MAX_LIGHTS == SHADOW_ATLAS_MAX_LIGHTS, "the atlas block has one entry per light");
+}
+
+struct FrameBlock {
+    glm::mat4 viewMatrix;
+    glm::mat4 projMatrix;
+    glm::mat4 lightMatrices[MAX_SHADOW_CASCADES]; // one per shadow cascade
+    glm::vec4 cascadeSplits;                      // view distance where each cascade ends
+    glm::ivec4 cascadeInfo;                       // cascade count, shadow filter
+    glm::vec4 shadowParams;                       // poisson radius (texels), variance bleed cutoff, minimum variance
+    glm::vec4 cameraPos;
+    glm::ivec4 clusterInfo;                       // LightClusters grid x, y, z + clustered light count
+    glm::vec4 clusterParams;                      // viewport width, height, depth slice scale, bias
+    glm::mat4 inverseViewProj;
+};
+
+struct LightBlockLight {
+    glm::ivec4 info;     // type, gets the sun's cascades
+    glm::vec4 color;
+    glm::vec4 function;
+    glm::vec4 pos;
+    glm::vec4 dir;
+    glm::vec4 cone;      // penumbra, angle
+};
+
+struct LightBlock {
+    glm::vec4 globalCoeffs; // ka, kd, ks
+    glm::ivec4 lightInfo;   // light count
+    LightBlockLight lights[UniformBlocks::MAX_LIGHTS];
+};
+
+struct MaterialBlock {
+    glm::ivec4 mapsUsed;  // texture, bump, normal
+    glm::vec4 mapParams;  // blend, bump strength, normal strength
+};
+
+// Everything SceneRenderer draws one scene with: the batches (instance data + each view's vao and instance buffer),
+// the texture sets and their material ubo, the light block, the bounds + bvh and the occluders. A scene that isn't on
+// screen (a preloaded season) keeps its own, swapScene just hands it over.
+// The cpu side comes from planBatches, which the scene loader runs on its thread. the gl side is made afterwards by
+// createBatchObjects, a few batches per frame
+struct SceneBatches {
+    std::vector<InstanceBatch> batches;
+    std::vector<std::string> meshFiles;          // geometry ids from PRIMITIVE_MESH on
+    std::vector<std::pair<int, int>> shapeSlots; // draw index -> (batch, instance slot)
+    std::vector<SceneMaterial> textureSets;      // the first material of each texture set, for its maps
+    std::vector<MaterialBlock> materialBlocks;   // one per texture set
+    LightBlock lightBlock{};
+
+    // culling
+    std::vector<AABB> localBounds; // per draw index, object space (unit box for primitives)
+    std::vector<AABB> worldBounds;
+    BVH bvh;
+    std::vector<glm::vec3> occluders; // empty while on screen, the occlusion culler has them then
+    bool boundsDirty = false;         // world bounds moved since the last refit
+
+    // shapes bound to the animation hierarchy go in the dynamic shadow layer, everything else is static
+    std::vector<unsigned char> shapeDynamic;
+    int dynamicShapeCount = 0;
+    bool animated = false; // parts of the instance buffers get rewritten
+
+    // gl objects, made from everything above by SceneRenderer::createBatchObjects
+    GLuint materialUBO = 0;   // one MaterialBlock per texture set, m_materialStride apart
+    int createdBatches = 0;   // batches[0, createdBatches) have their views
+    bool leafProxies = false; // settings.shadowLeafProxies when they were made
+    bool stale = false;       // the primitive buffers their vaos point at were recreated (tessellation changed)
+};
+
+// gpu side of the last frame that came back from the queries (a few frames old)
+struct PassTimings {
+    double prepassMs = 0.0;
+    double colorMs = 0.0;   // the g-buffer fill when deferred
+    double lightingMs = 0.0; // deferred lighting pass, 0 when forward
+    double skyboxMs = 0.0;
+    GLuint64 colorSamples = 0; // samples that passed the depth test in the shaded pass = fragments shaded
+};
 
 class SceneRenderer {
 public:
@@ -16,32 +165,162 @@ public:
     void resize(int width, int height);
     void setDefaultFBO(GLuint fbo) { m_defaultFBO = fbo; }
 
-    void render(const RenderData& renderData, const Camera& camera, 
-                ShapeRenderer& shapeRenderer, const Shadow &shadow);
+    void render(const Camera& camera, ShapeRenderer& shapeRenderer, const Shadow &shadow);
     
     GLuint getSceneTexture() const { return m_sceneTexture; }
     GLuint getDepthTexture() const { return m_depthTexture; }
     GLuint getSceneFBO() const { return m_sceneFBO; }
+    int getSceneWidth() const { return m_fboWidth; }
+    int getSceneHeight() const { return m_fboHeight; }
 
     void paintTexture(const Camera& camera);
     void paintTerrain(const Camera& camera);
 
+    // used by the async scene loader: textures are decoded on the worker and only uploaded here
+    bool hasTexture(const std::string& filename) const { return m_textureCache.contains(filename); }
+    std::set<std::string> residentTextures() const;
+    size_t textureBytes() const { return m_textureBytes; } // all cached scene textures (RGBA8, no mips)
+    GLuint uploadTexture(const std::string& filename, const QImage& image, GLuint slot = 0);
+
+    // the cpu side of a scene's batches: sort, instance data, bounds, bvh, occluders, light block. no gl and no
+    // renderer state, so it's safe on the scene loader thread. meshes has every mesh the scene uses
+    static std::unique_ptr<SceneBatches> planBatches(const RenderData& renderData,
+                                                     const std::map<std::string, MeshCPUData>& meshes, float farPlane);
+    // makes the gl objects of a planned scene, batch by batch until budgetNs is used up (at least one batch per call).
+    // true once all of them exist. the scene's meshes have to be on the gpu already
+    bool createBatchObjects(SceneBatches& scene, ShapeRenderer& shapeRenderer,
+                            qint64 budgetNs = std::numeric_limits<qint64>::max());
+    // puts scene on screen and hands back the one that was there, nothing is rebuilt. no gl calls either (the light
+    // block goes up on the next frame), so it's fine outside paintGL
+    std::unique_ptr<SceneBatches> swapScene(std::unique_ptr<SceneBatches> scene);
+    // a scene nobody keeps anymore, its gl objects are deleted on the next frame
+    void retireScene(std::unique_ptr<SceneBatches> scene);
+    // call it when the tessellation changes: the vaos are remade on the next frame. scenes that aren't on screen
+    // need SceneBatches::stale set by whoever keeps them
+    void invalidateBatches() { m_scene->stale = true; }
+    int batchCount() const { return static_cast<int>(m_scene->batches.size()); }
+    // instance buffers (every view) + material blocks of a scene
+    size_t batchBytes(const SceneBatches& scene) const;
+    // shapes whose ctm changed in the last animation update: their cpu copy and bounds are updated now, only these
+    // get re-uploaded
+    void markShapesDirty(const TransformHierarchy& animation);
+
+    // remakes stale vaos, uploads a swapped in light block and refits the bvh. both passes call it, whichever runs
+    // first does the work
+    void prepareFrame(ShapeRenderer& shapeRenderer);
+    // instanced depth-only draws of one layer's casters inside the frustum, with whatever depth shader is bound
+    // (cullMatrix is the light's proj * view, or a crop of it, it's only used for culling here)
+    void drawShadowCasters(ShapeRenderer& shapeRenderer, const glm::mat4& cullMatrix, InstanceViewType layer);
+    // bumped whenever that layer's casters change, the light renderer compares them to know what to redraw
+    uint64_t staticCasterVersion() const { return m_staticCasterVersion; }
+    uint64_t dynamicCasterVersion() const { return m_dynamicCasterVersion; }
+    bool hasDynamicCasters() const { return m_scene->dynamicShapeCount > 0; }
+    // boxes the animated casters swept through (old + new bounds) since the last call, so cached shadow views can
+    // tell whether anything moved inside them
+    std::vector<AABB> takeMovedCasters() { return std::exchange(m_movedCasters, {}); }
+
+    // short lived point lights (fireflies) for this frame, binned into the LightClusters grid in render()
+    void setClusterLights(std::vector<ClusterLight> lights) { m_clusterLights = std::move(lights); }
+    const ClusterStats& clusterStats() const { return m_clusters.stats(); }
+
+    // per scene bvh over the shapes' world bounds (refit when they animate), usable by the other passes too
+    const BVH& bvh() const { return m_scene->bvh; }
+    const CullStats& cullStats() const { return m_cullStats; }
+    const CullStats& shadowCullStats() const { return m_shadowCullStats; }
+    const OcclusionStats& occlusionStats() const { return m_occlusionStats; }
+    PassTimings passTimings() const;
+    std::string frameStatsReport() const;
+
 private:
     
     void paintTerrainInternal(const Camera& camera);
     
     void initializeFBO(int width, int height);
+    void initializeGBuffer();
+    void deleteGBuffer();
+    void shadeDeferred();
 
-    GLuint m_shader;
+    GLuint m_prepass_shader;
     GLuint m_terrain_shader;
 
+    // default.frag (forward), gbuffer.frag and the deferred lighting pass, one program per feature mask
+    ShaderVariants m_forwardVariants;
+    ShaderVariants m_gbufferVariants;
+    ShaderVariants m_deferredVariants;
+    int m_sceneLightCount = 0; // what the light block holds, picks the light class
+    int m_programBinds = 0;    // glUseProgram calls in the last shaded pass
+
+    void initializeUniformBlocks();
+    static void setupProgram(GLuint program);
+    uint32_t frameFeatures() const;
     void setupShadowUniform(const Shadow& shadow);
-    void setupCameraUniforms(const Camera& camera, glm::vec3 cameraPos);
-    void setupShapeUniforms(const RenderShapeData& shape, const SceneMaterial& material);
-    void setupLightUniforms(const std::vector<SceneLightData>& lights, SceneGlobalData globalData);
-    void setupTextureUniforms(const SceneMaterial& material);
+    void setupFrameUniforms(const Camera& camera, const Shadow& shadow);
+    static LightBlock makeLightBlock(const std::vector<SceneLightData>& lights, SceneGlobalData globalData);
+    void setupTextureUniforms(const SceneMaterial& material, int textureSet);
+    void updateLightClusters(const Camera& camera);
     GLuint loadTexture(const std::string& filename, bool isBump=false, GLuint slot=0);
 
+    static void collectOccluders(SceneBatches& scene, const std::vector<DrawnShape>& draws,
+                                 const std::map<std::string, MeshCPUData>& meshes);
+    static void createBatchViews(InstanceBatch& batch, GLuint vertexVBO, int vertexCount, GLuint shadowVBO,
+                                 int shadowVertexCount, GLenum usage);
+    static void deleteBatchObjects(SceneBatches& scene);
+    void deleteRetiredScenes();
+    void cullInstances(const Camera& camera);
+    void resolveVisibility();
+    void uploadVisibleInstances(InstanceViewType view, const std::vector<unsigned char>& shapeVisible);
+    void sortBatchesFrontToBack(const Camera& camera);
+    static InstanceData makeInstanceData(const DrawnShape& draw);
+
+    // uniform buffers, bound to their UniformBlocks::Binding once at init
+    GLuint m_frameUBO = 0;
+    GLuint m_lightUBO = 0;             // the light block of the scene on screen
+    bool m_lightsDirty = true;         // a scene was swapped in since it went up
+    GLuint m_atlasUBO = 0;
+    uint64_t m_atlasVersion = 0;       // Shadow::atlasVersion that's in m_atlasUBO
+    GLsizeiptr m_materialStride = 0;   // MaterialBlock padded to the uniform buffer offset alignment
+
+    // hardware depth compare for the shadow cascades. a sampler object instead of texture state, so the same depth
+    // texture can still be read as plain depth (the variance prefilter does)
+    GLuint m_shadowSampler = 0;
+
+    GLint m_loc_terrainProj;
+    GLint m_loc_terrainMV;
+
+    std::unique_ptr<SceneBatches> m_scene;                    // the one on screen, never null after initialize
+    std::vector<std::unique_ptr<SceneBatches>> m_retiredScenes; // gl objects to delete on the next frame
+
+    // culling
+    std::vector<int> m_visibleShapes;
+    std::vector<unsigned char> m_shapeVisible;
+    CullStats m_cullStats;
+    OcclusionCuller m_occlusion;
+    OcclusionStats m_occlusionStats;
+
+    std::vector<int> m_shadowCasters;
+    std::vector<unsigned char> m_shadowVisible;
+    CullStats m_shadowCullStats;
+
+    uint64_t m_staticCasterVersion = 0;
+    uint64_t m_dynamicCasterVersion = 0;
+    std::vector<AABB> m_movedCasters;
+
+    // clustered lights: light data, per cluster ranges and the index lists go to the shader as buffer textures
+    // (units 6, 7, 8), re-uploaded every frame
+    std::vector<ClusterLight> m_clusterLights;
+    LightClusters m_clusters;
+    GLuint m_clusterBuffers[3] = {};
+    GLuint m_clusterTextures[3] = {};
+
+    // batch indices with anything visible, nearest first (coarse buckets, texture set order inside a bucket)
+    std::vector<int> m_frontToBack;
+
+    GpuQuery m_prepassTimer;
+    GpuQuery m_colorTimer;
+    GpuQuery m_skyboxTimer;
+    GpuQuery m_colorSamples;
+    GpuQuery m_lightingTimer;
+
     GLuint m_defaultFBO;
 
     // scene fbo info
@@ -52,12 +331,24 @@ private:
     int m_fboWidth;
     int m_fboHeight;
 
+    // deferred path (settings.deferredShading), only allocated once it's used and dropped on resize.
+    // m_gbufferFBO writes the scene colour + the 3 g-buffer targets + scene depth, m_lightingFBO is just the scene
+    // colour so the lighting pass can read the depth texture
+    GLuint m_gbufferFBO = 0;
+    GLuint m_lightingFBO = 0;
+    GLuint m_gAlbedo = 0;
+    GLuint m_gNormal = 0;
+    GLuint m_gSpecular = 0;
+    GLuint m_fullscreen_vbo = 0;
+    GLuint m_fullscreen_vao = 0;
+
 
     void loadSkybox();
     void loadTerrain();
 
 
     std::map<std::string, GLuint> m_textureCache;
+    size_t m_textureBytes = 0;
 
     // terrain
     GLuint m_terrain_vao;
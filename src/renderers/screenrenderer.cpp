@@ -17,6 +17,11 @@ void ScreenRenderer::initialize() {
         ":/resources/shaders/copy.vert",
         ":/resources/shaders/copy.frag"
     );
+
+    // the copied texture always goes on unit 7
+    glUseProgram(m_shader);
+    glUniform1i(glGetUniformLocation(m_shader, "textureSampler"), 7);
+    glUseProgram(0);
     
     initializeFullscreenQuad();
 }
@@ -85,7 +90,6 @@ void ScreenRenderer::renderToScreen(GLuint texture, int width, int height) {
     // bind texture
     glActiveTexture(GL_TEXTURE7);
     glBindTexture(GL_TEXTURE_2D, texture);
-    glUniform1i(glGetUniformLocation(m_shader, "textureSampler"), 7);
     
     // draw fullscreen quad
     glBindVertexArray(m_quadVAO);
@@ -0,0 +1,66 @@
+#include "shadervariants.h"
+#include "utils/shaderloader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+
+uint32_t ShaderFeature::lightClass(int lightCount) {
+    uint32_t lightClass = 0;
+    while (lightClass < 3 && (1 << lightClass) < lightCount) lightClass++;
+    return lightClass << LIGHT_CLASS_SHIFT;
+}
+
+uint32_t ShaderFeature::shadowFilter(int filter) {
+    return static_cast<uint32_t>(std::clamp(filter, 0, 3)) << SHADOW_FILTER_SHIFT;
+}
+
+void ShaderVariants::initialize(const char* vertexPath, const char* fragmentPath, Setup setup) {
+    cleanup();
+    m_vertexPath = vertexPath;
+    m_fragmentPath = fragmentPath;
+    m_setup = std::move(setup);
+}
+
+void ShaderVariants::cleanup() {
+    for (auto& [features, program] : m_programs) {
+        if (program) glDeleteProgram(program);
+    }
+    m_programs.clear();
+    m_compileMs = 0.0;
+}
+
+std::string ShaderVariants::defines(uint32_t features) {
+    using namespace ShaderFeature;
+    std::string out;
+    out += "#define MAP_TEXTURE " + std::to_string((features & TEXTURE_MAP) ? 1 : 0) + "\n";
+    out += "#define MAP_BUMP " + std::to_string((features & BUMP_MAP) ? 1 : 0) + "\n";
+    out += "#define MAP_NORMAL " + std::to_string((features & NORMAL_MAP) ? 1 : 0) + "\n";
+    out += "#define MAX_SCENE_LIGHTS " + std::to_string(1 << ((features >> LIGHT_CLASS_SHIFT) & 3)) + "\n";
+    out += "#define SHADOW_FILTER " + std::to_string((features >> SHADOW_FILTER_SHIFT) & 3) + "\n";
+    out += "#define CLUSTERED_LIGHTS " + std::to_string((features & CLUSTERED_LIGHTS) ? 1 : 0) + "\n";
+    return out;
+}
+
+/**
+ * @brief ShaderVariants::program the variant for a feature mask, compiled on first use. a variant that fails to
+ * compile is logged once and stays 0 (nothing gets drawn with it) instead of being retried every frame
+ */
+GLuint ShaderVariants::program(uint32_t features) {
+    auto found = m_programs.find(features);
+    if (found != m_programs.end()) return found->second;
+
+    auto start = std::chrono::steady_clock::now();
+    GLuint program = 0;
+    try {
+        program = ShaderLoader::createShaderProgram(m_vertexPath.c_str(), m_fragmentPath.c_str(), defines(features));
+        if (m_setup) m_setup(program);
+    } catch (const std::runtime_error& e) {
+        std::cerr << "Failed to compile " << m_fragmentPath << " variant " << features << ": " << e.what() << std::endl;
+    }
+    m_compileMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    m_programs.emplace(features, program);
+    return program;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+
+// What a shader variant has compiled in. The material bits are per batch and go into DrawKey's variant field, the
+// rest follow the scene/frame and are or'ed in at draw time
+namespace ShaderFeature {
+    enum Bits : uint32_t {
+        TEXTURE_MAP = 1u << 0,
+        BUMP_MAP = 1u << 1,
+        NORMAL_MAP = 1u << 2,
+        MATERIAL_MASK = TEXTURE_MAP | BUMP_MAP | NORMAL_MAP,
+
+        LIGHT_CLASS_SHIFT = 3, // 2 bits: the light loop is unrolled for up to 1, 2, 4 or 8 scene lights
+        SHADOW_FILTER_SHIFT = 5, // 2 bits: ShadowFilter (settings.h)
+        CLUSTERED_LIGHTS = 1u << 7
+    };
+
+    // smallest light class that fits lightCount lights
+    uint32_t lightClass(int lightCount);
+    uint32_t shadowFilter(int filter);
+}
+
+/**
+ * Lazily compiled variants of one vertex + fragment shader pair.
+ *
+ * Every variant is the same source with the features of its bitmask turned into #defines (MAP_TEXTURE, MAP_BUMP,
+ * MAP_NORMAL, MAX_SCENE_LIGHTS, SHADOW_FILTER, CLUSTERED_LIGHTS), so an untextured leaf gets a shader without any of
+ * the map code and with a light loop that stops at the scene's light count, instead of branching on flags per
+ * fragment. A variant is compiled the first time program() asks for it and kept until cleanup(). setup runs once on
+ * every new program (uniform block bindings, sampler units).
+ */
+class ShaderVariants {
+public:
+    using Setup = std::function<void(GLuint program)>;
+
+    void initialize(const char* vertexPath, const char* fragmentPath, Setup setup);
+    void cleanup();
+
+    GLuint program(uint32_t features);
+
+    // the lines program() prepends for a feature mask
+    static std::string defines(uint32_t features);
+
+    int compiledCount() const { return static_cast<int>(m_programs.size()); }
+    double compileMs() const { return m_compileMs; } // all variants so far
+
+private:
+    std::string m_vertexPath;
+    std::string m_fragmentPath;
+    Setup m_setup;
+
+    std::unordered_map<uint32_t, GLuint> m_programs;
+    double m_compileMs = 0.0;
+};
@@ -11,14 +11,22 @@
  * @brief ShapeRenderer::initializes the GL data for our primitives. the vaos, vbos, and vertex count for each shape
  */
 void ShapeRenderer::initialize() {
+    const int p1 = settings.shapeParameter1;
+    const int p2 = settings.shapeParameter2;
 
-    m_shapeMap[PrimitiveType::PRIMITIVE_SPHERE] = createPrimitiveGLData(PrimitiveType::PRIMITIVE_SPHERE);
+    m_shapeMap[PrimitiveType::PRIMITIVE_SPHERE] = createPrimitiveGLData(PrimitiveType::PRIMITIVE_SPHERE, p1, p2);
 
-    m_shapeMap[PrimitiveType::PRIMITIVE_CUBE] = createPrimitiveGLData(PrimitiveType::PRIMITIVE_CUBE);
+    m_shapeMap[PrimitiveType::PRIMITIVE_CUBE] = createPrimitiveGLData(PrimitiveType::PRIMITIVE_CUBE, p1, p2);
 
-    m_shapeMap[PrimitiveType::PRIMITIVE_CONE] = createPrimitiveGLData(PrimitiveType::PRIMITIVE_CONE);
+    m_shapeMap[PrimitiveType::PRIMITIVE_CONE] = createPrimitiveGLData(PrimitiveType::PRIMITIVE_CONE, p1, p2);
 
-    m_shapeMap[PrimitiveType::PRIMITIVE_CYLINDER] = createPrimitiveGLData(PrimitiveType::PRIMITIVE_CYLINDER);
+    m_shapeMap[PrimitiveType::PRIMITIVE_CYLINDER] = createPrimitiveGLData(PrimitiveType::PRIMITIVE_CYLINDER, p1, p2);
+
+    // shadow proxies: as coarse as the tessellators go (a 4 sided cone is plenty for a leaf's shadow)
+    m_proxyMap[PrimitiveType::PRIMITIVE_SPHERE] = createPrimitiveGLData(PrimitiveType::PRIMITIVE_SPHERE, 2, 4);
+    m_proxyMap[PrimitiveType::PRIMITIVE_CUBE] = createPrimitiveGLData(PrimitiveType::PRIMITIVE_CUBE, 1, 1);
+    m_proxyMap[PrimitiveType::PRIMITIVE_CONE] = createPrimitiveGLData(PrimitiveType::PRIMITIVE_CONE, 1, 4);
+    m_proxyMap[PrimitiveType::PRIMITIVE_CYLINDER] = createPrimitiveGLData(PrimitiveType::PRIMITIVE_CYLINDER, 1, 4);
 
     m_currentParam1 = settings.shapeParameter1;
     m_currentParam2 = settings.shapeParameter2;
@@ -33,22 +41,29 @@ void ShapeRenderer::cleanup() {
         glDeleteBuffers(1, &pair.second.vbo);
     }
     m_shapeMap.clear();
+    for (auto& pair : m_proxyMap) {
+        glDeleteVertexArrays(1, &pair.second.vao);
+        glDeleteBuffers(1, &pair.second.vbo);
+    }
+    m_proxyMap.clear();
     m_meshLoader.cleanup();
 
 }
 
 /**
  * @brief ShapeRenderer::updateTessellation deletes the old vaos/vbos and recreates the maps using updated parameters
+ * @return true if anything was recreated (anything holding on to the old buffers has to be rebuilt)
  */
-void ShapeRenderer::updateTessellation(){
+bool ShapeRenderer::updateTessellation(){
 
     if (m_currentParam1 == settings.shapeParameter1 &&
         m_currentParam2 == settings.shapeParameter2) {
-        return; // no change, skip update !
+        return false; // no change, skip update !
     }
 
     cleanup();
     initialize();
+    return true;
 }
 
 /**
@@ -56,22 +71,22 @@ void ShapeRenderer::updateTessellation(){
  * @param type
  * @return
  */
-GLPrimitiveData ShapeRenderer::createPrimitiveGLData(PrimitiveType type){
+GLPrimitiveData ShapeRenderer::createPrimitiveGLData(PrimitiveType type, int param1, int param2){
 
     std::vector<float> shapeData;
 
     switch(type){
     case PrimitiveType::PRIMITIVE_SPHERE:
-        shapeData = SphereTessellator::tessellate(settings.shapeParameter1, settings.shapeParameter2);
+        shapeData = SphereTessellator::tessellate(param1, param2);
         break;
     case PrimitiveType::PRIMITIVE_CUBE:
-        shapeData = CubeTessellator::tessellate(settings.shapeParameter1);
+        shapeData = CubeTessellator::tessellate(param1);
         break;
     case PrimitiveType::PRIMITIVE_CONE:
-        shapeData = ConeTessellator::tessellate(settings.shapeParameter1, settings.shapeParameter2);
+        shapeData = ConeTessellator::tessellate(param1, param2);
         break;
     case PrimitiveType::PRIMITIVE_CYLINDER:
-        shapeData = CylinderTessellator::tessellate(settings.shapeParameter1, settings.shapeParameter2);
+        shapeData = CylinderTessellator::tessellate(param1, param2);
         break;
     default:
         break;
@@ -122,10 +137,6 @@ GLPrimitiveData ShapeRenderer::createPrimitiveGLData(PrimitiveType type){
     glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 14 * sizeof(GLfloat), reinterpret_cast<void*>(8 * sizeof(GLfloat))); //tangent
     glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, 14 * sizeof(GLfloat), reinterpret_cast<void*>(11 * sizeof(GLfloat))); //bitanget
 
-    // generating the instance vbo, which will be empty for now!
-    GLuint instanceVBO;
-    glGenBuffers(1, &instanceVBO);
-
     // ================== Returning to Default State
 
     // Task 14: Unbind your VBO and VAO here
@@ -135,5 +146,5 @@ GLPrimitiveData ShapeRenderer::createPrimitiveGLData(PrimitiveType type){
     int vertexCount = shapeData.size() / 14;
 
 
-    return GLPrimitiveData{shapeVAO, shapeVBO, instanceVBO, vertexCount};
+    return GLPrimitiveData{shapeVAO, shapeVBO, vertexCount};
 }
@@ -17,7 +17,6 @@ struct GLPrimitiveData {
 
     GLuint vao;
     GLuint vbo;
-    GLuint instanceVBO; 
     int vertexCount;
 
 };
@@ -27,17 +26,24 @@ public:
     void initialize();
     void cleanup();
     GLPrimitiveData getPrimitiveData(PrimitiveType type) {return m_shapeMap.at(type);}
+    // the same primitive at the lowest tessellation, for the shadow pass
+    GLPrimitiveData getShadowProxyData(PrimitiveType type) {return m_proxyMap.at(type);}
     GLuint getVAO(PrimitiveType type) const {return m_shapeMap.at(type).vao;}
     int getVertexCount(PrimitiveType type) const {return m_shapeMap.at(type).vertexCount;}
     MeshGLData getMeshData(const std::string& filepath) { return m_meshLoader.getMeshData(filepath); }
+    MeshGLData uploadMesh(const std::string& filepath, const std::vector<float>& vertices, MeshCPUData cpu) { return m_meshLoader.uploadMesh(filepath, vertices, std::move(cpu)); }
+    bool hasMesh(const std::string& filepath) const { return m_meshLoader.hasMesh(filepath); }
+    std::map<std::string, MeshCPUData> residentMeshData() const { return m_meshLoader.residentMeshData(); }
+    size_t meshBytes() const { return m_meshLoader.gpuBytes(); }
 
-    void updateTessellation();
+    bool updateTessellation(); // true if the vaos/vbos were recreated
     void loadSkybox();
 
 private:
     std::map<PrimitiveType, GLPrimitiveData> m_shapeMap;
+    std::map<PrimitiveType, GLPrimitiveData> m_proxyMap;
     MeshLoader m_meshLoader;
-    GLPrimitiveData createPrimitiveGLData(PrimitiveType type);
+    GLPrimitiveData createPrimitiveGLData(PrimitiveType type, int param1, int param2);
 
     int m_currentParam1 = -1;
     int m_currentParam2 = -1;
@@ -0,0 +1,164 @@
+#include "temporalaccumulator.h"
+#include "utils/shaderloader.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace {
+    // the new frame's share never drops below this, so the clamped history still follows changes within ~10 frames
+    const float MIN_BLEND = 0.1f;
+}
+
+void TemporalAccumulator::initialize() {
+    m_program = ShaderLoader::createShaderProgram(
+        ":/resources/shaders/fullscreen.vert",
+        ":/resources/shaders/temporal_resolve.frag"
+    );
+
+    m_loc_reproject = glGetUniformLocation(m_program, "u_Reproject");
+    m_loc_blend = glGetUniformLocation(m_program, "u_Blend");
+    glUseProgram(m_program);
+    glUniform1i(glGetUniformLocation(m_program, "u_CurrentTex"), 0);
+    glUniform1i(glGetUniformLocation(m_program, "u_HistoryTex"), 1);
+    glUniform1i(glGetUniformLocation(m_program, "u_DepthTex"), 2);
+    glUseProgram(0);
+
+    createQuad();
+}
+
+void TemporalAccumulator::cleanup() {
+    for (auto& [name, history] : m_histories) {
+        glDeleteTextures(2, history.textures);
+    }
+    m_histories.clear();
+
+    if (m_quadVAO) glDeleteVertexArrays(1, &m_quadVAO);
+    if (m_quadVBO) glDeleteBuffers(1, &m_quadVBO);
+    if (m_program) glDeleteProgram(m_program);
+    m_quadVAO = m_quadVBO = m_program = 0;
+    m_started = false;
+}
+
+void TemporalAccumulator::createQuad() {
+    std::vector<GLfloat> quad = {
+        -1.0f, -1.0f,  0.0f, 0.0f,
+         1.0f, -1.0f,  1.0f, 0.0f,
+         1.0f,  1.0f,  1.0f, 1.0f,
+
+        -1.0f, -1.0f,  0.0f, 0.0f,
+         1.0f,  1.0f,  1.0f, 1.0f,
+        -1.0f,  1.0f,  0.0f, 1.0f
+    };
+
+    glGenBuffers(1, &m_quadVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, m_quadVBO);
+    glBufferData(GL_ARRAY_BUFFER, quad.size() * sizeof(GLfloat), quad.data(), GL_STATIC_DRAW);
+
+    glGenVertexArrays(1, &m_quadVAO);
+    glBindVertexArray(m_quadVAO);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), (void*)0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), (void*)(2 * sizeof(GLfloat)));
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void TemporalAccumulator::beginFrame(const glm::mat4& viewProj) {
+    m_frame.prevViewProj = m_started ? m_frame.viewProj : viewProj;
+    m_frame.viewProj = viewProj;
+    m_frame.index++;
+    m_started = true;
+
+    // r2 sequence, evenly spread over the unit square however many frames it runs for
+    const double g = 1.32471795724474602596;
+    const double x = 0.5 + double(m_frame.index) / g;
+    const double y = 0.5 + double(m_frame.index) / (g * g);
+    m_frame.jitter = glm::vec2(float(x - std::floor(x)), float(y - std::floor(y)));
+
+    // what was written last frame is read this frame
+    for (auto& [name, history] : m_histories) {
+        if (history.resolved) {
+            history.write ^= 1;
+            history.valid = true;
+            history.frames++;
+        } else {
+            history.valid = false;
+            history.frames = 0;
+        }
+        history.resolved = false;
+    }
+}
+
+void TemporalAccumulator::invalidate() {
+    for (auto& [name, history] : m_histories) {
+        history.resolved = false;
+    }
+}
+
+/**
+ * @brief TemporalAccumulator::addResolvePass the history textures are made (or remade, at a new size) here, half
+ * floats at current's size. a history that isn't valid yet just takes current as it is
+ */
+RenderGraph::Resource TemporalAccumulator::addResolvePass(RenderGraph& graph, const std::string& name,
+                                                          RenderGraph::Resource current,
+                                                          RenderGraph::Resource sceneDepth) {
+
+    History& history = m_histories[name];
+    RenderTextureDesc desc = graph.desc(current);
+    desc.format = GL_RGBA16F;
+
+    if (!(history.desc == desc) || history.textures[0] == 0) {
+        if (history.textures[0]) glDeleteTextures(2, history.textures);
+        glGenTextures(2, history.textures);
+        for (GLuint texture : history.textures) {
+            glBindTexture(GL_TEXTURE_2D, texture);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, desc.width, desc.height, 0, GL_RGBA, GL_HALF_FLOAT, nullptr);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        history.desc = desc;
+        history.valid = false;
+        history.frames = 0;
+    }
+
+    const RenderGraph::Resource previous = graph.importTexture(name + " history", history.textures[history.write ^ 1],
+                                                               desc);
+    const RenderGraph::Resource result = graph.importTexture(name, history.textures[history.write], desc);
+
+    const float blend = history.valid ? std::max(1.0f / float(history.frames + 1), MIN_BLEND) : 1.0f;
+    // this frame's clip space back to last frame's
+    const glm::mat4 reproject = m_frame.prevViewProj * glm::inverse(m_frame.viewProj);
+    History* resolved = &history;
+
+    graph.addPass(name + " resolve", {current, previous, sceneDepth}, {result}, [=, this, &graph]() {
+        resolved->resolved = true;
+
+        graph.bindFramebuffer(result);
+        glDisable(GL_DEPTH_TEST);
+        glDisable(GL_BLEND);
+
+        glUseProgram(m_program);
+        glUniformMatrix4fv(m_loc_reproject, 1, GL_FALSE, &reproject[0][0]);
+        glUniform1f(m_loc_blend, blend);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, graph.texture(current));
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, graph.texture(previous));
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, graph.texture(sceneDepth));
+        glActiveTexture(GL_TEXTURE0);
+
+        glBindVertexArray(m_quadVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+        glBindVertexArray(0);
+        glUseProgram(0);
+
+        glEnable(GL_DEPTH_TEST);
+    });
+    return result;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <map>
+#include <string>
+
+#include "rendergraph.h"
+
+// the camera of this frame and the last one, and the jitter the effects offset their samples by
+struct TemporalFrame {
+    glm::mat4 viewProj = glm::mat4(1.0f);
+    glm::mat4 prevViewProj = glm::mat4(1.0f);
+    glm::vec2 jitter = glm::vec2(0.5f); // 0..1 on both axes, a different point of an r2 sequence every frame
+    unsigned index = 0;                 // frames since beginFrame started counting
+};
+
+/**
+ * History buffers for effects that spread their samples over several frames.
+ *
+ * An effect renders a cheap, noisy version (fewer samples, offset by frame().jitter) and hands it to
+ * addResolvePass. That reprojects last frame's result to this frame with the scene depth and the previous
+ * view-projection, clamps it to the min/max of the 3x3 neighbourhood of the new samples (so history that doesn't
+ * belong there anymore, disocclusions and moving things, gets pulled back towards the new frame) and blends the two.
+ * With a still camera the result converges to the average over the jitters, i.e. all the samples.
+ *
+ * Every history is two textures owned here and imported into the graph: last frame's, read, and this frame's,
+ * written. They swap in beginFrame. A history whose resolve didn't run last frame, or that changed size, starts over.
+ */
+class TemporalAccumulator {
+public:
+    void initialize();
+    void cleanup();
+
+    // before the effects add their passes
+    void beginFrame(const glm::mat4& viewProj);
+    const TemporalFrame& frame() const { return m_frame; }
+    // everything starts over next frame (new scene, teleported camera)
+    void invalidate();
+
+    // current blended into the history called name, returns the result (which is also next frame's history)
+    RenderGraph::Resource addResolvePass(RenderGraph& graph, const std::string& name, RenderGraph::Resource current,
+                                         RenderGraph::Resource sceneDepth);
+
+private:
+    struct History {
+        GLuint textures[2] = {0, 0};
+        RenderTextureDesc desc;
+        int write = 0;         // this frame's, the other one is last frame's
+        bool valid = false;    // last frame's holds a result
+        bool resolved = false; // the resolve ran this frame
+        unsigned frames = 0;   // accumulated into last frame's so far
+    };
+
+    void createQuad();
+
+    GLuint m_program = 0;
+    GLint m_loc_reproject = -1;
+    GLint m_loc_blend = -1;
+
+    GLuint m_quadVAO = 0;
+    GLuint m_quadVBO = 0;
+
+    TemporalFrame m_frame;
+    bool m_started = false;
+    std::map<std::string, History> m_histories;
+};
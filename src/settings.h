@@ -3,6 +3,13 @@
 
 #include <string>
 
+// How default.frag filters the shadow map (SHADOW_* defines there)
+enum ShadowFilter {
+    SHADOW_FILTER_PCF = 0,      // 4 hardware compared bilinear taps
+    SHADOW_FILTER_POISSON = 1,  // 4 taps on a rotated poisson disk
+    SHADOW_FILTER_VARIANCE = 2  // prefiltered variance map, 1 fetch
+};
+
 struct Settings {
     std::string sceneFilePath;
     int shapeParameter1 = 1;
@@ -16,12 +23,47 @@ struct Settings {
     bool extraCredit3 = false;
     bool extraCredit4 = false;
 
+    // Bloom (extraCredit2): multiplier on the glow, and how far it spreads (0..1, see PostProcess::setBloomRadius)
+    float bloomStrength = 1.0f;
+    float bloomRadius = 0.7f;
+
     // Particle season selection (treat like radio buttons)
     bool particlesWinter = true;
     bool particlesSpring = false;
     bool particlesSummer = false;
     bool particlesAutumn = false;
 
+    // Keep all four final_scene season variants loaded so switching seasons doesn't reparse
+    bool preloadSeasons = false;
+
+    // Skip instances outside the camera frustum (SceneRenderer's bvh)
+    bool frustumCulling = true;
+    // Skip instances hidden behind the big occluders (cliff, trunks), tested on the cpu
+    bool occlusionCulling = true;
+
+    // How the sun's shadow edges get softened
+    ShadowFilter shadowFilter = SHADOW_FILTER_PCF;
+    // Redraw at most one of the far shadow cascades per frame, the others catch up over the next few frames
+    bool amortizeShadowUpdates = true;
+    // Leaves go into the shadow map as the coarsest tessellation instead of the real one
+    bool shadowLeafProxies = true;
+    // Summer fireflies light up what's around them (clustered point lights, see LightClusters)
+    bool fireflyLights = true;
+    // G-buffer pass + one fullscreen lighting pass instead of lighting every shaded fragment (compare the timings in
+    // the frame stats)
+    bool deferredShading = false;
+    // God rays blurred at quarter resolution in 3 passes of 8 taps around each light, then upsampled with the scene
+    // depth, instead of sampleCount taps per light at every pixel
+    bool lowResGodRays = false;
+    // God rays and bloom take a fraction of their samples per frame, jittered, and accumulate them in history
+    // buffers reprojected with the scene depth (TemporalAccumulator)
+    bool temporalEffects = false;
+
+    // Depth-only pass before the shaded one, which then only shades the front-most fragment (GL_EQUAL)
+    bool depthPrepass = false;
+    // Print culling stats + gpu pass timings about once a second
+    bool printFrameStats = false;
+
     // Helper to get current season from particle settings
     int getCurrentSeasonIndex() const {
         if (particlesSpring) return 0; // SPRING
@@ -139,14 +139,44 @@ MeshGLData MeshLoader::getMeshData(const std::string& filepath) {
     }
 
     // if its not cached, create data for it !!
-    MeshGLData data = createMeshGLData(filepath);
+    std::vector<float> vertices = loadOBJ(filepath);
+    MeshGLData data = createMeshGLData(filepath, vertices, cpuData(vertices));
     m_meshCache[filepath] = data;
     return data;
 }
 
-MeshGLData MeshLoader::createMeshGLData(const std::string& filepath) {
-    // load vertex data from OBJ file
-    std::vector<float> meshData = loadOBJ(filepath);
+MeshGLData MeshLoader::uploadMesh(const std::string& filepath, const std::vector<float>& vertices, MeshCPUData cpu) {
+
+    auto it = m_meshCache.find(filepath);
+    if (it != m_meshCache.end()) {
+        return it->second;
+    }
+
+    MeshGLData data = createMeshGLData(filepath, vertices, std::move(cpu));
+    m_meshCache[filepath] = data;
+    return data;
+}
+
+MeshCPUData MeshLoader::cpuData(const std::vector<float>& vertices) {
+    MeshCPUData cpu;
+    const size_t vertexCount = vertices.size() / 14;
+    if (vertexCount == 0) return cpu;
+
+    auto positions = std::make_shared<std::vector<glm::vec3>>(vertexCount);
+    for (size_t i = 0; i < vertexCount; i++) {
+        (*positions)[i] = glm::vec3(vertices[i * 14], vertices[i * 14 + 1], vertices[i * 14 + 2]);
+    }
+
+    cpu.boundsMin = cpu.boundsMax = positions->front();
+    for (const glm::vec3& p : *positions) {
+        cpu.boundsMin = glm::min(cpu.boundsMin, p);
+        cpu.boundsMax = glm::max(cpu.boundsMax, p);
+    }
+    cpu.positions = std::move(positions);
+    return cpu;
+}
+
+MeshGLData MeshLoader::createMeshGLData(const std::string& filepath, const std::vector<float>& meshData, MeshCPUData cpu) {
 
     if (meshData.empty()) {
         std::cerr << "Failed to create GL data for mesh: " << filepath << std::endl;
@@ -178,24 +208,31 @@ MeshGLData MeshLoader::createMeshGLData(const std::string& filepath) {
     glEnableVertexAttribArray(4);
     glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, 14 * sizeof(GLfloat), reinterpret_cast<void*>(11 * sizeof(GLfloat)));
 
-    GLuint instanceVBO;
-    glGenBuffers(1, &instanceVBO);
-
     // Unbind
     glBindVertexArray(0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
 
     int vertexCount = meshData.size() / 14;
 
-    return MeshGLData{vao, vbo, instanceVBO, vertexCount};
+    MeshGLData data{vao, vbo, vertexCount, cpu.boundsMin, cpu.boundsMax};
+    m_cpuData[filepath] = std::move(cpu);
+    return data;
+}
+
+size_t MeshLoader::gpuBytes() const {
+    size_t bytes = 0;
+    for (const auto& [filepath, data] : m_meshCache) {
+        bytes += size_t(data.vertexCount) * 14 * sizeof(GLfloat);
+    }
+    return bytes;
 }
 
 void MeshLoader::cleanup() {
     for (auto& pair : m_meshCache) {
         glDeleteVertexArrays(1, &pair.second.vao);
         glDeleteBuffers(1, &pair.second.vbo);
-        glDeleteBuffers(1, &pair.second.instanceVBO);
 
     }
     m_meshCache.clear();
+    m_cpuData.clear();
 }
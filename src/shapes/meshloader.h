@@ -5,14 +5,27 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <memory>
 #include <GL/glew.h>
+#include <glm/glm.hpp>
 #include "utils/objloader.h"
 
 struct MeshGLData {
     GLuint vao;
     GLuint vbo;
-    GLuint instanceVBO;
     int vertexCount;
+
+    // object space bounds of the positions (for culling)
+    glm::vec3 boundsMin = glm::vec3(0.0f);
+    glm::vec3 boundsMax = glm::vec3(0.0f);
+};
+
+// the cpu side of a mesh: what culling and the occlusion culler need. positions are never changed once made, so the
+// scene loader thread can hold on to them while the gl thread keeps its own reference
+struct MeshCPUData {
+    glm::vec3 boundsMin = glm::vec3(0.0f);
+    glm::vec3 boundsMax = glm::vec3(0.0f);
+    std::shared_ptr<const std::vector<glm::vec3>> positions; // 3 per triangle, null if the mesh didn't load
 };
 
 class MeshLoader {
@@ -23,12 +36,23 @@ public:
     // get or create GL data for a mesh file (caches loaded meshes)
     MeshGLData getMeshData(const std::string& filepath);
 
+    // positions + bounds of vertices from loadOBJ, no gl (the scene loader thread makes them)
+    static MeshCPUData cpuData(const std::vector<float>& vertices);
+
+    // create + cache GL data from vertices that were already loaded with loadOBJ (e.g. on the scene loader thread)
+    MeshGLData uploadMesh(const std::string& filepath, const std::vector<float>& vertices, MeshCPUData cpu);
+    bool hasMesh(const std::string& filepath) const { return m_meshCache.contains(filepath); }
+    // cpu side of every cached mesh, shares the positions
+    std::map<std::string, MeshCPUData> residentMeshData() const { return m_cpuData; }
+    size_t gpuBytes() const; // vertex data of every cached mesh
+
     void cleanup();
 
 private:
     std::map<std::string, MeshGLData> m_meshCache;
+    std::map<std::string, MeshCPUData> m_cpuData;
 
-    MeshGLData createMeshGLData(const std::string& filepath);
+    MeshGLData createMeshGLData(const std::string& filepath, const std::vector<float>& meshData, MeshCPUData cpu);
 };
 
 #endif
@@ -0,0 +1,115 @@
+// imagediff: compares two screenshots (Save Image) of the same view, e.g. the full res against the low res god
+// rays, and prints how far apart they are:
+//
+//   imagediff a.png b.png [--threshold n] [--min-psnr db] [-o diff.png]
+//
+// rmse and psnr are over the rgb channels in 0..255, "differing" counts pixels where any channel is more than the
+// threshold (default 8) off. -o writes the per pixel difference, scaled up 4x so small ones show. with --min-psnr
+// the exit code is 2 when the images are further apart than that
+
+#include <QCoreApplication>
+#include <QImage>
+#include <QString>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+namespace {
+
+void printUsage() {
+    std::cerr << "usage: imagediff a.png b.png [--threshold n] [--min-psnr db] [-o diff.png]" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv); // image format plugins need an application object
+
+    std::string paths[2];
+    int pathCount = 0;
+    int threshold = 8;
+    double minPsnr = -1.0;
+    std::string output;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--threshold" && hasValue) {
+            threshold = std::atoi(argv[++i]);
+        } else if (arg == "--min-psnr" && hasValue) {
+            minPsnr = std::atof(argv[++i]);
+        } else if (arg == "-o" && hasValue) {
+            output = argv[++i];
+        } else if (arg == "-h" || arg == "--help") {
+            printUsage();
+            return 0;
+        } else if (arg.rfind("-", 0) == 0 || pathCount == 2) {
+            printUsage();
+            return 1;
+        } else {
+            paths[pathCount++] = arg;
+        }
+    }
+    if (pathCount != 2) {
+        printUsage();
+        return 1;
+    }
+
+    QImage images[2];
+    for (int i = 0; i < 2; i++) {
+        images[i] = QImage(QString::fromStdString(paths[i]));
+        if (images[i].isNull()) {
+            std::cerr << "could not read " << paths[i] << std::endl;
+            return 1;
+        }
+        images[i] = images[i].convertToFormat(QImage::Format_RGB888);
+    }
+    if (images[0].size() != images[1].size()) {
+        std::cerr << "sizes differ: " << images[0].width() << "x" << images[0].height() << " vs "
+                  << images[1].width() << "x" << images[1].height() << std::endl;
+        return 1;
+    }
+
+    const int width = images[0].width();
+    const int height = images[0].height();
+    QImage diff(width, height, QImage::Format_RGB888);
+
+    double squared = 0.0;
+    int maxDifference = 0;
+    long long differing = 0;
+    for (int y = 0; y < height; y++) {
+        const uchar *a = images[0].constScanLine(y);
+        const uchar *b = images[1].constScanLine(y);
+        uchar *d = diff.scanLine(y);
+        for (int x = 0; x < width; x++) {
+            int pixelMax = 0;
+            for (int c = 0; c < 3; c++) {
+                int difference = std::abs(int(a[3 * x + c]) - int(b[3 * x + c]));
+                squared += double(difference) * difference;
+                pixelMax = std::max(pixelMax, difference);
+                d[3 * x + c] = uchar(std::min(difference * 4, 255));
+            }
+            maxDifference = std::max(maxDifference, pixelMax);
+            if (pixelMax > threshold) differing++;
+        }
+    }
+
+    const double pixels = double(width) * height;
+    const double rmse = std::sqrt(squared / (pixels * 3.0));
+    const double psnr = rmse > 0.0 ? 20.0 * std::log10(255.0 / rmse) : INFINITY;
+
+    char buf[256];
+    snprintf(buf, sizeof(buf), "%dx%d | rmse %.3f | psnr %.2f dB | max %d | %.3f%% of pixels differ by more than %d",
+             width, height, rmse, psnr, maxDifference, 100.0 * double(differing) / pixels, threshold);
+    std::cout << buf << std::endl;
+
+    if (!output.empty() && !diff.save(QString::fromStdString(output))) {
+        std::cerr << "could not write " << output << std::endl;
+        return 1;
+    }
+    return minPsnr >= 0.0 && psnr < minPsnr ? 2 : 0;
+}
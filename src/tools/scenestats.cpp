@@ -0,0 +1,444 @@
+// scenestats: parses scene files the same way the app does (ScenefileReader -> SceneParser -> LSystem) without
+// opening a window or a GL context, and prints how heavy each scene is as json. meant to be diffed in review:
+//
+//   scenestats [files or dirs...] [--season 0-3] [--seed n] [--tess p1xp2]... [--no-timing] [-o out.json]
+//
+// directories are searched recursively for .json scene files (default: scenefiles). scenes come out sorted by path,
+// and rand() is reseeded before every scene so l-system materials pick the same way every run. timings are the only
+// thing that changes between runs, --no-timing leaves them out
+
+#include "utils/sceneparser.h"
+#include "shapes/shapetesselator.h"
+#include "utils/objloader.h"
+
+#include <QCoreApplication>
+#include <QImageReader>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QString>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Options {
+    std::vector<std::string> paths;
+    int seasonIdx = 3; // winter, same default as Settings
+    unsigned int seed = 1230;
+    std::vector<std::pair<int, int>> tessellations;
+    bool timing = true;
+    std::string output;
+};
+
+// bytes per shape in the instance vbo (model matrix, ambient, diffuse, specular, shininess, uv repeats), see InstanceData
+const size_t INSTANCE_BYTES = sizeof(glm::mat4) + 3 * sizeof(glm::vec3) + sizeof(float) + sizeof(glm::vec4) + sizeof(glm::vec2);
+const size_t VERTEX_BYTES = 14 * sizeof(float);
+
+const char *primitiveName(PrimitiveType type) {
+    switch (type) {
+    case PrimitiveType::PRIMITIVE_CUBE: return "cube";
+    case PrimitiveType::PRIMITIVE_CONE: return "cone";
+    case PrimitiveType::PRIMITIVE_CYLINDER: return "cylinder";
+    case PrimitiveType::PRIMITIVE_SPHERE: return "sphere";
+    case PrimitiveType::PRIMITIVE_MESH: return "mesh";
+    }
+    return "unknown";
+}
+
+QString tessellationName(const std::pair<int, int> &tess) {
+    return QString::fromStdString(std::to_string(tess.first) + "x" + std::to_string(tess.second));
+}
+
+double msSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// vertex count of one primitive at a tessellation setting. the shape renderer keeps one vbo per primitive type,
+// so this is also what it uploads
+size_t primitiveVertices(PrimitiveType type, const std::pair<int, int> &tess) {
+    static std::map<std::pair<PrimitiveType, std::pair<int, int>>, size_t> cache;
+
+    auto key = std::make_pair(type, tess);
+    auto it = cache.find(key);
+    if (it != cache.end()) {
+        return it->second;
+    }
+
+    std::vector<float> data;
+    switch (type) {
+    case PrimitiveType::PRIMITIVE_CUBE: data = CubeTessellator::tessellate(tess.first); break;
+    case PrimitiveType::PRIMITIVE_CONE: data = ConeTessellator::tessellate(tess.first, tess.second); break;
+    case PrimitiveType::PRIMITIVE_CYLINDER: data = CylinderTessellator::tessellate(tess.first, tess.second); break;
+    case PrimitiveType::PRIMITIVE_SPHERE: data = SphereTessellator::tessellate(tess.first, tess.second); break;
+    default: break;
+    }
+
+    size_t vertices = data.size() / 14;
+    cache[key] = vertices;
+    return vertices;
+}
+
+// triangle count of an obj, -1 if it can't be read. same loader as MeshLoader::loadOBJ
+long long meshTriangles(const std::string &file) {
+    static std::map<std::string, long long> cache;
+
+    auto it = cache.find(file);
+    if (it != cache.end()) {
+        return it->second;
+    }
+
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    std::string warn, err;
+
+    long long triangles = -1;
+    if (tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, file.c_str())) {
+        triangles = 0;
+        for (const tinyobj::shape_t &shape : shapes) {
+            for (unsigned char fv : shape.mesh.num_face_vertices) {
+                triangles += std::max(0, int(fv) - 2);
+            }
+        }
+    } else {
+        std::cerr << "could not read mesh " << file << ": " << err << std::endl;
+    }
+
+    cache[file] = triangles;
+    return triangles;
+}
+
+// only reads the image header
+QSize textureSize(const std::string &file) {
+    static std::map<std::string, QSize> cache;
+
+    auto it = cache.find(file);
+    if (it != cache.end()) {
+        return it->second;
+    }
+
+    QImageReader reader(QString::fromStdString(file));
+    QSize size = reader.size();
+    if (!size.isValid()) {
+        std::cerr << "could not read texture " << file << std::endl;
+        size = QSize(0, 0);
+    }
+
+    cache[file] = size;
+    return size;
+}
+
+// everything the renderer would batch on, minus the per-stem uv repeats (those are scaled per shape)
+std::string materialKey(const SceneMaterial &mat) {
+    std::ostringstream key;
+    auto color = [&](const SceneColor &c) { key << c.r << ',' << c.g << ',' << c.b << ',' << c.a << ';'; };
+    color(mat.cAmbient);
+    color(mat.cDiffuse);
+    color(mat.cSpecular);
+    key << mat.shininess << ';';
+    key << (mat.textureMap.isUsed ? mat.textureMap.filename : "") << ';';
+    key << (mat.bumpMap.isUsed ? mat.bumpMap.filename : "") << ';';
+    key << (mat.normalMap.isUsed ? mat.normalMap.filename : "");
+    return key.str();
+}
+
+QJsonObject sceneStats(const std::string &file, const Options &options) {
+    QJsonObject result;
+    result["file"] = QString::fromStdString(file);
+    result["season"] = options.seasonIdx;
+
+    std::srand(options.seed);
+
+    RenderData renderData;
+    SceneParseStats parseStats;
+    if (!SceneParser::parse(file, renderData, options.seasonIdx, &parseStats)) {
+        result["success"] = false;
+        return result;
+    }
+    result["success"] = true;
+
+    auto statsStart = std::chrono::steady_clock::now();
+
+    // l-systems, one entry per expansion
+    QJsonArray lsystems;
+    for (const LSystemParseStats &ls : parseStats.lsystems) {
+        QJsonObject obj;
+        obj["axiom"] = QString::fromStdString(ls.axiom);
+        obj["iterations"] = ls.iterations;
+
+        QJsonArray symbols;
+        for (size_t count : ls.symbolsPerIteration) {
+            symbols.append(qint64(count));
+        }
+        obj["symbolsPerIteration"] = symbols;
+        obj["stems"] = ls.stems;
+        obj["leaves"] = ls.leaves;
+        obj["flowers"] = ls.flowers;
+
+        if (options.timing) {
+            QJsonObject timing;
+            timing["expand"] = ls.expandMs;
+            timing["interpret"] = ls.interpretMs;
+            obj["timingMs"] = timing;
+        }
+        lsystems.append(obj);
+    }
+    result["lsystems"] = lsystems;
+
+    // final shape counts (every instance of a template included, that's what gets drawn)
+    std::map<PrimitiveType, qint64> byPrimitive;
+    qint64 stems = 0, leaves = 0, flowers = 0, other = 0;
+    std::set<std::string> materials;
+    std::set<std::string> textures;
+    std::set<std::string> meshes;
+
+    forEachDrawnShape(renderData, [&](int, const RenderShapeData &shape, const glm::mat4 &) {
+        byPrimitive[shape.primitive.type]++;
+        switch (shape.role) {
+        case ShapeRole::STEM: stems++; break;
+        case ShapeRole::LEAF: leaves++; break;
+        case ShapeRole::FLOWER: flowers++; break;
+        default: other++; break;
+        }
+
+        const SceneMaterial &mat = shape.material;
+        materials.insert(materialKey(mat));
+        if (mat.textureMap.isUsed) textures.insert(mat.textureMap.filename);
+        if (mat.bumpMap.isUsed) textures.insert(mat.bumpMap.filename);
+        if (mat.normalMap.isUsed) textures.insert(mat.normalMap.filename);
+        if (shape.primitive.type == PrimitiveType::PRIMITIVE_MESH) meshes.insert(shape.primitive.meshfile);
+    });
+
+    QJsonObject shapes;
+    shapes["total"] = qint64(renderData.drawCount);
+    shapes["instanced"] = qint64(renderData.drawCount) - qint64(renderData.shapes.size()); // no copy of their own
+    shapes["stems"] = stems;
+    shapes["leaves"] = leaves;
+    shapes["flowers"] = flowers;
+    shapes["other"] = other;
+    QJsonObject primitives;
+    for (const auto &[type, count] : byPrimitive) {
+        primitives[primitiveName(type)] = count;
+    }
+    shapes["byPrimitive"] = primitives;
+    result["shapes"] = shapes;
+
+    result["templates"] = parseStats.templates;
+    result["templateInstances"] = parseStats.templateInstances;
+    result["lights"] = qint64(renderData.lights.size());
+    result["animatedGroups"] = renderData.animation.nodeCount();
+    result["uniqueMaterials"] = qint64(materials.size());
+
+    // meshes: every instance draws the whole obj
+    auto meshStart = std::chrono::steady_clock::now();
+    QJsonArray meshFiles;
+    qint64 meshTris = 0;
+    size_t meshBytes = 0;
+    for (const std::string &mesh : meshes) {
+        long long tris = meshTriangles(mesh);
+        QJsonObject obj;
+        obj["file"] = QString::fromStdString(mesh);
+        obj["triangles"] = qint64(tris);
+        meshFiles.append(obj);
+
+        if (tris > 0) {
+            meshBytes += size_t(tris) * 3 * VERTEX_BYTES;
+        }
+    }
+    forEachDrawnShape(renderData, [&](int, const RenderShapeData &shape, const glm::mat4 &) {
+        if (shape.primitive.type == PrimitiveType::PRIMITIVE_MESH) {
+            meshTris += std::max(0LL, meshTriangles(shape.primitive.meshfile));
+        }
+    });
+    double meshMs = msSince(meshStart);
+    result["meshes"] = meshFiles;
+
+    // textures are uploaded as rgba8 without mips
+    auto textureStart = std::chrono::steady_clock::now();
+    QJsonArray textureFiles;
+    size_t textureBytes = 0;
+    for (const std::string &texture : textures) {
+        QSize size = textureSize(texture);
+        QJsonObject obj;
+        obj["file"] = QString::fromStdString(texture);
+        obj["width"] = size.width();
+        obj["height"] = size.height();
+        textureFiles.append(obj);
+        textureBytes += size_t(size.width()) * size_t(size.height()) * 4;
+    }
+    double textureMs = msSince(textureStart);
+    result["textures"] = textureFiles;
+
+    // triangles + primitive vbo sizes for every tessellation setting we were asked about
+    QJsonObject triangles;
+    QJsonObject primitiveBytes;
+    for (const auto &tess : options.tessellations) {
+        qint64 tris = meshTris;
+        size_t bytes = 0;
+        for (const auto &[type, count] : byPrimitive) {
+            if (type == PrimitiveType::PRIMITIVE_MESH) continue;
+            size_t vertices = primitiveVertices(type, tess);
+            tris += qint64(vertices / 3) * count;
+            bytes += vertices * VERTEX_BYTES;
+        }
+        triangles[tessellationName(tess)] = tris;
+        primitiveBytes[tessellationName(tess)] = qint64(bytes);
+    }
+    result["triangles"] = triangles;
+
+    QJsonObject gpu;
+    gpu["primitiveVbos"] = primitiveBytes;
+    gpu["meshVbos"] = qint64(meshBytes);
+    gpu["instanceData"] = qint64(renderData.drawCount * INSTANCE_BYTES);
+    gpu["textures"] = qint64(textureBytes);
+
+    QJsonObject memory;
+    memory["cpuBytes"] = qint64(SceneParser::estimateMemory(renderData));
+    memory["gpuBytes"] = gpu;
+    result["memory"] = memory;
+
+    if (options.timing) {
+        QJsonObject timing;
+        timing["read"] = parseStats.readMs;
+        timing["traverse"] = parseStats.traverseMs;
+        timing["meshes"] = meshMs;
+        timing["textures"] = textureMs;
+        timing["stats"] = msSince(statsStart) - meshMs - textureMs;
+        result["timingMs"] = timing;
+    }
+
+    return result;
+}
+
+bool parseTessellation(const std::string &arg, std::pair<int, int> &tess) {
+    size_t x = arg.find('x');
+    if (x == std::string::npos) {
+        return false;
+    }
+    tess.first = std::atoi(arg.substr(0, x).c_str());
+    tess.second = std::atoi(arg.substr(x + 1).c_str());
+    return tess.first > 0 && tess.second > 0;
+}
+
+void printUsage() {
+    std::cerr << "usage: scenestats [files or dirs...] [--season 0-3] [--seed n] [--tess p1xp2]... [--no-timing] [-o out.json]"
+              << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv); // image format plugins need an application object
+
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--no-timing") {
+            options.timing = false;
+        } else if (arg == "--season" && hasValue) {
+            options.seasonIdx = std::atoi(argv[++i]);
+        } else if (arg == "--seed" && hasValue) {
+            options.seed = unsigned(std::atoi(argv[++i]));
+        } else if (arg == "--tess" && hasValue) {
+            std::pair<int, int> tess;
+            if (!parseTessellation(argv[++i], tess)) {
+                std::cerr << "bad tessellation " << argv[i] << ", expected something like 10x10" << std::endl;
+                return 1;
+            }
+            options.tessellations.push_back(tess);
+        } else if (arg == "-o" && hasValue) {
+            options.output = argv[++i];
+        } else if (arg == "-h" || arg == "--help") {
+            printUsage();
+            return 0;
+        } else if (arg.rfind("-", 0) == 0) {
+            printUsage();
+            return 1;
+        } else {
+            options.paths.push_back(arg);
+        }
+    }
+
+    if (options.seasonIdx < 0 || options.seasonIdx > 3) {
+        std::cerr << "season has to be 0 (spring) to 3 (winter)" << std::endl;
+        return 1;
+    }
+    if (options.paths.empty()) {
+        options.paths.push_back("scenefiles");
+    }
+    if (options.tessellations.empty()) {
+        options.tessellations = {{1, 1}, {5, 5}, {10, 10}, {25, 25}};
+    }
+
+    std::vector<std::string> files;
+    for (const std::string &path : options.paths) {
+        if (std::filesystem::is_directory(path)) {
+            for (const auto &entry : std::filesystem::recursive_directory_iterator(path)) {
+                if (entry.is_regular_file() && entry.path().extension() == ".json") {
+                    files.push_back(entry.path().generic_string());
+                }
+            }
+        } else if (std::filesystem::exists(path)) {
+            files.push_back(path);
+        } else {
+            std::cerr << "no such file or directory: " << path << std::endl;
+            return 1;
+        }
+    }
+    std::sort(files.begin(), files.end());
+    files.erase(std::unique(files.begin(), files.end()), files.end());
+
+    // the reader/parser log to std::cout, keep that out of the json
+    std::streambuf *coutBuffer = std::cout.rdbuf(std::cerr.rdbuf());
+
+    QJsonArray scenes;
+    int failed = 0;
+    for (const std::string &file : files) {
+        QJsonObject scene = sceneStats(file, options);
+        if (!scene["success"].toBool()) failed++;
+        scenes.append(scene);
+    }
+
+    std::cout.rdbuf(coutBuffer);
+
+    QJsonArray tessellations;
+    for (const auto &tess : options.tessellations) {
+        tessellations.append(tessellationName(tess));
+    }
+
+    QJsonObject root;
+    root["season"] = options.seasonIdx;
+    root["seed"] = qint64(options.seed);
+    root["tessellations"] = tessellations;
+    root["scenes"] = scenes;
+
+    QByteArray json = QJsonDocument(root).toJson(QJsonDocument::Indented);
+
+    if (options.output.empty()) {
+        std::fwrite(json.constData(), 1, json.size(), stdout);
+    } else {
+        FILE *out = std::fopen(options.output.c_str(), "wb");
+        if (!out) {
+            std::cerr << "could not open " << options.output << std::endl;
+            return 1;
+        }
+        std::fwrite(json.constData(), 1, json.size(), out);
+        std::fclose(out);
+    }
+
+    std::cerr << files.size() << " scenes, " << failed << " failed" << std::endl;
+    return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,266 @@
+#include "lightutils.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace {
+    const float SPLIT_LAMBDA = 0.75f;  // 0 is uniform splits, 1 is logarithmic
+    const float FAR_QUANTUM = 8.0f;    // the shadow distance only changes in steps of this, so the splits sit still
+    const float RADIUS_QUANTUM = 0.25f;
+    const float DEPTH_PADDING = 0.5f;  // world units in front of / behind the casters
+
+    const float ATTENUATION_CUTOFF = 64.0f; // 1 / attenuation where a light stops being worth a shadow
+    const float MIN_RANGE = 1.0f;
+    const float MAX_RANGE = 50.0f;
+    const float LOCAL_NEAR = 0.05f;
+    const float CONE_MARGIN = 0.1f; // radians added to the spot's cone so the penumbra edge isn't right on the border
+
+    // view space corners of the camera frustum between two view distances
+    void sliceCorners(const glm::mat4& invViewProj, const glm::vec3& eye, float near, float from, float to, glm::vec3 out[8]) {
+        for (int i = 0; i < 4; i++) {
+            glm::vec4 ndc((i & 1) ? 1.0f : -1.0f, (i & 2) ? 1.0f : -1.0f, -1.0f, 1.0f);
+            glm::vec4 p = invViewProj * ndc;
+            glm::vec3 ray = glm::vec3(p) / p.w - eye; // ends on the near plane
+            out[i] = eye + ray * (from / near);
+            out[i + 4] = eye + ray * (to / near);
+        }
+    }
+}
+
+/**
+ * @brief LightUtils::calculateLightMatrix builds the light space matrix used for shadow mapping. ortho for directional lights,
+ * perspective for spot lights, identity for point lights (the shadow atlas builds its own for spot/point lights, see
+ * localShadowMatrices)
+ * @param light
+ * @param position
+ * @param dir
+ * @return
+ */
+glm::mat4 LightUtils::calculateLightMatrix(SceneLight *light, glm::vec3 position, glm::vec3 dir) {
+
+    glm::mat4 lightSpaceMatrix = glm::mat4(1.0f);
+    glm::vec3 lightInvDir = -1.0f * dir;
+    glm::mat4 lightProjection, lightView;
+
+    switch(light->type) {
+    case LightType::LIGHT_POINT:
+        break;
+    case LightType::LIGHT_DIRECTIONAL:
+        // calculate light space matrix for shadow mapping
+        // Position the light far enough to see the whole scene
+        {
+            float orthoSize = 100.0f;  // covers a 200x200 area (adjust based on your scene)
+            float nearPlane = 0.1f;
+            float farPlane = 200.0f;   // far enough to capture distant objects
+            
+            // Position light above the scene center, offset by light direction
+            glm::vec3 lightPos = lightInvDir * 100.0f;  // move light far back along inverse direction
+            
+            lightProjection = glm::ortho(-orthoSize, orthoSize, -orthoSize, orthoSize, nearPlane, farPlane);
+            lightView = glm::lookAt(lightPos, glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+            lightSpaceMatrix = lightProjection * lightView;
+        }
+        break;
+
+    case LightType::LIGHT_SPOT:
+        // change orthographic mat into perspective mat
+        glm::vec3 look = glm::vec3(dir);
+        glm::vec3 up = glm::vec3(0.0f, 0.0f, 1.0f);
+
+        glm::vec3 w = -glm::normalize(glm::vec3(look));
+        glm::vec3 v_prime = up - (glm::dot(up, w)) * w;
+        glm::vec3 v = glm::normalize(v_prime);
+        glm::vec3 u = glm::cross(v, w);
+
+        glm::mat4 mT = glm::mat4(1.0f, 0.0f, 0.0f, 0.0f,
+                                 0.0f, 1.0f, 0.0f, 0.0f,
+                                 0.0f, 0.0f, 1.0f, 0.0f,
+                                 -position[0], -position[1], -position[2], 1.0f);
+
+        glm::mat4 rot = glm::mat4(glm::vec4(u, 0.0f),
+                                  glm::vec4(v, 0.0f),
+                                  glm::vec4(w, 0.0f),
+                                  glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+        glm::mat4 mR = glm::transpose(rot);
+
+        lightView = mR * mT;
+
+        float far = 10.f;
+        float near = 3.0f;
+        float theta = light->angle * 2.0f;
+
+        glm::mat4 scaleMat = glm::mat4(1.0f / (far * tan(theta / 2.0f)), 0.0f, 0.0f, 0.0f,
+                                       0.0f, 1.0f / (far * tan(theta / 2.0f)), 0.0f, 0.0f,
+                                       0.0f, 0.0f, 1.0f / far, 0.0f,
+                                       0.0f, 0.0f, 0.0f, 1.0f);
+
+        float c = -near / far;
+
+        glm::mat4 unhingingMat = glm::mat4(1.0f, 0.0f, 0.0f, 0.0f,
+                                           0.0f, 1.0f, 0.0f, 0.0f,
+                                           0.0f, 0.0f, 1.0f / (1.0f + c), -1.0f,
+                                           0.0f, 0.0f, -c / (1.0f + c), 0.0f);
+
+        glm::mat4 glFix = glm::mat4(1.0f, 0.0f, 0.0f, 0.0f,
+                                    0.0f, 1.0f, 0.0f, 0.0f,
+                                    0.0f, 0.0f, -2.0f, 0.0f,
+                                    0.0f, 0.0f, -1.0f, 1.0f);
+
+
+        lightProjection = glFix * unhingingMat * scaleMat;
+        lightSpaceMatrix = lightProjection * lightView;
+        break;
+    }
+
+    return lightSpaceMatrix;
+
+}
+
+/**
+ * @brief LightUtils::fitCascades practical split scheme (log/uniform blend) over the part of the view that actually
+ * has something in it, then per cascade:
+ * - xy: a square around the slice's bounding sphere (same size whichever way the camera turns), or around the whole
+ *   scene if that's smaller. the square's position is snapped to whole texels so the map doesn't shimmer as the
+ *   camera moves
+ * - z: just the casters under that square (their instance bounds), from the one nearest the light to the farthest
+ * @return count 0 if there's nothing to fit to
+ */
+ShadowCascades LightUtils::fitCascades(const glm::vec3& lightDir, const glm::mat4& view, const glm::mat4& proj,
+                                       float near, float far, int count, int resolution, const BVH& casters) {
+    ShadowCascades cascades;
+    const AABB scene = casters.bounds();
+    if (scene.empty() || glm::length(lightDir) < 1e-6f) return cascades;
+    count = std::clamp(count, 1, MAX_SHADOW_CASCADES);
+
+    const glm::mat4 invView = glm::inverse(view);
+    const glm::vec3 eye = glm::vec3(invView[3]);
+
+    // no point splitting up the view past the farthest thing in the scene
+    float sceneFar = 0.0f;
+    for (int i = 0; i < 8; i++) {
+        glm::vec3 corner((i & 1) ? scene.max.x : scene.min.x, (i & 2) ? scene.max.y : scene.min.y, (i & 4) ? scene.max.z : scene.min.z);
+        sceneFar = std::max(sceneFar, -(view * glm::vec4(corner, 1.0f)).z);
+    }
+    far = std::clamp(std::ceil(sceneFar / FAR_QUANTUM) * FAR_QUANTUM, near + FAR_QUANTUM, far);
+
+    // light view: just a rotation, the ortho box is placed in its coordinates
+    const glm::vec3 dir = glm::normalize(lightDir);
+    const glm::vec3 up = std::abs(dir.y) > 0.99f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+    const glm::mat4 lightView = glm::lookAt(glm::vec3(0.0f), dir, up);
+
+    const AABB sceneLight = AABB::transformed(scene, lightView);
+    const glm::vec2 sceneExtent = glm::vec2(sceneLight.max - sceneLight.min);
+    const float sceneSize = std::max(sceneExtent.x, sceneExtent.y);
+
+    const glm::mat4 invViewProj = glm::inverse(proj * view);
+    std::vector<int> inside;
+    float from = near;
+
+    for (int c = 0; c < count; c++) {
+        float t = float(c + 1) / count;
+        float to = SPLIT_LAMBDA * near * std::pow(far / near, t) + (1.0f - SPLIT_LAMBDA) * (near + (far - near) * t);
+        if (c == count - 1) to = far;
+
+        glm::vec3 corners[8];
+        sliceCorners(invViewProj, eye, near, from, to, corners);
+        glm::vec3 center(0.0f);
+        for (const glm::vec3& p : corners) center += p / 8.0f;
+        float radius = 0.0f;
+        for (const glm::vec3& p : corners) radius = std::max(radius, glm::length(p - center));
+        radius = std::ceil(radius / RADIUS_QUANTUM) * RADIUS_QUANTUM;
+
+        // whichever is smaller, both only move when the camera moves a whole texel (or the scene changes)
+        glm::vec2 boxCenter;
+        float halfSize;
+        if (sceneSize < 2.0f * radius) {
+            halfSize = 0.5f * std::ceil(sceneSize / RADIUS_QUANTUM) * RADIUS_QUANTUM;
+            boxCenter = glm::vec2(sceneLight.center());
+        } else {
+            halfSize = radius;
+            boxCenter = glm::vec2(lightView * glm::vec4(center, 1.0f));
+        }
+        // one texel of margin on each side makes up for the snap
+        const float texel = 2.0f * halfSize / (resolution - 2);
+        halfSize += texel;
+        boxCenter = glm::floor(boxCenter / texel) * texel;
+        const glm::vec2 lo = boxCenter - halfSize, hi = boxCenter + halfSize;
+
+        // casters under the box, over the whole depth of the scene (anything between the sun and the slice counts)
+        glm::mat4 column = glm::ortho(lo.x, hi.x, lo.y, hi.y, -sceneLight.max.z - DEPTH_PADDING, -sceneLight.min.z + DEPTH_PADDING);
+        inside.clear();
+        casters.query(Frustum::fromMatrix(column * lightView), inside);
+
+        float zMin = FLT_MAX, zMax = -FLT_MAX;
+        for (int item : inside) {
+            AABB box = AABB::transformed(casters.itemBounds(item), lightView);
+            zMin = std::min(zMin, box.min.z);
+            zMax = std::max(zMax, box.max.z);
+        }
+        if (inside.empty()) {
+            zMin = sceneLight.min.z;
+            zMax = sceneLight.max.z;
+        }
+
+        // light view looks down -z, so the caster nearest the light has the biggest z
+        glm::mat4 ortho = glm::ortho(lo.x, hi.x, lo.y, hi.y, -zMax - DEPTH_PADDING, -zMin + DEPTH_PADDING);
+        cascades.matrices[c] = ortho * lightView;
+        cascades.splits[c] = to;
+        from = to;
+    }
+
+    cascades.count = count;
+    return cascades;
+}
+
+int LightUtils::sunIndex(const std::vector<SceneLightData>& lights) {
+    for (size_t i = 0; i < lights.size(); i++) {
+        if (lights[i].type == LightType::LIGHT_DIRECTIONAL) return static_cast<int>(i);
+    }
+    return -1;
+}
+
+/**
+ * @brief LightUtils::lightRange solves c0 + c1 * d + c2 * d^2 = ATTENUATION_CUTOFF for d
+ */
+float LightUtils::lightRange(const glm::vec3& function) {
+    const float c0 = function.x, c1 = function.y, c2 = function.z;
+    float range = MAX_RANGE;
+    if (c2 > 1e-6f) {
+        float disc = c1 * c1 - 4.0f * c2 * (c0 - ATTENUATION_CUTOFF);
+        range = (-c1 + std::sqrt(std::max(disc, 0.0f))) / (2.0f * c2);
+    } else if (c1 > 1e-6f) {
+        range = (ATTENUATION_CUTOFF - c0) / c1;
+    }
+    return std::clamp(range, MIN_RANGE, MAX_RANGE);
+}
+
+/**
+ * @brief LightUtils::localShadowMatrices the spot's cone or the 6 faces of a cube around the point light. the face
+ * order is what default.frag picks with the major axis of light -> fragment
+ */
+int LightUtils::localShadowMatrices(const SceneLightData& light, float range, glm::mat4 out[MAX_LIGHT_SHADOW_VIEWS]) {
+    const glm::vec3 pos = glm::vec3(light.pos);
+
+    if (light.type == LightType::LIGHT_SPOT) {
+        glm::vec3 dir = glm::normalize(glm::vec3(light.dir));
+        glm::vec3 up = std::abs(dir.y) > 0.99f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        float fov = std::min(2.0f * light.angle + CONE_MARGIN, glm::radians(170.0f));
+        out[0] = glm::perspective(fov, 1.0f, LOCAL_NEAR, range) * glm::lookAt(pos, pos + dir, up);
+        return 1;
+    }
+
+    if (light.type == LightType::LIGHT_POINT) {
+        const glm::vec3 dirs[6] = {{1, 0, 0}, {-1, 0, 0}, {0, 1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1}};
+        const glm::vec3 ups[6] = {{0, -1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1}, {0, -1, 0}, {0, -1, 0}};
+        const glm::mat4 proj = glm::perspective(glm::radians(90.0f), 1.0f, LOCAL_NEAR, range);
+        for (int f = 0; f < 6; f++) {
+            out[f] = proj * glm::lookAt(pos, pos + dirs[f], ups[f]);
+        }
+        return 6;
+    }
+
+    return 0;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "scenedata.h"
+#include "culling/bvh.h"
+#include <vector>
+#include <glm/glm.hpp>
+
+const int MAX_SHADOW_CASCADES = 4;
+const int MAX_LIGHT_SHADOW_VIEWS = 6; // a point light is a cube, 6 perspective views
+
+// Cascaded shadow map matrices for the sun, one per slice of the camera frustum (nearest first)
+struct ShadowCascades {
+    int count = 0;
+    glm::mat4 matrices[MAX_SHADOW_CASCADES];
+    glm::vec4 splits = glm::vec4(0.0f); // view space distance where each cascade ends
+};
+
+// Light math that doesn't need a GL context (the parser bakes these into SceneLightData)
+class LightUtils {
+public:
+    static glm::mat4 calculateLightMatrix(SceneLight *light, glm::vec3 position, glm::vec3 dir);
+
+    // splits [near, far] between count cascades and fits an ortho matrix for a directional light to each slice
+    // (resolution is one cascade's width in texels, casters are looked up in the bvh)
+    static ShadowCascades fitCascades(const glm::vec3& lightDir, const glm::mat4& view, const glm::mat4& proj,
+                                      float near, float far, int count, int resolution, const BVH& casters);
+
+    // the light that gets the cascades: the first directional one, -1 if there isn't one
+    static int sunIndex(const std::vector<SceneLightData>& lights);
+    // distance where the attenuation has dropped below what's worth shadowing (clamped, no falloff = the max)
+    static float lightRange(const glm::vec3& function);
+    // proj * view for each shadow view of a spot (1, the cone) or point light (6, cube faces +x -x +y -y +z -z)
+    // out to range. returns how many were written, 0 for other lights
+    static int localShadowMatrices(const SceneLightData& light, float range, glm::mat4 out[MAX_LIGHT_SHADOW_VIEWS]);
+};
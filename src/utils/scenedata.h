@@ -4,6 +4,7 @@
 #include <string>
 
 #include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
 
 
 
@@ -204,6 +205,25 @@ struct LSystemData {
     std::vector<LSystemRule> rules;    // All rules
 };
 
+// Keyframes for a group's "animation" block. Times are in seconds.
+struct SceneVec3Keyframe {
+    float time;
+    glm::vec3 value;
+};
+
+struct SceneRotationKeyframe {
+    float time;
+    glm::quat value; // built from the same [x, y, z, angle in degrees] format as "rotate"
+};
+
+// Keyframed TRS applied on top of the group's own transformations (T * R * S, in the group's local space)
+struct SceneAnimation {
+    std::vector<SceneVec3Keyframe> translate;
+    std::vector<SceneRotationKeyframe> rotate;
+    std::vector<SceneVec3Keyframe> scale;
+    bool loop = true;
+};
+
 // Struct which represents a node in the scene graph/tree, to be parsed by the student's `SceneParser`.
 struct SceneNode {
     std::vector<SceneTransformation*> transformations; // Note the order of transformations described in lab 5
@@ -212,5 +232,6 @@ struct SceneNode {
     std::vector<SceneNode*> children;
 
     LSystemData* lsystem = nullptr;
+    SceneAnimation* animation = nullptr; // only set on groups with an "animation" block
 
 };
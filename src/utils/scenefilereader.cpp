@@ -20,8 +20,9 @@
                                          << e.tagName().toStdString() << ">" << std::endl;
 
 // Students, please ignore this file.
-ScenefileReader::ScenefileReader(const std::string &name) {
+ScenefileReader::ScenefileReader(const std::string &name, int seasonIdx) {
     file_name = name;
+    m_seasonIdx = seasonIdx;
 
     memset(&m_cameraData, 0, sizeof(SceneCameraData));
     memset(&m_globalData, 0, sizeof(SceneGlobalData));
@@ -45,6 +46,7 @@ ScenefileReader::~ScenefileReader() {
         {
             delete (m_nodes[node])->primitives[i];
         }
+        delete (m_nodes[node])->animation;
         (m_nodes[node])->transformations.clear();
         (m_nodes[node])->primitives.clear();
         (m_nodes[node])->children.clear();
@@ -67,6 +69,10 @@ SceneNode *ScenefileReader::getRootNode() const {
     return m_root;
 }
 
+const std::map<std::string, SceneNode *> &ScenefileReader::getTemplates() const {
+    return m_templates;
+}
+
 // This is where it all goes down...
 bool ScenefileReader::readJSON() {
     // Read the file
@@ -545,7 +551,7 @@ bool ScenefileReader::parseTemplateGroups(const QJsonValue &templateGroups) {
 
 bool ScenefileReader::parseTemplateGroupData(const QJsonObject &templateGroup) {
     QStringList requiredFields = {"name"};
-    QStringList optionalFields = {"translate", "rotate", "scale", "matrix", "lights", "primitives", "groups"};
+    QStringList optionalFields = {"translate", "rotate", "scale", "matrix", "lights", "primitives", "groups", "lsystem", "animation"};
     QStringList allFields = requiredFields + optionalFields;
     for (auto &field : templateGroup.keys()) {
         if (!allFields.contains(field)) {
@@ -580,7 +586,7 @@ bool ScenefileReader::parseTemplateGroupData(const QJsonObject &templateGroup) {
  * NAME OF NODE CANNOT REFERENCE TEMPLATE NODE
  */
 bool ScenefileReader::parseGroupData(const QJsonObject &object, SceneNode *node) {
-    QStringList optionalFields = {"name", "translate", "rotate", "scale", "matrix", "lights", "primitives", "groups", "lsystem"};
+    QStringList optionalFields = {"name", "translate", "rotate", "scale", "matrix", "lights", "primitives", "groups", "lsystem", "animation"};
     QStringList allFields = optionalFields;
     for (auto &field : object.keys()) {
         if (!allFields.contains(field)) {
@@ -728,6 +734,17 @@ bool ScenefileReader::parseGroupData(const QJsonObject &object, SceneNode *node)
         node->transformations.push_back(matrixTransformation);
     }
 
+    // parse keyframed animation if defined (applied after the static transformations above)
+    if (object.contains("animation")) {
+        if (!object["animation"].isObject()) {
+            std::cout << "group animation must be of type object" << std::endl;
+            return false;
+        }
+        if (!parseAnimation(object["animation"].toObject(), node)) {
+            return false;
+        }
+    }
+
     // parse lights if any
     if (object.contains("lights")) {
         if (!object["lights"].isArray()) {
@@ -776,6 +793,93 @@ bool ScenefileReader::parseGroupData(const QJsonObject &object, SceneNode *node)
     return true;
 }
 
+/**
+ * Parse a group's "animation" object. Each track is an array of {"time": t, "value": [...]} keys;
+ * translate/scale values have 3 elements, rotate values use the same [x, y, z, degrees] format as "rotate".
+ */
+bool ScenefileReader::parseAnimation(const QJsonObject &anim, SceneNode *node) {
+    QStringList optionalFields = {"translate", "rotate", "scale", "loop"};
+    for (auto &field : anim.keys()) {
+        if (!optionalFields.contains(field)) {
+            std::cout << "unknown field \"" << field.toStdString() << "\" on animation object" << std::endl;
+            return false;
+        }
+    }
+
+    SceneAnimation *animation = new SceneAnimation();
+    node->animation = animation;
+
+    if (anim.contains("loop")) {
+        if (!anim["loop"].isBool()) {
+            std::cout << "animation loop must be a bool" << std::endl;
+            return false;
+        }
+        animation->loop = anim["loop"].toBool();
+    }
+
+    for (const QString &track : {QString("translate"), QString("rotate"), QString("scale")}) {
+        if (!anim.contains(track)) {
+            continue;
+        }
+        if (!anim[track].isArray()) {
+            std::cout << "animation " << track.toStdString() << " must be of type array" << std::endl;
+            return false;
+        }
+
+        const int valueSize = (track == "rotate") ? 4 : 3;
+        float prevTime = -1.f;
+        for (auto key : anim[track].toArray()) {
+            if (!key.isObject()) {
+                std::cout << "animation keyframes must be of type object" << std::endl;
+                return false;
+            }
+            QJsonObject keyObj = key.toObject();
+            if (!keyObj["time"].isDouble() || !keyObj["value"].isArray()) {
+                std::cout << "animation keyframes need a \"time\" and a \"value\"" << std::endl;
+                return false;
+            }
+
+            float time = keyObj["time"].toDouble();
+            if (time < prevTime) {
+                std::cout << "animation " << track.toStdString() << " keyframes must be sorted by time" << std::endl;
+                return false;
+            }
+            prevTime = time;
+
+            QJsonArray valueArray = keyObj["value"].toArray();
+            if (valueArray.size() != valueSize) {
+                std::cout << "animation " << track.toStdString() << " values must have " << valueSize << " elements" << std::endl;
+                return false;
+            }
+            for (auto v : valueArray) {
+                if (!v.isDouble()) {
+                    std::cout << "animation values must contain floating-point values" << std::endl;
+                    return false;
+                }
+            }
+
+            if (track == "rotate") {
+                glm::vec3 axis(valueArray[0].toDouble(), valueArray[1].toDouble(), valueArray[2].toDouble());
+                if (glm::length(axis) < 1e-6f) {
+                    std::cout << "animation rotate axis must not be zero" << std::endl;
+                    return false;
+                }
+                float angle = valueArray[3].toDouble() * M_PI / 180.f;
+                animation->rotate.push_back({time, glm::angleAxis(angle, glm::normalize(axis))});
+            } else {
+                glm::vec3 value(valueArray[0].toDouble(), valueArray[1].toDouble(), valueArray[2].toDouble());
+                if (track == "translate") {
+                    animation->translate.push_back({time, value});
+                } else {
+                    animation->scale.push_back({time, value});
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
 bool ScenefileReader::parseGroups(const QJsonValue &groups, SceneNode *parent) {
     if (!groups.isArray()) {
         std::cout << "groups must be of type array" << std::endl;
@@ -1090,9 +1194,9 @@ bool ScenefileReader::parseLSystem(const QJsonObject &obj, SceneNode *node){
             return false;
         }
         
-        // Always use season from settings (ignore JSON season field)
+        // Always use season from settings (ignore JSON season field), unless the caller picked one
         Season season = Season::SUMMER;
-        int seasonIdx = settings.getCurrentSeasonIndex();
+        int seasonIdx = (m_seasonIdx >= 0) ? m_seasonIdx : settings.getCurrentSeasonIndex();
         if (seasonIdx == 0) season = Season::SPRING;
         else if (seasonIdx == 1) season = Season::SUMMER;
         else if (seasonIdx == 2) season = Season::FALL;
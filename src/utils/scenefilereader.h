@@ -12,7 +12,9 @@
 class ScenefileReader {
 public:
     // Create a ScenefileReader, passing it the scene file.
-    ScenefileReader(const std::string &filename);
+    // seasonIdx picks the plant preset materials (same indices as Settings::getCurrentSeasonIndex), -1 reads the global settings.
+    // Pass it explicitly when parsing off the GUI thread.
+    ScenefileReader(const std::string &filename, int seasonIdx = -1);
 
     // Clean up all data for the scene
     ~ScenefileReader();
@@ -26,6 +28,9 @@ public:
 
     SceneNode *getRootNode() const;
 
+    // Template groups by name. References to a template share the same SceneNode.
+    const std::map<std::string, SceneNode *> &getTemplates() const;
+
 private:
     // The filename should be contained within this parser implementation.
     // If you want to parse a new file, instantiate a different parser.
@@ -38,10 +43,12 @@ private:
     bool parsePrimitive(const QJsonObject &prim, SceneNode *node);
     bool parseLightData(const QJsonObject &lightData, SceneNode *node);
     bool parseLSystem(const QJsonObject &obj, SceneNode *node);
+    bool parseAnimation(const QJsonObject &anim, SceneNode *node);
     bool parseMaterialProperties(const QJsonObject &matObj, SceneMaterial &mat);
 
 
     std::string file_name;
+    int m_seasonIdx;
 
     mutable std::map<std::string, SceneNode *> m_templates;
 
@@ -0,0 +1,192 @@
+#include "sceneloader.h"
+#include "textureutils.h"
+#include "settings.h"
+
+#include <future>
+#include <iostream>
+#include <map>
+
+SceneLoader::~SceneLoader() {
+    cancel();
+}
+
+void SceneLoader::load(const std::string &filepath, int seasonIdx, std::map<std::string, MeshCPUData> residentMeshes,
+                       std::set<std::string> residentTextures, bool preload) {
+
+    Request request{filepath, seasonIdx, std::move(residentMeshes), std::move(residentTextures), preload, settings.farPlane};
+
+    if (m_thread.joinable() && !m_finished) {
+        // the worker can't be interrupted mid-parse, so just drop whatever it makes and go again after
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_cancelled = true;
+        m_queued = std::move(request);
+        return;
+    }
+
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+    start(std::move(request));
+}
+
+bool SceneLoader::isLoading() const {
+    return m_thread.joinable();
+}
+
+std::string SceneLoader::status() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_status;
+}
+
+std::unique_ptr<LoadedScene> SceneLoader::takeResult() {
+    if (!m_thread.joinable() || !m_finished) {
+        return nullptr;
+    }
+    m_thread.join();
+
+    std::unique_ptr<LoadedScene> result;
+    std::optional<Request> queued;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        result = std::move(m_result);
+        queued = std::move(m_queued);
+        m_queued.reset();
+    }
+
+    // a newer load came in while this one was running
+    if (queued) {
+        start(std::move(*queued));
+        return nullptr;
+    }
+
+    return result;
+}
+
+void SceneLoader::cancel() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_cancelled = true;
+        m_queued.reset();
+    }
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+    m_result.reset();
+}
+
+void SceneLoader::start(Request request) {
+    m_finished = false;
+    m_cancelled = false;
+    m_progress = 0.f;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_result.reset();
+    }
+
+    m_thread = std::thread(&SceneLoader::run, this, std::move(request));
+}
+
+void SceneLoader::setStatus(const std::string &status, float progress) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_status = status;
+    m_progress = progress;
+}
+
+/**
+ * @brief SceneLoader::run the worker. parses the scene (this is where the l-systems grow), then decodes every mesh and texture
+ * the scene needs that isn't on the gpu yet. meshes and textures are decoded at the same time on two tasks. last the
+ * batches are planned (sort, bvh, occluders), so the gl thread only has to make their buffers
+ * @param request
+ */
+void SceneLoader::run(Request request) {
+    auto scene = std::make_unique<LoadedScene>();
+    scene->filepath = request.filepath;
+    scene->seasonIdx = request.seasonIdx;
+    scene->preload = request.preload;
+
+    setStatus("Parsing scene...", 0.f);
+    scene->success = SceneParser::parse(request.filepath, scene->renderData, request.seasonIdx);
+
+    if (scene->success && !m_cancelled) {
+        // collect what has to be decoded, same texture slots as SceneRenderer::setupTextureUniforms
+        std::set<std::string> meshFiles;
+        std::map<std::string, bool> textureFiles; // filename -> is bump map (first use wins, same as the texture cache)
+
+        // every instance of a template uses the template's shapes, so those are enough
+        auto collect = [&](const RenderShapeData &shape) {
+            if (shape.primitive.type == PrimitiveType::PRIMITIVE_MESH && !request.residentMeshes.contains(shape.primitive.meshfile)) {
+                meshFiles.insert(shape.primitive.meshfile);
+            }
+
+            const SceneMaterial &mat = shape.material;
+            if (mat.textureMap.isUsed) textureFiles.emplace(mat.textureMap.filename, false);
+            if (mat.normalMap.isUsed) textureFiles.emplace(mat.normalMap.filename, false);
+            if (mat.bumpMap.isUsed) textureFiles.emplace(mat.bumpMap.filename, true);
+        };
+        for (const RenderShapeData &shape : scene->renderData.shapes) {
+            collect(shape);
+        }
+        for (const RenderTemplateData &t : scene->renderData.templates) {
+            for (const RenderShapeData &shape : t.shapes) {
+                collect(shape);
+            }
+        }
+        for (const std::string &file : request.residentTextures) {
+            textureFiles.erase(file);
+        }
+
+        const size_t total = meshFiles.size() + textureFiles.size();
+        std::atomic<size_t> done = 0;
+        auto itemDone = [&]() {
+            size_t d = ++done;
+            setStatus("Loading meshes and textures...", 0.4f + 0.6f * float(d) / float(std::max<size_t>(total, 1)));
+        };
+
+        setStatus("Loading meshes and textures...", 0.4f);
+
+        auto meshTask = std::async(std::launch::async, [&]() {
+            std::vector<DecodedMesh> meshes;
+            for (const std::string &file : meshFiles) {
+                if (m_cancelled) break;
+                std::vector<float> vertices = MeshLoader::loadOBJ(file);
+                MeshCPUData cpu = MeshLoader::cpuData(vertices);
+                meshes.push_back({file, std::move(vertices), std::move(cpu)});
+                itemDone();
+            }
+            return meshes;
+        });
+
+        auto textureTask = std::async(std::launch::async, [&]() {
+            std::vector<DecodedTexture> textures;
+            for (const auto &[file, isBump] : textureFiles) {
+                if (m_cancelled) break;
+                textures.push_back({file, TextureUtils::loadTextureImage(file, isBump)});
+                itemDone();
+            }
+            return textures;
+        });
+
+        scene->meshes = meshTask.get();
+        scene->textures = textureTask.get();
+
+        if (!m_cancelled) {
+            setStatus("Sorting batches...", 1.f);
+            std::map<std::string, MeshCPUData> meshData = std::move(request.residentMeshes);
+            for (const DecodedMesh &mesh : scene->meshes) {
+                meshData[mesh.filename] = mesh.cpu;
+            }
+            scene->batches = SceneRenderer::planBatches(scene->renderData, meshData, request.farPlane);
+        }
+    }
+
+    if (!scene->success) {
+        std::cerr << "Failed to load scene: " << request.filepath << std::endl;
+    }
+
+    setStatus(scene->success ? "Uploading..." : "Failed to load scene", 1.f);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_result = std::move(scene);
+    }
+    m_finished = true;
+}
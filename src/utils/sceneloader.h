@@ -0,0 +1,109 @@
+#pragma once
+
+#include "sceneparser.h"
+#include "renderers/scenerenderer.h"
+#include "shapes/meshloader.h"
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <QImage>
+
+// Mesh vertices decoded with MeshLoader::loadOBJ, waiting to be uploaded
+struct DecodedMesh {
+    std::string filename;
+    std::vector<float> vertices;
+    MeshCPUData cpu; // MeshLoader::cpuData of the vertices, made on the worker too
+};
+
+// Texture decoded with TextureUtils::loadTextureImage, waiting to be uploaded
+struct DecodedTexture {
+    std::string filename;
+    QImage image;
+};
+
+// Everything the worker produced for one scene. The GL thread uploads meshes/textures a few at a time
+// (uploadCursor), then makes the batches' gl objects a few at a time, and swaps renderData + batches in once
+// everything is resident.
+struct LoadedScene {
+    std::string filepath;
+    int seasonIdx = -1;
+    bool preload = false; // background preload (seasonal variant), not meant to be shown right away
+    bool success = false;
+
+    RenderData renderData;
+    std::vector<DecodedMesh> meshes;
+    std::vector<DecodedTexture> textures;
+    std::unique_ptr<SceneBatches> batches; // SceneRenderer::planBatches, sorted + bvh + occluders, no gl objects yet
+
+    size_t uploadCursor = 0; // meshes first, then textures
+
+    size_t uploadCount() const { return meshes.size() + textures.size(); }
+    // uploads + batches made so far, 0..1
+    float uploadProgress() const {
+        size_t total = uploadCount() + (batches ? batches->batches.size() : 0);
+        size_t done = uploadCursor + (batches ? batches->createdBatches : 0);
+        return total > 0 ? float(done) / float(total) : 1.f;
+    }
+};
+
+/**
+ * Parses a scene file (l-system growth included) and decodes its meshes and textures on a worker thread,
+ * so the GUI thread never blocks on a load. Only one load runs at a time; asking for another while one is
+ * running cancels the running one (its result is dropped) and starts the new one when the worker is free.
+ *
+ * All of the public functions are meant to be called from the GUI thread.
+ */
+class SceneLoader {
+public:
+    ~SceneLoader();
+
+    // residentMeshes / residentTextures are files the renderers already have on the gpu, those are skipped. the
+    // resident meshes' bounds + positions are what the batches are planned with
+    void load(const std::string &filepath, int seasonIdx, std::map<std::string, MeshCPUData> residentMeshes,
+              std::set<std::string> residentTextures, bool preload = false);
+
+    // true from load() until the result has been taken
+    bool isLoading() const;
+
+    // 0..1 progress of the worker + what it's doing right now
+    float progress() const { return m_progress.load(); }
+    std::string status() const;
+
+    // the finished scene, once. nullptr while the worker is still busy
+    std::unique_ptr<LoadedScene> takeResult();
+
+    // stops waiting for the current load and joins the worker (used on exit)
+    void cancel();
+
+private:
+    struct Request {
+        std::string filepath;
+        int seasonIdx;
+        std::map<std::string, MeshCPUData> residentMeshes;
+        std::set<std::string> residentTextures;
+        bool preload;
+        float farPlane; // settings.farPlane when it was asked for, the worker doesn't read the settings
+    };
+
+    void start(Request request);
+    void run(Request request);
+    void setStatus(const std::string &status, float progress);
+
+    std::thread m_thread;
+    std::atomic<bool> m_finished = false;
+    std::atomic<bool> m_cancelled = false;
+    std::atomic<float> m_progress = 0.f;
+
+    mutable std::mutex m_mutex; // guards everything below
+    std::string m_status;
+    std::unique_ptr<LoadedScene> m_result;
+    std::optional<Request> m_queued;
+};
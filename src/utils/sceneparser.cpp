@@ -1,7 +1,7 @@
 #include "sceneparser.h"
 #include "scenefilereader.h"
 #include "lsystem/lsystem.h"
-#include "renderers/lightrenderer.h"
+#include "lightutils.h"
 #include <glm/gtx/transform.hpp>
 
 #include <chrono>
@@ -12,12 +12,21 @@
  * @brief SceneParser::parse parses the Scene Graph !! calses dfsRenderData to recursively populate renderData
  * @param filepath
  * @param renderData
+ * @param seasonIdx
+ * @param stats optional, gets the phase timings
  * @return
  */
 
-bool SceneParser::parse(std::string filepath, RenderData &renderData) {
-    ScenefileReader fileReader = ScenefileReader(filepath);
+bool SceneParser::parse(std::string filepath, RenderData &renderData, int seasonIdx, SceneParseStats *stats) {
+    using Clock = std::chrono::steady_clock;
+    auto msSince = [](Clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    };
+
+    auto readStart = Clock::now();
+    ScenefileReader fileReader = ScenefileReader(filepath, seasonIdx);
     bool success = fileReader.readJSON();
+    if (stats) stats->readMs = msSince(readStart);
     if (!success) {
         return false;
     }
@@ -26,12 +35,35 @@ bool SceneParser::parse(std::string filepath, RenderData &renderData) {
     renderData.globalData = fileReader.getGlobalData();
 
     renderData.shapes.clear();
+    renderData.templates.clear();
+    renderData.instances.clear();
+    renderData.drawCount = 0;
+    renderData.animation.clear();
+
+    // remember which nodes are template roots so references to them are flattened only once
+    ParseContext cache;
+    cache.stats = stats;
+    for (const auto &[name, node] : fileReader.getTemplates()) {
+        cache.names[node] = name;
+    }
 
     SceneNode* root = fileReader.getRootNode();
     glm::mat4 baseCTM = glm::mat4(1.0f); //identity matrix --> leaves things unchanged
 
-    dfsGetRenderData(renderData, root, baseCTM);
+    auto traverseStart = Clock::now();
+    dfsGetRenderData(renderData, root, baseCTM, cache, AnimationParent());
 
+    // now that the plain shapes are all in, the instances' draw indices follow them
+    const int plainShapes = static_cast<int>(renderData.shapes.size());
+    for (RenderInstanceData &instance : renderData.instances) {
+        instance.firstShape += plainShapes - PENDING_DRAW_INDEX;
+    }
+    renderData.animation.offsetShapes(PENDING_DRAW_INDEX, plainShapes - PENDING_DRAW_INDEX);
+    renderData.drawCount = plainShapes + cache.instancedShapes;
+
+    // puts every binding at its t = 0 pose, instanced shapes are only ever read from there
+    renderData.animation.update(0.f);
+    if (stats) stats->traverseMs = msSince(traverseStart);
 
     return true;
 }
@@ -64,26 +96,42 @@ ScenePrimitive SceneParser::makePrimitive(PrimitiveType type, const SceneMateria
 
 /**
  * @brief SceneParser::dfsGetRenderData recursivelly fills out the scene graph !! for each node checks for transformations and
- * builds the transformation matrix, adds shapes and lights to the list
+ * builds the transformation matrix, adds shapes and lights to the list. template groups are handed off to addTemplateInstance
  * @param renderData
  * @param currNode
  * @param currCTM
+ * @param cache
  */
-void SceneParser::dfsGetRenderData(RenderData& renderData, SceneNode* currNode, glm::mat4 currCTM) {
+void SceneParser::dfsGetRenderData(RenderData& renderData, SceneNode* currNode, glm::mat4 currCTM, ParseContext &cache,
+                                   AnimationParent anim) {
     //passing the **value** of currCTM so muttating it doesnt affect siblings :)
 
     if (!currNode->transformations.empty()) {
         for (SceneTransformation* trans : currNode->transformations) {
-            currCTM = currCTM * getTransMatrix(*trans);
+            glm::mat4 m = getTransMatrix(*trans);
+            currCTM = currCTM * m;
+            anim.ctm = anim.ctm * m;
         }
     }
 
+    // animated groups become a node in the runtime hierarchy; everything below is placed relative to it.
+    // the baked ctms use the pose at t = 0
+    if (currNode->animation) {
+        anim.node = renderData.animation.addNode(anim.node, anim.ctm, *currNode->animation);
+        anim.ctm = glm::mat4(1.0f);
+        currCTM = currCTM * TransformHierarchy::sample(*currNode->animation, 0.f);
+    }
+
 
     if (!currNode->primitives.empty()){
         for (ScenePrimitive* p : currNode->primitives) {
 
             RenderShapeData r = RenderShapeData{*p,p->material,currCTM};
             renderData.shapes.push_back(r);
+
+            if (anim.node >= 0) {
+                renderData.animation.bindShape(renderData.shapes.size() - 1, anim.node, anim.ctm);
+            }
         }
 
     }
@@ -96,107 +144,247 @@ void SceneParser::dfsGetRenderData(RenderData& renderData, SceneNode* currNode,
     }
 
     if (currNode->lsystem && currNode->lsystem->valid){
+        if (anim.node >= 0) {
+            // generate in local space first so every piece can be bound with its offset from the animated frame
+            size_t first = renderData.shapes.size();
+            addLSystemShapes(renderData, *currNode->lsystem, glm::mat4(1.0f), cache.stats);
+            for (size_t i = first; i < renderData.shapes.size(); i++) {
+                glm::mat4 local = renderData.shapes[i].ctm;
+                renderData.shapes[i].ctm = currCTM * local;
+                renderData.animation.bindShape(i, anim.node, anim.ctm * local);
+            }
+        } else {
+            addLSystemShapes(renderData, *currNode->lsystem, currCTM, cache.stats);
+        }
+    }
 
-        std::vector<LSymbol> symbols = LSystem::expandLSystem(*currNode->lsystem);
 
-        std::vector<StemData> stems;
-        std::vector<glm::mat4> leafCTMs;
-        std::vector<glm::mat4> flowerCTMs;
-        LSystem::interpretLSystem(*currNode->lsystem, symbols, stems, leafCTMs, flowerCTMs);
+    if (!currNode->children.empty()){
+        for (SceneNode* children : currNode->children){
+            if (cache.names.contains(children)) {
+                addTemplateInstance(renderData, children, currCTM, cache, anim);
+            } else {
+                dfsGetRenderData(renderData, children, currCTM, cache, anim);
+            }
+        }
+    }
 
+    else {
+        return;
+    }
+}
 
-        const float refThickness = 1.0f;  // adjust based on the scene file's intended base size
-        const float refLength = 1.0f;
+/**
+ * @brief SceneParser::addTemplateInstance flattens a template group into its own local space the first time it's referenced
+ * and reuses that for every later reference, so an l-system inside a template only grows once. a reference from the
+ * scene is just an instance record (template + ctm), its shapes get draw indices but aren't copied. references inside a
+ * template that's being flattened copy the shapes in, they become part of the outer template
+ * @param renderData
+ * @param templateNode
+ * @param ctm
+ * @param cache
+ * @param anim the animated group the reference sits under (if any)
+ */
+void SceneParser::addTemplateInstance(RenderData &renderData, SceneNode *templateNode, glm::mat4 ctm, ParseContext &cache,
+                                      const AnimationParent &anim) {
+
+    auto cached = cache.shapes.find(templateNode);
+    if (cached == cache.shapes.end()) {
+        // first reference -> flatten the template with an identity ctm into a scratch RenderData. templates nested
+        // in this one are cached the same way, and the copies they add to local end up in this one's shapes
+        RenderData local;
+        cache.flattening++;
+        dfsGetRenderData(local, templateNode, glm::mat4(1.0f), cache, AnimationParent());
+        cache.flattening--;
+        cache.animations[templateNode] = std::move(local.animation);
+
+        // lights can't be baked without their source SceneLight (the light matrix depends on the final ctm),
+        // so keep those around with their template-local ctm
+        std::vector<std::pair<SceneLight*, glm::mat4>> &lights = cache.lights[templateNode];
+        std::vector<std::pair<SceneNode*, glm::mat4>> stack = {{templateNode, glm::mat4(1.0f)}};
+        while (!stack.empty()) {
+            auto [node, nodeCTM] = stack.back();
+            stack.pop_back();
+            for (SceneTransformation* trans : node->transformations) {
+                nodeCTM = nodeCTM * getTransMatrix(*trans);
+            }
+            if (node->animation) {
+                nodeCTM = nodeCTM * TransformHierarchy::sample(*node->animation, 0.f);
+            }
+            for (SceneLight* light : node->lights) {
+                lights.push_back({light, nodeCTM});
+            }
+            for (SceneNode* child : node->children) {
+                stack.push_back({child, nodeCTM});
+            }
+        }
 
-        // Only generate flowers if we have flower materials and mesh file
-        const auto& flowerMats = currNode->lsystem->flowerMaterials;
-        if (!flowerMats.empty() && !currNode->lsystem->flowerMeshFile.empty()) {
-            for (const glm::mat4 &localM : flowerCTMs) {
-                RenderShapeData r;
+        cached = cache.shapes.emplace(templateNode, std::move(local.shapes)).first;
+        if (cache.stats) cache.stats->templates++;
+    }
+    if (cache.stats) cache.stats->templateInstances++;
 
-                // randomly select a flower material from the available options
-                int matIndex = rand() % flowerMats.size();
-                const SceneMaterial& chosenMat = flowerMats[matIndex];
+    const std::vector<RenderShapeData> &shapes = cached->second;
+    int firstShape;
 
-                ScenePrimitive p;
-                p.type = PrimitiveType::PRIMITIVE_MESH;
-                p.meshfile = currNode->lsystem->flowerMeshFile;
-                p.material = chosenMat;
+    if (cache.flattening > 0) {
+        firstShape = static_cast<int>(renderData.shapes.size());
+        renderData.shapes.reserve(renderData.shapes.size() + shapes.size());
+        for (const RenderShapeData &shape : shapes) {
+            RenderShapeData r = shape;
+            r.ctm = ctm * shape.ctm;
+            renderData.shapes.push_back(r);
+        }
+    } else {
+        // the first reference from the scene lists the template
+        auto index = cache.indices.find(templateNode);
+        if (index == cache.indices.end()) {
+            renderData.templates.push_back({cache.names[templateNode], shapes});
+            index = cache.indices.emplace(templateNode, static_cast<int>(renderData.templates.size()) - 1).first;
+        }
 
-                r.primitive = p;
-                r.material = chosenMat;
-                r.ctm = currCTM * localM;
+        firstShape = PENDING_DRAW_INDEX + cache.instancedShapes;
+        cache.instancedShapes += static_cast<int>(shapes.size());
+        renderData.instances.push_back({index->second, ctm, firstShape});
+    }
 
-                renderData.shapes.push_back(r);
+    // animated groups inside the template get their own copy of the nodes per instance. shapes that aren't under
+    // one of those still have to follow the animated group this reference sits under
+    const TransformHierarchy &templateAnimation = cache.animations[templateNode];
+    if (!templateAnimation.empty() || anim.node >= 0) {
+        renderData.animation.append(templateAnimation, anim.node, anim.node >= 0 ? anim.ctm : ctm, firstShape);
+    }
+    if (anim.node >= 0) {
+        std::vector<bool> bound(shapes.size(), false);
+        for (int b = 0; b < templateAnimation.bindingCount(); b++) {
+            bound[templateAnimation.boundShape(b)] = true;
+        }
+        for (size_t i = 0; i < shapes.size(); i++) {
+            if (!bound[i]) {
+                renderData.animation.bindShape(firstShape + i, anim.node, anim.ctm * shapes[i].ctm);
             }
         }
+    }
 
-        for (const StemData &stem : stems) {
-            RenderShapeData r;
+    // lights keep the pose they were parsed with
+    for (const auto &[light, localCTM] : cache.lights[templateNode]) {
+        renderData.lights.push_back(getSceneLightData(*light, ctm * localCTM));
+    }
+}
 
-            // Make a COPY of the material so we can modify it per-shape
-            SceneMaterial mat = currNode->lsystem->stemMaterial;
+/**
+ * @brief SceneParser::addLSystemShapes expands + interprets an l-system and adds all of its stems, leaves and flowers
+ * @param renderData
+ * @param lsystem
+ * @param currCTM
+ * @param stats optional, gets one LSystemParseStats entry
+ */
+void SceneParser::addLSystemShapes(RenderData &renderData, const LSystemData &lsystem, glm::mat4 currCTM, SceneParseStats *stats) {
+    using Clock = std::chrono::steady_clock;
+    LSystemParseStats lsStats;
 
-            // Scale texture repeats based on actual dimensions
-            // repeatU controls horizontal wrap (circumference) - scale by thickness ratio
-            // repeatV controls vertical wrap (length) - scale by length ratio
-            if (mat.textureMap.isUsed) {
-                mat.textureMap.repeatU *= (stem.thickness / refThickness);
-                mat.textureMap.repeatV *= (stem.length / refLength);
-            }
-            if (mat.bumpMap.isUsed) {
-                mat.bumpMap.repeatU *= (stem.thickness / refThickness);
-                mat.bumpMap.repeatV *= (stem.length / refLength);
-            }
-            if (mat.normalMap.isUsed) {
-                mat.normalMap.repeatU *= (stem.thickness / refThickness);
-                mat.normalMap.repeatV *= (stem.length / refLength);
-            }
+    auto expandStart = Clock::now();
+    std::vector<LSymbol> symbols = LSystem::expandLSystem(lsystem, stats ? &lsStats.symbolsPerIteration : nullptr);
+    auto interpretStart = Clock::now();
 
-            r.primitive = makePrimitive(currNode->lsystem->stemPrimitive, mat);
-            r.material = mat;
-            r.ctm = currCTM * stem.ctm;
+    std::vector<StemData> stems;
+    std::vector<glm::mat4> leafCTMs;
+    std::vector<glm::mat4> flowerCTMs;
+    LSystem::interpretLSystem(lsystem, symbols, stems, leafCTMs, flowerCTMs);
+    size_t firstShape = renderData.shapes.size();
 
-            renderData.shapes.push_back(r);
-        }
 
-        // std::cout << renderData.shapes.size() << std::endl;
+    const float refThickness = 1.0f;  // adjust based on the scene file's intended base size
+    const float refLength = 1.0f;
 
+    // Only generate flowers if we have flower materials and mesh file
+    const auto& flowerMats = lsystem.flowerMaterials;
+    if (!flowerMats.empty() && !lsystem.flowerMeshFile.empty()) {
+        for (const glm::mat4 &localM : flowerCTMs) {
+            RenderShapeData r;
 
+            // randomly select a flower material from the available options
+            int matIndex = rand() % flowerMats.size();
+            const SceneMaterial& chosenMat = flowerMats[matIndex];
 
+            ScenePrimitive p;
+            p.type = PrimitiveType::PRIMITIVE_MESH;
+            p.meshfile = lsystem.flowerMeshFile;
+            p.material = chosenMat;
 
-        // Only generate leaves if we have leaf materials (winter has none)
-        const auto& leafMats = currNode->lsystem->leafMaterials;
-        if (!leafMats.empty()) {
-            for (const glm::mat4 &localM : leafCTMs) {
-                RenderShapeData r;
+            r.primitive = p;
+            r.material = chosenMat;
+            r.ctm = currCTM * localM;
+            r.role = ShapeRole::FLOWER;
 
-                // Randomly select a leaf material from the available options
-                int matIndex = rand() % leafMats.size();
-                const SceneMaterial& chosenMat = leafMats[matIndex];
+            renderData.shapes.push_back(r);
+        }
+    }
 
-                r.primitive = makePrimitive(currNode->lsystem->leafPrimitive, chosenMat);
-                r.material = chosenMat;
+    for (const StemData &stem : stems) {
+        RenderShapeData r;
 
-                r.ctm = currCTM * localM;
+        // Make a COPY of the material so we can modify it per-shape
+        SceneMaterial mat = lsystem.stemMaterial;
 
-                renderData.shapes.push_back(r);
-            }
+        // Scale texture repeats based on actual dimensions
+        // repeatU controls horizontal wrap (circumference) - scale by thickness ratio
+        // repeatV controls vertical wrap (length) - scale by length ratio
+        if (mat.textureMap.isUsed) {
+            mat.textureMap.repeatU *= (stem.thickness / refThickness);
+            mat.textureMap.repeatV *= (stem.length / refLength);
         }
-        // return;
+        if (mat.bumpMap.isUsed) {
+            mat.bumpMap.repeatU *= (stem.thickness / refThickness);
+            mat.bumpMap.repeatV *= (stem.length / refLength);
+        }
+        if (mat.normalMap.isUsed) {
+            mat.normalMap.repeatU *= (stem.thickness / refThickness);
+            mat.normalMap.repeatV *= (stem.length / refLength);
+        }
+
+        r.primitive = makePrimitive(lsystem.stemPrimitive, mat);
+        r.material = mat;
+        r.ctm = currCTM * stem.ctm;
+        r.role = ShapeRole::STEM;
+
+        renderData.shapes.push_back(r);
     }
 
-    std::cout << renderData.shapes.size() << std::endl;
+    // Only generate leaves if we have leaf materials (winter has none)
+    const auto& leafMats = lsystem.leafMaterials;
+    if (!leafMats.empty()) {
+        for (const glm::mat4 &localM : leafCTMs) {
+            RenderShapeData r;
 
+            // Randomly select a leaf material from the available options
+            int matIndex = rand() % leafMats.size();
+            const SceneMaterial& chosenMat = leafMats[matIndex];
 
-    if (!currNode->children.empty()){
-        for (SceneNode* children : currNode->children){
-            dfsGetRenderData(renderData, children, currCTM);
+            r.primitive = makePrimitive(lsystem.leafPrimitive, chosenMat);
+            r.material = chosenMat;
+
+            r.ctm = currCTM * localM;
+            r.role = ShapeRole::LEAF;
+
+            renderData.shapes.push_back(r);
         }
     }
 
-    else {
-        return;
+    if (stats) {
+        lsStats.axiom = lsystem.axiom;
+        lsStats.iterations = lsystem.iterations;
+        lsStats.expandMs = std::chrono::duration<double, std::milli>(interpretStart - expandStart).count();
+        lsStats.interpretMs = std::chrono::duration<double, std::milli>(Clock::now() - interpretStart).count();
+        for (size_t i = firstShape; i < renderData.shapes.size(); i++) {
+            switch (renderData.shapes[i].role) {
+            case ShapeRole::STEM: lsStats.stems++; break;
+            case ShapeRole::LEAF: lsStats.leaves++; break;
+            case ShapeRole::FLOWER: lsStats.flowers++; break;
+            default: break;
+            }
+        }
+        stats->lsystems.push_back(std::move(lsStats));
     }
 }
 
@@ -244,8 +432,39 @@ SceneLightData SceneParser::getSceneLightData(SceneLight &light, glm::mat4 ctm){
         dir = glm::normalize(ctm * glm::vec4(light.dir));
     }
 
-    glm::mat4 lightSpaceMat = LightRenderer::calculateLightMatrix(&light, glm::vec3(pos), glm::vec3(dir));
+    glm::mat4 lightSpaceMat = LightUtils::calculateLightMatrix(&light, glm::vec3(pos), glm::vec3(dir));
     return SceneLightData{light.id, light.type, light.color, light.function, pos, dir, light.penumbra,
                           light.angle, 0.0f, 0.0f, lightSpaceMat};
 
 }
+
+/**
+ * @brief SceneParser::estimateMemory rough cpu-side size of a parsed scene, strings and vector slack included
+ * @param renderData
+ * @return bytes
+ */
+size_t SceneParser::estimateMemory(const RenderData &renderData) {
+    auto shapeBytes = [](const RenderShapeData &shape) {
+        const SceneMaterial &mat = shape.material;
+        return sizeof(RenderShapeData) + shape.primitive.meshfile.capacity()
+             + mat.textureMap.filename.capacity() + mat.normalMap.filename.capacity() + mat.bumpMap.filename.capacity();
+    };
+
+    size_t bytes = sizeof(RenderData);
+    bytes += renderData.lights.capacity() * sizeof(SceneLightData);
+    bytes += renderData.instances.capacity() * sizeof(RenderInstanceData);
+
+    bytes += (renderData.shapes.capacity() - renderData.shapes.size()) * sizeof(RenderShapeData);
+    for (const RenderShapeData &shape : renderData.shapes) {
+        bytes += shapeBytes(shape);
+    }
+    for (const RenderTemplateData &t : renderData.templates) {
+        bytes += sizeof(RenderTemplateData) + t.name.capacity();
+        for (const RenderShapeData &shape : t.shapes) {
+            bytes += shapeBytes(shape);
+        }
+    }
+
+    bytes += renderData.animation.memoryUsage();
+    return bytes;
+}
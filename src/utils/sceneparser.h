@@ -1,25 +1,97 @@
 #pragma once
 
 #include "scenedata.h"
+#include "transformhierarchy.h"
 // #include "imagereader.h"
 #include <vector>
 #include <string>
+#include <map>
+
+// What generated a shape. Everything from the scene file itself is OTHER, the rest comes out of an l-system
+enum class ShapeRole {
+    OTHER,
+    STEM,
+    LEAF,
+    FLOWER
+};
 
 // Struct which contains data for a single primitive, to be used for rendering
 struct RenderShapeData {
     ScenePrimitive primitive;
     SceneMaterial material;
     glm::mat4 ctm; // the cumulative transformation matrix
+    ShapeRole role = ShapeRole::OTHER;
+};
+
+// A template group flattened once in its own local space, shared by every reference to it
+struct RenderTemplateData {
+    std::string name;
+    std::vector<RenderShapeData> shapes; // ctm is relative to the template root
+};
 
+// One reference of a template group: only where it goes, the shapes are the template's
+struct RenderInstanceData {
+    int templateIndex; // index into RenderData::templates
+    glm::mat4 ctm;     // the reference's placement in world space
+    int firstShape;    // draw index of the first of the template's shapes, see RenderData
 };
 
 // Struct which contains all the data needed to render a scene
+//
+// Every shape that gets drawn has a draw index: [0, shapes.size()) are the shapes outside of any template, and
+// instance i covers [instances[i].firstShape, firstShape + its template's shape count). drawCount is the total.
+// Templates nested in other templates are copied into the outer template's shapes, only the references from the
+// scene itself are instances
 struct RenderData {
     SceneGlobalData globalData;
     SceneCameraData cameraData;
 
     std::vector<SceneLightData> lights;
     std::vector<RenderShapeData> shapes;
+
+    std::vector<RenderTemplateData> templates;
+    std::vector<RenderInstanceData> instances;
+    int drawCount = 0;
+
+    // animated groups, bound by draw index. plain shapes get their ctm rewritten every update (applyToShapes),
+    // instanced ones have no RenderShapeData of their own, the renderer reads their ctm from the bindings
+    TransformHierarchy animation;
+};
+
+// Calls f(drawIndex, shape, ctm) for every shape that gets drawn, in draw index order. ctm is where the shape was
+// parsed, animated ones are wherever RenderData::animation has them now
+template <typename F>
+void forEachDrawnShape(const RenderData &renderData, F &&f) {
+    for (size_t i = 0; i < renderData.shapes.size(); i++) {
+        f(static_cast<int>(i), renderData.shapes[i], renderData.shapes[i].ctm);
+    }
+    for (const RenderInstanceData &instance : renderData.instances) {
+        const std::vector<RenderShapeData> &shapes = renderData.templates[instance.templateIndex].shapes;
+        for (size_t i = 0; i < shapes.size(); i++) {
+            f(instance.firstShape + static_cast<int>(i), shapes[i], instance.ctm * shapes[i].ctm);
+        }
+    }
+}
+
+// Numbers for one l-system expansion (templates only expand theirs once, no matter how often they're referenced)
+struct LSystemParseStats {
+    std::string axiom;
+    int iterations = 0;
+    std::vector<size_t> symbolsPerIteration; // [0] is the axiom, [iterations] the final string
+    int stems = 0;
+    int leaves = 0;
+    int flowers = 0;
+    double expandMs = 0.0;
+    double interpretMs = 0.0; // turtle interpretation + building the shapes
+};
+
+// Optional timings/counters filled in by SceneParser::parse, used by the scenestats tool
+struct SceneParseStats {
+    double readMs = 0.0;     // ScenefileReader::readJSON (json + plant presets)
+    double traverseMs = 0.0; // scene graph dfs, l-systems included
+    int templates = 0;         // template groups flattened
+    int templateInstances = 0; // references to them, each one a copy of the template's shapes in RenderData::shapes
+    std::vector<LSystemParseStats> lsystems;
 };
 
 class SceneParser {
@@ -27,12 +99,49 @@ public:
     // Parse the scene and store the results in renderData.
     // @param filepath    The path of the scene file to load.
     // @param renderData  On return, this will contain the metadata of the loaded scene.
+    // @param seasonIdx   Season for plant presets, -1 uses the global settings (see ScenefileReader).
+    // @param stats       If not null, filled with per phase timings and l-system counts.
     // @return            A boolean value indicating whether the parse was successful.
-    static bool parse(std::string filepath, RenderData &renderData);
+    static bool parse(std::string filepath, RenderData &renderData, int seasonIdx = -1, SceneParseStats *stats = nullptr);
+
+    // rough cpu-side footprint of a parsed scene (shapes, templates, instances, lights, animation)
+    static size_t estimateMemory(const RenderData &renderData);
 
 private:
+    // Per-parse bookkeeping for template groups, so each one is only flattened once.
+    struct ParseContext {
+        std::map<SceneNode*, std::string> names;    // template root -> template name
+        std::map<SceneNode*, std::vector<RenderShapeData>> shapes; // template root -> its shapes in template space
+        std::map<SceneNode*, int> indices;          // template root -> index into the scene's RenderData::templates
+        std::map<SceneNode*, std::vector<std::pair<SceneLight*, glm::mat4>>> lights; // lights with template-local CTMs
+        std::map<SceneNode*, TransformHierarchy> animations; // animated groups inside the template, in template space
+        SceneParseStats *stats = nullptr;
+
+        int flattening = 0;      // > 0 while a template is flattened, references in there are copied
+        int instancedShapes = 0; // draw indices handed out to instances so far
+    };
+
+    // Instances get their draw indices before the number of plain shapes is known, so they're numbered from here
+    // during the dfs and moved down to follow the plain shapes at the end of parse
+    static const int PENDING_DRAW_INDEX = 1 << 30;
+
+    // Nearest animated ancestor during the dfs, and the static ctm from its frame down to the current node.
+    struct AnimationParent {
+        int node = -1;
+        glm::mat4 ctm = glm::mat4(1.0f);
+    };
+
     // Recursive DFS helper to traverse the scene graph and fill renderData.
-    static void dfsGetRenderData(RenderData &renderData, SceneNode *currNode, glm::mat4 currCTM);
+    static void dfsGetRenderData(RenderData &renderData, SceneNode *currNode, glm::mat4 currCTM, ParseContext &cache,
+                                 AnimationParent anim);
+
+    // Flattens a template group once (cached). References from the scene add an instance of it placed at ctm,
+    // references inside another template being flattened copy its shapes in.
+    static void addTemplateInstance(RenderData &renderData, SceneNode *templateNode, glm::mat4 ctm, ParseContext &cache,
+                                    const AnimationParent &anim);
+
+    // Generates the stems, leaves and flowers of an L-system node and appends them with ctm applied.
+    static void addLSystemShapes(RenderData &renderData, const LSystemData &lsystem, glm::mat4 ctm, SceneParseStats *stats);
 
     // Build a transformation matrix from a SceneTransformation.
     static glm::mat4 getTransMatrix(SceneTransformation &trans);
@@ -0,0 +1,279 @@
+#include "shaderloader.h"
+
+#include <QByteArray>
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QStandardPaths>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+    // bump when the cache file layout changes, old files then just miss
+    const char *BINARY_CACHE_VERSION = "1";
+
+    std::string glString(GLenum name) {
+        const GLubyte *value = glGetString(name);
+        return value ? reinterpret_cast<const char *>(value) : "";
+    }
+}
+
+std::map<ShaderLoader::ProgramId, ShaderLoader::Pending> ShaderLoader::s_pending;
+std::map<std::string, std::string> ShaderLoader::s_files;
+std::string ShaderLoader::s_driver;
+std::string ShaderLoader::s_cacheDir;
+ShaderLoaderStats ShaderLoader::s_stats;
+
+void ShaderLoader::initialize() {
+    s_stats = ShaderLoaderStats();
+    s_driver = glString(GL_VENDOR) + "|" + glString(GL_RENDERER) + "|" + glString(GL_VERSION);
+
+    // some drivers can't hand out binaries at all, then everything is compiled every start
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    s_cacheDir.clear();
+    if (formats > 0) {
+        QString dir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/shaders";
+        if (!dir.isEmpty() && QDir().mkpath(dir)) s_cacheDir = dir.toStdString();
+    }
+    if (s_cacheDir.empty()) {
+        std::cout << "No program binary cache, shaders are compiled from source every start" << std::endl;
+    }
+
+    if (GLEW_KHR_parallel_shader_compile) {
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFF); // as many as the driver wants
+        s_stats.parallel = true;
+    }
+}
+
+const ShaderLoaderStats &ShaderLoader::stats() {
+    return s_stats;
+}
+
+GLuint ShaderLoader::createShaderProgram(const char *vertex_file_path, const char *fragment_file_path,
+                                         const std::string &defines) {
+    auto start = std::chrono::steady_clock::now();
+
+    Pending pending;
+    auto found = s_pending.find(ProgramId(vertex_file_path, fragment_file_path, defines));
+    if (found != s_pending.end()) {
+        pending = found->second;
+        s_pending.erase(found);
+    } else {
+        pending = begin(vertex_file_path, fragment_file_path, defines);
+    }
+    GLuint programID = finish(pending, vertex_file_path, fragment_file_path);
+
+    s_stats.ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return programID;
+}
+
+void ShaderLoader::prefetch(const char *vertex_file_path, const char *fragment_file_path, const std::string &defines) {
+    auto start = std::chrono::steady_clock::now();
+
+    ProgramId id(vertex_file_path, fragment_file_path, defines);
+    if (s_pending.count(id)) return;
+    try {
+        s_pending.emplace(id, begin(vertex_file_path, fragment_file_path, defines));
+    } catch (const std::runtime_error &e) {
+        // createShaderProgram will run into the same thing and throw it where it matters
+        std::cerr << "Could not prefetch " << fragment_file_path << ": " << e.what() << std::endl;
+    }
+
+    s_stats.ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * @brief ShaderLoader::begin a linked program from the binary cache if there is one, otherwise compile + link calls
+ * without asking for any status, so the driver is free to do the work in the background
+ */
+ShaderLoader::Pending ShaderLoader::begin(const char *vertex_file_path, const char *fragment_file_path,
+                                          const std::string &defines) {
+    const std::string vertexSource = expandedSource(vertex_file_path, defines);
+    const std::string fragmentSource = expandedSource(fragment_file_path, defines);
+
+    Pending pending;
+    if (!s_cacheDir.empty()) {
+        std::string all = vertexSource + '\0' + fragmentSource + '\0' + s_driver + '\0' + BINARY_CACHE_VERSION;
+        pending.key = QCryptographicHash::hash(QByteArray::fromStdString(all), QCryptographicHash::Sha1).toHex().toStdString();
+    }
+
+    pending.program = glCreateProgram();
+    if (!pending.key.empty() && loadBinary(pending.program, pending.key)) {
+        s_stats.binaryHits++;
+        return pending;
+    }
+
+    auto compile = [](GLenum shaderType, const std::string &code) {
+        GLuint shaderID = glCreateShader(shaderType);
+        const char *codePtr = code.c_str();
+        glShaderSource(shaderID, 1, &codePtr, nullptr);
+        glCompileShader(shaderID);
+        return shaderID;
+    };
+    pending.vertexShader = compile(GL_VERTEX_SHADER, vertexSource);
+    pending.fragmentShader = compile(GL_FRAGMENT_SHADER, fragmentSource);
+
+    glAttachShader(pending.program, pending.vertexShader);
+    glAttachShader(pending.program, pending.fragmentShader);
+    if (!pending.key.empty()) glProgramParameteri(pending.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(pending.program);
+    return pending;
+}
+
+// the first status query, this is where a parallel compile gets waited on
+GLuint ShaderLoader::finish(Pending pending, const char *vertex_file_path, const char *fragment_file_path) {
+    GLint status;
+    glGetProgramiv(pending.program, GL_LINK_STATUS, &status);
+
+    if (status == GL_FALSE) {
+        // a shader that didn't compile explains it better than the link log
+        std::string log;
+        for (GLuint shader : {pending.vertexShader, pending.fragmentShader}) {
+            GLint compiled = GL_TRUE;
+            if (shader) glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+            if (compiled == GL_FALSE) {
+                log = std::string(shader == pending.vertexShader ? vertex_file_path : fragment_file_path) + ": " +
+                      shaderLog(shader);
+                break;
+            }
+        }
+        if (log.empty()) {
+            GLint length;
+            glGetProgramiv(pending.program, GL_INFO_LOG_LENGTH, &length);
+            log.assign(length, '\0');
+            glGetProgramInfoLog(pending.program, length, nullptr, &log[0]);
+        }
+
+        glDeleteShader(pending.vertexShader);
+        glDeleteShader(pending.fragmentShader);
+        glDeleteProgram(pending.program);
+        throw std::runtime_error(log);
+    }
+
+    if (pending.vertexShader) {
+        // Shaders no longer necessary, stored in program
+        glDeleteShader(pending.vertexShader);
+        glDeleteShader(pending.fragmentShader);
+        s_stats.binaryMisses++;
+        if (!pending.key.empty()) storeBinary(pending.program, pending.key);
+    }
+
+    s_stats.programs++;
+    return pending.program;
+}
+
+std::string ShaderLoader::shaderLog(GLuint shader) {
+    GLint length;
+    glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+    std::string log(length, '\0');
+    glGetShaderInfoLog(shader, length, nullptr, &log[0]);
+    return log;
+}
+
+/**
+ * @brief ShaderLoader::loadBinary cache files are the binary format (GLenum) followed by the binary. a binary the
+ * driver refuses is deleted, the next start writes a fresh one
+ */
+bool ShaderLoader::loadBinary(GLuint program, const std::string &key) {
+    const std::string path = s_cacheDir + "/" + key + ".bin";
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return false;
+
+    std::vector<char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    file.close();
+
+    GLint status = GL_FALSE;
+    if (data.size() > sizeof(GLenum)) {
+        GLenum format;
+        std::memcpy(&format, data.data(), sizeof(GLenum));
+        glProgramBinary(program, format, data.data() + sizeof(GLenum), static_cast<GLsizei>(data.size() - sizeof(GLenum)));
+        glGetProgramiv(program, GL_LINK_STATUS, &status);
+    }
+    if (status == GL_TRUE) return true;
+
+    s_stats.binaryRejected++;
+    std::remove(path.c_str());
+    return false;
+}
+
+void ShaderLoader::storeBinary(GLuint program, const std::string &key) {
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return;
+
+    std::vector<char> data(sizeof(GLenum) + length);
+    GLenum format = 0;
+    glGetProgramBinary(program, length, nullptr, &format, data.data() + sizeof(GLenum));
+    std::memcpy(data.data(), &format, sizeof(GLenum));
+
+    // written next to it and renamed, so a crash halfway never leaves a truncated binary behind
+    const std::string path = s_cacheDir + "/" + key + ".bin";
+    const std::string temp = path + ".tmp";
+    {
+        std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+        if (!file.write(data.data(), data.size())) return;
+    }
+    std::rename(temp.c_str(), path.c_str());
+}
+
+std::string ShaderLoader::expandedSource(const char *filepath, const std::string &defines) {
+    std::set<std::string> included;
+    std::string code = readSource(filepath, included, 0);
+    if (!defines.empty()) {
+        size_t afterVersion = code.compare(0, 8, "#version") == 0 ? code.find('\n') + 1 : 0;
+        code.insert(afterVersion, defines);
+    }
+    return code;
+}
+
+const std::string &ShaderLoader::fileText(const std::string &filepath) {
+    auto found = s_files.find(filepath);
+    if (found != s_files.end()) return found->second;
+
+    QFile file(QString::fromStdString(filepath));
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        throw std::runtime_error(std::string("Failed to open shader: ") + filepath);
+    }
+    QByteArray data = file.readAll();
+    return s_files.emplace(filepath, std::string(data.constData(), data.size())).first->second;
+}
+
+// #include "file" lines are replaced by that file (looked up next to the one including it). every file goes in
+// at most once per shader, so the shared blocks can include what they need without clashing
+std::string ShaderLoader::readSource(const std::string &filepath, std::set<std::string> &included, int depth) {
+    if (depth > 8) {
+        throw std::runtime_error(std::string("Shader includes nested too deep: ") + filepath);
+    }
+    included.insert(filepath);
+
+    const std::string dir = filepath.substr(0, filepath.rfind('/') + 1);
+    std::string code;
+    std::istringstream stream(fileText(filepath));
+    std::string line;
+    while (std::getline(stream, line)) {
+        size_t first = line.find_first_not_of(" \t");
+        if (first != std::string::npos && line.compare(first, 8, "#include") == 0) {
+            size_t open = line.find('"', first);
+            size_t close = line.rfind('"');
+            if (open == std::string::npos || close <= open) {
+                throw std::runtime_error(std::string("Bad #include in ") + filepath + ": " + line);
+            }
+            std::string path = dir + line.substr(open + 1, close - open - 1);
+            if (!included.count(path)) {
+                code += readSource(path, included, depth + 1);
+            }
+            continue;
+        }
+        code += line;
+        code += '\n';
+    }
+    return code;
+}
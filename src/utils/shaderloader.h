@@ -5,80 +5,70 @@
 #define GL_SILENCE_DEPRECATION
 #endif
 #include <GL/glew.h>
-#include <QFile>
-#include <QTextStream>
-#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <tuple>
+
+// what the loader did since initialize(), for the startup report
+struct ShaderLoaderStats {
+    int programs = 0;
+    int binaryHits = 0;     // linked straight from the program binary cache
+    int binaryMisses = 0;   // compiled from source (and stored, if the driver gives a binary back)
+    int binaryRejected = 0; // a cached binary the driver refused (driver update etc.), compiled from source instead
+    bool parallel = false;  // KHR_parallel_shader_compile
+    double ms = 0.0;        // spent inside the loader
+};
 
+/**
+ * Compiles and links programs from the qrc shaders.
+ *
+ * Sources go through a small preprocessor first: #include "file" is replaced by that file and the defines passed in
+ * go in after the #version line. The expanded sources + the driver (vendor, renderer, version) are hashed into a key
+ * for the program binary cache on disk, so a warm start links every program from its binary without compiling
+ * anything. A binary the driver doesn't take anymore is thrown away and the program is compiled from source again.
+ *
+ * prefetch() starts compiling and linking without asking for the result. With KHR_parallel_shader_compile the
+ * driver does that on its own threads, so kicking every program off at once and only checking them when
+ * createShaderProgram() asks for them overlaps all the compiles (and whatever the cpu does in between).
+ */
 class ShaderLoader{
 public:
-    static GLuint createShaderProgram(const char * vertex_file_path, const char * fragment_file_path){
-        // Create and compile the shaders.
-        GLuint vertexShaderID = createShader(GL_VERTEX_SHADER, vertex_file_path);
-        GLuint fragmentShaderID = createShader(GL_FRAGMENT_SHADER, fragment_file_path);
-
-        // Link the shader program.
-        GLuint programID = glCreateProgram();
-        glAttachShader(programID, vertexShaderID);
-        glAttachShader(programID, fragmentShaderID);
-        glLinkProgram(programID);
-
-        // Print the info log if error
-        GLint status;
-        glGetProgramiv(programID, GL_LINK_STATUS, &status);
+    // after glewInit, before the first program
+    static void initialize();
 
-        if (status == GL_FALSE) {
-            GLint length;
-            glGetProgramiv(programID, GL_INFO_LOG_LENGTH, &length);
+    // defines: extra lines (#define ...) that go in right after the #version line of both shaders
+    static GLuint createShaderProgram(const char * vertex_file_path, const char * fragment_file_path,
+                                      const std::string &defines = "");
 
-            std::string log(length, '\0');
-            glGetProgramInfoLog(programID, length, nullptr, &log[0]);
+    // starts a program createShaderProgram() is going to be asked for with the same arguments later
+    static void prefetch(const char * vertex_file_path, const char * fragment_file_path, const std::string &defines = "");
 
-            glDeleteProgram(programID);
-            throw std::runtime_error(log);
-        }
-
-        // Shaders no longer necessary, stored in program
-        glDeleteShader(vertexShaderID);
-        glDeleteShader(fragmentShaderID);
-
-        return programID;
-    }
+    static const ShaderLoaderStats &stats();
 
 private:
-    static GLuint createShader(GLenum shaderType, const char *filepath){
-        GLuint shaderID = glCreateShader(shaderType);
-
-        // Read shader file.
-        std::string code;
-        QString filepathStr = QString(filepath);
-        QFile file(filepathStr);
-        if (file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-            QTextStream stream(&file);
-            code = stream.readAll().toStdString();
-        }else{
-            throw std::runtime_error(std::string("Failed to open shader: ")+filepath);
-        }
-
-        // Compile shader code.
-        const char *codePtr = code.c_str();
-        glShaderSource(shaderID, 1, &codePtr, nullptr); // Assumes code is null terminated
-        glCompileShader(shaderID);
-
-        // Print info log if shader fails to compile.
-        GLint status;
-        glGetShaderiv(shaderID, GL_COMPILE_STATUS, &status);
-
-        if (status == GL_FALSE) {
-            GLint length;
-            glGetShaderiv(shaderID, GL_INFO_LOG_LENGTH, &length);
-
-            std::string log(length, '\0');
-            glGetShaderInfoLog(shaderID, length, nullptr, &log[0]);
-
-            glDeleteShader(shaderID);
-            throw std::runtime_error(log);
-        }
-
-        return shaderID;
-    }
+    struct Pending {
+        GLuint program = 0;
+        GLuint vertexShader = 0; // 0 when it came from a binary
+        GLuint fragmentShader = 0;
+        std::string key;         // binary cache key
+    };
+    using ProgramId = std::tuple<std::string, std::string, std::string>; // vertex, fragment, defines
+
+    static Pending begin(const char *vertex_file_path, const char *fragment_file_path, const std::string &defines);
+    static GLuint finish(Pending pending, const char *vertex_file_path, const char *fragment_file_path);
+
+    static std::string expandedSource(const char *filepath, const std::string &defines);
+    static std::string readSource(const std::string &filepath, std::set<std::string> &included, int depth);
+    static const std::string &fileText(const std::string &filepath);
+
+    static bool loadBinary(GLuint program, const std::string &key);
+    static void storeBinary(GLuint program, const std::string &key);
+    static std::string shaderLog(GLuint shader);
+
+    static std::map<ProgramId, Pending> s_pending;
+    static std::map<std::string, std::string> s_files; // qrc files never change, read each one once
+    static std::string s_driver;
+    static std::string s_cacheDir; // empty = no binary cache
+    static ShaderLoaderStats s_stats;
 };
@@ -1,5 +1,8 @@
 #include "textureutils.h"
 
+#include <QString>
+#include <iostream>
+
 
 /**
  * @brief TextureUtils::parseBumpMap into usable normals !!! takes the average of the normals around teh current pixel and stores
@@ -74,3 +77,24 @@ float TextureUtils::getHeight(const QImage& image, int x, int y) {
     float grayscaleIntensity = (pixel.red() + pixel.green() + pixel.blue()) / (3.0f * 255.0f);
     return grayscaleIntensity;
 }
+
+/**
+ * @brief TextureUtils::loadTextureImage the cpu half of SceneRenderer::loadTexture, split out so images can be decoded
+ * off the gl thread
+ * @param filename
+ * @param isBump
+ * @return
+ */
+QImage TextureUtils::loadTextureImage(const std::string& filename, bool isBump) {
+    QImage image(QString::fromStdString(filename));
+    if (image.isNull()) {
+        std::cerr << "Failed to load texture: " << filename << std::endl;
+        return QImage();
+    }
+
+    if (isBump){ //if it's a bump map we have to figure out the tangent space normals and store that as a new image ot be used within our shader !
+        image = parseBumpMap(image);
+    }
+
+    return image.convertToFormat(QImage::Format_RGBA8888).mirrored();
+}
@@ -2,11 +2,16 @@
 #pragma once
 #include <QImage>
 #include <glm/glm.hpp>
+#include <string>
 
 class TextureUtils {
 public:
     static QImage parseBumpMap(const QImage& bumpMap);
 
+    // reads a texture file into the RGBA8888 (flipped) layout we upload with glTexImage2D. bump maps are converted
+    // to normals first. doesn't touch GL so it's safe to call from the loader thread. returns a null image on failure
+    static QImage loadTextureImage(const std::string& filename, bool isBump);
+
 private:
     static float getHeight(const QImage& image, int x, int y);
 };
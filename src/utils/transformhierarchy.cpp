@@ -0,0 +1,159 @@
+#include "transformhierarchy.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+namespace {
+
+// linear interpolation between the two keys surrounding time (clamped at the ends)
+glm::vec3 sampleTrack(const std::vector<SceneVec3Keyframe> &keys, float time, glm::vec3 fallback) {
+    if (keys.empty()) return fallback;
+    if (time <= keys.front().time) return keys.front().value;
+    if (time >= keys.back().time) return keys.back().value;
+
+    auto next = std::upper_bound(keys.begin(), keys.end(), time,
+                                 [](float t, const SceneVec3Keyframe &k) { return t < k.time; });
+    auto prev = next - 1;
+    float span = next->time - prev->time;
+    float a = span > 0.f ? (time - prev->time) / span : 1.f;
+    return glm::mix(prev->value, next->value, a);
+}
+
+glm::quat sampleTrack(const std::vector<SceneRotationKeyframe> &keys, float time) {
+    if (keys.empty()) return glm::quat(1.f, 0.f, 0.f, 0.f);
+    if (time <= keys.front().time) return keys.front().value;
+    if (time >= keys.back().time) return keys.back().value;
+
+    auto next = std::upper_bound(keys.begin(), keys.end(), time,
+                                 [](float t, const SceneRotationKeyframe &k) { return t < k.time; });
+    auto prev = next - 1;
+    float span = next->time - prev->time;
+    float a = span > 0.f ? (time - prev->time) / span : 1.f;
+    return glm::slerp(prev->value, next->value, a);
+}
+
+}
+
+int TransformHierarchy::addNode(int parent, const glm::mat4 &prefix, const SceneAnimation &animation) {
+    m_parent.push_back(parent);
+    m_prefix.push_back(prefix);
+    m_world.push_back(glm::mat4(1.0f));
+    m_tracks.push_back(animation);
+    m_duration.push_back(duration(animation));
+    m_lastTime.push_back(-1.f); // forces the first update to evaluate everything
+    m_dirty.push_back(1);
+    return static_cast<int>(m_parent.size()) - 1;
+}
+
+void TransformHierarchy::bindShape(int shapeIndex, int node, const glm::mat4 &offset) {
+    m_bindShape.push_back(shapeIndex);
+    m_bindNode.push_back(node);
+    m_bindOffset.push_back(offset);
+    m_bindWorld.push_back(glm::mat4(1.0f));
+}
+
+void TransformHierarchy::append(const TransformHierarchy &other, int parent, const glm::mat4 &parentOffset, int shapeOffset) {
+    const int nodeOffset = nodeCount();
+
+    for (int i = 0; i < other.nodeCount(); i++) {
+        if (other.m_parent[i] < 0) {
+            addNode(parent, parentOffset * other.m_prefix[i], other.m_tracks[i]);
+        } else {
+            addNode(other.m_parent[i] + nodeOffset, other.m_prefix[i], other.m_tracks[i]);
+        }
+    }
+
+    for (int b = 0; b < other.bindingCount(); b++) {
+        bindShape(other.m_bindShape[b] + shapeOffset, other.m_bindNode[b] + nodeOffset, other.m_bindOffset[b]);
+    }
+}
+
+void TransformHierarchy::offsetShapes(int from, int offset) {
+    for (int &shape : m_bindShape) {
+        if (shape >= from) shape += offset;
+    }
+}
+
+void TransformHierarchy::clear() {
+    m_parent.clear();
+    m_prefix.clear();
+    m_world.clear();
+    m_tracks.clear();
+    m_duration.clear();
+    m_lastTime.clear();
+    m_dirty.clear();
+
+    m_bindShape.clear();
+    m_bindNode.clear();
+    m_bindOffset.clear();
+    m_bindWorld.clear();
+
+    m_dirtyBindings.clear();
+}
+
+size_t TransformHierarchy::memoryUsage() const {
+    size_t bytes = m_parent.capacity() * sizeof(int) + m_prefix.capacity() * sizeof(glm::mat4)
+                 + m_world.capacity() * sizeof(glm::mat4) + m_duration.capacity() * sizeof(float)
+                 + m_lastTime.capacity() * sizeof(float) + m_dirty.capacity();
+    for (const SceneAnimation &anim : m_tracks) {
+        bytes += sizeof(SceneAnimation) + anim.translate.capacity() * sizeof(SceneVec3Keyframe)
+               + anim.rotate.capacity() * sizeof(SceneRotationKeyframe) + anim.scale.capacity() * sizeof(SceneVec3Keyframe);
+    }
+    bytes += m_bindShape.capacity() * sizeof(int) + m_bindNode.capacity() * sizeof(int)
+           + m_bindOffset.capacity() * sizeof(glm::mat4) + m_bindWorld.capacity() * sizeof(glm::mat4)
+           + m_dirtyBindings.capacity() * sizeof(int);
+    return bytes;
+}
+
+bool TransformHierarchy::update(float time) {
+    const int n = nodeCount();
+
+    // nodes are in topological order so the parent's dirty flag + world matrix are always ready
+    for (int i = 0; i < n; i++) {
+        float t = time;
+        if (m_duration[i] <= 0.f) {
+            t = 0.f;
+        } else if (m_tracks[i].loop) {
+            t = std::fmod(time, m_duration[i]);
+        } else {
+            t = std::min(time, m_duration[i]);
+        }
+
+        const int parent = m_parent[i];
+        bool dirty = (t != m_lastTime[i]) || (parent >= 0 && m_dirty[parent]);
+        m_dirty[i] = dirty;
+        if (!dirty) continue;
+
+        m_lastTime[i] = t;
+        glm::mat4 local = m_prefix[i] * sample(m_tracks[i], t);
+        m_world[i] = (parent >= 0) ? m_world[parent] * local : local;
+    }
+
+    m_dirtyBindings.clear();
+    for (int b = 0; b < bindingCount(); b++) {
+        if (!m_dirty[m_bindNode[b]]) continue;
+
+        m_bindWorld[b] = m_world[m_bindNode[b]] * m_bindOffset[b];
+        m_dirtyBindings.push_back(b);
+    }
+
+    return !m_dirtyBindings.empty();
+}
+
+glm::mat4 TransformHierarchy::sample(const SceneAnimation &animation, float time) {
+    glm::vec3 t = sampleTrack(animation.translate, time, glm::vec3(0.f));
+    glm::quat r = sampleTrack(animation.rotate, time);
+    glm::vec3 s = sampleTrack(animation.scale, time, glm::vec3(1.f));
+
+    return glm::translate(glm::mat4(1.0f), t) * glm::mat4_cast(r) * glm::scale(glm::mat4(1.0f), s);
+}
+
+float TransformHierarchy::duration(const SceneAnimation &animation) {
+    float d = 0.f;
+    if (!animation.translate.empty()) d = std::max(d, animation.translate.back().time);
+    if (!animation.rotate.empty()) d = std::max(d, animation.rotate.back().time);
+    if (!animation.scale.empty()) d = std::max(d, animation.scale.back().time);
+    return d;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "scenedata.h"
+
+#include <vector>
+#include <utility>
+
+#include <glm/glm.hpp>
+
+/**
+ * Runtime transform hierarchy for animated groups.
+ *
+ * Only groups with an "animation" block become nodes. Nodes are stored in topological (dfs pre-order) order,
+ * so a parent always comes before its children and the world matrices can be rebuilt in one linear sweep.
+ * Everything is kept as flat arrays (parent index, static prefix, local, world, dirty) instead of a pointer tree.
+ *
+ *   world[i] = world[parent[i]] * prefix[i] * T(t) * R(t) * S(t)
+ *
+ * where prefix[i] is the static ctm from the parent's animated frame (or world space for roots) down to the group,
+ * including the group's own translate/rotate/scale. Shapes are bound to a node with a fixed offset from that frame.
+ */
+class TransformHierarchy {
+public:
+    // returns the index of the new node. parent must already exist (or be -1 for a root)
+    int addNode(int parent, const glm::mat4 &prefix, const SceneAnimation &animation);
+    void bindShape(int shapeIndex, int node, const glm::mat4 &offset);
+
+    // appends another hierarchy (e.g. a flattened template) under parent; its roots get parentOffset prepended
+    // and its shape indices are shifted by shapeOffset
+    void append(const TransformHierarchy &other, int parent, const glm::mat4 &parentOffset, int shapeOffset);
+    // adds offset to every bound shape index >= from
+    void offsetShapes(int from, int offset);
+
+    void clear();
+    bool empty() const { return m_parent.empty(); }
+    int nodeCount() const { return static_cast<int>(m_parent.size()); }
+    size_t memoryUsage() const;
+
+    // evaluates the tracks at time (seconds) and propagates dirty nodes to their subtrees.
+    // returns true if any bound shape moved
+    bool update(float time);
+
+    // binding slots that changed in the last update
+    const std::vector<int> &dirtyBindings() const { return m_dirtyBindings; }
+
+    // ctm of a shape bound at a given binding slot
+    int bindingCount() const { return static_cast<int>(m_bindShape.size()); }
+    int boundShape(int binding) const { return m_bindShape[binding]; }
+    const glm::mat4 &boundCTM(int binding) const { return m_bindWorld[binding]; }
+
+    // writes the current ctm into every shape that moved in the last update. bound indices past the end of shapes
+    // (instanced shapes, see RenderData) are left to whoever reads boundCTM
+    template <typename Shape>
+    void applyToShapes(std::vector<Shape> &shapes) const {
+        for (int b : m_dirtyBindings) {
+            if (m_bindShape[b] < static_cast<int>(shapes.size())) shapes[m_bindShape[b]].ctm = m_bindWorld[b];
+        }
+    }
+
+    // local T * R * S of an animation at time (used by the parser for the rest pose too)
+    static glm::mat4 sample(const SceneAnimation &animation, float time);
+
+private:
+    static float duration(const SceneAnimation &animation);
+
+    // per node (topological order)
+    std::vector<int> m_parent;
+    std::vector<glm::mat4> m_prefix;
+    std::vector<glm::mat4> m_world;
+    std::vector<SceneAnimation> m_tracks;
+    std::vector<float> m_duration;
+    std::vector<float> m_lastTime;
+    std::vector<unsigned char> m_dirty;
+
+    // per bound shape (in shape order)
+    std::vector<int> m_bindShape;
+    std::vector<int> m_bindNode;
+    std::vector<glm::mat4> m_bindOffset;
+    std::vector<glm::mat4> m_bindWorld;
+
+    std::vector<int> m_dirtyBindings;
+};